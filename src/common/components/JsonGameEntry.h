@@ -3,6 +3,7 @@
 
 #include "utils/file.h"
 #include "utils/json.h"
+#include "utils/jsonLine.h"
 #include "utils/str.h"
 
 #define FAVORITES_PATH "/mnt/SDCARD/Roms/favourite.json"
@@ -25,13 +26,14 @@ JsonGameEntry JsonGameEntry_fromJson(const char *json_str)
                            .imgpath = "",
                            .emupath = ""};
 
-    cJSON *root = cJSON_Parse(json_str);
-    json_getString(root, "label", entry.label);
-    json_getString(root, "launch", entry.launch);
-    json_getInt(root, "type", &entry.type);
-    json_getString(root, "rompath", entry.rompath);
-    json_getString(root, "imgpath", entry.imgpath);
-    cJSON_Delete(root);
+    JsonLineField_s fields[] = {
+        JSON_LINE_STRING("label", entry.label),
+        JSON_LINE_STRING("launch", entry.launch),
+        JSON_LINE_INT("type", &entry.type),
+        JSON_LINE_STRING("rompath", entry.rompath),
+        JSON_LINE_STRING("imgpath", entry.imgpath),
+    };
+    jsonLine_read(json_str, fields, 5);
 
     strcpy(entry.emupath, entry.rompath);
     str_split(entry.emupath, "/../../");
@@ -159,8 +159,9 @@ ListItem *list_addItemWithInfoNote(List *list, ListItem item, const char *info_n
 ListItem *list_addItemWithLang(List *list, ListItem item, const lang_hash key)
 {
     ListItem *_item = list_addItem(list, item);
-    if (lang_list && lang_list[key])
-        strcpy(_item->label, lang_list[key]);
+    const char *label = lang_get(key, NULL);
+    if (label)
+        strcpy(_item->label, label);
     return _item;
 }
 
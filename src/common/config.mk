@@ -25,7 +25,8 @@ ifneq ($(INCLUDE_UTILS),0)
 CFILES := $(CFILES) \
 	../common/utils/str.c \
 	../common/utils/log.c \
-	../common/utils/file.c
+	../common/utils/file.c \
+	../common/utils/journal.c
 endif
 CFILES := $(CFILES) $(foreach dir, $(SOURCES), $(wildcard $(dir)/*.c))
 CPPFILES := $(CPPFILES) $(foreach dir, $(SOURCES), $(wildcard $(dir)/*.cpp))
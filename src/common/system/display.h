@@ -425,6 +425,71 @@ void display_writeBuffers(display_t *display, uint32_t **pixels, rect_t rect, bo
     display_readOrWriteBuffers(display, pixels, rect, rotate, mask, true);
 }
 
+/**
+ * @brief Copy a region of a full-size pixel buffer to a framebuffer buffer.
+ *
+ * Unlike display_writeBuffer(), `pixels` holds the whole source image
+ * (`pitch` pixels per row) and only `rect` is read from it, so partial
+ * updates don't need an intermediate copy.
+ *
+ * @param index The index of the buffer to write.
+ * @param display The display structure.
+ * @param pixels Pointer to the source image.
+ * @param pitch Source row length in pixels.
+ * @param rect The rectangle area to copy, in source coordinates.
+ * @param rotate Whether to rotate the buffer content.
+ * @return long Number of pixels written.
+ */
+long display_blitToBuffer(int index, display_t *display, const uint32_t *pixels, int pitch, rect_t rect, bool rotate)
+{
+    int xres = display->vinfo.xres;
+    int yres = display->vinfo.yres;
+
+    if (rect.x < 0) {
+        rect.w += rect.x;
+        rect.x = 0;
+    }
+    if (rect.y < 0) {
+        rect.h += rect.y;
+        rect.y = 0;
+    }
+    if (rect.x + rect.w > xres)
+        rect.w = xres - rect.x;
+    if (rect.y + rect.h > yres)
+        rect.h = yres - rect.y;
+    if (rect.w <= 0 || rect.h <= 0)
+        return 0;
+
+    uint32_t *page = display->fb_addr + (long)index * yres * xres;
+
+    for (int y = rect.y; y < rect.y + rect.h; y++) {
+        const uint32_t *src = pixels + (long)y * pitch + rect.x;
+
+        if (rotate) {
+            uint32_t *dst = page + (long)(yres - 1 - y) * xres + (xres - 1 - rect.x);
+            for (int x = 0; x < rect.w; x++)
+                *dst-- = *src++;
+        }
+        else {
+            memcpy(page + (long)y * xres + rect.x, src, rect.w * sizeof(uint32_t));
+        }
+    }
+
+    return (long)rect.w * rect.h;
+}
+
+/**
+ * @brief Show a framebuffer buffer (page flip).
+ *
+ * @param display The display structure.
+ * @param index The index of the buffer to show.
+ */
+void display_panToBuffer(display_t *display, int index)
+{
+    display->vinfo.yoffset = index * display->vinfo.yres;
+    ioctl(fb_fd, FBIOPAN_DISPLAY, &display->vinfo);
+}
+
 //
 //    Draw frame, fixed 640x480x32bpp for now
 //
@@ -1,7 +1,13 @@
 #ifndef SYSTEM_LANG_H__
 #define SYSTEM_LANG_H__
 
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "./settings.h"
 #include "utils/file.h"
@@ -14,6 +20,10 @@
 #define LANG_DIR "/mnt/SDCARD/miyoo/app/lang"
 #define LANG_DIR_FALLBACK "/customer/app/lang"
 #define LANG_DIR_BACKUP "/mnt/SDCARD/miyoo/app/lang_backup"
+#define LANG_PACK_DIR "/tmp"
+
+#define LANG_PACK_MAGIC 0x4b50474c // "LGPK"
+#define LANG_PACK_VERSION 1
 
 #define LANG_FALLBACK_SELECT "SELECT"
 #define LANG_FALLBACK_BACK "BACK"
@@ -35,7 +45,29 @@
 #define LANG_FALLBACK_EXIT_TO_MENU "Exit to menu"
 #define LANG_FALLBACK_ADVANCED "Advanced"
 
-static char **lang_list = NULL;
+//
+//    Compiled language packs
+//
+//    `lang_load()` compiles the active `.lang` JSON into LANG_PACK_DIR once,
+//    then maps it: a fixed header with an offset per key, followed by a pool
+//    of NUL-terminated strings. `lang_get()` is a table lookup with no
+//    allocations. A pack is rebuilt when the source's path, mtime or size
+//    no longer match its header.
+//
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t pool_size;
+    int64_t source_mtime;
+    int64_t source_size;
+    int64_t built_at;
+    char source_path[STR_MAX];
+    uint32_t offsets[LANG_MAX]; // from the start of the pack, 0 if missing
+} LangPack_s;
+
+static const LangPack_s *lang_pack = NULL;
+static size_t lang_pack_size = 0;
 
 typedef enum {
     LANG_EXPERT_TAB = 0,
@@ -145,51 +177,178 @@ bool lang_getFilePath(const char *lang_name, char *lang_path)
     return exists(lang_path);
 }
 
+static void _lang_packPath(const char *lang_path, char *pack_path)
+{
+    snprintf(pack_path, STR_MAX, LANG_PACK_DIR "/lang_%s.pack", file_basename(lang_path));
+}
+
+static bool _lang_packIsCurrent(const LangPack_s *pack, size_t size, const char *lang_path, const struct stat *source, bool fresh)
+{
+    if (size < sizeof(LangPack_s) ||
+        pack->magic != LANG_PACK_MAGIC ||
+        pack->version != LANG_PACK_VERSION ||
+        pack->count != LANG_MAX ||
+        size != sizeof(LangPack_s) + pack->pool_size ||
+        strcmp(pack->source_path, lang_path) != 0 ||
+        pack->source_mtime != source->st_mtime ||
+        pack->source_size != source->st_size)
+        return false;
+
+    // Built right after the source changed: it may have changed again since
+    if (!fresh && pack->source_mtime + FILE_MTIME_RACY_S >= pack->built_at)
+        return false;
+
+    // Every string must end inside the pool
+    if (pack->pool_size > 0 && ((const char *)pack)[size - 1] != '\0')
+        return false;
+
+    for (int i = 0; i < LANG_MAX; i++) {
+        if (pack->offsets[i] != 0 && (pack->offsets[i] < sizeof(LangPack_s) || pack->offsets[i] >= size))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Compile a `.lang` JSON file into a pack (atomic replace)
+ */
+bool lang_compile(const char *lang_path, const char *pack_path)
+{
+    LangPack_s *header;
+    struct stat st;
+    char temp_path[STR_MAX + 8];
+    char *pool = NULL;
+    uint32_t pool_size = 0;
+    bool written = false;
+    int fd;
+
+    if (stat(lang_path, &st) != 0)
+        return false;
+
+    cJSON *root = json_load(lang_path);
+    if (!root)
+        return false;
+
+    header = (LangPack_s *)calloc(1, sizeof(LangPack_s));
+    header->magic = LANG_PACK_MAGIC;
+    header->version = LANG_PACK_VERSION;
+    header->count = LANG_MAX;
+    header->source_mtime = st.st_mtime;
+    header->source_size = st.st_size;
+    header->built_at = time(NULL);
+    strncpy(header->source_path, lang_path, STR_MAX - 1);
+
+    cJSON *item;
+    cJSON_ArrayForEach(item, root)
+    {
+        char *end;
+        long key = strtol(item->string, &end, 10);
+        const char *value = cJSON_GetStringValue(item);
+
+        if (*end != '\0' || key < 0 || key >= LANG_MAX || value == NULL)
+            continue;
+
+        // Same limit as the strings were copied with before
+        size_t len = strnlen(value, JSON_STRING_LEN - 1);
+        pool = (char *)realloc(pool, pool_size + len + 1);
+        memcpy(pool + pool_size, value, len);
+        pool[pool_size + len] = '\0';
+
+        header->offsets[key] = sizeof(LangPack_s) + pool_size;
+        pool_size += len + 1;
+    }
+    header->pool_size = pool_size;
+
+    cJSON_Delete(root);
+
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", pack_path);
+
+    if ((fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) != -1) {
+        written = write(fd, header, sizeof(LangPack_s)) == sizeof(LangPack_s) &&
+                  (pool_size == 0 || write(fd, pool, pool_size) == pool_size);
+        close(fd);
+
+        if (written)
+            written = rename(temp_path, pack_path) == 0;
+        else
+            unlink(temp_path);
+    }
+
+    free(header);
+    free(pool);
+
+    printf_debug("Lang: compiled %s (%s)\n", lang_path, written ? "ok" : "failed");
+    return written;
+}
+
+static bool _lang_mapPack(const char *lang_path, const char *pack_path, bool fresh)
+{
+    struct stat source;
+    struct stat st;
+    const LangPack_s *pack;
+    int fd;
+
+    if (stat(lang_path, &source) != 0)
+        return false;
+
+    if ((fd = open(pack_path, O_RDONLY)) == -1)
+        return false;
+
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(LangPack_s)) {
+        close(fd);
+        return false;
+    }
+
+    pack = (const LangPack_s *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (pack == MAP_FAILED)
+        return false;
+
+    if (!_lang_packIsCurrent(pack, st.st_size, lang_path, &source, fresh)) {
+        munmap((void *)pack, st.st_size);
+        return false;
+    }
+
+    lang_pack = pack;
+    lang_pack_size = st.st_size;
+    return true;
+}
+
 bool lang_load(void)
 {
     if (!settings_loaded)
         settings_load();
 
     char lang_path[STR_MAX];
+    char pack_path[STR_MAX];
 
     if (!lang_getFilePath(settings.language, lang_path) &&
         !lang_getFilePath(LANG_DEFAULT, lang_path))
         return false;
 
-    lang_list = (char **)malloc(LANG_MAX * sizeof(char *));
-    memset(lang_list, 0, LANG_MAX * sizeof(char *));
-
-    cJSON *lang_file = json_load(lang_path);
-
-    char key[32];
-    char value[STR_MAX];
-    for (int i = 0; i < LANG_MAX; i++) {
-        sprintf(key, "%d", i);
-        if (json_getString(lang_file, key, value)) {
-            lang_list[i] = (char *)malloc(STR_MAX * sizeof(char));
-            strcpy(lang_list[i], value);
-        }
-    }
+    _lang_packPath(lang_path, pack_path);
 
-    cJSON_Delete(lang_file);
+    if (_lang_mapPack(lang_path, pack_path, false))
+        return true;
 
-    return true;
+    return lang_compile(lang_path, pack_path) && _lang_mapPack(lang_path, pack_path, true);
 }
 
 void lang_free(void)
 {
-    for (int i = 0; i < LANG_MAX; i++) {
-        if (lang_list[i] == NULL)
-            continue;
-        free(lang_list[i]);
-    }
-    free(lang_list);
+    if (lang_pack == NULL)
+        return;
+    munmap((void *)lang_pack, lang_pack_size);
+    lang_pack = NULL;
+    lang_pack_size = 0;
 }
 
 const char *lang_get(lang_hash key, const char *fallback)
 {
-    if (lang_list && lang_list[key])
-        return lang_list[key];
+    if (lang_pack && key >= 0 && key < LANG_MAX && lang_pack->offsets[key])
+        return (const char *)lang_pack + lang_pack->offsets[key];
     return fallback;
 }
 
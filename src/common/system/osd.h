@@ -7,7 +7,7 @@
 #include "utils/config.h"
 #include "utils/log.h"
 #include "utils/msleep.h"
-#include "utils/timer.h"
+#include "utils/trace.h"
 
 #include "./clock.h"
 #include "./display.h"
@@ -84,13 +84,9 @@ static void free_overlay_data(overlay_thread_data *data)
     free(data);
 }
 
-static void *_overlay_draw_thread(void *arg)
+static unsigned int **_overlay_backupBuffers(overlay_thread_data *data, int numBuffers, rect_t rect)
 {
-    overlay_thread_data *data = (overlay_thread_data *)arg;
-
-    // Backup original fb content
-    START_TIMER(framebuffer_backup);
-    int numBuffers = data->display.vinfo.yres_virtual / data->display.vinfo.yres;
+    TRACE_SCOPE("framebuffer_backup");
     unsigned int **originalPixels = malloc(numBuffers * sizeof(unsigned int *));
     if (!originalPixels) {
         return NULL;
@@ -106,10 +102,21 @@ static void *_overlay_draw_thread(void *arg)
         }
     }
 
-    rect_t rect = {data->destX, data->destY, data->surface->w, data->surface->h};
-
     display_readBuffers(&data->display, originalPixels, rect, data->rotate, data->useMask);
-    END_TIMER(framebuffer_backup);
+    return originalPixels;
+}
+
+static void *_overlay_draw_thread(void *arg)
+{
+    overlay_thread_data *data = (overlay_thread_data *)arg;
+
+    // Backup original fb content
+    int numBuffers = data->display.vinfo.yres_virtual / data->display.vinfo.yres;
+    rect_t rect = {data->destX, data->destY, data->surface->w, data->surface->h};
+    unsigned int **originalPixels = _overlay_backupBuffers(data, numBuffers, rect);
+    if (!originalPixels) {
+        return NULL;
+    }
     printf_debug("Backup buffer total size: %d KiB\n",
                  (numBuffers * data->surface->w * data->surface->h * sizeof(unsigned int)) / 1024);
 
@@ -154,16 +161,17 @@ static void *_overlay_draw_thread(void *arg)
     // TODO: If the content "behind" the overlay has changed, this will not restore it correctly, causing a 1 frame glitch. How to fix? Only backup if the overlay is (partially) outside the game screen?
     // TODO: Theoretically the backup/restore is only needed if the position of the overlay is outside the game screen because that part of the screen is not updated by the game.
 
-    START_TIMER(framebuffer_restore);
-    display_writeBuffers(&data->display, originalPixels, rect, data->rotate, data->useMask);
+    {
+        TRACE_SCOPE("framebuffer_restore");
+        display_writeBuffers(&data->display, originalPixels, rect, data->rotate, data->useMask);
 
-    // Free buffer backups
-    numBuffers = data->display.vinfo.yres_virtual / data->display.vinfo.yres;
-    for (int b = 0; b < numBuffers; b++) {
-        free(originalPixels[b]);
+        // Free buffer backups
+        numBuffers = data->display.vinfo.yres_virtual / data->display.vinfo.yres;
+        for (int b = 0; b < numBuffers; b++) {
+            free(originalPixels[b]);
+        }
+        free(originalPixels);
     }
-    free(originalPixels);
-    END_TIMER(framebuffer_restore);
 
     free_overlay_data(data);
 
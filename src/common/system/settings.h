@@ -2,6 +2,9 @@
 #define SETTINGS_H__
 
 #include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 
 #include "display.h"
 #include "system/volume.h"
@@ -21,6 +24,9 @@
 #define DEFAULT_THEME_PATH "/mnt/SDCARD/Themes/Silky by DiMo/"
 #define RECORDED_DIR "/mnt/SDCARD/Media/Videos/Recorded"
 
+#define SETTINGS_SNAPSHOT_MAGIC 0x54534e4f // "ONST"
+#define SETTINGS_SNAPSHOT_VERSION 1
+
 typedef struct settings_s {
     int volume;
     char keymap[JSON_STRING_LEN];
@@ -145,10 +151,13 @@ void _settings_reset(settings_s *_settings)
 
 void _settings_load_keymap(void)
 {
-    if (!exists(CONFIG_PATH "keymap.json"))
+    char staged[PATH_MAX];
+    const char *source = writeCache_resolve(CONFIG_PATH "keymap.json", staged);
+
+    if (source == NULL || !exists(source))
         return;
 
-    cJSON *keymap = json_load(CONFIG_PATH "keymap.json");
+    cJSON *keymap = json_load(source);
     json_getInt(keymap, "mainui_single_press", &settings.mainui_single_press);
     json_getInt(keymap, "mainui_long_press", &settings.mainui_long_press);
     json_getInt(keymap, "mainui_double_press", &settings.mainui_double_press);
@@ -163,8 +172,10 @@ void _settings_load_keymap(void)
 void _settings_load_mainui(void)
 {
     char *json_str = NULL;
+    char staged[PATH_MAX];
+    const char *source = writeCache_resolve(MAIN_UI_SETTINGS, staged);
 
-    if (!(json_str = file_read(MAIN_UI_SETTINGS)))
+    if (source == NULL || !(json_str = file_read(source)))
         return;
 
     cJSON *json_root = cJSON_Parse(json_str);
@@ -193,7 +204,125 @@ void _settings_load_mainui(void)
     cJSON_Delete(json_root);
 }
 
-void settings_load(void)
+//
+//    Snapshot: the result of settings_load() as a binary blob in /tmp
+//
+//    Creating or removing a flag or key file changes its directory mtime,
+//    so a few stats tell whether the snapshot is still current. Values
+//    changed in place must call config_invalidateSnapshot() (the config_set*
+//    helpers do).
+//
+static const char *_settings_snapshot_sources[] = {
+    CONFIG_PATH,
+    CONFIG_PATH "battery",
+    CONFIG_PATH "startup",
+    CONFIG_PATH "display",
+    CONFIG_PATH "keymap.json",
+    MAIN_UI_SETTINGS,
+    "/tmp/rtc_available"};
+
+#define SETTINGS_SNAPSHOT_SOURCES (sizeof(_settings_snapshot_sources) / sizeof(_settings_snapshot_sources[0]))
+
+typedef struct {
+    int64_t mtime;
+    int64_t size;
+} SettingsSnapshotSource_s;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t settings_size;
+    uint32_t source_count;
+    int64_t built_at;
+    SettingsSnapshotSource_s sources[SETTINGS_SNAPSHOT_SOURCES];
+    settings_s settings;
+} SettingsSnapshot_s;
+
+static void _settings_snapshot_stat(SettingsSnapshotSource_s *sources)
+{
+    struct stat st;
+
+    for (int i = 0; i < SETTINGS_SNAPSHOT_SOURCES; i++) {
+        if (stat(_settings_snapshot_sources[i], &st) == 0) {
+            sources[i].mtime = st.st_mtime;
+            sources[i].size = st.st_size;
+        }
+        else {
+            sources[i].mtime = sources[i].size = -1;
+        }
+    }
+}
+
+bool _settings_load_snapshot(void)
+{
+    SettingsSnapshotSource_s sources[SETTINGS_SNAPSHOT_SOURCES];
+    struct stat st;
+    bool valid = false;
+    int fd;
+
+    if ((fd = open(CONFIG_SNAPSHOT_PATH, O_RDONLY)) == -1)
+        return false;
+
+    if (fstat(fd, &st) == 0 && st.st_size == sizeof(SettingsSnapshot_s)) {
+        const SettingsSnapshot_s *snapshot = mmap(NULL, sizeof(SettingsSnapshot_s), PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (snapshot != MAP_FAILED) {
+            valid = snapshot->magic == SETTINGS_SNAPSHOT_MAGIC &&
+                    snapshot->version == SETTINGS_SNAPSHOT_VERSION &&
+                    snapshot->settings_size == sizeof(settings_s) &&
+                    snapshot->source_count == SETTINGS_SNAPSHOT_SOURCES;
+
+            if (valid) {
+                _settings_snapshot_stat(sources);
+
+                for (int i = 0; i < SETTINGS_SNAPSHOT_SOURCES && valid; i++) {
+                    valid = sources[i].mtime == snapshot->sources[i].mtime &&
+                            sources[i].size == snapshot->sources[i].size &&
+                            sources[i].mtime + FILE_MTIME_RACY_S < snapshot->built_at;
+                }
+            }
+
+            if (valid)
+                settings = snapshot->settings;
+
+            munmap((void *)snapshot, sizeof(SettingsSnapshot_s));
+        }
+    }
+
+    close(fd);
+    return valid;
+}
+
+/**
+ * @brief Write the current settings as the snapshot (atomic replace)
+ */
+void _settings_save_snapshot(void)
+{
+    SettingsSnapshot_s snapshot;
+    int fd;
+
+    memset(&snapshot, 0, sizeof(SettingsSnapshot_s));
+    snapshot.magic = SETTINGS_SNAPSHOT_MAGIC;
+    snapshot.version = SETTINGS_SNAPSHOT_VERSION;
+    snapshot.settings_size = sizeof(settings_s);
+    snapshot.source_count = SETTINGS_SNAPSHOT_SOURCES;
+    snapshot.built_at = time(NULL);
+    _settings_snapshot_stat(snapshot.sources);
+    snapshot.settings = settings;
+
+    if ((fd = open(CONFIG_SNAPSHOT_PATH ".tmp", O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+        return;
+
+    bool written = write(fd, &snapshot, sizeof(SettingsSnapshot_s)) == sizeof(SettingsSnapshot_s);
+    close(fd);
+
+    if (written)
+        rename(CONFIG_SNAPSHOT_PATH ".tmp", CONFIG_SNAPSHOT_PATH);
+    else
+        unlink(CONFIG_SNAPSHOT_PATH ".tmp");
+}
+
+void _settings_load_sources(void)
 {
     _settings_reset(&settings);
 
@@ -246,6 +375,14 @@ void settings_load(void)
 
     _settings_load_keymap();
     _settings_load_mainui();
+}
+
+void settings_load(void)
+{
+    if (!_settings_load_snapshot()) {
+        _settings_load_sources();
+        _settings_save_snapshot();
+    }
 
     _settings_clone(&__settings, &settings);
 
@@ -255,8 +392,10 @@ void settings_load(void)
 void _settings_save_keymap(void)
 {
     FILE *fp;
+    char *content = NULL;
+    size_t len = 0;
 
-    if ((fp = fopen(CONFIG_PATH "keymap.json", "w+")) == 0)
+    if ((fp = open_memstream(&content, &len)) == NULL)
         return;
 
     fprintf(fp, "{\n");
@@ -277,10 +416,10 @@ void _settings_save_keymap(void)
     fprintf(fp, JSON_FORMAT_STRING_NC, "mainui_button_y",
             settings.mainui_button_y);
     fprintf(fp, "}\n");
-
-    fflush(fp);
-    fsync(fileno(fp));
     fclose(fp);
+
+    writeCache_put(CONFIG_PATH "keymap.json", content, len);
+    free(content);
 }
 
 bool _settings_dirty_mainui(void)
@@ -310,8 +449,10 @@ void _settings_save_mainui(void)
     }
 
     FILE *fp;
+    char *content = NULL;
+    size_t len = 0;
 
-    if ((fp = fopen(MAIN_UI_SETTINGS, "w+")) == NULL)
+    if ((fp = open_memstream(&content, &len)) == NULL)
         return;
 
     fprintf(fp, "{\n");
@@ -331,10 +472,10 @@ void _settings_save_mainui(void)
     fprintf(fp, JSON_FORMAT_TAB_NUMBER, "audiofix", settings.audiofix);
     fprintf(fp, JSON_FORMAT_TAB_NUMBER_NC, "wifi", settings.wifi_on);
     fprintf(fp, "}");
-
-    fflush(fp);
-    fsync(fileno(fp));
     fclose(fp);
+
+    writeCache_put(MAIN_UI_SETTINGS, content, len);
+    free(content);
 }
 
 void settings_save(void)
@@ -373,21 +514,37 @@ void settings_save(void)
 
     _settings_save_keymap();
     _settings_save_mainui();
+    _settings_save_snapshot();
 
     temp_flag_set("settings_changed", true);
 }
 
 bool settings_saveSystemProperty(const char *prop_name, int value)
 {
-    cJSON *json_root = json_load(MAIN_UI_SETTINGS);
+    char staged[PATH_MAX];
+    const char *source = writeCache_resolve(MAIN_UI_SETTINGS, staged);
+
+    if (source == NULL)
+        return false;
+
+    cJSON *json_root = json_load(source);
     cJSON *prop = cJSON_GetObjectItem(json_root, prop_name);
 
-    if (cJSON_GetNumberValue(prop) == value)
+    if (prop == NULL || cJSON_GetNumberValue(prop) == value) {
+        cJSON_Delete(json_root);
         return false;
+    }
 
     cJSON_SetNumberValue(prop, value);
-    json_save(json_root, MAIN_UI_SETTINGS);
+
+    char *output = cJSON_Print(json_root);
+    if (output != NULL) {
+        writeCache_put(MAIN_UI_SETTINGS, output, strlen(output));
+        cJSON_free(output);
+    }
+
     cJSON_Delete(json_root);
+    config_invalidateSnapshot();
     temp_flag_set("settings_changed", true);
 
     return true;
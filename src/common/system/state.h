@@ -6,6 +6,7 @@
 #include "utils/file.h"
 #include "utils/flags.h"
 #include "utils/hash.h"
+#include "utils/journal.h"
 #include "utils/log.h"
 #include "utils/process.h"
 #include "utils/str.h"
@@ -65,6 +66,11 @@ bool check_isAdvMenu(void)
     return false;
 }
 
+// A resident gameSwitcher (`gameSwitcher --resident`) goes by this name
+// while hidden, so it isn't taken for the visible one
+#define GS_RESIDENT_PROCESS "gsResident"
+#define GS_RESIDENT_FLAG ".gameSwitcherResident"
+
 bool check_isGameSwitcher(void)
 {
     pid_t pid;
@@ -245,7 +251,7 @@ char *history_getRecentPath(char *rom_path)
     FILE *file;
     char line[STR_MAX * 3];
 
-    file = fopen(getMiyooRecentFilePath(), "r");
+    file = journal_open(getMiyooRecentFilePath());
 
     if (file == NULL) {
         return NULL;
@@ -317,10 +323,64 @@ bool history_getRomscreenPath(char *path_out)
     return false;
 }
 
+#define LAUNCH_PRELOAD "/mnt/SDCARD/miyoo/app/../lib/libpadsp.so"
+
+/**
+ * @brief Formats the cmd_to_run.sh line that runs `launch` with `rompath`
+ */
+void state_formatLaunchCommand(char *cmd_out, size_t size, const char *launch,
+                               const char *rompath)
+{
+    snprintf(cmd_out, size, "LD_PRELOAD=" LAUNCH_PRELOAD " \"%s\" \"%s\"", launch, rompath);
+}
+
+/**
+ * @brief Splits a launch command into the launch script (first quoted
+ * string) and the rom path (everything after the first `" "`, without the
+ * closing quote). A `launch:rom` rom path is split as well.
+ *
+ * @return true if both parts were found
+ */
+bool state_parseLaunchCommand(const char *cmd, char *launch_out, char *rompath_out)
+{
+    const char *launch_start = strchr(cmd, '"');
+    const char *launch_end = launch_start ? strchr(launch_start + 1, '"') : NULL;
+    const char *rom_start = strstr(cmd, "\" \"");
+    const char *rom_end = cmd + strlen(cmd);
+
+    launch_out[0] = '\0';
+    rompath_out[0] = '\0';
+
+    if (launch_end == NULL || rom_start == NULL)
+        return false;
+
+    while (rom_end > cmd && strchr("\r\n\t ", rom_end[-1]) != NULL)
+        rom_end--;
+    rom_start += 3;
+    if (rom_end <= rom_start || rom_end[-1] != '"')
+        return false;
+    rom_end--;
+
+    snprintf(launch_out, STR_MAX, "%.*s", (int)(launch_end - launch_start - 1), launch_start + 1);
+    snprintf(rompath_out, STR_MAX, "%.*s", (int)(rom_end - rom_start), rom_start);
+
+    // Custom launch script: "launch:rompath"
+    char *colon = strchr(rompath_out, ':');
+    if (colon != NULL) {
+        *colon = '\0';
+        strcpy(launch_out, rompath_out);
+        memmove(rompath_out, colon + 1, strlen(colon + 1) + 1);
+        if ((colon = strchr(rompath_out, ':')) != NULL)
+            *colon = '\0';
+    }
+
+    return true;
+}
+
 void resumeGame(int index)
 {
     const char *recentPath = getMiyooRecentFilePath();
-    FILE *file = fopen(recentPath, "r");
+    FILE *file = journal_open(recentPath);
 
     int type;
 
@@ -408,7 +468,7 @@ void resumeGame(int index)
 
             fclose(file);
             file = NULL;
-            sprintf(LaunchCommand, "LD_PRELOAD=/mnt/SDCARD/miyoo/app/../lib/libpadsp.so \"%s\" \"%s\"", launch, rompath);
+            state_formatLaunchCommand(LaunchCommand, sizeof(LaunchCommand), launch, rompath);
 
             remove("/mnt/SDCARD/.tmp_update/.runGameSwitcher");
 
@@ -416,10 +476,7 @@ void resumeGame(int index)
             if (lineCount > 1) {
                 temp_flag_set("quick_switch", true);
 
-                char *line_n = file_read_lineN(recentPath, lineCount);
-                file_add_line_to_beginning(recentPath, line_n);
-                file_delete_line(recentPath, lineCount + 1);
-                free(line_n);
+                journal_moveLine(recentPath, lineCount, jsonContent);
             }
 
             file_put_sync(fp, CMD_TO_RUN_PATH, "%s", LaunchCommand);
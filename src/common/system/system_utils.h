@@ -5,6 +5,7 @@
 #include "system/settings_sync.h"
 #include "system/state.h"
 #include "utils/file.h"
+#include "utils/trace.h"
 
 //
 //    [onion] Check retroarch running & savestate_auto_save in retroarch.cfg is
@@ -28,6 +29,7 @@ void kill_mainUI(void)
 
 void set_gameSwitcher(void)
 {
+    TRACE_INSTANT("gs_request");
     flag_set("/mnt/SDCARD/.tmp_update/", ".runGameSwitcher", true);
 }
 
@@ -7,13 +7,11 @@
 
 #include "./load.h"
 #include "./resources.h"
-#include "utils/rotate180.h"
 
 void theme_backgroundLoad(void)
 {
     char theme_path[STR_MAX];
-    resources.background =
-        rotate180(theme_loadImage(theme_getPath(theme_path), "background"));
+    resources.background = theme_loadImageRotated(theme_getPath(theme_path), "background");
     resources._background_loaded = true;
 }
 
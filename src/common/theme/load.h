@@ -7,6 +7,7 @@
 
 #include "utils/file.h"
 #include "utils/json.h"
+#include "utils/scaler.h"
 #include "utils/str.h"
 
 #define SYSTEM_CONFIG "/mnt/SDCARD/system.json"
@@ -16,7 +17,8 @@
 #define THEME_OVERRIDES "/mnt/SDCARD/Saves/CurrentProfile/theme"
 #define FALLBACK_THEME_PATH "/mnt/SDCARD/miyoo/app/"
 
-typedef SDL_Surface *(*ScaleSurfaceFunc)(SDL_Surface *surface, double xScale, double yScale, int smoothing);
+// `flags` is SMOOTHING_ON/OFF, optionally combined with SCALER_ROTATE180
+typedef SDL_Surface *(*ScaleSurfaceFunc)(SDL_Surface *surface, double xScale, double yScale, int flags);
 
 static ScaleSurfaceFunc scaleSurfaceFunc = NULL;
 static double g_scale = 1.0;
@@ -70,7 +72,7 @@ int theme_getImagePath(const char *theme_path, const char *name, char *out_path)
     return load_mode;
 }
 
-SDL_Surface *theme_loadImage(const char *theme_path, const char *name)
+static SDL_Surface *_theme_loadImage(const char *theme_path, const char *name, bool rotate)
 {
     char image_path[512];
     theme_getImagePath(theme_path, name, image_path);
@@ -94,14 +96,32 @@ SDL_Surface *theme_loadImage(const char *theme_path, const char *name)
     }
 
     if (g_scale != 1.0 && scaleSurfaceFunc) {
-        SDL_Surface *scaled = scaleSurfaceFunc(image, g_scale, g_scale, 1);
+        // The scaler writes the rotated result in the same pass
+        SDL_Surface *scaled = scaleSurfaceFunc(image, g_scale, g_scale, SMOOTHING_ON | (rotate ? SCALER_ROTATE180 : 0));
         SDL_FreeSurface(image);
         image = scaled;
     }
+    else if (rotate) {
+        scaler_rotate180(image);
+    }
 
     return image;
 }
 
+SDL_Surface *theme_loadImage(const char *theme_path, const char *name)
+{
+    return _theme_loadImage(theme_path, name, false);
+}
+
+/**
+ * @brief Loads a theme image rotated by 180 degrees, for surfaces blitted
+ * straight to the (upside down) display.
+ */
+SDL_Surface *theme_loadImageRotated(const char *theme_path, const char *name)
+{
+    return _theme_loadImage(theme_path, name, true);
+}
+
 TTF_Font *theme_loadFont(const char *theme_path, const char *font, int size)
 {
     char font_path[STR_MAX * 2];
@@ -5,6 +5,7 @@
 #include "theme/background.h"
 #include "theme/config.h"
 #include "theme/resources.h"
+#include "utils/scaler.h"
 
 // static SDL_Color color_black = {0, 0, 0};
 
@@ -203,7 +204,7 @@ void theme_renderListCustom(SDL_Surface *screen, List *list, ListRenderParams_s
 
             if (preview->w > preview_width || (params.preview_stretch && preview->w < preview_width)) {
                 double scale = (double)preview_width / (double)preview->w;
-                preview = zoomSurface(preview, scale, scale, params.preview_smoothing ? SMOOTHING_ON : SMOOTHING_OFF);
+                preview = scaler_zoomSurface(preview, scale, scale, params.preview_smoothing ? SMOOTHING_ON : SMOOTHING_OFF);
                 free_after = true;
             }
 
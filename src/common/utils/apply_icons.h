@@ -3,8 +3,12 @@
 
 #include <dirent.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <sys/file.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "utils/file.h"
 #include "utils/json.h"
@@ -25,6 +29,10 @@
 #define GUEST_ON_CONFIG "/mnt/SDCARD/App/Guest_Mode/data/configON.json"
 #define GUEST_OFF_CONFIG "/mnt/SDCARD/App/Guest_Mode/data/configOFF.json"
 
+#define ICONS_MANIFEST "/mnt/SDCARD/Icons/.applied_manifest"
+#define ICONS_MANIFEST_HEADER "apply_icons manifest v1"
+#define ICONS_MAX_WORKERS 4
+
 typedef enum IconMode {
     ICON_MODE_EMU,
     ICON_MODE_APP,
@@ -40,13 +48,37 @@ IconMode_e icons_getIconMode(const char *config_path)
     return ICON_MODE_EMU;
 }
 
-void _saveConfigFile(const char *config_path, const char *content)
+/**
+ * @brief Replace `config_path` with `content` through a temp file, so an
+ * interrupted write never leaves a truncated config behind.
+ */
+bool _writeConfigFile(const char *config_path, const char *content)
 {
-    FILE *config_file = fopen(config_path, "w+");
-    fprintf(config_file, "%s", content);
-    fflush(config_file);
-    fclose(config_file);
+    char temp_path[STR_MAX * 2 + 8];
+    FILE *config_file;
+    bool ok;
+
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", config_path);
+
+    if ((config_file = fopen(temp_path, "w")) == NULL)
+        return false;
+
+    ok = fputs(content, config_file) >= 0;
+    ok = fflush(config_file) == 0 && ok;
+    fsync(fileno(config_file));
+    ok = fclose(config_file) == 0 && ok;
+
+    if (ok)
+        ok = rename(temp_path, config_path) == 0;
+    if (!ok)
+        remove(temp_path);
+
+    return ok;
+}
 
+// Some configs are copied into place depending on the current state
+void _syncConfigCopies(const char *config_path)
+{
     if (strcmp(SEARCH_CONFIG_SRC, config_path) == 0 && is_file(SEARCH_CONFIG))
         system("cp \"" SEARCH_CONFIG_SRC "\" \"" SEARCH_CONFIG "\"");
     else if (strcmp(GUEST_OFF_CONFIG, config_path) == 0) {
@@ -59,6 +91,12 @@ void _saveConfigFile(const char *config_path, const char *content)
     }
 }
 
+void _saveConfigFile(const char *config_path, const char *content)
+{
+    _writeConfigFile(config_path, content);
+    _syncConfigCopies(config_path);
+}
+
 bool apply_singleIconByFullPath(const char *config_path, const char *icon_path)
 {
     if (!is_file(config_path) || !is_file(icon_path))
@@ -129,13 +167,14 @@ const char *icons_getSelectedIconPathFormat(IconMode_e mode)
     return "%s/sel/%s.png";
 }
 
-bool _apply_singleIconFromPack(const char *config_path,
-                               const char *icon_pack_path, bool reset_default)
+/**
+ * @brief Resolve the icon paths `config` should point to in the pack.
+ * `sel_path` is left empty when the pack has no selected variant.
+ */
+bool _apply_iconTarget(cJSON *config, const char *config_path,
+                       const char *icon_pack_path, bool reset_default,
+                       char *icon_path, char *sel_path)
 {
-    if (!is_file(config_path))
-        return false;
-
-    cJSON *config = json_load(config_path);
     char temp_path[STR_MAX];
     if (!json_getString(config, "icon", temp_path))
         return false;
@@ -145,7 +184,6 @@ bool _apply_singleIconFromPack(const char *config_path,
 
     IconMode_e mode = icons_getIconMode(config_path);
 
-    char icon_path[STR_MAX];
     sprintf(icon_path, icons_getIconPathFormat(mode), icon_pack_path,
             icon_name);
 
@@ -161,29 +199,116 @@ bool _apply_singleIconFromPack(const char *config_path,
         }
     }
 
-    char sel_path[STR_MAX];
     sprintf(sel_path, icons_getSelectedIconPathFormat(mode), icon_pack_path,
             icon_name);
     free(icon_name);
 
-    if (is_file(sel_path))
+    if (!is_file(sel_path))
+        sel_path[0] = '\0';
+
+    return true;
+}
+
+// cJSON_Parse records errors in a global, parse one config at a time
+static pthread_mutex_t _apply_parse_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static cJSON *_apply_loadConfig(const char *config_path)
+{
+    char *contents = file_read(config_path);
+    if (contents == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&_apply_parse_lock);
+    cJSON *config = cJSON_Parse(contents);
+    pthread_mutex_unlock(&_apply_parse_lock);
+
+    free(contents);
+    return config;
+}
+
+static bool _apply_configMatches(cJSON *config, const char *icon_path,
+                                 const char *sel_path)
+{
+    const char *icon = cJSON_GetStringValue(cJSON_GetObjectItem(config, "icon"));
+    cJSON *iconsel = cJSON_GetObjectItem(config, "iconsel");
+
+    if (icon == NULL || strcmp(icon, icon_path) != 0)
+        return false;
+    if (sel_path[0] == '\0')
+        return iconsel == NULL;
+    return iconsel != NULL && cJSON_IsString(iconsel) &&
+           strcmp(cJSON_GetStringValue(iconsel), sel_path) == 0;
+}
+
+/**
+ * @brief Point `config_path` at the icons of the pack. The config is only
+ * rewritten when its current paths differ.
+ *
+ * @param written Set to true if the file was rewritten (may be NULL)
+ * @return true if the pack (or the default pack) has an icon for it
+ */
+bool _apply_iconFromPack(const char *config_path, const char *icon_pack_path,
+                         bool reset_default, bool *written)
+{
+    char icon_path[STR_MAX];
+    char sel_path[STR_MAX];
+
+    if (written)
+        *written = false;
+
+    if (!is_file(config_path))
+        return false;
+
+    cJSON *config = _apply_loadConfig(config_path);
+    if (!config)
+        return false;
+
+    if (!_apply_iconTarget(config, config_path, icon_pack_path, reset_default,
+                           icon_path, sel_path)) {
+        cJSON_Delete(config);
+        return false;
+    }
+
+    if (_apply_configMatches(config, icon_path, sel_path)) {
+        cJSON_Delete(config);
+        return true;
+    }
+
+    if (sel_path[0] != '\0')
         json_forceSetString(config, "iconsel", sel_path);
     else
         cJSON_DeleteItemFromObject(config, "iconsel");
 
     json_forceSetString(config, "icon", icon_path);
 
-    char* config_str = cJSON_Print(config);
-    _saveConfigFile(config_path, config_str);
+    char *config_str = cJSON_Print(config);
+    bool ok = _writeConfigFile(config_path, config_str);
     cJSON_free(config_str);
     cJSON_Delete(config);
 
+    if (written)
+        *written = ok;
+
     printf_debug("Applied icon to %s\nicon:    %s\niconsel: %s\n", config_path,
                  icon_path, sel_path);
 
     return true;
 }
 
+bool _apply_singleIconFromPack(const char *config_path,
+                               const char *icon_pack_path, bool reset_default)
+{
+    bool written;
+    bool applied = _apply_iconFromPack(config_path, icon_pack_path,
+                                       reset_default, &written);
+
+    // Keep the copies (search, guest mode) in sync
+    if (written)
+        _syncConfigCopies(config_path);
+
+    return applied;
+}
+
 bool apply_singleIcon(const char *config_path)
 {
     char icon_pack_path[STR_MAX];
@@ -207,58 +332,304 @@ bool apply_singleIcon(const char *config_path)
     return _apply_singleIconFromPack(config_path, icon_pack_path, false);
 }
 
-int _apply_iconPackOnConfigs(const char *path, const char *icon_pack_path,
-                             bool reset_default)
+//
+//    Pack application
+//
+//    apply_iconPack() first collects every config, then drops the ones the
+//    manifest says are already pointing at this pack: same pack, same pack
+//    directory mtimes and the config unchanged since it was last checked.
+//    The rest are resolved and, only if their paths differ, rewritten on a
+//    small worker pool.
+//
+typedef struct {
+    char *path;
+    int64_t mtime;
+    int64_t size;
+    bool applied;
+    bool checked; // resolved in this run (not taken from the manifest)
+} IconConfig_s;
+
+typedef struct {
+    IconConfig_s *configs;
+    int count;
+    int capacity;
+    int next;
+    const char *icon_pack_path;
+    bool reset_default;
+    pthread_mutex_t lock;
+    int written;
+} IconApply_s;
+
+static void _apply_addConfig(IconApply_s *apply, const char *config_path)
+{
+    struct stat st;
+
+    if (stat(config_path, &st) != 0 || !S_ISREG(st.st_mode))
+        return;
+
+    if (apply->count == apply->capacity) {
+        apply->capacity = apply->capacity ? apply->capacity * 2 : 64;
+        apply->configs = realloc(apply->configs, apply->capacity * sizeof(IconConfig_s));
+    }
+
+    IconConfig_s *config = &apply->configs[apply->count++];
+    memset(config, 0, sizeof(IconConfig_s));
+    config->path = strdup(config_path);
+    config->mtime = st.st_mtime;
+    config->size = st.st_size;
+}
+
+static void _apply_collectConfigs(IconApply_s *apply, const char *path)
 {
     DIR *dp;
     struct dirent *ep;
     char config_path[STR_MAX * 2];
-    int count = 0;
 
-    if ((dp = opendir(path)) != NULL) {
-        while ((ep = readdir(dp))) {
-            if (ep->d_type != DT_DIR)
-                continue;
-            if (ep->d_name[0] == '.')
-                continue;
-            if (strcmp("romscripts", ep->d_name) == 0)
-                continue;
-
-            snprintf(config_path, STR_MAX * 2 - 1, "%s/%s/config.json", path,
-                     ep->d_name);
-
-            if (strcmp(SEARCH_CONFIG, config_path) == 0)
-                continue;
-            if (strcmp(GUEST_CONFIG, config_path) == 0)
-                continue;
-
-            if (!is_file(config_path))
-                continue;
-
-            if (_apply_singleIconFromPack(config_path, icon_pack_path,
-                                          reset_default))
-                count++;
+    if ((dp = opendir(path)) == NULL)
+        return;
+
+    while ((ep = readdir(dp))) {
+        if (ep->d_type != DT_DIR)
+            continue;
+        if (ep->d_name[0] == '.')
+            continue;
+        if (strcmp("romscripts", ep->d_name) == 0)
+            continue;
+
+        snprintf(config_path, STR_MAX * 2 - 1, "%s/%s/config.json", path,
+                 ep->d_name);
+
+        if (strcmp(SEARCH_CONFIG, config_path) == 0)
+            continue;
+        if (strcmp(GUEST_CONFIG, config_path) == 0)
+            continue;
+
+        _apply_addConfig(apply, config_path);
+    }
+    closedir(dp);
+}
+
+// Adding or removing an icon changes the mtime of its directory
+static uint64_t _apply_packSignature(const char *icon_pack_path, bool reset_default)
+{
+    static const char *subdirs[] = {"", "/sel", "/app", "/app/sel", "/rapp", "/rapp/sel"};
+    char dir_path[STR_MAX + 16];
+    uint64_t signature = reset_default ? 1 : 0;
+    struct stat st;
+
+    for (int pass = 0; pass < (reset_default ? 2 : 1); pass++) {
+        const char *pack = pass == 0 ? icon_pack_path : ICON_PACK_DEFAULT;
+        for (int i = 0; i < sizeof(subdirs) / sizeof(subdirs[0]); i++) {
+            snprintf(dir_path, sizeof(dir_path), "%s%s", pack, subdirs[i]);
+            int64_t mtime = stat(dir_path, &st) == 0 ? st.st_mtime : -1;
+            signature = signature * 1000003 + (uint64_t)mtime;
         }
-        closedir(dp);
     }
 
-    return count;
+    return signature;
+}
+
+static int _apply_compareConfigs(const void *a, const void *b)
+{
+    return strcmp(((const IconConfig_s *)a)->path, ((const IconConfig_s *)b)->path);
+}
+
+/**
+ * @brief Marks the configs the manifest already covers. `configs` must be
+ * sorted by path.
+ */
+static void _apply_loadManifest(IconApply_s *apply, uint64_t signature)
+{
+    char *line = NULL;
+    size_t len = 0;
+    FILE *fp;
+
+    for (int i = 0; i < apply->count; i++)
+        apply->configs[i].checked = true;
+
+    if ((fp = fopen(ICONS_MANIFEST, "r")) == NULL)
+        return;
+
+    long long built_at = 0;
+    unsigned long long manifest_signature = 0;
+    bool valid = getline(&line, &len, fp) != -1 &&
+                 sscanf(line, ICONS_MANIFEST_HEADER "\t%llu\t%lld", &manifest_signature, &built_at) == 2 &&
+                 manifest_signature == signature;
+
+    // The second line holds the pack path
+    if (valid && getline(&line, &len, fp) != -1) {
+        line[strcspn(line, "\r\n")] = '\0';
+        valid = strcmp(line, apply->icon_pack_path) == 0;
+    }
+    else {
+        valid = false;
+    }
+
+    if (!valid) {
+        free(line);
+        fclose(fp);
+        return;
+    }
+
+    while (getline(&line, &len, fp) != -1) {
+        IconConfig_s key;
+        long long mtime, size;
+        int applied;
+        char *tab = strchr(line, '\t');
+
+        if (tab == NULL)
+            continue;
+        *tab = '\0';
+
+        if (sscanf(tab + 1, "%lld\t%lld\t%d", &mtime, &size, &applied) != 3)
+            continue;
+
+        key.path = line;
+        IconConfig_s *config = bsearch(&key, apply->configs, apply->count,
+                                       sizeof(IconConfig_s), _apply_compareConfigs);
+
+        // Modified around the time the manifest was written: may have
+        // changed again without its mtime moving
+        if (config == NULL || config->mtime != mtime || config->size != size ||
+            mtime + FILE_MTIME_RACY_S >= built_at)
+            continue;
+
+        config->applied = applied != 0;
+        config->checked = false;
+    }
+
+    free(line);
+    fclose(fp);
+}
+
+static void _apply_saveManifest(IconApply_s *apply, uint64_t signature)
+{
+    struct stat st;
+    FILE *fp;
+
+    if ((fp = fopen(ICONS_MANIFEST ".tmp", "w")) == NULL)
+        return;
+
+    fprintf(fp, ICONS_MANIFEST_HEADER "\t%llu\t%lld\n%s\n",
+            (unsigned long long)signature, (long long)time(NULL),
+            apply->icon_pack_path);
+
+    for (int i = 0; i < apply->count; i++) {
+        IconConfig_s *config = &apply->configs[i];
+        // Rewritten configs have a new mtime
+        if (config->checked && stat(config->path, &st) == 0) {
+            config->mtime = st.st_mtime;
+            config->size = st.st_size;
+        }
+        fprintf(fp, "%s\t%lld\t%lld\t%d\n", config->path,
+                (long long)config->mtime, (long long)config->size,
+                config->applied ? 1 : 0);
+    }
+
+    bool ok = fflush(fp) == 0;
+    ok = fclose(fp) == 0 && ok;
+
+    if (ok)
+        rename(ICONS_MANIFEST ".tmp", ICONS_MANIFEST);
+    else
+        remove(ICONS_MANIFEST ".tmp");
+}
+
+static void *_apply_worker(void *arg)
+{
+    IconApply_s *apply = (IconApply_s *)arg;
+
+    while (1) {
+        pthread_mutex_lock(&apply->lock);
+        int index = -1;
+        while (apply->next < apply->count) {
+            if (apply->configs[apply->next].checked) {
+                index = apply->next++;
+                break;
+            }
+            apply->next++;
+        }
+        pthread_mutex_unlock(&apply->lock);
+
+        if (index == -1)
+            break;
+
+        IconConfig_s *config = &apply->configs[index];
+        bool written;
+        config->applied = _apply_iconFromPack(config->path, apply->icon_pack_path,
+                                              apply->reset_default, &written);
+
+        if (written) {
+            pthread_mutex_lock(&apply->lock);
+            apply->written++;
+            pthread_mutex_unlock(&apply->lock);
+        }
+    }
+
+    return NULL;
 }
 
 int apply_iconPack(const char *icon_pack_path, bool reset_default)
 {
+    IconApply_s apply;
+    pthread_t workers[ICONS_MAX_WORKERS];
+    int num_workers = 0;
+    int pending = 0;
+    int count = 0;
+
     FILE *fp;
     file_put_sync(fp, ACTIVE_ICON_PACK, "%s", icon_pack_path);
 
-    int count = 0;
+    memset(&apply, 0, sizeof(IconApply_s));
+    apply.icon_pack_path = icon_pack_path;
+    apply.reset_default = reset_default;
+
+    _apply_collectConfigs(&apply, CONFIG_EMU_PATH);
+    _apply_collectConfigs(&apply, CONFIG_APP_PATH);
+    _apply_collectConfigs(&apply, CONFIG_RAPP_PATH);
+
+    if (apply.count > 0)
+        qsort(apply.configs, apply.count, sizeof(IconConfig_s), _apply_compareConfigs);
+
+    uint64_t signature = _apply_packSignature(icon_pack_path, reset_default);
+    _apply_loadManifest(&apply, signature);
+
+    for (int i = 0; i < apply.count; i++)
+        if (apply.configs[i].checked)
+            pending++;
+
+    if (pending > 0) {
+        pthread_mutex_init(&apply.lock, NULL);
+
+        for (; num_workers < ICONS_MAX_WORKERS && num_workers < pending; num_workers++)
+            if (pthread_create(&workers[num_workers], NULL, _apply_worker, &apply) != 0)
+                break;
 
-    count += _apply_iconPackOnConfigs(CONFIG_EMU_PATH, icon_pack_path,
-                                      reset_default);
-    count += _apply_iconPackOnConfigs(CONFIG_APP_PATH, icon_pack_path,
-                                      reset_default);
-    count += _apply_iconPackOnConfigs(CONFIG_RAPP_PATH, icon_pack_path,
-                                      reset_default);
+        // Couldn't start any thread, do it here
+        if (num_workers == 0)
+            _apply_worker(&apply);
 
+        for (int i = 0; i < num_workers; i++)
+            pthread_join(workers[i], NULL);
+
+        pthread_mutex_destroy(&apply.lock);
+    }
+
+    for (int i = 0; i < apply.count; i++)
+        if (apply.configs[i].applied)
+            count++;
+
+    printf_debug("Icon pack %s: %d configs, %d checked, %d rewritten\n",
+                 icon_pack_path, apply.count, pending, apply.written);
+
+    if (apply.written > 0 || pending > 0)
+        _apply_saveManifest(&apply, signature);
+
+    for (int i = 0; i < apply.count; i++)
+        free(apply.configs[i].path);
+    free(apply.configs);
+
+    // These are copied into place, keep them on this thread
     if (_apply_singleIconFromPack(SEARCH_CONFIG_SRC, icon_pack_path,
                                   reset_default))
         count++;
@@ -269,6 +640,9 @@ int apply_iconPack(const char *icon_pack_path, bool reset_default)
                                   reset_default))
         count++;
 
+    if (apply.written > 0)
+        sync();
+
     return count;
 }
 
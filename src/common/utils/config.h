@@ -10,11 +10,21 @@
 #include "flags.h"
 #include "log.h"
 #include "str.h"
+#include "writeCache.h"
 
 #define CONFIG_PATH "/mnt/SDCARD/.tmp_update/config/"
 #define CONFIG_INT "%d"
 #define CONFIG_STR "%[^\n]"
 
+// Compiled settings snapshot, see settings_load()
+#define CONFIG_SNAPSHOT_PATH "/tmp/settings.snapshot"
+
+/**
+ * @brief Drop the settings snapshot after changing a config value in place
+ * (which doesn't touch any directory mtime the snapshot checks)
+ */
+void config_invalidateSnapshot(void) { unlink(CONFIG_SNAPSHOT_PATH); }
+
 bool config_flag_get(const char *key) { return flag_get(CONFIG_PATH, key); }
 
 void config_flag_set(const char *key, bool value)
@@ -23,6 +33,7 @@ void config_flag_set(const char *key, bool value)
     concat(hidden_flag, key, "_");
     flag_set(CONFIG_PATH, key, value);
     flag_set(CONFIG_PATH, hidden_flag, !value);
+    config_invalidateSnapshot();
 }
 
 bool config_get(const char *key, const char *format, void *dest)
@@ -32,43 +43,31 @@ bool config_get(const char *key, const char *format, void *dest)
     char filename[STR_MAX];
     concat(filename, CONFIG_PATH, key);
 
-    if (exists(filename)) {
-        file_get(fp, filename, format, dest);
+    char staged[PATH_MAX];
+    const char *source = writeCache_resolve(filename, staged);
+
+    if (source != NULL && exists(source)) {
+        file_get(fp, source, format, dest);
         return true;
     }
 
     return false;
 }
 
-void _config_prepare(const char *key, char *filename)
-{
-    concat(filename, CONFIG_PATH, key);
-
-    char dir_path[STR_MAX];
-    strcpy(dir_path, filename);
-    dirname(dir_path);
-
-    if (!exists(dir_path)) {
-        char dir_cmd[512];
-        sprintf(dir_cmd, "mkdir -p \"%s\"", dir_path);
-        system(dir_cmd);
-    }
-}
-
 void config_setNumber(const char *key, int value)
 {
-    FILE *fp;
     char filename[STR_MAX];
-    _config_prepare(key, filename);
-    file_put_sync(fp, filename, "%d", value);
+    concat(filename, CONFIG_PATH, key);
+    writeCache_printf(filename, "%d", value);
+    config_invalidateSnapshot();
 }
 
 void config_setString(const char *key, char *value)
 {
-    FILE *fp;
     char filename[STR_MAX];
-    _config_prepare(key, filename);
-    file_put_sync(fp, filename, "%s", value);
+    concat(filename, CONFIG_PATH, key);
+    writeCache_printf(filename, "%s", value);
+    config_invalidateSnapshot();
 }
 
 #endif // CONFIG_H__
@@ -0,0 +1,347 @@
+#ifndef UTILS_DIR_LIST_H__
+#define UTILS_DIR_LIST_H__
+
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+//
+//    Directory listing in a single readdir() pass
+//
+//    Names are copied into an arena (a few large blocks instead of one
+//    allocation per entry) and indexed by a growable array. Full paths
+//    are only built when asked for. Sorting can be limited to the first
+//    screenful: the smallest entries are selected in one pass over the
+//    index and the rest is sorted the first time an entry past them is
+//    accessed. Large directories can also be read a batch at a time.
+//
+
+#define DIRLIST_ARENA_BLOCK 16384
+#define DIRLIST_INITIAL_CAPACITY 64
+
+typedef enum {
+    DIRLIST_SORT_NONE, // directory order
+    DIRLIST_SORT_NAME,
+    DIRLIST_SORT_MTIME // newest first, then by name
+} DirListSort_e;
+
+typedef struct DirListBlock_s {
+    struct DirListBlock_s *next;
+    size_t used;
+    size_t size;
+    char data[];
+} DirListBlock_s;
+
+typedef struct {
+    const char *name; // in the arena
+    time_t mtime;     // only set for DIRLIST_SORT_MTIME
+    unsigned char type;
+} DirListEntry_s;
+
+/**
+ * @brief Decides which entries are kept. `type` is the dirent d_type
+ * (DT_UNKNOWN on some filesystems).
+ */
+typedef bool (*DirListFilter_t)(const char *name, unsigned char type, void *userdata);
+
+typedef struct {
+    char dir_path[PATH_MAX]; // with a trailing '/'
+    DIR *dir;                // open while entries are streaming in
+    DirListFilter_t filter;
+    void *userdata;
+    DirListBlock_s *blocks;
+    DirListEntry_s *entries;
+    int count;
+    int capacity;
+    DirListSort_e order;
+    int sorted; // entries [0, sorted) are in their final order
+    pthread_mutex_t lock;
+} DirList_s;
+
+static const char *_dirList_store(DirList_s *list, const char *name)
+{
+    size_t len = strlen(name) + 1;
+    DirListBlock_s *block = list->blocks;
+
+    if (block == NULL || block->size - block->used < len) {
+        size_t size = len > DIRLIST_ARENA_BLOCK ? len : DIRLIST_ARENA_BLOCK;
+        if ((block = (DirListBlock_s *)malloc(sizeof(DirListBlock_s) + size)) == NULL)
+            return NULL;
+        block->next = list->blocks;
+        block->used = 0;
+        block->size = size;
+        list->blocks = block;
+    }
+
+    char *copy = block->data + block->used;
+    memcpy(copy, name, len);
+    block->used += len;
+    return copy;
+}
+
+static int _dirList_compareName(const void *a, const void *b)
+{
+    return strcmp(((const DirListEntry_s *)a)->name, ((const DirListEntry_s *)b)->name);
+}
+
+static int _dirList_compareMtime(const void *a, const void *b)
+{
+    const DirListEntry_s *ea = (const DirListEntry_s *)a;
+    const DirListEntry_s *eb = (const DirListEntry_s *)b;
+    if (ea->mtime != eb->mtime)
+        return ea->mtime > eb->mtime ? -1 : 1;
+    return strcmp(ea->name, eb->name);
+}
+
+static void _dirList_swap(DirListEntry_s *a, DirListEntry_s *b)
+{
+    DirListEntry_s tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+// Max-heap of the `k` smallest entries seen so far
+static void _dirList_siftDown(DirListEntry_s *heap, int k, int i, int (*compare)(const void *, const void *))
+{
+    for (;;) {
+        int largest = i, left = i * 2 + 1, right = left + 1;
+        if (left < k && compare(&heap[left], &heap[largest]) > 0)
+            largest = left;
+        if (right < k && compare(&heap[right], &heap[largest]) > 0)
+            largest = right;
+        if (largest == i)
+            return;
+        _dirList_swap(&heap[i], &heap[largest]);
+        i = largest;
+    }
+}
+
+static void _dirList_finishSort(DirList_s *list)
+{
+    int (*compare)(const void *, const void *) =
+        list->order == DIRLIST_SORT_MTIME ? _dirList_compareMtime : _dirList_compareName;
+
+    if (list->sorted < list->count && list->order != DIRLIST_SORT_NONE)
+        qsort(list->entries + list->sorted, list->count - list->sorted, sizeof(DirListEntry_s), compare);
+    list->sorted = list->count;
+}
+
+/**
+ * @brief Start listing `dir_path`. Nothing is read yet.
+ *
+ * @param filter NULL keeps every entry except "." and ".."
+ */
+bool dirList_open(DirList_s *list, const char *dir_path, DirListFilter_t filter, void *userdata)
+{
+    size_t len = strlen(dir_path);
+
+    memset(list, 0, sizeof(DirList_s));
+    pthread_mutex_init(&list->lock, NULL);
+
+    if (len == 0 || len + 2 > sizeof(list->dir_path))
+        return false;
+
+    snprintf(list->dir_path, sizeof(list->dir_path), "%s%s", dir_path, dir_path[len - 1] == '/' ? "" : "/");
+    list->filter = filter;
+    list->userdata = userdata;
+
+    return (list->dir = opendir(list->dir_path)) != NULL;
+}
+
+/**
+ * @brief Read up to `max` more matching entries (0: all of them), so a
+ * huge directory can be shown while the rest is still coming in. The
+ * directory is closed once it's exhausted.
+ *
+ * @return int Number of entries added
+ */
+int dirList_readSome(DirList_s *list, int max)
+{
+    struct dirent *ent;
+    int added = 0;
+
+    if (list->dir == NULL)
+        return 0;
+
+    pthread_mutex_lock(&list->lock);
+
+    while ((max <= 0 || added < max) && (ent = readdir(list->dir)) != NULL) {
+        const char *name = ent->d_name;
+
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            continue;
+        if (list->filter != NULL && !list->filter(name, ent->d_type, list->userdata))
+            continue;
+
+        if (list->count == list->capacity) {
+            int capacity = list->capacity ? list->capacity * 2 : DIRLIST_INITIAL_CAPACITY;
+            DirListEntry_s *entries = (DirListEntry_s *)realloc(list->entries, capacity * sizeof(DirListEntry_s));
+            if (entries == NULL)
+                break;
+            list->entries = entries;
+            list->capacity = capacity;
+        }
+
+        DirListEntry_s *entry = &list->entries[list->count];
+        if ((entry->name = _dirList_store(list, name)) == NULL)
+            break;
+        entry->type = ent->d_type;
+        entry->mtime = 0;
+        list->count++;
+        added++;
+    }
+
+    if (max <= 0 || added < max) {
+        closedir(list->dir);
+        list->dir = NULL;
+    }
+
+    pthread_mutex_unlock(&list->lock);
+    return added;
+}
+
+/**
+ * @brief Read everything that's left.
+ *
+ * @return int Total number of entries
+ */
+int dirList_readAll(DirList_s *list)
+{
+    dirList_readSome(list, 0);
+    return list->count;
+}
+
+bool dirList_isComplete(const DirList_s *list)
+{
+    return list->dir == NULL;
+}
+
+int dirList_count(const DirList_s *list)
+{
+    return list->count;
+}
+
+/**
+ * @brief Order the entries read so far. Only the first `first` entries
+ * are put in place now (0: all), the rest is sorted when one of them is
+ * accessed. Entries read afterwards are appended unsorted, sort again.
+ */
+void dirList_sort(DirList_s *list, DirListSort_e order, int first)
+{
+    int (*compare)(const void *, const void *) =
+        order == DIRLIST_SORT_MTIME ? _dirList_compareMtime : _dirList_compareName;
+
+    pthread_mutex_lock(&list->lock);
+
+    list->order = order;
+    list->sorted = 0;
+
+    if (order == DIRLIST_SORT_MTIME) {
+        char path[PATH_MAX];
+        struct stat st;
+        for (int i = 0; i < list->count; i++) {
+            snprintf(path, sizeof(path), "%s%s", list->dir_path, list->entries[i].name);
+            list->entries[i].mtime = stat(path, &st) == 0 ? st.st_mtime : 0;
+        }
+    }
+
+    if (order == DIRLIST_SORT_NONE || first <= 0 || first >= list->count) {
+        _dirList_finishSort(list);
+        pthread_mutex_unlock(&list->lock);
+        return;
+    }
+
+    // Select the `first` smallest into a max-heap, then sort just those
+    DirListEntry_s *entries = list->entries;
+    for (int i = first / 2 - 1; i >= 0; i--)
+        _dirList_siftDown(entries, first, i, compare);
+
+    for (int i = first; i < list->count; i++) {
+        if (compare(&entries[i], &entries[0]) < 0) {
+            _dirList_swap(&entries[i], &entries[0]);
+            _dirList_siftDown(entries, first, 0, compare);
+        }
+    }
+
+    qsort(entries, first, sizeof(DirListEntry_s), compare);
+    list->sorted = first;
+
+    pthread_mutex_unlock(&list->lock);
+}
+
+/**
+ * @brief Name of entry `index` in sorted order, NULL if out of range.
+ */
+const char *dirList_name(DirList_s *list, int index)
+{
+    const char *name = NULL;
+
+    pthread_mutex_lock(&list->lock);
+
+    if (index >= 0 && index < list->count) {
+        if (index >= list->sorted)
+            _dirList_finishSort(list);
+        name = list->entries[index].name;
+    }
+
+    pthread_mutex_unlock(&list->lock);
+    return name;
+}
+
+/**
+ * @brief Build the full path of entry `index`.
+ */
+bool dirList_path(DirList_s *list, int index, char *path_out, size_t size)
+{
+    const char *name = dirList_name(list, index);
+
+    if (name == NULL)
+        return false;
+
+    return (size_t)snprintf(path_out, size, "%s%s", list->dir_path, name) < size;
+}
+
+/**
+ * @brief Like dirList_path(), in a new allocation of the exact size.
+ */
+char *dirList_pathDup(DirList_s *list, int index)
+{
+    const char *name = dirList_name(list, index);
+    char *path;
+
+    if (name == NULL)
+        return NULL;
+
+    size_t dir_len = strlen(list->dir_path), name_len = strlen(name);
+    if ((path = (char *)malloc(dir_len + name_len + 1)) == NULL)
+        return NULL;
+
+    memcpy(path, list->dir_path, dir_len);
+    memcpy(path + dir_len, name, name_len + 1);
+    return path;
+}
+
+void dirList_free(DirList_s *list)
+{
+    if (list->dir != NULL)
+        closedir(list->dir);
+
+    while (list->blocks != NULL) {
+        DirListBlock_s *next = list->blocks->next;
+        free(list->blocks);
+        list->blocks = next;
+    }
+
+    free(list->entries);
+    pthread_mutex_destroy(&list->lock);
+    memset(list, 0, sizeof(DirList_s));
+}
+
+#endif // UTILS_DIR_LIST_H__
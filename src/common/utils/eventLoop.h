@@ -0,0 +1,161 @@
+#ifndef UTILS_EVENT_LOOP_H__
+#define UTILS_EVENT_LOOP_H__
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "utils/log.h"
+
+//
+//    Blocking event loop for apps that used to spin on poll() + usleep()
+//
+//    Sources:
+//      input   - an input device fd (e.g. /dev/input/event0), not read here
+//      timer   - a timerfd for animations and timeouts
+//      battery - an inotify watch on /tmp/percBat, which batmon rewrites
+//                in place
+//
+//    eventLoop_wait() sleeps until one of them is ready, so an idle app
+//    doesn't wake at all.
+//
+
+#define EVENT_LOOP_BATTERY_FILE "/tmp/percBat"
+
+typedef enum {
+    EVENT_NONE = 0,
+    EVENT_INPUT = 1 << 0,
+    EVENT_TIMER = 1 << 1,
+    EVENT_BATTERY = 1 << 2,
+    EVENT_INTERRUPTED = 1 << 3
+} EventType_e;
+
+enum { EVENT_SRC_INPUT, EVENT_SRC_TIMER, EVENT_SRC_BATTERY, EVENT_SRC_COUNT };
+
+typedef struct {
+    struct pollfd fds[EVENT_SRC_COUNT];
+    int battery_wd;
+} EventLoop_s;
+
+static void _eventLoop_watchBattery(EventLoop_s *loop)
+{
+    if (loop->fds[EVENT_SRC_BATTERY].fd == -1 || loop->battery_wd != -1)
+        return;
+
+    // Fails while batmon isn't running, retried on the next wait
+    loop->battery_wd = inotify_add_watch(loop->fds[EVENT_SRC_BATTERY].fd, EVENT_LOOP_BATTERY_FILE, IN_CLOSE_WRITE);
+}
+
+/**
+ * @brief Set up the event loop. `input_fd` may be -1 to only wait for
+ * timers and battery changes.
+ */
+bool eventLoop_init(EventLoop_s *loop, int input_fd)
+{
+    memset(loop, 0, sizeof(EventLoop_s));
+
+    loop->fds[EVENT_SRC_INPUT].fd = input_fd;
+    loop->fds[EVENT_SRC_TIMER].fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    loop->fds[EVENT_SRC_BATTERY].fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    loop->battery_wd = -1;
+
+    for (int i = 0; i < EVENT_SRC_COUNT; i++)
+        loop->fds[i].events = POLLIN;
+
+    if (loop->fds[EVENT_SRC_TIMER].fd == -1) {
+        print_debug("Failed to create timerfd");
+        return false;
+    }
+
+    _eventLoop_watchBattery(loop);
+
+    return true;
+}
+
+void eventLoop_free(EventLoop_s *loop)
+{
+    if (loop->fds[EVENT_SRC_TIMER].fd != -1)
+        close(loop->fds[EVENT_SRC_TIMER].fd);
+    if (loop->fds[EVENT_SRC_BATTERY].fd != -1)
+        close(loop->fds[EVENT_SRC_BATTERY].fd);
+    loop->fds[EVENT_SRC_TIMER].fd = loop->fds[EVENT_SRC_BATTERY].fd = -1;
+}
+
+/**
+ * @brief Arm the timer to fire once after `delay_ms`. Passing 0 disarms it.
+ */
+void eventLoop_setTimer(EventLoop_s *loop, uint32_t delay_ms)
+{
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = delay_ms / 1000;
+    spec.it_value.tv_nsec = (delay_ms % 1000) * 1000000L;
+    timerfd_settime(loop->fds[EVENT_SRC_TIMER].fd, 0, &spec, NULL);
+}
+
+static bool _eventLoop_batteryChanged(EventLoop_s *loop)
+{
+    int fd = loop->fds[EVENT_SRC_BATTERY].fd;
+    char buf[1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t len;
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (char *ptr = buf; ptr < buf + len;) {
+            struct inotify_event *event = (struct inotify_event *)ptr;
+            if (event->mask & IN_CLOSE_WRITE)
+                changed = true;
+            // batmon removed the file on exit, watch it again once it's back
+            if (event->mask & IN_IGNORED)
+                loop->battery_wd = -1;
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return changed;
+}
+
+/**
+ * @brief Block until input is readable, the timer fires or the battery
+ * file changes, or until `timeout_ms` passes (-1 waits forever).
+ *
+ * Input is only reported, the caller reads the device itself.
+ *
+ * @return int A mask of EventType_e, EVENT_NONE on timeout.
+ */
+int eventLoop_wait(EventLoop_s *loop, int timeout_ms)
+{
+    int events = EVENT_NONE;
+
+    _eventLoop_watchBattery(loop);
+
+    int ret = poll(loop->fds, EVENT_SRC_COUNT, timeout_ms);
+
+    if (ret == 0)
+        return EVENT_NONE;
+
+    if (ret < 0) {
+        // Signal handlers set the quit flags, let the caller check them
+        return errno == EINTR ? EVENT_INTERRUPTED : EVENT_NONE;
+    }
+
+    if (loop->fds[EVENT_SRC_INPUT].revents & POLLIN)
+        events |= EVENT_INPUT;
+
+    if (loop->fds[EVENT_SRC_TIMER].revents & POLLIN) {
+        uint64_t expirations;
+        if (read(loop->fds[EVENT_SRC_TIMER].fd, &expirations, sizeof(expirations)) > 0)
+            events |= EVENT_TIMER;
+    }
+
+    if ((loop->fds[EVENT_SRC_BATTERY].revents & POLLIN) && _eventLoop_batteryChanged(loop))
+        events |= EVENT_BATTERY;
+
+    return events;
+}
+
+#endif // UTILS_EVENT_LOOP_H__
@@ -57,6 +57,10 @@
 #define PATH_MAX 4096
 #endif
 
+// SD card (FAT) mtimes have a 2 s resolution: a file modified within that
+// window of a cached stat may have changed again without its mtime moving
+#define FILE_MTIME_RACY_S 2
+
 #define CONTENT_INT "%d"
 #define CONTENT_STR "%[^\n]"
 
@@ -8,6 +8,7 @@
 
 #include "file.h"
 #include "str.h"
+#include "writeCache.h"
 
 #define temp_flag_get(key) flag_get("/tmp/", key)
 #define temp_flag_set(key, value) flag_set("/tmp/", key, value)
@@ -16,7 +17,7 @@ bool flag_get(const char *path, const char *key)
 {
     char filename[STR_MAX];
     concat(filename, path, key);
-    return exists(filename);
+    return writeCache_exists(filename);
 }
 
 void flag_set(const char *path, const char *key, bool value)
@@ -25,9 +26,9 @@ void flag_set(const char *path, const char *key, bool value)
     concat(filename, path, key);
 
     if (value)
-        close(creat(filename, 777));
+        writeCache_put(filename, "", 0);
     else
-        remove(filename);
+        writeCache_remove(filename);
 }
 
 #endif // FLAGS_H__
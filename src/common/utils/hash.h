@@ -6,11 +6,12 @@
 // usually malloc(...+8) - to prevent out of boundary reads! Many thanks go to
 // Yurii 'Hordi' Hordiienko, he lessened with 3 instructions the original
 // 'Pippip', thus:
+#include <ctype.h>
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdlib.h>
 #define _PADr_KAZE(x, n) (((x) << (n)) >> (n))
-uint32_t FNV1A_Pippip_Yurii(const char *str, size_t wrdlen)
+static inline uint32_t FNV1A_Pippip_Yurii(const char *str, size_t wrdlen)
 {
     const uint32_t PRIME = 591798841;
     uint32_t hash32;
@@ -33,6 +34,29 @@ uint32_t FNV1A_Pippip_Yurii(const char *str, size_t wrdlen)
     return hash32 ^ (hash32 >> 16);
 } // Last update: 2019-Oct-30, 14 C lines strong, Kaze.
 
+/**
+ * @brief 32-bit FNV-1a of a NUL terminated string, for hash tables keyed
+ * by paths, names and config keys.
+ */
+static inline uint32_t hash_str(const char *str)
+{
+    uint32_t hash = 2166136261u;
+    while (*str)
+        hash = (hash ^ (unsigned char)*str++) * 16777619u;
+    return hash;
+}
+
+/**
+ * @brief Same as hash_str(), ignoring ASCII case
+ */
+static inline uint32_t hash_strCaseInsensitive(const char *str)
+{
+    uint32_t hash = 2166136261u;
+    while (*str)
+        hash = (hash ^ (unsigned char)tolower((unsigned char)*str++)) * 16777619u;
+    return hash;
+}
+
 // https://godbolt.org/z/i40ipj x86-64 gcc 9.2 -O3
 /*
 FNV1A_Pippip_Yurii:                              FNV1A_Pippip(char const*,
@@ -0,0 +1,556 @@
+#ifndef UTILS_IMAGE_BATCH_H__
+#define UTILS_IMAGE_BATCH_H__
+
+#include <dirent.h>
+#include <getopt.h>
+#include <png.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+//
+//	Batch image conversion: decode -> scale -> encode, streamed row by row
+//	on a pool of worker threads. Used by pngScale and jpg2png (--batch).
+//
+//	A decoder opens the source, calls imageBatch_fit() / imageBatch_begin()
+//	once the dimensions are known and then feeds every decoded row to
+//	imageBatch_pushRow(). Scaling is an exact area average in fixed point,
+//	so only one source row and one accumulator row are held in memory.
+//	Decoders report errors by longjmp'ing to sink->jmp (see
+//	imageBatch_pngError), which they must setjmp() before decoding.
+//
+
+#define IMAGEBATCH_MAX_WORKERS 8
+#define IMAGEBATCH_FRAC 16 // extra precision kept between the two passes
+
+typedef struct {
+    jmp_buf jmp;
+    const char *path;
+    const char *out_path;
+    uint32_t max_w;
+    uint32_t max_h;
+
+    // Filled by imageBatch_begin
+    bool skipped;
+    uint32_t sw, sh, dw, dh, channels;
+    uint32_t src_y;
+    uint32_t dst_y;
+
+    uint8_t *in_row;
+    uint32_t *h_row;
+    uint32_t *acc_row;
+    uint8_t *out_row;
+    void *scratch;
+
+    char tmp_path[512];
+    FILE *out_fp;
+    png_structp png_ptr;
+    png_infop info_ptr;
+} ImageBatchSink_s;
+
+/**
+ * @brief Decodes `path` into `sink`. Returns false on error.
+ */
+typedef bool (*ImageBatchDecoder_t)(const char *path, ImageBatchSink_s *sink);
+
+typedef struct {
+    const char *name;
+    const char *extensions; // comma separated, without dots
+    ImageBatchDecoder_t decode;
+} ImageBatchConfig_s;
+
+typedef struct {
+    const ImageBatchConfig_s *config;
+    char **paths;
+    int count;
+    int capacity;
+    int next;
+    const char *out_dir;
+    uint32_t max_w;
+    uint32_t max_h;
+    pthread_mutex_t lock;
+
+    int converted;
+    int skipped;
+    int failed;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+} ImageBatch_s;
+
+/**
+ * @brief Fits `sw`x`sh` into `mw`x`mh`, keeping the aspect ratio.
+ * Same rules as the single file mode: fit to width, then clamp height.
+ */
+void imageBatch_fit(uint32_t mw, uint32_t mh, uint32_t sw, uint32_t sh,
+                    uint32_t *dw, uint32_t *dh)
+{
+    *dw = mw;
+    *dh = (uint32_t)((uint64_t)sh * mw / sw);
+    if (*dh > mh) {
+        *dh = mh;
+        *dw = (uint32_t)((uint64_t)sw * mh / sh);
+    }
+    if (*dw == 0)
+        *dw = 1;
+    if (*dh == 0)
+        *dh = 1;
+}
+
+void imageBatch_pngError(png_structp png_ptr, png_const_charp msg)
+{
+    ImageBatchSink_s *sink = (ImageBatchSink_s *)png_get_error_ptr(png_ptr);
+    fprintf(stderr, "%s: %s\n", sink->path, msg);
+    longjmp(sink->jmp, 1);
+}
+
+void imageBatch_pngWarning(png_structp png_ptr, png_const_charp msg) {}
+
+/**
+ * @brief Returns a buffer owned by the sink, freed after the image is done.
+ * For decoders that can't stream (interlaced PNG).
+ */
+void *imageBatch_scratch(ImageBatchSink_s *sink, size_t size)
+{
+    free(sink->scratch);
+    sink->scratch = malloc(size);
+    if (sink->scratch == NULL)
+        longjmp(sink->jmp, 1);
+    return sink->scratch;
+}
+
+/**
+ * @brief Starts the scaler and the PNG writer.
+ *
+ * @param sw Decoded width (may be smaller than the original, e.g. jpeg DCT scaling)
+ * @param sh Decoded height
+ * @param dw Output width, usually from imageBatch_fit
+ * @param dh Output height
+ * @param channels Bytes per decoded pixel, 3 (RGB) or 4 (RGBA)
+ * @return uint8_t* Row buffer to decode into, or NULL on error.
+ */
+uint8_t *imageBatch_begin(ImageBatchSink_s *sink, uint32_t sw, uint32_t sh,
+                          uint32_t dw, uint32_t dh, uint32_t channels)
+{
+    sink->sw = sw;
+    sink->sh = sh;
+    sink->dw = dw;
+    sink->dh = dh;
+    sink->channels = channels;
+    sink->src_y = 0;
+    sink->dst_y = 0;
+
+    sink->in_row = malloc(sw * channels);
+    sink->h_row = malloc(dw * 4 * sizeof(uint32_t));
+    sink->acc_row = calloc(dw * 4, sizeof(uint32_t));
+    sink->out_row = malloc(dw * 4);
+    if (!sink->in_row || !sink->h_row || !sink->acc_row || !sink->out_row)
+        longjmp(sink->jmp, 1);
+
+    snprintf(sink->tmp_path, sizeof(sink->tmp_path), "%s.tmp", sink->out_path);
+    if ((sink->out_fp = fopen(sink->tmp_path, "wb")) == NULL) {
+        fprintf(stderr, "%s: png write error\n", sink->tmp_path);
+        longjmp(sink->jmp, 1);
+    }
+
+    sink->png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, sink,
+                                            imageBatch_pngError, imageBatch_pngWarning);
+    sink->info_ptr = png_create_info_struct(sink->png_ptr);
+    png_init_io(sink->png_ptr, sink->out_fp);
+    png_set_IHDR(sink->png_ptr, sink->info_ptr, dw, dh, 8, PNG_COLOR_TYPE_RGBA,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(sink->png_ptr, sink->info_ptr);
+
+    return sink->in_row;
+}
+
+// Horizontal pass: source pixel i covers [i*dw, (i+1)*dw), output pixel j
+// covers [j*sw, (j+1)*sw), each output gets the overlap-weighted sum.
+static void _imageBatch_scaleRow(ImageBatchSink_s *sink, const uint8_t *in)
+{
+    const uint32_t sw = sink->sw, dw = sink->dw, ch = sink->channels;
+    uint32_t *out = sink->h_row;
+    uint64_t pos = 0, next_src = dw, next_dst = sw;
+    uint32_t sum[4] = {0, 0, 0, 0};
+    uint32_t i = 0, j = 0;
+
+    while (j < dw) {
+        uint64_t end = next_src < next_dst ? next_src : next_dst;
+        uint32_t w = (uint32_t)(end - pos);
+        const uint8_t *p = in + i * ch;
+
+        sum[0] += w * p[0];
+        sum[1] += w * p[1];
+        sum[2] += w * p[2];
+        sum[3] += w * (ch == 4 ? p[3] : 0xFF);
+        pos = end;
+
+        if (pos == next_src) {
+            i++;
+            next_src += dw;
+        }
+        if (pos == next_dst) {
+            for (int c = 0; c < 4; c++) {
+                out[j * 4 + c] = (uint32_t)(((uint64_t)sum[c] * IMAGEBATCH_FRAC + sw / 2) / sw);
+                sum[c] = 0;
+            }
+            j++;
+            next_dst += sw;
+        }
+    }
+}
+
+static void _imageBatch_emitRow(ImageBatchSink_s *sink)
+{
+    const uint32_t div = sink->sh * IMAGEBATCH_FRAC;
+    const uint32_t n = sink->dw * 4;
+
+    for (uint32_t k = 0; k < n; k++) {
+        sink->out_row[k] = (uint8_t)((sink->acc_row[k] + div / 2) / div);
+        sink->acc_row[k] = 0;
+    }
+    png_write_row(sink->png_ptr, sink->out_row);
+    sink->dst_y++;
+}
+
+/**
+ * @brief Feeds the next decoded row (sink->in_row unless the decoder
+ * buffers the whole image).
+ */
+void imageBatch_pushRow(ImageBatchSink_s *sink, const uint8_t *row)
+{
+    if (sink->src_y >= sink->sh)
+        return;
+
+    _imageBatch_scaleRow(sink, row);
+
+    // Vertical pass, same overlap rule with sh/dh
+    const uint32_t n = sink->dw * 4;
+    uint64_t pos = (uint64_t)sink->src_y * sink->dh;
+    uint64_t end = pos + sink->dh;
+
+    while (pos < end && sink->dst_y < sink->dh) {
+        uint64_t next_dst = (uint64_t)(sink->dst_y + 1) * sink->sh;
+        uint64_t seg_end = end < next_dst ? end : next_dst;
+        uint32_t w = (uint32_t)(seg_end - pos);
+
+        for (uint32_t k = 0; k < n; k++)
+            sink->acc_row[k] += w * sink->h_row[k];
+        pos = seg_end;
+
+        if (pos == next_dst)
+            _imageBatch_emitRow(sink);
+    }
+
+    sink->src_y++;
+}
+
+static bool _imageBatch_finish(ImageBatchSink_s *sink, bool ok)
+{
+    if (sink->png_ptr) {
+        if (ok) {
+            if (setjmp(sink->jmp) == 0) {
+                while (sink->dst_y < sink->dh) // truncated source
+                    _imageBatch_emitRow(sink);
+                png_write_end(sink->png_ptr, sink->info_ptr);
+            }
+            else {
+                ok = false;
+            }
+        }
+        png_destroy_write_struct(&sink->png_ptr, &sink->info_ptr);
+    }
+    if (sink->out_fp) {
+        if (fclose(sink->out_fp) != 0)
+            ok = false;
+        sink->out_fp = NULL;
+        if (ok && rename(sink->tmp_path, sink->out_path) != 0)
+            ok = false;
+        if (!ok)
+            remove(sink->tmp_path);
+    }
+
+    free(sink->in_row);
+    free(sink->h_row);
+    free(sink->acc_row);
+    free(sink->out_row);
+    free(sink->scratch);
+    return ok;
+}
+
+static bool _imageBatch_hasExtension(const char *path, const char *extensions)
+{
+    const char *ext = strrchr(path, '.');
+    if (ext == NULL || strchr(ext, '/') != NULL)
+        return false;
+    ext++;
+
+    size_t len = strlen(ext);
+    const char *p = extensions;
+    while (*p) {
+        const char *comma = strchr(p, ',');
+        size_t n = comma ? (size_t)(comma - p) : strlen(p);
+        if (n == len && strncasecmp(p, ext, n) == 0)
+            return true;
+        p += n + (comma ? 1 : 0);
+    }
+    return false;
+}
+
+static void _imageBatch_addPath(ImageBatch_s *batch, const char *path)
+{
+    if (batch->count == batch->capacity) {
+        batch->capacity = batch->capacity ? batch->capacity * 2 : 64;
+        batch->paths = realloc(batch->paths, batch->capacity * sizeof(char *));
+    }
+    batch->paths[batch->count++] = strdup(path);
+}
+
+// `source` is either a directory (non-recursive) or a text file with one path per line
+static bool _imageBatch_collect(ImageBatch_s *batch, const char *source)
+{
+    struct stat st;
+    char path[512];
+
+    if (stat(source, &st) != 0) {
+        fprintf(stderr, "%s: not found\n", source);
+        return false;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(source);
+        struct dirent *entry;
+        if (dir == NULL)
+            return false;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.' ||
+                !_imageBatch_hasExtension(entry->d_name, batch->config->extensions))
+                continue;
+            snprintf(path, sizeof(path), "%s/%s", source, entry->d_name);
+            _imageBatch_addPath(batch, path);
+        }
+        closedir(dir);
+    }
+    else {
+        FILE *fp = fopen(source, "r");
+        if (fp == NULL)
+            return false;
+        while (fgets(path, sizeof(path), fp)) {
+            path[strcspn(path, "\r\n")] = 0;
+            if (path[0] != 0)
+                _imageBatch_addPath(batch, path);
+        }
+        fclose(fp);
+    }
+
+    return true;
+}
+
+static void _imageBatch_outputPath(ImageBatch_s *batch, const char *path, char *out, size_t size)
+{
+    const char *name = strrchr(path, '/');
+    const char *ext = strrchr(path, '.');
+    name = name ? name + 1 : path;
+    int base_len = (int)((ext && ext > name ? ext : name + strlen(name)) - name);
+
+    if (batch->out_dir)
+        snprintf(out, size, "%s/%.*s.png", batch->out_dir, base_len, name);
+    else
+        snprintf(out, size, "%.*s%.*s.png", (int)(name - path), path, base_len, name);
+}
+
+// pngScale without -o would write over its own sources
+static bool _imageBatch_overwritesSource(ImageBatch_s *batch, const char *path)
+{
+    struct stat st_in, st_out;
+    char out_path[512];
+
+    _imageBatch_outputPath(batch, path, out_path, sizeof(out_path));
+    return stat(path, &st_in) == 0 && stat(out_path, &st_out) == 0 &&
+           st_out.st_ino == st_in.st_ino && st_out.st_dev == st_in.st_dev;
+}
+
+static void _imageBatch_freePaths(ImageBatch_s *batch)
+{
+    for (int i = 0; i < batch->count; i++)
+        free(batch->paths[i]);
+    free(batch->paths);
+}
+
+static void _imageBatch_process(ImageBatch_s *batch, const char *path)
+{
+    ImageBatchSink_s sink;
+    struct stat st_in, st_out;
+    char out_path[512];
+    bool ok = false;
+
+    memset(&sink, 0, sizeof(sink));
+    _imageBatch_outputPath(batch, path, out_path, sizeof(out_path));
+
+    if (stat(path, &st_in) != 0) {
+        fprintf(stderr, "%s: not found\n", path);
+        pthread_mutex_lock(&batch->lock);
+        batch->failed++;
+        pthread_mutex_unlock(&batch->lock);
+        return;
+    }
+
+    if (stat(out_path, &st_out) == 0 && st_out.st_mtime >= st_in.st_mtime)
+        sink.skipped = true;
+
+    if (!sink.skipped) {
+        sink.path = path;
+        sink.out_path = out_path;
+        sink.max_w = batch->max_w;
+        sink.max_h = batch->max_h;
+        ok = batch->config->decode(path, &sink);
+        ok = _imageBatch_finish(&sink, ok && !sink.skipped) || sink.skipped;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    if (sink.skipped) {
+        batch->skipped++;
+    }
+    else if (ok) {
+        batch->converted++;
+        batch->bytes_in += st_in.st_size;
+        if (stat(out_path, &st_out) == 0)
+            batch->bytes_out += st_out.st_size;
+    }
+    else {
+        batch->failed++;
+    }
+    pthread_mutex_unlock(&batch->lock);
+}
+
+static void *_imageBatch_worker(void *arg)
+{
+    ImageBatch_s *batch = (ImageBatch_s *)arg;
+
+    while (1) {
+        pthread_mutex_lock(&batch->lock);
+        int index = batch->next < batch->count ? batch->next++ : -1;
+        pthread_mutex_unlock(&batch->lock);
+
+        if (index == -1)
+            break;
+        _imageBatch_process(batch, batch->paths[index]);
+    }
+
+    return NULL;
+}
+
+static double _imageBatch_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Entry point for `<tool> --batch <dir|list.txt> [options]`
+ *
+ * @param argc Arguments starting at "--batch"
+ * @return int Exit code, 1 if any image failed
+ */
+int imageBatch_main(int argc, char *argv[], const ImageBatchConfig_s *config)
+{
+    ImageBatch_s batch;
+    pthread_t workers[IMAGEBATCH_MAX_WORKERS];
+    long num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.config = config;
+    batch.max_w = 250;
+    batch.max_h = 360;
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "o:w:h:j:")) != -1) {
+        switch (opt) {
+        case 'o':
+            batch.out_dir = optarg;
+            break;
+        case 'w':
+            batch.max_w = atoi(optarg);
+            break;
+        case 'h':
+            batch.max_h = atoi(optarg);
+            break;
+        case 'j':
+            num_workers = atoi(optarg);
+            break;
+        default:
+            goto usage;
+        }
+    }
+
+    if (optind >= argc || !batch.max_w || !batch.max_h)
+        goto usage;
+    if (num_workers < 1)
+        num_workers = 1;
+    if (num_workers > IMAGEBATCH_MAX_WORKERS)
+        num_workers = IMAGEBATCH_MAX_WORKERS;
+
+    for (; optind < argc; optind++) {
+        if (!_imageBatch_collect(&batch, argv[optind])) {
+            _imageBatch_freePaths(&batch);
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < batch.count; i++) {
+        if (_imageBatch_overwritesSource(&batch, batch.paths[i])) {
+            fprintf(stderr, "%s: %s would be overwritten, use -o to set an output folder\n",
+                    config->name, batch.paths[i]);
+            _imageBatch_freePaths(&batch);
+            return 1;
+        }
+    }
+
+    if (batch.out_dir)
+        mkdir(batch.out_dir, 0777);
+
+    double start = _imageBatch_now();
+    pthread_mutex_init(&batch.lock, NULL);
+
+    if (num_workers > batch.count)
+        num_workers = batch.count > 0 ? batch.count : 1;
+    for (int i = 0; i < num_workers; i++)
+        pthread_create(&workers[i], NULL, _imageBatch_worker, &batch);
+    for (int i = 0; i < num_workers; i++)
+        pthread_join(workers[i], NULL);
+
+    pthread_mutex_destroy(&batch.lock);
+    sync();
+
+    double elapsed = _imageBatch_now() - start;
+    if (elapsed <= 0)
+        elapsed = 1e-9;
+
+    printf("%s: %d converted, %d up to date, %d failed in %.2fs with %ld workers\n",
+           config->name, batch.converted, batch.skipped, batch.failed, elapsed, num_workers);
+    printf("%s: %.1f images/s, %.2f MB/s read, %.2f MB/s written\n", config->name,
+           batch.converted / elapsed, batch.bytes_in / elapsed / 1048576.0,
+           batch.bytes_out / elapsed / 1048576.0);
+
+    _imageBatch_freePaths(&batch);
+
+    return batch.failed > 0 ? 1 : 0;
+
+usage:
+    printf("usage: %s --batch <dir|list.txt>... [-o out_dir:def=next to source] "
+           "[-w max_width:def=250] [-h max_height:def=360] [-j workers:def=cpus]\n",
+           config->name);
+    return 1;
+}
+
+#endif // UTILS_IMAGE_BATCH_H__
@@ -1,110 +1,488 @@
 #include <SDL/SDL.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "imageCache.h"
 #include "utils/log.h"
 
-#define IMAGECACHE_MAXSIZE 50
+typedef enum {
+    SLOT_EMPTY = 0,
+    SLOT_LOADING,
+    SLOT_READY,
+    SLOT_FAILED
+} SlotState_e;
 
-static pthread_t romscreen_thread_pt;
-static bool thread_active = false;
+typedef struct {
+    SDL_Surface *surface;
+    size_t bytes;
+    uint32_t last_used;
+    SlotState_e state;
+} ImageCacheSlot_s;
 
-static const int image_cache_len = IMAGECACHE_MAXSIZE;
-static SDL_Surface *image_cache[IMAGECACHE_MAXSIZE] = {NULL};
-static int image_cache_offset = -1;
+// Everything below is guarded by `cache_mutex`
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
 
-static SDL_Surface *(*load_image)(int) = NULL;
-static int images_total = 0;
+static pthread_t workers[IMAGECACHE_MAX_WORKERS];
+static int workers_len = 0;
+static bool workers_running = false;
+static int workers_paused = 0;
+static int in_flight = 0;
 
-int modulo(int x, int n) { return (x % n + n) % n; }
+static ImageCacheSlot_s *slots = NULL;
+static int slots_len = 0;
+static ImageCacheLoader_t load_image = NULL;
+static void *load_userdata = NULL;
 
-static void *_imageCacheThread(void *param)
+static int cursor = -1;
+static int cursor_radius = 0;
+static int pinned = -1;
+static uint32_t use_clock = 0;
+static size_t byte_budget = IMAGECACHE_DEFAULT_BUDGET;
+static size_t typical_bytes = 0;
+static ImageCacheStats_s stats = {0};
+
+static int _distance(int index) { return abs(index - cursor); }
+
+static bool _inWindow(int index)
+{
+    return cursor >= 0 && _distance(index) <= cursor_radius;
+}
+
+static void _freeSlot(ImageCacheSlot_s *slot)
+{
+    if (slot->state == SLOT_READY) {
+        SDL_FreeSurface(slot->surface);
+        stats.used_bytes -= slot->bytes;
+        stats.resident--;
+    }
+    slot->surface = NULL;
+    slot->bytes = 0;
+    slot->state = SLOT_EMPTY;
+}
+
+/**
+ * @brief Picks the least recently used image outside the prefetch window.
+ * If there is none, picks the image farthest from the cursor, as long as
+ * it is farther than `keep_distance`.
+ */
+static int _findVictim(int keep_distance)
 {
-    int offset = *((int *)param) - image_cache_len / 2;
-    int start = image_cache_offset - image_cache_len + 1;
-    int end = image_cache_offset;
+    int lru = -1;
+    int farthest = -1;
+
+    for (int i = 0; i < slots_len; i++) {
+        if (slots[i].state != SLOT_READY || i == cursor || i == pinned)
+            continue;
+
+        if (!_inWindow(i)) {
+            if (lru == -1 || slots[i].last_used < slots[lru].last_used)
+                lru = i;
+        }
+        else if (_distance(i) > keep_distance &&
+                 (farthest == -1 || _distance(i) > _distance(farthest))) {
+            farthest = i;
+        }
+    }
+
+    return lru != -1 ? lru : farthest;
+}
 
-    if (offset > images_total - image_cache_len)
-        offset = images_total - image_cache_len;
-    if (offset < 0)
-        offset = 0;
+static void _makeRoom(size_t bytes, int keep_distance)
+{
+    int victim;
+
+    while (stats.used_bytes + bytes > byte_budget &&
+           (victim = _findVictim(keep_distance)) != -1) {
+        printf_debug("imageCache: evicting %d (%zu bytes)\n", victim, slots[victim].bytes);
+        _freeSlot(&slots[victim]);
+        stats.evictions++;
+    }
+}
+
+/**
+ * @brief Returns the empty slot closest to the cursor, looking ahead of the
+ * cursor first, or -1 when there is nothing (affordable) left to prefetch.
+ */
+static int _nextJob(void)
+{
+    if (workers_paused > 0 || load_image == NULL || cursor < 0)
+        return -1;
+
+    for (int d = 0; d <= cursor_radius; d++) {
+        int candidates[2] = {cursor + d, cursor - d};
+
+        for (int i = 0; i < (d == 0 ? 1 : 2); i++) {
+            int index = candidates[i];
+
+            if (index < 0 || index >= slots_len || slots[index].state != SLOT_EMPTY)
+                continue;
+
+            // No room, and nothing less important to make room with
+            if (stats.used_bytes + typical_bytes > byte_budget && _findVictim(d) == -1)
+                return -1;
+
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Loads a slot. Must be called with the lock held, the lock is
+ * released while the loader runs.
+ */
+static SDL_Surface *_loadSlot(int index, bool prefetch)
+{
+    ImageCacheLoader_t loader = load_image;
+    void *userdata = load_userdata;
 
-    for (int i = 0; i < image_cache_len; i++) {
-        int curr = offset + i;
+    slots[index].state = SLOT_LOADING;
+    in_flight++;
+    pthread_mutex_unlock(&cache_mutex);
 
-        if (curr >= images_total)
-            break;
+    SDL_Surface *surface = loader != NULL ? loader(index, userdata) : NULL;
 
-        if (curr >= start && curr <= end)
+    pthread_mutex_lock(&cache_mutex);
+    in_flight--;
+
+    ImageCacheSlot_s *slot = &slots[index];
+
+    if (prefetch && !_inWindow(index)) {
+        // The cursor moved past this image while it was being decoded
+        slot->state = SLOT_EMPTY;
+        stats.cancelled++;
+        if (surface != NULL)
+            SDL_FreeSurface(surface);
+    }
+    else if (surface == NULL) {
+        slot->state = SLOT_FAILED;
+        stats.failed++;
+    }
+    else {
+        size_t bytes = (size_t)surface->pitch * surface->h;
+        typical_bytes = bytes;
+        _makeRoom(bytes, _inWindow(index) ? _distance(index) : cursor_radius);
+
+        if (prefetch && stats.used_bytes + bytes > byte_budget) {
+            // Everything resident is closer to the cursor than this one
+            slot->state = SLOT_EMPTY;
+            stats.cancelled++;
+            SDL_FreeSurface(surface);
+        }
+        else {
+            slot->surface = surface;
+            slot->bytes = bytes;
+            slot->last_used = ++use_clock;
+            slot->state = SLOT_READY;
+            stats.used_bytes += bytes;
+            stats.resident++;
+            stats.loads++;
+        }
+    }
+
+    pthread_cond_broadcast(&done_cond);
+
+    return slot->state == SLOT_READY ? slot->surface : NULL;
+}
+
+static void *_imageCacheWorker(void *_)
+{
+    pthread_mutex_lock(&cache_mutex);
+
+    while (workers_running) {
+        int index = _nextJob();
+
+        if (index == -1) {
+            pthread_cond_wait(&work_cond, &cache_mutex);
             continue;
+        }
+
+        _loadSlot(index, true);
+    }
 
-        int idx = modulo(curr, image_cache_len);
+    pthread_mutex_unlock(&cache_mutex);
+    return NULL;
+}
+
+/**
+ * @brief Stops workers from picking new jobs and waits for in-flight ones,
+ * so slots can be moved around safely. Call with the lock held.
+ */
+static void _pauseWorkers(void)
+{
+    workers_paused++;
+    while (in_flight > 0)
+        pthread_cond_wait(&done_cond, &cache_mutex);
+}
 
-        if (image_cache[idx] != NULL)
-            SDL_FreeSurface(image_cache[idx]);
+static void _resumeWorkers(void)
+{
+    workers_paused--;
+    pthread_cond_broadcast(&work_cond);
+}
+
+bool imageCache_init(int num_workers, size_t budget)
+{
+    bool success = true;
 
-        if (load_image != NULL)
-            image_cache[idx] = load_image(curr);
+    pthread_mutex_lock(&cache_mutex);
+
+    if (budget > 0)
+        byte_budget = budget;
+
+    if (!workers_running) {
+        workers_running = true;
+
+        if (num_workers > IMAGECACHE_MAX_WORKERS)
+            num_workers = IMAGECACHE_MAX_WORKERS;
+
+        for (int i = 0; i < num_workers; i++) {
+            if (pthread_create(&workers[workers_len], NULL, _imageCacheWorker, NULL) != 0) {
+                print_debug("imageCache: failed to start worker");
+                success = false;
+                break;
+            }
+            workers_len++;
+        }
     }
 
-    image_cache_offset = offset + image_cache_len - 1;
+    pthread_mutex_unlock(&cache_mutex);
 
-    thread_active = false;
-    return 0;
+    return success;
 }
 
-void imageCache_load(int *offset, SDL_Surface *(*_load_image)(int), int total)
+void imageCache_setSource(ImageCacheLoader_t loader, void *userdata, int total)
 {
-    if (thread_active)
-        return;
-    thread_active = true;
-    load_image = _load_image;
-    images_total = total;
-    pthread_create(&romscreen_thread_pt, NULL, _imageCacheThread, offset);
+    pthread_mutex_lock(&cache_mutex);
+    _pauseWorkers();
+
+    for (int i = 0; i < slots_len; i++)
+        _freeSlot(&slots[i]);
+    free(slots);
+
+    slots = total > 0 ? (ImageCacheSlot_s *)calloc(total, sizeof(ImageCacheSlot_s)) : NULL;
+    slots_len = slots != NULL ? total : 0;
+    load_image = loader;
+    load_userdata = userdata;
+    cursor = -1;
+    pinned = -1;
+
+    _resumeWorkers();
+    pthread_mutex_unlock(&cache_mutex);
 }
 
-void imageCache_removeItem(int image_index)
+void imageCache_setTotal(int total)
 {
-    int start = image_cache_offset - image_cache_len + 1;
-    int end = image_cache_offset;
+    if (total < 0)
+        total = 0;
 
-    if (image_index < start || image_index > end)
-        return;
+    pthread_mutex_lock(&cache_mutex);
+    _pauseWorkers();
 
-    int idx = modulo(image_index, image_cache_len);
+    for (int i = total; i < slots_len; i++)
+        _freeSlot(&slots[i]);
 
-    if (image_cache[idx] != NULL) {
-        printf_debug("Removing image %d (%d)\n", image_index, idx);
-        SDL_FreeSurface(image_cache[idx]);
-        image_cache[idx] = NULL;
+    if (total > slots_len) {
+        ImageCacheSlot_s *resized = (ImageCacheSlot_s *)realloc(slots, total * sizeof(ImageCacheSlot_s));
+        if (resized != NULL) {
+            memset(resized + slots_len, 0, (total - slots_len) * sizeof(ImageCacheSlot_s));
+            slots = resized;
+            slots_len = total;
+        }
     }
+    else {
+        slots_len = total;
+    }
+
+    if (cursor >= slots_len)
+        cursor = slots_len - 1;
+    if (pinned >= slots_len)
+        pinned = -1;
+
+    _resumeWorkers();
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void imageCache_setCursor(int index, int radius)
+{
+    pthread_mutex_lock(&cache_mutex);
+
+    cursor = index < slots_len ? index : slots_len - 1;
+    cursor_radius = radius > 0 ? radius : 0;
+
+    // Loads outside the new window are dropped as soon as they finish
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+SDL_Surface *imageCache_getItem(int index)
+{
+    SDL_Surface *surface = NULL;
+
+    pthread_mutex_lock(&cache_mutex);
+
+    if (index < 0 || index >= slots_len) {
+        pthread_mutex_unlock(&cache_mutex);
+        return NULL;
+    }
+
+    pinned = index;
+    bool resident = slots[index].state == SLOT_READY;
 
-    int num_images =
-        (images_total < image_cache_len ? images_total : image_cache_len) - 1;
-    for (int i = 0; i < num_images; i++) {
-        int curr = modulo(image_index + i, image_cache_len);
-        int next = modulo(image_index + i + 1, image_cache_len);
-        image_cache[curr] = image_cache[next];
-        image_cache[next] = NULL;
+    // A worker is already decoding it, wait instead of decoding twice
+    while (slots[index].state == SLOT_LOADING)
+        pthread_cond_wait(&done_cond, &cache_mutex);
+
+    ImageCacheSlot_s *slot = &slots[index];
+
+    if (slot->state == SLOT_READY) {
+        resident ? stats.hits++ : stats.misses++;
+        slot->last_used = ++use_clock;
+        surface = slot->surface;
     }
+    else if (slot->state == SLOT_EMPTY) {
+        stats.misses++;
+        surface = _loadSlot(index, false);
+    }
+
+    pthread_mutex_unlock(&cache_mutex);
 
-    image_cache_offset = image_index + image_cache_len - 2;
+    return surface;
 }
 
-SDL_Surface *imageCache_getItem(int *index)
+SDL_Surface *imageCache_peekItem(int index)
 {
-    imageCache_load(index, load_image, images_total);
-    int idx = modulo(*index, image_cache_len);
-    return image_cache[idx];
+    SDL_Surface *surface = NULL;
+
+    pthread_mutex_lock(&cache_mutex);
+
+    if (index >= 0 && index < slots_len && slots[index].state == SLOT_READY) {
+        slots[index].last_used = ++use_clock;
+        surface = slots[index].surface;
+    }
+
+    pthread_mutex_unlock(&cache_mutex);
+
+    return surface;
 }
 
-bool imageCache_isActive(void) { return thread_active; }
+void imageCache_removeItem(int index)
+{
+    pthread_mutex_lock(&cache_mutex);
+    _pauseWorkers();
+
+    if (index >= 0 && index < slots_len) {
+        printf_debug("Removing image %d\n", index);
+        _freeSlot(&slots[index]);
+        memmove(&slots[index], &slots[index + 1], (slots_len - index - 1) * sizeof(ImageCacheSlot_s));
+        slots_len--;
 
-void imageCache_freeAll(void)
+        if (cursor > index)
+            cursor--;
+        if (cursor >= slots_len)
+            cursor = slots_len - 1;
+        pinned = -1;
+    }
+
+    _resumeWorkers();
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void imageCache_remap(const int *old_index, int total)
 {
-    for (int i = 0; i < image_cache_len; i++) {
-        if (image_cache[i] != NULL)
-            SDL_FreeSurface(image_cache[i]);
+    if (total < 0)
+        total = 0;
+
+    pthread_mutex_lock(&cache_mutex);
+    _pauseWorkers();
+
+    ImageCacheSlot_s *remapped = total > 0 ? (ImageCacheSlot_s *)calloc(total, sizeof(ImageCacheSlot_s)) : NULL;
+
+    if (remapped != NULL) {
+        for (int i = 0; i < total; i++) {
+            int index = old_index[i];
+
+            if (index < 0 || index >= slots_len)
+                continue;
+
+            // Moved, so a second reference to it gets an empty slot
+            remapped[i] = slots[index];
+            memset(&slots[index], 0, sizeof(ImageCacheSlot_s));
+        }
     }
-}
\ No newline at end of file
+
+    for (int i = 0; i < slots_len; i++)
+        _freeSlot(&slots[i]);
+    free(slots);
+
+    slots = remapped;
+    slots_len = remapped != NULL ? total : 0;
+    cursor = -1;
+    pinned = -1;
+
+    _resumeWorkers();
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void imageCache_cancelAll(void)
+{
+    pthread_mutex_lock(&cache_mutex);
+
+    // No cursor means no prefetching until the next setCursor()
+    cursor = -1;
+    while (in_flight > 0)
+        pthread_cond_wait(&done_cond, &cache_mutex);
+
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+bool imageCache_isActive(void)
+{
+    pthread_mutex_lock(&cache_mutex);
+    bool active = in_flight > 0 || (workers_len > 0 && _nextJob() != -1);
+    pthread_mutex_unlock(&cache_mutex);
+    return active;
+}
+
+void imageCache_getStats(ImageCacheStats_s *out)
+{
+    pthread_mutex_lock(&cache_mutex);
+    *out = stats;
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void imageCache_freeAll(void)
+{
+    pthread_mutex_lock(&cache_mutex);
+    workers_running = false;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&cache_mutex);
+
+    for (int i = 0; i < workers_len; i++)
+        pthread_join(workers[i], NULL);
+
+    pthread_mutex_lock(&cache_mutex);
+
+    for (int i = 0; i < slots_len; i++)
+        _freeSlot(&slots[i]);
+    free(slots);
+
+    slots = NULL;
+    slots_len = 0;
+    workers_len = 0;
+    workers_paused = 0;
+    load_image = NULL;
+    load_userdata = NULL;
+    cursor = -1;
+    pinned = -1;
+    typical_bytes = 0;
+    memset(&stats, 0, sizeof(stats));
+
+    pthread_mutex_unlock(&cache_mutex);
+}
@@ -1,12 +1,104 @@
 #ifndef UTILS_IMAGE_CACHE_H__
 #define UTILS_IMAGE_CACHE_H__
 
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct SDL_Surface SDL_Surface;
 
-void imageCache_load(int *offset, SDL_Surface *(*_load_image)(int), int total);
-void imageCache_removeItem(int image_index);
-SDL_Surface *imageCache_getItem(int *index);
+#define IMAGECACHE_MAX_WORKERS 4
+#define IMAGECACHE_DEFAULT_WORKERS 2
+#define IMAGECACHE_DEFAULT_BUDGET (16 * 1024 * 1024)
+
+/**
+ * @brief Decodes (and scales) the image at `index`. Called from a worker
+ * thread, or from the UI thread on a cold miss. Returns a new surface which
+ * is then owned by the cache, or NULL if there is no image.
+ */
+typedef SDL_Surface *(*ImageCacheLoader_t)(int index, void *userdata);
+
+typedef struct {
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int loads;
+    unsigned int failed;
+    unsigned int cancelled;
+    unsigned int evictions;
+    size_t used_bytes;
+    int resident;
+} ImageCacheStats_s;
+
+/**
+ * @brief Starts the worker pool. Safe to call more than once, later calls
+ * only update the byte budget.
+ *
+ * @param num_workers Worker threads (0 = everything is loaded on demand)
+ * @param byte_budget LRU limit for decoded pixel data
+ */
+bool imageCache_init(int num_workers, size_t byte_budget);
+
+/**
+ * @brief Replaces the image source. Drops all cached images and waits for
+ * in-flight loads to finish before returning.
+ */
+void imageCache_setSource(ImageCacheLoader_t loader, void *userdata, int total);
+
+/**
+ * @brief Changes the number of images, keeping the cached ones in range.
+ */
+void imageCache_setTotal(int total);
+
+/**
+ * @brief Moves the cursor. Workers prefetch the images within `radius`,
+ * closest first. Pending loads outside the new window are cancelled.
+ */
+void imageCache_setCursor(int index, int radius);
+
+/**
+ * @brief Returns the image at `index`, waiting for (or doing) the load if
+ * it isn't resident yet. The surface is owned by the cache and is never
+ * evicted while `index` is the cursor.
+ */
+SDL_Surface *imageCache_getItem(int index);
+
+/**
+ * @brief Returns the image at `index` if it is resident, without blocking.
+ */
+SDL_Surface *imageCache_peekItem(int index);
+
+/**
+ * @brief Frees the image at `index` and shifts all following images down
+ * by one, mirroring the removal of an item from the source list.
+ */
+void imageCache_removeItem(int index);
+
+/**
+ * @brief Reorders the cached images after the source list changed: image
+ * `i` becomes the one that was at `old_index[i]` (-1 for a new item).
+ * Images that aren't carried over are freed and the cursor is reset.
+ */
+void imageCache_remap(const int *old_index, int total);
+
+/**
+ * @brief Cancels all queued loads and waits for in-flight ones. Call this
+ * before mutating the data the loader reads from.
+ */
+void imageCache_cancelAll(void);
+
 bool imageCache_isActive(void);
+void imageCache_getStats(ImageCacheStats_s *stats);
+
+/**
+ * @brief Stops the workers and frees every cached image.
+ */
 void imageCache_freeAll(void);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // UTILS_IMAGE_CACHE_H__
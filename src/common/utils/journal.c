@@ -0,0 +1,258 @@
+#include "journal.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file.h"
+#include "log.h"
+#include "str.h"
+
+typedef struct {
+    char **lines;
+    int count;
+    int capacity;
+} JournalList_s;
+
+static void _journal_path(char *out, const char *list_path, const char *suffix)
+{
+    snprintf(out, PATH_MAX, "%s%s", list_path, suffix);
+}
+
+static void _journal_trimNewline(char *line)
+{
+    line[strcspn(line, "\r\n")] = '\0';
+}
+
+static void _journal_insert(JournalList_s *list, int index, char *line)
+{
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->lines = realloc(list->lines, list->capacity * sizeof(char *));
+    }
+    memmove(&list->lines[index + 1], &list->lines[index], (list->count - index) * sizeof(char *));
+    list->lines[index] = line;
+    list->count++;
+}
+
+static char *_journal_take(JournalList_s *list, int index)
+{
+    char *line = list->lines[index];
+    memmove(&list->lines[index], &list->lines[index + 1], (list->count - index - 1) * sizeof(char *));
+    list->count--;
+    return line;
+}
+
+static void _journal_free(JournalList_s *list)
+{
+    for (int i = 0; i < list->count; i++)
+        free(list->lines[i]);
+    free(list->lines);
+}
+
+// Index of line `line_no` if it still holds `line`, else of the first copy
+static int _journal_find(JournalList_s *list, int line_no, const char *line)
+{
+    if (line_no >= 1 && line_no <= list->count && strcmp(list->lines[line_no - 1], line) == 0)
+        return line_no - 1;
+    for (int i = 0; i < list->count; i++)
+        if (strcmp(list->lines[i], line) == 0)
+            return i;
+    return -1;
+}
+
+static void _journal_apply(JournalList_s *list, const char *record)
+{
+    char op = record[0];
+    char *line;
+    int line_no = (int)strtol(record + 1, &line, 10);
+    int index;
+
+    if (*line != ' ')
+        return;
+    line++;
+
+    switch (op) {
+    case JOURNAL_ADD:
+        _journal_insert(list, 0, strdup(line));
+        break;
+    case JOURNAL_REMOVE:
+        if ((index = _journal_find(list, line_no, line)) != -1)
+            free(_journal_take(list, index));
+        break;
+    case JOURNAL_MOVE:
+        if ((index = _journal_find(list, line_no, line)) != -1)
+            _journal_insert(list, 0, _journal_take(list, index));
+        else
+            _journal_insert(list, 0, strdup(line));
+        break;
+    default:
+        break;
+    }
+}
+
+// A compaction interrupted after the journal was dropped left the new list
+// in the temp file, one interrupted before that left an incomplete one
+static void _journal_recover(const char *list_path)
+{
+    char journal_path[PATH_MAX];
+    char temp_path[PATH_MAX];
+
+    _journal_path(temp_path, list_path, JOURNAL_TEMP_SUFFIX);
+    if (!exists(temp_path))
+        return;
+
+    _journal_path(journal_path, list_path, JOURNAL_SUFFIX);
+    if (exists(journal_path))
+        remove(temp_path);
+    else
+        rename(temp_path, list_path);
+}
+
+static bool _journal_load(const char *list_path, JournalList_s *list)
+{
+    char journal_path[PATH_MAX];
+    char *line = NULL;
+    size_t len = 0;
+    FILE *fp;
+
+    memset(list, 0, sizeof(JournalList_s));
+    _journal_path(journal_path, list_path, JOURNAL_SUFFIX);
+
+    if ((fp = fopen(list_path, "r")) != NULL) {
+        while (getline(&line, &len, fp) != -1) {
+            _journal_trimNewline(line);
+            if (line[0] != '\0')
+                _journal_insert(list, list->count, strdup(line));
+        }
+        fclose(fp);
+    }
+
+    if ((fp = fopen(journal_path, "r")) != NULL) {
+        while (getline(&line, &len, fp) != -1) {
+            _journal_trimNewline(line);
+            _journal_apply(list, line);
+        }
+        fclose(fp);
+    }
+
+    free(line);
+    return true;
+}
+
+static void _journal_write(FILE *fp, JournalList_s *list)
+{
+    for (int i = 0; i < list->count; i++) {
+        fputs(list->lines[i], fp);
+        fputc('\n', fp);
+    }
+}
+
+bool journal_isEmpty(const char *list_path)
+{
+    char journal_path[PATH_MAX];
+    _journal_path(journal_path, list_path, JOURNAL_SUFFIX);
+    return !exists(journal_path);
+}
+
+FILE *journal_open(const char *list_path)
+{
+    JournalList_s list;
+    FILE *fp;
+
+    _journal_recover(list_path);
+
+    if (journal_isEmpty(list_path))
+        return fopen(list_path, "r");
+
+    if ((fp = tmpfile()) == NULL)
+        return NULL;
+
+    _journal_load(list_path, &list);
+    _journal_write(fp, &list);
+    _journal_free(&list);
+
+    rewind(fp);
+    return fp;
+}
+
+bool journal_compact(const char *list_path)
+{
+    char journal_path[PATH_MAX];
+    char temp_path[PATH_MAX];
+    JournalList_s list;
+    FILE *fp;
+
+    _journal_recover(list_path);
+
+    if (journal_isEmpty(list_path))
+        return true;
+
+    _journal_path(journal_path, list_path, JOURNAL_SUFFIX);
+    _journal_path(temp_path, list_path, JOURNAL_TEMP_SUFFIX);
+
+    if ((fp = fopen(temp_path, "w")) == NULL) {
+        print_debug("Error creating the temporary file");
+        return false;
+    }
+
+    _journal_load(list_path, &list);
+    _journal_write(fp, &list);
+    _journal_free(&list);
+
+    fflush(fp);
+    fsync(fileno(fp));
+    fclose(fp);
+
+    remove(journal_path);
+    if (rename(temp_path, list_path) != 0) {
+        print_debug("Error renaming the temporary file");
+        return false;
+    }
+    sync();
+
+    printf_debug("Compacted journal of %s\n", list_path);
+    return true;
+}
+
+bool journal_append(const char *list_path, JournalOp_e op, int line_no, const char *line)
+{
+    char journal_path[PATH_MAX];
+    struct stat st;
+    FILE *fp;
+
+    _journal_recover(list_path);
+    _journal_path(journal_path, list_path, JOURNAL_SUFFIX);
+
+    if ((fp = fopen(journal_path, "a")) == NULL) {
+        print_debug("Error opening the journal");
+        return false;
+    }
+
+    fprintf(fp, "%c%d %.*s\n", op, line_no, (int)strcspn(line, "\r\n"), line);
+    fflush(fp);
+    fsync(fileno(fp));
+    fclose(fp);
+
+    if (stat(journal_path, &st) == 0 && st.st_size > JOURNAL_COMPACT_SIZE)
+        return journal_compact(list_path);
+
+    return true;
+}
+
+bool journal_addLine(const char *list_path, const char *line)
+{
+    return journal_append(list_path, JOURNAL_ADD, 0, line);
+}
+
+bool journal_deleteLine(const char *list_path, int n, const char *line)
+{
+    return journal_append(list_path, JOURNAL_REMOVE, n, line);
+}
+
+bool journal_moveLine(const char *list_path, int n, const char *line)
+{
+    return journal_append(list_path, JOURNAL_MOVE, n, line);
+}
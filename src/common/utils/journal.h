@@ -0,0 +1,74 @@
+#ifndef UTILS_JOURNAL_H__
+#define UTILS_JOURNAL_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+//    Append-only journal for JSON-lines lists (recents, favourites)
+//
+//    Edits are appended to `<list>.journal` instead of rewriting the list.
+//    Each record is `<op><line_no> <line>`:
+//      +0 <line>  add to the top
+//      -N <line>  remove line N (or the first copy of <line> if N moved)
+//      ^N <line>  move line N to the top
+//    Line numbers are 1-based and refer to the merged view at the time the
+//    record was written. The journal is compacted back into the MainUI
+//    compatible list once it grows past JOURNAL_COMPACT_SIZE, and whenever
+//    journal_compact() is called (before MainUI gets to read the list).
+//
+
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_TEMP_SUFFIX ".tmp"
+#define JOURNAL_COMPACT_SIZE 8192
+
+typedef enum {
+    JOURNAL_ADD = '+',
+    JOURNAL_REMOVE = '-',
+    JOURNAL_MOVE = '^'
+} JournalOp_e;
+
+/**
+ * @brief Opens the merged view of the list for reading. Returns the list
+ * itself when there is no journal. Close with fclose().
+ */
+FILE *journal_open(const char *list_path);
+
+/**
+ * @brief Appends a record. `line` may include its trailing newline.
+ */
+bool journal_append(const char *list_path, JournalOp_e op, int line_no, const char *line);
+
+/**
+ * @brief Adds `line` to the top of the list
+ */
+bool journal_addLine(const char *list_path, const char *line);
+
+/**
+ * @brief Removes line `n` (1-based) of the merged view. `line` is its
+ * content, as read by the caller.
+ */
+bool journal_deleteLine(const char *list_path, int n, const char *line);
+
+/**
+ * @brief Moves line `n` (1-based) of the merged view, holding `line`, to
+ * the top
+ */
+bool journal_moveLine(const char *list_path, int n, const char *line);
+
+/**
+ * @brief Writes the merged view back to the list and drops the journal
+ */
+bool journal_compact(const char *list_path);
+
+bool journal_isEmpty(const char *list_path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_JOURNAL_H__
@@ -0,0 +1,480 @@
+#ifndef UTILS_JSON_LINE_H__
+#define UTILS_JSON_LINE_H__
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cjson/cJSON.h"
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+//
+//    JSON-lines reader for MainUI's list files (recentlist.json,
+//    favourite.json): one flat object per line, of which only a few
+//    fields are needed.
+//
+//    The scanner walks the line once and copies the requested fields
+//    straight into the caller's buffers: no DOM, no allocation. Strings
+//    are scanned 16 bytes at a time with NEON (memchr() elsewhere),
+//    looking for the closing quote or an escape. Keys are matched
+//    case-sensitively, the first occurrence wins (same as
+//    cJSON_GetObjectItemCaseSensitive).
+//
+//    Lines the scanner rejects (malformed, nested too deep, escaped
+//    keys) are handed to cJSON, so the result never depends on which
+//    path read the line.
+//
+//    Functions are `static inline` so the header can be pulled in by
+//    several translation units of the same binary.
+//
+
+#define JSON_LINE_MAX_DEPTH 16
+#define JSON_LINE_MAX_FIELDS 32
+
+typedef enum {
+    JSON_LINE_TYPE_STRING,
+    JSON_LINE_TYPE_INT
+} JsonLineType_e;
+
+typedef struct {
+    const char *key;
+    JsonLineType_e type;
+    void *dest; // char[size] or int, left untouched if the key is missing
+    size_t size;
+    bool found;
+} JsonLineField_s;
+
+// `buffer` must be an array, its size is taken with sizeof
+#define JSON_LINE_STRING(key, buffer) {(key), JSON_LINE_TYPE_STRING, (buffer), sizeof(buffer), false}
+#define JSON_LINE_INT(key, value_ptr) {(key), JSON_LINE_TYPE_INT, (value_ptr), sizeof(int), false}
+
+typedef struct {
+    const char *p;
+    const char *end;
+    JsonLineField_s *fields;
+    int count;
+    int found;
+    uint32_t seen; // fields whose key was met, found or not
+} _JsonLineScanner_s;
+
+// First `"` or `\` in [p, end), or `end`
+static inline const char *_jsonLine_findSpecial(const char *p, const char *end)
+{
+#ifdef __ARM_NEON
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+
+    while (end - p >= 16) {
+        uint8x16_t chars = vld1q_u8((const uint8_t *)p);
+        uint64x2_t hits = vreinterpretq_u64_u8(
+            vorrq_u8(vceqq_u8(chars, quote), vceqq_u8(chars, backslash)));
+        if ((vgetq_lane_u64(hits, 0) | vgetq_lane_u64(hits, 1)) != 0)
+            break;
+        p += 16;
+    }
+
+    while (p < end && *p != '"' && *p != '\\')
+        p++;
+    return p;
+#else
+    // libc's memchr() is vectorized: two passes beat a byte loop
+    const char *quote = (const char *)memchr(p, '"', end - p);
+    if (quote == NULL)
+        quote = end;
+    const char *escape = (const char *)memchr(p, '\\', quote - p);
+    return escape != NULL ? escape : quote;
+#endif
+}
+
+static inline void _jsonLine_skipSpace(_JsonLineScanner_s *s)
+{
+    while (s->p < s->end && (*s->p == ' ' || *s->p == '\t' || *s->p == '\n' || *s->p == '\r'))
+        s->p++;
+}
+
+static inline int _jsonLine_hex(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static inline bool _jsonLine_readHex4(_JsonLineScanner_s *s, uint32_t *out)
+{
+    if (s->end - s->p < 4)
+        return false;
+
+    *out = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = _jsonLine_hex(s->p[i]);
+        if (digit < 0)
+            return false;
+        *out = (*out << 4) | digit;
+    }
+
+    s->p += 4;
+    return true;
+}
+
+// Appends to `dest` while it has room, the terminator is written by the caller
+static inline void _jsonLine_put(char *dest, size_t size, size_t *len, const char *src, size_t n)
+{
+    if (dest == NULL || *len + 1 >= size)
+        return;
+    if (n > size - 1 - *len)
+        n = size - 1 - *len;
+    memcpy(dest + *len, src, n);
+    *len += n;
+}
+
+static inline bool _jsonLine_escape(_JsonLineScanner_s *s, char *dest, size_t size, size_t *len)
+{
+    char utf8[4];
+    uint32_t code;
+
+    if (s->p >= s->end)
+        return false;
+
+    char c = *s->p++;
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+        _jsonLine_put(dest, size, len, &c, 1);
+        return true;
+    case 'b':
+        _jsonLine_put(dest, size, len, "\b", 1);
+        return true;
+    case 'f':
+        _jsonLine_put(dest, size, len, "\f", 1);
+        return true;
+    case 'n':
+        _jsonLine_put(dest, size, len, "\n", 1);
+        return true;
+    case 'r':
+        _jsonLine_put(dest, size, len, "\r", 1);
+        return true;
+    case 't':
+        _jsonLine_put(dest, size, len, "\t", 1);
+        return true;
+    case 'u':
+        break;
+    default:
+        return false;
+    }
+
+    if (!_jsonLine_readHex4(s, &code) || (code >= 0xDC00 && code <= 0xDFFF))
+        return false;
+
+    if (code >= 0xD800 && code <= 0xDBFF) {
+        uint32_t low;
+        if (s->end - s->p < 2 || s->p[0] != '\\' || s->p[1] != 'u')
+            return false;
+        s->p += 2;
+        if (!_jsonLine_readHex4(s, &low) || low < 0xDC00 || low > 0xDFFF)
+            return false;
+        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+    }
+
+    if (code == 0)
+        return false; // cJSON stops the string there, let it decide
+
+    size_t n;
+    if (code < 0x80) {
+        utf8[0] = code;
+        n = 1;
+    }
+    else if (code < 0x800) {
+        utf8[0] = 0xC0 | (code >> 6);
+        utf8[1] = 0x80 | (code & 0x3F);
+        n = 2;
+    }
+    else if (code < 0x10000) {
+        utf8[0] = 0xE0 | (code >> 12);
+        utf8[1] = 0x80 | ((code >> 6) & 0x3F);
+        utf8[2] = 0x80 | (code & 0x3F);
+        n = 3;
+    }
+    else {
+        utf8[0] = 0xF0 | (code >> 18);
+        utf8[1] = 0x80 | ((code >> 12) & 0x3F);
+        utf8[2] = 0x80 | ((code >> 6) & 0x3F);
+        utf8[3] = 0x80 | (code & 0x3F);
+        n = 4;
+    }
+
+    _jsonLine_put(dest, size, len, utf8, n);
+    return true;
+}
+
+// Reads the string starting after its opening quote, into `dest` if not NULL
+static inline bool _jsonLine_string(_JsonLineScanner_s *s, char *dest, size_t size)
+{
+    size_t len = 0;
+
+    for (;;) {
+        const char *special = _jsonLine_findSpecial(s->p, s->end);
+        _jsonLine_put(dest, size, &len, s->p, special - s->p);
+        s->p = special;
+
+        if (s->p >= s->end)
+            return false;
+
+        if (*s->p++ == '"')
+            break;
+
+        if (!_jsonLine_escape(s, dest, size, &len))
+            return false;
+    }
+
+    if (dest != NULL && size > 0)
+        dest[len] = '\0';
+    return true;
+}
+
+static inline bool _jsonLine_number(_JsonLineScanner_s *s, int *dest)
+{
+    const char *start = s->p;
+    const char *p = s->p;
+    bool is_integer = true;
+    int digits = 0;
+    int value = 0;
+
+    if (p < s->end && *p == '-')
+        p++;
+    if (p >= s->end || *p < '0' || *p > '9')
+        return false;
+    while (p < s->end && *p >= '0' && *p <= '9') {
+        if (digits++ < 9)
+            value = value * 10 + (*p - '0');
+        p++;
+    }
+    if (p < s->end && (*p == '.' || *p == 'e' || *p == 'E'))
+        is_integer = false;
+    if (p < s->end && *p == '.') {
+        if (++p >= s->end || *p < '0' || *p > '9')
+            return false;
+        while (p < s->end && *p >= '0' && *p <= '9')
+            p++;
+    }
+    if (p < s->end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < s->end && (*p == '+' || *p == '-'))
+            p++;
+        if (p >= s->end || *p < '0' || *p > '9')
+            return false;
+        while (p < s->end && *p >= '0' && *p <= '9')
+            p++;
+    }
+
+    s->p = p;
+
+    if (dest == NULL)
+        return true;
+
+    // Entry types are small integers, strtod() is only needed for the rest
+    if (is_integer && digits <= 9) {
+        *dest = *start == '-' ? -value : value;
+    }
+    else {
+        // Same rounding and clamping as cJSON's valueint
+        double number = strtod(start, NULL);
+        *dest = number >= INT_MAX ? INT_MAX : number <= (double)INT_MIN ? INT_MIN : (int)number;
+    }
+
+    return true;
+}
+
+static inline bool _jsonLine_literal(_JsonLineScanner_s *s, const char *literal, size_t len)
+{
+    if ((size_t)(s->end - s->p) < len || memcmp(s->p, literal, len) != 0)
+        return false;
+    s->p += len;
+    return true;
+}
+
+static inline bool _jsonLine_value(_JsonLineScanner_s *s, JsonLineField_s *field, int depth);
+
+static inline bool _jsonLine_container(_JsonLineScanner_s *s, bool is_object, int depth)
+{
+    char close = is_object ? '}' : ']';
+
+    if (depth >= JSON_LINE_MAX_DEPTH)
+        return false;
+
+    _jsonLine_skipSpace(s);
+    if (s->p < s->end && *s->p == close) {
+        s->p++;
+        return true;
+    }
+
+    for (;;) {
+        JsonLineField_s *field = NULL;
+
+        _jsonLine_skipSpace(s);
+
+        if (is_object) {
+            if (s->p >= s->end || *s->p != '"')
+                return false;
+
+            const char *key = ++s->p;
+            const char *key_end = _jsonLine_findSpecial(key, s->end);
+            if (key_end >= s->end || *key_end != '"')
+                return false; // escaped keys go to cJSON
+            s->p = key_end + 1;
+
+            // Only the top level object holds the wanted fields
+            for (int i = 0; depth == 0 && i < s->count; i++) {
+                const char *wanted = s->fields[i].key;
+                if (!(s->seen & (1u << i)) && strlen(wanted) == (size_t)(key_end - key) &&
+                    memcmp(wanted, key, key_end - key) == 0) {
+                    s->seen |= 1u << i;
+                    field = &s->fields[i];
+                    break;
+                }
+            }
+
+            _jsonLine_skipSpace(s);
+            if (s->p >= s->end || *s->p++ != ':')
+                return false;
+            _jsonLine_skipSpace(s);
+        }
+
+        if (!_jsonLine_value(s, field, depth + 1))
+            return false;
+
+        _jsonLine_skipSpace(s);
+        if (s->p >= s->end)
+            return false;
+        if (*s->p == close) {
+            s->p++;
+            return true;
+        }
+        if (*s->p++ != ',')
+            return false;
+    }
+}
+
+static inline bool _jsonLine_value(_JsonLineScanner_s *s, JsonLineField_s *field, int depth)
+{
+    JsonLineType_e type;
+    bool wanted;
+
+    if (s->p >= s->end)
+        return false;
+
+    switch (*s->p) {
+    case '"':
+        wanted = field != NULL && field->type == JSON_LINE_TYPE_STRING;
+        s->p++;
+        if (!_jsonLine_string(s, wanted ? (char *)field->dest : NULL, wanted ? field->size : 0))
+            return false;
+        type = JSON_LINE_TYPE_STRING;
+        break;
+    case '{':
+    case '[':
+        return _jsonLine_container(s, *s->p++ == '{', depth);
+    case 't':
+        return _jsonLine_literal(s, "true", 4);
+    case 'f':
+        return _jsonLine_literal(s, "false", 5);
+    case 'n':
+        return _jsonLine_literal(s, "null", 4);
+    default:
+        wanted = field != NULL && field->type == JSON_LINE_TYPE_INT;
+        if (!_jsonLine_number(s, wanted ? (int *)field->dest : NULL))
+            return false;
+        type = JSON_LINE_TYPE_INT;
+        break;
+    }
+
+    // A value of another type doesn't count, like cJSON_IsString()/IsNumber()
+    if (field != NULL && field->type == type) {
+        field->found = true;
+        s->found++;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Extracts `fields` from a one-line JSON object, without cJSON.
+ *
+ * @return Number of fields found, -1 if the scanner can't read the line
+ * (it may have filled some fields already)
+ */
+static inline int jsonLine_scan(const char *line, JsonLineField_s *fields, int count)
+{
+    if (line == NULL || count > JSON_LINE_MAX_FIELDS)
+        return -1;
+
+    _JsonLineScanner_s s = {line, line + strlen(line), fields, count, 0, 0};
+
+    for (int i = 0; i < count; i++)
+        fields[i].found = false;
+
+    _jsonLine_skipSpace(&s);
+    if (s.p >= s.end || *s.p++ != '{')
+        return -1;
+
+    if (!_jsonLine_container(&s, true, 0))
+        return -1;
+
+    return s.found;
+}
+
+static inline bool _jsonLine_readCJSON(const char *line, JsonLineField_s *fields, int count)
+{
+    cJSON *root = cJSON_Parse(line);
+
+    if (!cJSON_IsObject(root)) {
+        cJSON_Delete(root);
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        JsonLineField_s *field = &fields[i];
+        cJSON *item = cJSON_GetObjectItemCaseSensitive(root, field->key);
+
+        field->found = false;
+
+        if (field->type == JSON_LINE_TYPE_STRING && cJSON_IsString(item) && field->size > 0) {
+            strncpy((char *)field->dest, item->valuestring, field->size - 1);
+            ((char *)field->dest)[field->size - 1] = '\0';
+            field->found = true;
+        }
+        else if (field->type == JSON_LINE_TYPE_INT && cJSON_IsNumber(item)) {
+            *(int *)field->dest = item->valueint;
+            field->found = true;
+        }
+    }
+
+    cJSON_Delete(root);
+    return true;
+}
+
+/**
+ * @brief Reads `fields` from a JSON-lines entry, falling back to cJSON
+ * for lines the scanner rejects. `found` tells which fields were set.
+ *
+ * @return false if the line isn't a JSON object
+ */
+static inline bool jsonLine_read(const char *line, JsonLineField_s *fields, int count)
+{
+    if (jsonLine_scan(line, fields, count) >= 0)
+        return true;
+
+    return _jsonLine_readCJSON(line, fields, count);
+}
+
+#endif // UTILS_JSON_LINE_H__
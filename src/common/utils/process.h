@@ -3,11 +3,18 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "utils/log.h"
 
 #ifndef DT_DIR
 #define DT_DIR 4
@@ -119,4 +126,268 @@ bool process_start_read_return(const char *cmdline, char *out_str)
     return 0;
 }
 
+//
+//    Async spawner
+//
+//    Starts programs with posix_spawnp() and an argument vector (no shell)
+//    and reports their exit through a callback. SIGCHLD is blocked and read
+//    from a signalfd: poll process_spawnFd() next to the other fds and call
+//    process_spawnReap() when it's readable.
+//
+//    Jobs wait in a bounded queue: at most PROCESS_SPAWN_RUNNING run at a
+//    time, and jobs for the same program run one after the other in the
+//    order they were submitted (e.g. `playActivity stop_all` then
+//    `playActivity resume`).
+//
+
+#define PROCESS_SPAWN_QUEUE 16
+#define PROCESS_SPAWN_RUNNING 4
+#define PROCESS_SPAWN_ARGS 8
+#define PROCESS_SPAWN_ARGS_LEN 512
+
+typedef enum {
+    PROCESS_SPAWN_NO_SUSPEND = 1 << 0 // keymon doesn't SIGSTOP it while suspending
+} ProcessSpawnFlags_e;
+
+extern char **environ;
+
+/**
+ * @brief Called once a spawned program exited, with its waitpid() status,
+ * or -1 if it couldn't be started.
+ */
+typedef void (*ProcessDoneCallback_t)(int status, void *userdata);
+
+typedef struct {
+    pid_t pid; // 0 while queued
+    int flags;
+    int argc;
+    int arg_offsets[PROCESS_SPAWN_ARGS];
+    char args[PROCESS_SPAWN_ARGS_LEN];
+    ProcessDoneCallback_t on_done;
+    void *userdata;
+} ProcessJob_s;
+
+static struct {
+    int fd;
+    int count;
+    ProcessJob_s jobs[PROCESS_SPAWN_QUEUE]; // in submit order
+} _process_spawner = {.fd = -1};
+
+#define process_spawnArgs(on_done, userdata, ...) \
+    process_spawnFlags((const char *const[]){__VA_ARGS__, NULL}, 0, on_done, userdata)
+#define process_spawnArgsFlags(flags, on_done, userdata, ...) \
+    process_spawnFlags((const char *const[]){__VA_ARGS__, NULL}, flags, on_done, userdata)
+#define process_spawnArgsNow(...) \
+    process_spawnNow((char *const[]){__VA_ARGS__, NULL})
+
+/**
+ * @brief Block SIGCHLD and open the signalfd. Called by process_spawn()
+ * if needed, call it first to poll the fd from the start.
+ *
+ * Children started with system() or popen() inherit the blocked SIGCHLD,
+ * which is harmless for programs that wait with waitpid().
+ */
+bool process_spawnInit(void)
+{
+    sigset_t mask;
+
+    if (_process_spawner.fd != -1)
+        return true;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    _process_spawner.fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    return _process_spawner.fd != -1;
+}
+
+int process_spawnFd(void)
+{
+    return _process_spawner.fd;
+}
+
+/**
+ * @brief Whether `pid` is a running job spawned with all of `flags`
+ */
+bool process_spawnHasFlags(pid_t pid, int flags)
+{
+    for (int i = 0; i < _process_spawner.count; i++)
+        if (_process_spawner.jobs[i].pid == pid)
+            return (_process_spawner.jobs[i].flags & flags) == flags;
+    return false;
+}
+
+static void _process_spawnRemove(int index)
+{
+    _process_spawner.count--;
+    memmove(&_process_spawner.jobs[index], &_process_spawner.jobs[index + 1],
+            (_process_spawner.count - index) * sizeof(ProcessJob_s));
+}
+
+static bool _process_spawnArgv(pid_t *pid, char *const argv[])
+{
+    posix_spawnattr_t attr;
+    sigset_t mask;
+    int ret;
+
+    // Children get the default signal mask back
+    sigemptyset(&mask);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    ret = posix_spawnp(pid, argv[0], NULL, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+
+    if (ret != 0) {
+        printf_debug("process_spawn: can't start %s (%s)\n", argv[0], strerror(ret));
+        *pid = 0;
+        return false;
+    }
+
+    printf_debug("process_spawn: started %s (%d)\n", argv[0], *pid);
+    return true;
+}
+
+static bool _process_spawnStart(ProcessJob_s *job)
+{
+    char *argv[PROCESS_SPAWN_ARGS + 1];
+
+    for (int i = 0; i < job->argc; i++)
+        argv[i] = job->args + job->arg_offsets[i];
+    argv[job->argc] = NULL;
+
+    return _process_spawnArgv(&job->pid, argv);
+}
+
+// Starts queued jobs while there's room, in order per program
+static void _process_spawnNext(void)
+{
+    int running = 0;
+
+    for (int i = 0; i < _process_spawner.count; i++)
+        running += _process_spawner.jobs[i].pid != 0;
+
+    for (int i = 0; i < _process_spawner.count && running < PROCESS_SPAWN_RUNNING; i++) {
+        ProcessJob_s *job = &_process_spawner.jobs[i];
+        bool blocked = false;
+
+        if (job->pid != 0)
+            continue;
+
+        for (int j = 0; j < i && !blocked; j++)
+            blocked = strcmp(_process_spawner.jobs[j].args, job->args) == 0;
+        if (blocked)
+            continue;
+
+        if (_process_spawnStart(job)) {
+            running++;
+            continue;
+        }
+
+        ProcessDoneCallback_t on_done = job->on_done;
+        void *userdata = job->userdata;
+        _process_spawnRemove(i--);
+        if (on_done != NULL)
+            on_done(-1, userdata);
+    }
+}
+
+/**
+ * @brief Queue `argv` (NULL terminated, argv[0] is looked up in PATH) and
+ * start it as soon as possible. Never waits for the program.
+ *
+ * @param flags ProcessSpawnFlags_e
+ * @param on_done Optional, called from process_spawnReap()
+ * @return false if the queue is full or the arguments don't fit
+ */
+bool process_spawnFlags(const char *const argv[], int flags, ProcessDoneCallback_t on_done, void *userdata)
+{
+    ProcessJob_s *job;
+    int offset = 0;
+
+    process_spawnInit();
+
+    if (_process_spawner.count >= PROCESS_SPAWN_QUEUE) {
+        printf_debug("process_spawn: queue full, dropping %s\n", argv[0]);
+        return false;
+    }
+
+    job = &_process_spawner.jobs[_process_spawner.count];
+    memset(job, 0, sizeof(ProcessJob_s));
+
+    for (; argv[job->argc] != NULL; job->argc++) {
+        size_t len = strlen(argv[job->argc]) + 1;
+        if (job->argc == PROCESS_SPAWN_ARGS || offset + len > PROCESS_SPAWN_ARGS_LEN) {
+            printf_debug("process_spawn: too many arguments for %s\n", argv[0]);
+            return false;
+        }
+        job->arg_offsets[job->argc] = offset;
+        memcpy(job->args + offset, argv[job->argc], len);
+        offset += len;
+    }
+
+    if (job->argc == 0)
+        return false;
+
+    job->flags = flags;
+    job->on_done = on_done;
+    job->userdata = userdata;
+    _process_spawner.count++;
+
+    _process_spawnNext();
+    return true;
+}
+
+/**
+ * @brief Start `argv` right away, bypassing the queue and the running
+ * limit. For programs that must run even when the queue is stuck, e.g.
+ * `shutdown`. The child isn't tracked, nothing reaps it.
+ *
+ * @return false if it couldn't be started
+ */
+bool process_spawnNow(char *const argv[])
+{
+    pid_t pid;
+    return _process_spawnArgv(&pid, argv);
+}
+
+/**
+ * @brief Collect exited jobs, run their callbacks and start queued ones.
+ * Call when process_spawnFd() is readable.
+ */
+void process_spawnReap(void)
+{
+    struct signalfd_siginfo info;
+    bool done;
+
+    while (read(_process_spawner.fd, &info, sizeof(info)) == sizeof(info))
+        ; // signals coalesce, every job is checked below
+
+    do {
+        done = true;
+
+        for (int i = 0; i < _process_spawner.count; i++) {
+            ProcessJob_s *job = &_process_spawner.jobs[i];
+            int status;
+
+            if (job->pid == 0 || waitpid(job->pid, &status, WNOHANG) != job->pid)
+                continue;
+
+            ProcessDoneCallback_t on_done = job->on_done;
+            void *userdata = job->userdata;
+            _process_spawnRemove(i);
+
+            // The callback may spawn, so start over afterwards
+            if (on_done != NULL)
+                on_done(status, userdata);
+            done = false;
+            break;
+        }
+    } while (!done);
+
+    _process_spawnNext();
+}
+
 #endif // PROCESS_H__
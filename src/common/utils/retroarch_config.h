@@ -0,0 +1,265 @@
+#ifndef UTILS_RETROARCH_CONFIG_H__
+#define UTILS_RETROARCH_CONFIG_H__
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/hash.h"
+#include "utils/log.h"
+
+//
+//    Parsed RetroArch config files (retroarch.cfg, overrides, core .info)
+//
+//    A file is read once into a hashed key -> value table and kept until
+//    its mtime or size changes, so any number of lookups only cost a
+//    stat(). Missing files are cached too, most override files don't
+//    exist. Thread-safe, gameSwitcher looks up overrides from its image
+//    loader threads.
+//
+
+#define RA_CONFIG_CACHE_FILES 16
+
+typedef struct {
+    uint32_t hash;
+    const char *key; // NULL: empty slot
+    const char *value;
+} RaConfigEntry_s;
+
+typedef struct {
+    char path[PATH_MAX];
+    bool exists;
+    time_t mtime;
+    off_t size;
+    uint32_t last_used;
+    char *data; // keys and values point into this
+    RaConfigEntry_s *entries;
+    uint32_t capacity; // power of 2
+} RaConfigFile_s;
+
+static RaConfigFile_s _ra_config_files[RA_CONFIG_CACHE_FILES];
+static uint32_t _ra_config_clock = 0;
+static pthread_mutex_t _ra_config_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void _ra_config_clear(RaConfigFile_s *file)
+{
+    free(file->data);
+    free(file->entries);
+    memset(file, 0, sizeof(RaConfigFile_s));
+}
+
+static char *_ra_config_trim(char *start, char *end)
+{
+    while (start < end && strchr(" \t\r", *start))
+        start++;
+    while (end > start && strchr(" \t\r", end[-1]))
+        end--;
+    if (end - start >= 2 && *start == '"' && end[-1] == '"') {
+        start++;
+        end--;
+    }
+    *end = '\0';
+    return start;
+}
+
+static void _ra_config_insert(RaConfigFile_s *file, const char *key, const char *value)
+{
+    uint32_t hash = hash_str(key);
+    uint32_t mask = file->capacity - 1;
+
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        RaConfigEntry_s *entry = &file->entries[i];
+        if (entry->key == NULL) {
+            *entry = (RaConfigEntry_s){hash, key, value};
+            return;
+        }
+        // First occurrence wins, like file_parseKeyValue()
+        if (entry->hash == hash && strcmp(entry->key, key) == 0)
+            return;
+    }
+}
+
+static bool _ra_config_parse(RaConfigFile_s *file, int fd)
+{
+    uint32_t lines = 1;
+    ssize_t len = 0, ret;
+
+    file->data = (char *)malloc(file->size + 1);
+    if (file->data == NULL)
+        return false;
+
+    while (len < file->size && (ret = read(fd, file->data + len, file->size - len)) > 0)
+        len += ret;
+    file->data[len] = '\0';
+
+    for (char *c = file->data; *c; c++)
+        lines += *c == '\n';
+
+    for (file->capacity = 16; file->capacity < lines * 2;)
+        file->capacity <<= 1;
+
+    file->entries = (RaConfigEntry_s *)calloc(file->capacity, sizeof(RaConfigEntry_s));
+    if (file->entries == NULL)
+        return false;
+
+    for (char *line = file->data; line != NULL && *line;) {
+        char *end = strchr(line, '\n');
+        char *next = end ? end + 1 : NULL;
+        char *divider;
+
+        if (end == NULL)
+            end = line + strlen(line);
+
+        if (*line != '#' && (divider = memchr(line, '=', end - line)) != NULL) {
+            char *key = _ra_config_trim(line, divider);
+            char *value = _ra_config_trim(divider + 1, end);
+            if (*key)
+                _ra_config_insert(file, key, value);
+        }
+
+        line = next;
+    }
+
+    return true;
+}
+
+// Returns the cached file for `path`, (re)parsed if it changed
+static RaConfigFile_s *_ra_config_load(const char *path)
+{
+    RaConfigFile_s *file = NULL, *oldest = &_ra_config_files[0];
+    struct stat st;
+    int fd = -1;
+    bool exists = stat(path, &st) == 0 && S_ISREG(st.st_mode);
+
+    for (int i = 0; i < RA_CONFIG_CACHE_FILES; i++) {
+        RaConfigFile_s *slot = &_ra_config_files[i];
+        if (strcmp(slot->path, path) == 0) {
+            file = slot;
+            break;
+        }
+        if (slot->last_used < oldest->last_used)
+            oldest = slot;
+    }
+
+    if (file != NULL && file->exists == exists &&
+        (!exists || (file->mtime == st.st_mtime && file->size == st.st_size))) {
+        file->last_used = ++_ra_config_clock;
+        return file;
+    }
+
+    if (file == NULL)
+        file = oldest;
+    _ra_config_clear(file);
+
+    strncpy(file->path, path, PATH_MAX - 1);
+    file->last_used = ++_ra_config_clock;
+
+    if (exists && (fd = open(path, O_RDONLY)) != -1 && fstat(fd, &st) == 0) {
+        file->mtime = st.st_mtime;
+        file->size = st.st_size;
+        file->exists = _ra_config_parse(file, fd);
+        printf_debug("ra_config: parsed %s\n", path);
+    }
+
+    if (fd != -1)
+        close(fd);
+
+    if (!file->exists) {
+        // Negative entry, without a table
+        free(file->data);
+        free(file->entries);
+        file->data = NULL;
+        file->entries = NULL;
+        file->capacity = 0;
+    }
+
+    return file;
+}
+
+static const char *_ra_config_lookup(RaConfigFile_s *file, const char *key)
+{
+    if (!file->exists || file->capacity == 0)
+        return NULL;
+
+    uint32_t hash = hash_str(key);
+    uint32_t mask = file->capacity - 1;
+
+    for (uint32_t i = hash & mask; file->entries[i].key != NULL; i = (i + 1) & mask) {
+        if (file->entries[i].hash == hash && strcmp(file->entries[i].key, key) == 0)
+            return file->entries[i].value;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Look up `key` in config files ordered from the highest precedence
+ * to the lowest (game, content directory, core override, retroarch.cfg).
+ *
+ * @param paths Config file paths, missing files are skipped
+ * @param value_out Receives the first value found (unquoted)
+ * @return int Index of the file that had the key, -1 if none
+ */
+int ra_config_getLayered(const char *const paths[], int count, const char *key, char *value_out, size_t size)
+{
+    int found = -1;
+
+    pthread_mutex_lock(&_ra_config_lock);
+
+    for (int i = 0; i < count && found == -1; i++) {
+        const char *value = _ra_config_lookup(_ra_config_load(paths[i]), key);
+        if (value != NULL) {
+            snprintf(value_out, size, "%s", value);
+            found = i;
+        }
+    }
+
+    pthread_mutex_unlock(&_ra_config_lock);
+    return found;
+}
+
+/**
+ * @brief Look up `key` in a single config file.
+ */
+bool ra_config_get(const char *path, const char *key, char *value_out, size_t size)
+{
+    return ra_config_getLayered(&path, 1, key, value_out, size) != -1;
+}
+
+/**
+ * @brief Like ra_config_getLayered() for "true"/"false" values. Files
+ * where the value is something else are skipped.
+ */
+int ra_config_getLayeredBool(const char *const paths[], int count, const char *key, bool *out_value)
+{
+    char value[16];
+
+    for (int i = 0; i < count; i++) {
+        if (!ra_config_get(paths[i], key, value, sizeof(value)))
+            continue;
+
+        if (strcmp(value, "true") == 0 || strcmp(value, "false") == 0) {
+            *out_value = value[0] == 't';
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void ra_config_free(void)
+{
+    pthread_mutex_lock(&_ra_config_lock);
+    for (int i = 0; i < RA_CONFIG_CACHE_FILES; i++)
+        _ra_config_clear(&_ra_config_files[i]);
+    pthread_mutex_unlock(&_ra_config_lock);
+}
+
+#endif // UTILS_RETROARCH_CONFIG_H__
@@ -4,8 +4,18 @@
 #include "SDL/SDL_rotozoom.h"
 #include <SDL/SDL.h>
 
+#include "utils/scaler.h"
+
 SDL_Surface *rotate180(SDL_Surface *original)
 {
+    if (original == NULL)
+        return NULL;
+
+    if (original->format->BytesPerPixel == 4) {
+        scaler_rotate180(original);
+        return original;
+    }
+
     SDL_Surface *rotated = rotozoomSurface(original, 180.0, 1.0, 0);
     SDL_FillRect(original, NULL, SDL_MapRGB(original->format, 255, 0, 0));
     SDL_Rect rect = {-2, -2};
@@ -0,0 +1,419 @@
+#ifndef UTILS_SCALER_H__
+#define UTILS_SCALER_H__
+
+#include <SDL/SDL.h>
+#include <SDL/SDL_rotozoom.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+//
+//    32bpp surface scaler with specialised kernels:
+//    - integer factor nearest-neighbour (incl. 1:1, row replication)
+//    - 2:1 box downscale (smooth)
+//    - generic nearest-neighbour, same sampling as zoomSurface
+//    - bilinear, NEON on the device
+//    Every kernel can write the result rotated by 180 degrees.
+//
+//    Functions are `static inline` so the header can be pulled in by
+//    several translation units of the same binary.
+//
+
+#define SCALER_SMOOTH 0x1
+#define SCALER_ROTATE180 0x2
+
+typedef struct {
+    uint32_t index;
+    uint32_t weights[2]; // (128 - w) and w, repeated in every byte
+} ScalerTap_s;
+
+static inline uint32_t *_scaler_row(const void *pixels, int pitch, int y)
+{
+    return (uint32_t *)((uint8_t *)pixels + (size_t)y * pitch);
+}
+
+// Blends two pixels, w is the weight of b in 0..128
+static inline uint32_t _scaler_lerp(uint32_t a, uint32_t b, uint32_t w)
+{
+    uint32_t rb = ((a & 0x00FF00FF) * (128 - w) + (b & 0x00FF00FF) * w) >> 7;
+    uint32_t ag = (((a >> 8) & 0x00FF00FF) * (128 - w) + ((b >> 8) & 0x00FF00FF) * w) >> 7;
+    return (rb & 0x00FF00FF) | ((ag & 0x00FF00FF) << 8);
+}
+
+static inline uint32_t _scaler_avg4(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    uint32_t rb = ((a & 0x00FF00FF) + (b & 0x00FF00FF) + (c & 0x00FF00FF) + (d & 0x00FF00FF) + 0x00020002) >> 2;
+    uint32_t ag = (((a >> 8) & 0x00FF00FF) + ((b >> 8) & 0x00FF00FF) + ((c >> 8) & 0x00FF00FF) + ((d >> 8) & 0x00FF00FF) + 0x00020002) >> 2;
+    return (rb & 0x00FF00FF) | ((ag & 0x00FF00FF) << 8);
+}
+
+static inline void _scaler_integer(const uint32_t *src, int sw, int sh, int src_pitch,
+                                   uint32_t *dst, int dw, int dh, int dst_pitch,
+                                   int kx, int ky, bool rotate)
+{
+    for (int sy = 0; sy < sh; sy++) {
+        const uint32_t *s = _scaler_row(src, src_pitch, sy);
+        int dy = sy * ky;
+        uint32_t *d = _scaler_row(dst, dst_pitch, rotate ? dh - 1 - dy : dy);
+        int sx = 0;
+
+        if (!rotate && kx == 1) {
+            memcpy(d, s, sw * sizeof(uint32_t));
+            sx = sw;
+        }
+#ifdef __ARM_NEON
+        else if (!rotate && kx == 2) {
+            for (; sx + 4 <= sw; sx += 4) {
+                uint32x4_t v = vld1q_u32(s + sx);
+                uint32x4x2_t z = vzipq_u32(v, v);
+                vst1q_u32(d + sx * 2, z.val[0]);
+                vst1q_u32(d + sx * 2 + 4, z.val[1]);
+            }
+        }
+        else if (rotate && kx == 1) {
+            for (; sx + 4 <= sw; sx += 4) {
+                uint32x4_t v = vrev64q_u32(vld1q_u32(s + sx));
+                vst1q_u32(d + dw - 4 - sx, vcombine_u32(vget_high_u32(v), vget_low_u32(v)));
+            }
+        }
+#endif
+
+        if (rotate) {
+            for (; sx < sw; sx++) {
+                uint32_t pix = s[sx];
+                uint32_t *p = d + dw - 1 - sx * kx;
+                for (int k = 0; k < kx; k++)
+                    *p-- = pix;
+            }
+        }
+        else {
+            for (; sx < sw; sx++) {
+                uint32_t pix = s[sx];
+                uint32_t *p = d + sx * kx;
+                for (int k = 0; k < kx; k++)
+                    *p++ = pix;
+            }
+        }
+
+        for (int k = 1; k < ky; k++) {
+            uint32_t *copy = _scaler_row(dst, dst_pitch, rotate ? dh - 1 - dy - k : dy + k);
+            memcpy(copy, d, dw * sizeof(uint32_t));
+        }
+    }
+}
+
+static inline void _scaler_box2(const uint32_t *src, int src_pitch,
+                                uint32_t *dst, int dw, int dh, int dst_pitch,
+                                bool rotate)
+{
+    for (int y = 0; y < dh; y++) {
+        const uint32_t *s0 = _scaler_row(src, src_pitch, y * 2);
+        const uint32_t *s1 = _scaler_row(src, src_pitch, y * 2 + 1);
+        uint32_t *d = _scaler_row(dst, dst_pitch, rotate ? dh - 1 - y : y);
+        int x = 0;
+
+#ifdef __ARM_NEON
+        for (; x + 4 <= dw; x += 4) {
+            uint32x4x2_t a = vld2q_u32(s0 + x * 2);
+            uint32x4x2_t b = vld2q_u32(s1 + x * 2);
+            uint8x16_t ta = vhaddq_u8(vreinterpretq_u8_u32(a.val[0]), vreinterpretq_u8_u32(a.val[1]));
+            uint8x16_t tb = vhaddq_u8(vreinterpretq_u8_u32(b.val[0]), vreinterpretq_u8_u32(b.val[1]));
+            uint32x4_t v = vreinterpretq_u32_u8(vrhaddq_u8(ta, tb));
+            if (rotate) {
+                v = vrev64q_u32(v);
+                vst1q_u32(d + dw - 4 - x, vcombine_u32(vget_high_u32(v), vget_low_u32(v)));
+            }
+            else {
+                vst1q_u32(d + x, v);
+            }
+        }
+#endif
+
+        for (; x < dw; x++) {
+            uint32_t pix = _scaler_avg4(s0[x * 2], s0[x * 2 + 1], s1[x * 2], s1[x * 2 + 1]);
+            d[rotate ? dw - 1 - x : x] = pix;
+        }
+    }
+}
+
+static inline bool _scaler_nearest(const uint32_t *src, int sw, int sh, int src_pitch,
+                                   uint32_t *dst, int dw, int dh, int dst_pitch,
+                                   bool rotate)
+{
+    uint32_t *xtab = (uint32_t *)malloc(dw * sizeof(uint32_t));
+    if (xtab == NULL)
+        return false;
+
+    // Same stepping as zoomSurface, so results are pixel identical
+    uint32_t stepx = (uint32_t)(65536.0 * (float)sw / (float)dw);
+    uint32_t stepy = (uint32_t)(65536.0 * (float)sh / (float)dh);
+
+    for (int dx = 0; dx < dw; dx++) {
+        uint32_t x = rotate ? dw - 1 - dx : dx;
+        uint32_t sx = ((uint64_t)x * stepx) >> 16;
+        xtab[dx] = sx < (uint32_t)sw ? sx : sw - 1;
+    }
+
+    int prev_sy = -1;
+    uint32_t *prev = NULL;
+
+    for (int y = 0; y < dh; y++) {
+        int sy = ((uint64_t)y * stepy) >> 16;
+        if (sy >= sh)
+            sy = sh - 1;
+
+        uint32_t *d = _scaler_row(dst, dst_pitch, rotate ? dh - 1 - y : y);
+
+        if (sy == prev_sy) {
+            memcpy(d, prev, dw * sizeof(uint32_t));
+            continue;
+        }
+
+        const uint32_t *s = _scaler_row(src, src_pitch, sy);
+        for (int dx = 0; dx < dw; dx++)
+            d[dx] = s[xtab[dx]];
+
+        prev_sy = sy;
+        prev = d;
+    }
+
+    free(xtab);
+    return true;
+}
+
+// Vertical pass of the bilinear kernel, w is the weight of r1 in 0..128
+static inline void _scaler_blendRows(uint32_t *out, const uint32_t *r0, const uint32_t *r1, int w, uint32_t wy)
+{
+    int x = 0;
+
+    if (wy == 0) {
+        memcpy(out, r0, w * sizeof(uint32_t));
+        return;
+    }
+
+#ifdef __ARM_NEON
+    uint8x8_t w0 = vdup_n_u8(128 - wy);
+    uint8x8_t w1 = vdup_n_u8(wy);
+
+    for (; x + 4 <= w; x += 4) {
+        uint8x16_t a = vld1q_u8((const uint8_t *)(r0 + x));
+        uint8x16_t b = vld1q_u8((const uint8_t *)(r1 + x));
+        uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(a), w0), vget_low_u8(b), w1);
+        uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(a), w0), vget_high_u8(b), w1);
+        vst1q_u8((uint8_t *)(out + x), vcombine_u8(vshrn_n_u16(lo, 7), vshrn_n_u16(hi, 7)));
+    }
+#endif
+
+    for (; x < w; x++)
+        out[x] = _scaler_lerp(r0[x], r1[x], wy);
+}
+
+static inline bool _scaler_bilinear(const uint32_t *src, int sw, int sh, int src_pitch,
+                                    uint32_t *dst, int dw, int dh, int dst_pitch,
+                                    bool rotate)
+{
+    ScalerTap_s *xtab = (ScalerTap_s *)malloc(dw * sizeof(ScalerTap_s));
+    uint32_t *blended = (uint32_t *)malloc(sw * sizeof(uint32_t));
+
+    if (xtab == NULL || blended == NULL) {
+        free(xtab);
+        free(blended);
+        return false;
+    }
+
+    // One pixel less, so the right and bottom taps stay inside the source
+    uint32_t stepx = (uint32_t)(65536.0 * (float)(sw - 1) / (float)dw);
+    uint32_t stepy = (uint32_t)(65536.0 * (float)(sh - 1) / (float)dh);
+
+    for (int dx = 0; dx < dw; dx++) {
+        uint32_t pos = (rotate ? dw - 1 - dx : dx) * stepx;
+        uint32_t w = (pos >> 9) & 0x7F;
+        xtab[dx].index = pos >> 16;
+        xtab[dx].weights[0] = (128 - w) * 0x01010101;
+        xtab[dx].weights[1] = w * 0x01010101;
+    }
+
+    for (int y = 0; y < dh; y++) {
+        uint32_t pos = y * stepy;
+        int sy = pos >> 16;
+        const uint32_t *r0 = _scaler_row(src, src_pitch, sy);
+        const uint32_t *r1 = _scaler_row(src, src_pitch, sy + 1 < sh ? sy + 1 : sy);
+        uint32_t *d = _scaler_row(dst, dst_pitch, rotate ? dh - 1 - y : y);
+        uint32_t wy = (pos >> 9) & 0x7F;
+
+        if (dw * 2 < sw) {
+            // Strong downscale: blending whole rows first would be wasted
+            for (int dx = 0; dx < dw; dx++) {
+                const ScalerTap_s *tap = &xtab[dx];
+                uint32_t wx = tap->weights[1] & 0xFF;
+                uint32_t top = _scaler_lerp(r0[tap->index], r0[tap->index + 1], wx);
+                uint32_t bottom = _scaler_lerp(r1[tap->index], r1[tap->index + 1], wx);
+                d[dx] = _scaler_lerp(top, bottom, wy);
+            }
+            continue;
+        }
+
+        _scaler_blendRows(blended, r0, r1, sw, wy);
+
+        for (int dx = 0; dx < dw; dx++) {
+            const ScalerTap_s *tap = &xtab[dx];
+#ifdef __ARM_NEON
+            uint8x8_t pair = vld1_u8((const uint8_t *)(blended + tap->index));
+            uint16x8_t m = vmull_u8(pair, vreinterpret_u8_u32(vld1_u32(tap->weights)));
+            uint16x4_t sum = vadd_u16(vget_low_u16(m), vget_high_u16(m));
+            uint8x8_t n = vshrn_n_u16(vcombine_u16(sum, sum), 7);
+            d[dx] = vget_lane_u32(vreinterpret_u32_u8(n), 0);
+#else
+            d[dx] = _scaler_lerp(blended[tap->index], blended[tap->index + 1], tap->weights[1] & 0xFF);
+#endif
+        }
+    }
+
+    free(xtab);
+    free(blended);
+    return true;
+}
+
+/**
+ * @brief Scales a 32bpp buffer into another, picking the fastest kernel
+ * for the given factors.
+ *
+ * @param flags SCALER_SMOOTH and/or SCALER_ROTATE180
+ * @return false if a temporary buffer couldn't be allocated
+ */
+static inline bool scaler_blit(const uint32_t *src, int sw, int sh, int src_pitch,
+                               uint32_t *dst, int dw, int dh, int dst_pitch, int flags)
+{
+    bool smooth = flags & SCALER_SMOOTH;
+    bool rotate = flags & SCALER_ROTATE180;
+
+    if (sw < 1 || sh < 1 || dw < 1 || dh < 1)
+        return false;
+
+    // Smoothed integer upscales are interpolated, like zoomSurface does
+    if (dw % sw == 0 && dh % sh == 0 && (!smooth || (dw == sw && dh == sh))) {
+        _scaler_integer(src, sw, sh, src_pitch, dst, dw, dh, dst_pitch, dw / sw, dh / sh, rotate);
+        return true;
+    }
+
+    if (smooth && dw * 2 == sw && dh * 2 == sh) {
+        _scaler_box2(src, src_pitch, dst, dw, dh, dst_pitch, rotate);
+        return true;
+    }
+
+    if (smooth && sw > 1 && sh > 1)
+        return _scaler_bilinear(src, sw, sh, src_pitch, dst, dw, dh, dst_pitch, rotate);
+
+    return _scaler_nearest(src, sw, sh, src_pitch, dst, dw, dh, dst_pitch, rotate);
+}
+
+/**
+ * @brief Scales a surface to the given size, returns a new 32bpp surface
+ * with the source's channel layout (or RGBA if the source isn't 32bpp).
+ */
+static inline SDL_Surface *scaler_scaleSurface(SDL_Surface *src, int dw, int dh, int flags)
+{
+    if (src == NULL || dw < 1 || dh < 1)
+        return NULL;
+
+    SDL_Surface *converted = NULL;
+
+    if (src->format->BitsPerPixel != 32) {
+        converted = SDL_CreateRGBSurface(SDL_SWSURFACE, src->w, src->h, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
+        if (converted == NULL)
+            return NULL;
+        SDL_BlitSurface(src, NULL, converted, NULL);
+        src = converted;
+    }
+
+    SDL_Surface *dst = SDL_CreateRGBSurface(SDL_SWSURFACE, dw, dh, 32,
+                                            src->format->Rmask, src->format->Gmask,
+                                            src->format->Bmask, src->format->Amask);
+
+    if (dst != NULL) {
+        SDL_LockSurface(src);
+        bool success = scaler_blit((const uint32_t *)src->pixels, src->w, src->h, src->pitch,
+                                   (uint32_t *)dst->pixels, dw, dh, dst->pitch, flags);
+        SDL_UnlockSurface(src);
+
+        if (success) {
+            // Same as zoomSurface
+            SDL_SetAlpha(dst, SDL_SRCALPHA, 255);
+        }
+        else {
+            SDL_FreeSurface(dst);
+            dst = NULL;
+        }
+    }
+
+    if (converted != NULL)
+        SDL_FreeSurface(converted);
+
+    return dst;
+}
+
+/**
+ * @brief Drop-in replacement for zoomSurface (matches ScaleSurfaceFunc)
+ *
+ * @param flags SMOOTHING_ON/OFF (SMOOTHING_ON is SCALER_SMOOTH), may be
+ * combined with SCALER_ROTATE180
+ */
+static inline SDL_Surface *scaler_zoomSurface(SDL_Surface *src, double zoomx, double zoomy, int flags)
+{
+    if (src == NULL)
+        return NULL;
+
+    // Keep palette and colorkey handling of 8bpp surfaces as it was
+    if (src->format->BitsPerPixel == 8) {
+        int smooth = flags & SCALER_SMOOTH ? SMOOTHING_ON : SMOOTHING_OFF;
+        SDL_Surface *zoomed = zoomSurface(src, zoomx, zoomy, smooth);
+        if (zoomed != NULL && flags & SCALER_ROTATE180) {
+            SDL_Surface *rotated = rotozoomSurface(zoomed, 180.0, 1.0, smooth);
+            SDL_FreeSurface(zoomed);
+            zoomed = rotated;
+        }
+        return zoomed;
+    }
+
+    if (zoomx < 0.001)
+        zoomx = 0.001;
+    if (zoomy < 0.001)
+        zoomy = 0.001;
+
+    int dw = (int)((double)src->w * zoomx);
+    int dh = (int)((double)src->h * zoomy);
+
+    return scaler_scaleSurface(src, dw > 0 ? dw : 1, dh > 0 ? dh : 1, flags & (SCALER_SMOOTH | SCALER_ROTATE180));
+}
+
+/**
+ * @brief Rotates a 32bpp surface by 180 degrees in place
+ */
+static inline void scaler_rotate180(SDL_Surface *surface)
+{
+    SDL_LockSurface(surface);
+
+    int w = surface->w;
+    int h = surface->h;
+
+    for (int y = 0; y < (h + 1) / 2; y++) {
+        uint32_t *top = _scaler_row(surface->pixels, surface->pitch, y);
+        uint32_t *bottom = _scaler_row(surface->pixels, surface->pitch, h - 1 - y);
+        int len = top == bottom ? w / 2 : w;
+
+        for (int x = 0; x < len; x++) {
+            uint32_t pix = top[x];
+            top[x] = bottom[w - 1 - x];
+            bottom[w - 1 - x] = pix;
+        }
+    }
+
+    SDL_UnlockSurface(surface);
+}
+
+#endif // UTILS_SCALER_H__
@@ -5,6 +5,7 @@
 #include <SDL/SDL_rotozoom.h>
 #include <linux/input.h>
 #include <sys/poll.h>
+#include <sys/time.h>
 
 #include "system/display.h"
 #include "system/keymap_hw.h"
@@ -12,6 +13,7 @@
 #include "theme/load.h"
 #include "utils/keystate.h"
 #include "utils/log.h"
+#include "utils/scaler.h"
 #include "utils/sdl_init.h"
 
 #ifdef PLATFORM_MIYOOMINI
@@ -24,18 +26,50 @@ static int _input_fd = -1;
 static struct pollfd _fds[1];
 static bool keyinput_disabled = false;
 
+#define KEYINPUT_WAIT_MS 4
+
 #define INIT_PNG 1
 #define INIT_TTF 2
 #define INIT_INPUT 4
 #define INIT_AUDIO 8
 #define INIT_ALL (INIT_PNG | INIT_TTF | INIT_INPUT | INIT_AUDIO)
 
+//
+//    Damage tracking
+//
+//    Render functions mark the parts of `screen` they drew with
+//    render_markDirty(); render() then only pushes those rects. A frame with
+//    no marks is pushed in full, so callers that don't track damage keep
+//    working unchanged.
+//
+#define RENDER_MAX_PAGES 4
+#define RENDER_MAX_DIRTY 8
+
+typedef struct {
+    SDL_Rect rects[RENDER_MAX_DIRTY];
+    int count;
+    bool full;
+} RenderDamage_s;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t flips;
+    uint64_t pixels;      // pixels written to the framebuffer
+    uint64_t full_pixels; // pixels full redraws of every page would have cost
+    uint64_t usec;
+} RenderStats_s;
+
+static RenderDamage_s _frame_damage;
+static RenderDamage_s _page_damage[RENDER_MAX_PAGES];
+static bool _render_page_flip = false;
+static RenderStats_s _render_stats;
+
 void init(int flags)
 {
     display_init(_render_direct_to_fb);
 
     if (g_display.width != 640 || g_display.height != 480) {
-        theme_initScaling((double)g_display.width / 640.0, zoomSurface);
+        theme_initScaling((double)g_display.width / 640.0, scaler_zoomSurface);
     }
 
     if (_render_direct_to_fb) {
@@ -60,22 +94,201 @@ void init(int flags)
     }
 }
 
+static bool _rect_touches(const SDL_Rect *a, const SDL_Rect *b)
+{
+    return a->x <= b->x + b->w && b->x <= a->x + a->w &&
+           a->y <= b->y + b->h && b->y <= a->y + a->h;
+}
+
+static SDL_Rect _rect_union(const SDL_Rect *a, const SDL_Rect *b)
+{
+    int x0 = a->x < b->x ? a->x : b->x;
+    int y0 = a->y < b->y ? a->y : b->y;
+    int x1 = a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w;
+    int y1 = a->y + a->h > b->y + b->h ? a->y + a->h : b->y + b->h;
+    return (SDL_Rect){x0, y0, x1 - x0, y1 - y0};
+}
+
+static void _damage_clear(RenderDamage_s *damage)
+{
+    damage->count = 0;
+    damage->full = false;
+}
+
+static void _damage_add(RenderDamage_s *damage, SDL_Rect rect)
+{
+    if (damage->full || rect.w == 0 || rect.h == 0)
+        return;
+
+    // Fold in every rect the new one touches, the union may touch more
+    for (int i = 0; i < damage->count; i++) {
+        if (_rect_touches(&damage->rects[i], &rect)) {
+            rect = _rect_union(&damage->rects[i], &rect);
+            damage->rects[i] = damage->rects[--damage->count];
+            i = -1;
+        }
+    }
+
+    if (damage->count == RENDER_MAX_DIRTY) {
+        for (int i = 0; i < damage->count; i++)
+            rect = _rect_union(&damage->rects[i], &rect);
+        damage->count = 0;
+    }
+
+    if (rect.w * rect.h >= screen->w * screen->h) {
+        damage->full = true;
+        damage->count = 0;
+        return;
+    }
+
+    damage->rects[damage->count++] = rect;
+}
+
+static void _damage_merge(RenderDamage_s *dst, const RenderDamage_s *src)
+{
+    if (src->full) {
+        dst->full = true;
+        dst->count = 0;
+        return;
+    }
+    for (int i = 0; i < src->count; i++)
+        _damage_add(dst, src->rects[i]);
+}
+
+static long _render_writeDamage(int index, const RenderDamage_s *damage)
+{
+    uint32_t *pixels = (uint32_t *)screen->pixels;
+    int pitch = screen->pitch / sizeof(uint32_t);
+
+    if (damage->full)
+        return display_blitToBuffer(index, &g_display, pixels, pitch, (rect_t){0, 0, screen->w, screen->h}, true);
+
+    long written = 0;
+    for (int i = 0; i < damage->count; i++) {
+        const SDL_Rect *r = &damage->rects[i];
+        written += display_blitToBuffer(index, &g_display, pixels, pitch, (rect_t){r->x, r->y, r->w, r->h}, true);
+    }
+    return written;
+}
+
+static int _render_numPages(void)
+{
+    int numBuffers = g_display.vinfo.yres_virtual / g_display.vinfo.yres;
+    return numBuffers < RENDER_MAX_PAGES ? numBuffers : RENDER_MAX_PAGES;
+}
+
+/**
+ * @brief Mark a region of `screen` as changed since the last render().
+ * Pass NULL to mark the whole screen.
+ */
+void render_markDirty(const SDL_Rect *rect)
+{
+    if (rect == NULL) {
+        _frame_damage.full = true;
+        _frame_damage.count = 0;
+        return;
+    }
+
+    int x0 = rect->x < 0 ? 0 : rect->x;
+    int y0 = rect->y < 0 ? 0 : rect->y;
+    int x1 = rect->x + rect->w > screen->w ? screen->w : rect->x + rect->w;
+    int y1 = rect->y + rect->h > screen->h ? screen->h : rect->y + rect->h;
+
+    if (x1 > x0 && y1 > y0)
+        _damage_add(&_frame_damage, (SDL_Rect){x0, y0, x1 - x0, y1 - y0});
+}
+
+/**
+ * @brief Draw into the back buffer and flip with FBIOPAN_DISPLAY instead of
+ * writing every framebuffer page. Only for processes that own the display
+ * while they render (see render_syncPages()).
+ */
+void render_setPageFlip(bool enabled)
+{
+    _render_page_flip = enabled;
+
+    // Pages still hold whatever was on screen before
+    for (int b = 0; b < RENDER_MAX_PAGES; b++) {
+        _damage_clear(&_page_damage[b]);
+        _page_damage[b].full = true;
+    }
+}
+
+/**
+ * @brief Bring every framebuffer page up to date with the last frame, so it
+ * doesn't matter which page the next process shows.
+ */
+void render_syncPages(void)
+{
+    if (!_render_direct_to_fb || !_render_page_flip)
+        return;
+
+    int numBuffers = _render_numPages();
+    for (int b = 0; b < numBuffers; b++) {
+        if (_page_damage[b].full || _page_damage[b].count > 0) {
+            _render_stats.pixels += _render_writeDamage(b, &_page_damage[b]);
+            _damage_clear(&_page_damage[b]);
+        }
+    }
+}
+
+void render_getStats(RenderStats_s *stats_out)
+{
+    *stats_out = _render_stats;
+}
+
 void render(void)
 {
+    if (_frame_damage.count == 0)
+        _frame_damage.full = true;
+
     if (_render_direct_to_fb) {
-        int numBuffers = g_display.vinfo.yres_virtual / g_display.vinfo.yres;
-        for (int b = 0; b < numBuffers; b++) {
-            display_writeBuffer(b, &g_display, (uint32_t *)screen->pixels, (rect_t){0, 0, screen->w, screen->h}, true, false);
+        struct timeval before, after, elapsed;
+        gettimeofday(&before, NULL);
+
+        int numBuffers = _render_numPages();
+
+        if (_render_page_flip && numBuffers > 1) {
+            // The back page also misses whatever changed since it was shown
+            for (int b = 0; b < numBuffers; b++)
+                _damage_merge(&_page_damage[b], &_frame_damage);
+
+            int back = (g_display.vinfo.yoffset / g_display.vinfo.yres + 1) % numBuffers;
+            _render_stats.pixels += _render_writeDamage(back, &_page_damage[back]);
+            _damage_clear(&_page_damage[back]);
+
+            display_panToBuffer(&g_display, back);
+            _render_stats.flips++;
+        }
+        else {
+            for (int b = 0; b < numBuffers; b++)
+                _render_stats.pixels += _render_writeDamage(b, &_frame_damage);
         }
+
+        gettimeofday(&after, NULL);
+        timersub(&after, &before, &elapsed);
+        _render_stats.usec += elapsed.tv_sec * 1000000 + elapsed.tv_usec;
+        _render_stats.full_pixels += (uint64_t)numBuffers * screen->w * screen->h;
+        _render_stats.frames++;
     }
     else {
         SDL_BlitSurface(screen, NULL, video, NULL);
         SDL_Flip(video);
     }
+
+    _damage_clear(&_frame_damage);
 }
 
 void deinit(void)
 {
+    if (_render_stats.frames > 0) {
+        printf_debug("render: %u frames, %u flips, %llu px written (%.1f%% of full redraws), %llu us/frame\n",
+                     _render_stats.frames, _render_stats.flips,
+                     (unsigned long long)_render_stats.pixels,
+                     100.0 * _render_stats.pixels / _render_stats.full_pixels,
+                     (unsigned long long)(_render_stats.usec / _render_stats.frames));
+    }
+
     if (screen != NULL) {
         SDL_FreeSurface(screen);
     }
@@ -165,7 +378,11 @@ SDLKey _translate_input(int key)
     }
 }
 
-bool _updateKeystate(KeyState keystate[320], bool *quit_flag, bool enabled, SDLKey *changed_key)
+/**
+ * @brief Read pending input events into `keystate`, waiting up to `wait_ms`
+ * for the first one (0 doesn't wait, -1 waits until there is input).
+ */
+bool _updateKeystateWait(KeyState keystate[320], bool *quit_flag, bool enabled, SDLKey *changed_key, int wait_ms)
 {
     if (!_render_direct_to_fb) {
         return updateKeystate(keystate, quit_flag, enabled, changed_key);
@@ -178,7 +395,11 @@ bool _updateKeystate(KeyState keystate[320], bool *quit_flag, bool enabled, SDLK
         return false;
     }
 
-    while (poll(_fds, 1, 0) > 0) {
+    if (poll(_fds, 1, wait_ms) <= 0) {
+        return false;
+    }
+
+    do {
         if (read(_input_fd, &ev, sizeof(ev)) != sizeof(ev)) {
             fprintf(stderr, "Failed to read input event\n");
             return false;
@@ -212,11 +433,18 @@ bool _updateKeystate(KeyState keystate[320], bool *quit_flag, bool enabled, SDLK
             // Handle SYN_DROPPED if necessary
             fprintf(stderr, "Event dropped\n");
         }
-    }
-
-    usleep(4000); // Sleep for 4 milliseconds
+    } while (poll(_fds, 1, 0) > 0);
 
     return retval;
 }
 
+/**
+ * @brief Polling variant for simple loops: waits at most KEYINPUT_WAIT_MS
+ * for input, but returns as soon as there is some.
+ */
+bool _updateKeystate(KeyState keystate[320], bool *quit_flag, bool enabled, SDLKey *changed_key)
+{
+    return _updateKeystateWait(keystate, quit_flag, enabled, changed_key, KEYINPUT_WAIT_MS);
+}
+
 #endif // UTILS_SDL_DIRECT_FB_H
@@ -0,0 +1,157 @@
+#ifndef UTILS_SHA256_H__
+#define UTILS_SHA256_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+//
+//    SHA-256 (FIPS 180-4), incremental so files can be hashed while they
+//    are being downloaded or written
+//
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_HEX_SIZE (SHA256_DIGEST_SIZE * 2 + 1)
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length; // bytes hashed so far
+    uint8_t block[64];
+    uint32_t block_len;
+} Sha256_s;
+
+static const uint32_t _sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define _SHA256_ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void _sha256_transform(Sha256_s *ctx, const uint8_t *data)
+{
+    uint32_t w[64], s[8];
+
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)data[i * 4] << 24 | (uint32_t)data[i * 4 + 1] << 16 |
+               (uint32_t)data[i * 4 + 2] << 8 | data[i * 4 + 3];
+
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = _SHA256_ROR(w[i - 15], 7) ^ _SHA256_ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = _SHA256_ROR(w[i - 2], 17) ^ _SHA256_ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    memcpy(s, ctx->state, sizeof(s));
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t e1 = _SHA256_ROR(s[4], 6) ^ _SHA256_ROR(s[4], 11) ^ _SHA256_ROR(s[4], 25);
+        uint32_t ch = (s[4] & s[5]) ^ (~s[4] & s[6]);
+        uint32_t t1 = s[7] + e1 + ch + _sha256_k[i] + w[i];
+        uint32_t e0 = _SHA256_ROR(s[0], 2) ^ _SHA256_ROR(s[0], 13) ^ _SHA256_ROR(s[0], 22);
+        uint32_t maj = (s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]);
+        uint32_t t2 = e0 + maj;
+
+        s[7] = s[6];
+        s[6] = s[5];
+        s[5] = s[4];
+        s[4] = s[3] + t1;
+        s[3] = s[2];
+        s[2] = s[1];
+        s[1] = s[0];
+        s[0] = t1 + t2;
+    }
+
+    for (int i = 0; i < 8; i++)
+        ctx->state[i] += s[i];
+}
+
+void sha256_init(Sha256_s *ctx)
+{
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->block_len = 0;
+}
+
+void sha256_update(Sha256_s *ctx, const void *data, size_t len)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    ctx->length += len;
+
+    if (ctx->block_len > 0) {
+        size_t fill = 64 - ctx->block_len;
+        if (fill > len)
+            fill = len;
+        memcpy(ctx->block + ctx->block_len, bytes, fill);
+        ctx->block_len += fill;
+        bytes += fill;
+        len -= fill;
+        if (ctx->block_len < 64)
+            return;
+        _sha256_transform(ctx, ctx->block);
+        ctx->block_len = 0;
+    }
+
+    for (; len >= 64; bytes += 64, len -= 64)
+        _sha256_transform(ctx, bytes);
+
+    memcpy(ctx->block, bytes, len);
+    ctx->block_len = len;
+}
+
+/**
+ * @brief Finish the hash and write it as lowercase hex (SHA256_HEX_SIZE).
+ */
+void sha256_finalHex(Sha256_s *ctx, char *hex_out)
+{
+    uint64_t bits = ctx->length * 8;
+    uint8_t pad[72] = {0x80};
+    size_t pad_len = (ctx->block_len < 56 ? 56 : 120) - ctx->block_len;
+
+    for (int i = 0; i < 8; i++)
+        pad[pad_len + i] = (uint8_t)(bits >> (56 - i * 8));
+    sha256_update(ctx, pad, pad_len + 8);
+
+    for (int i = 0; i < 8; i++)
+        sprintf(hex_out + i * 8, "%08x", ctx->state[i]);
+}
+
+/**
+ * @brief Hash a whole file.
+ *
+ * @return false if it can't be read
+ */
+bool sha256_file(const char *path, char *hex_out)
+{
+    uint8_t buf[16384];
+    size_t len;
+    Sha256_s ctx;
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL)
+        return false;
+
+    sha256_init(&ctx);
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+        sha256_update(&ctx, buf, len);
+
+    bool ok = !ferror(fp);
+    fclose(fp);
+
+    if (ok)
+        sha256_finalHex(&ctx, hex_out);
+    return ok;
+}
+
+#endif // UTILS_SHA256_H__
@@ -0,0 +1,193 @@
+#ifndef UTILS_TRACE_H__
+#define UTILS_TRACE_H__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+//
+//    Cross-process trace recorder
+//
+//    Events go into a ring buffer in a shared file on tmpfs. Every process
+//    maps it on its first event, so tracing costs one failed open() per
+//    process while it's off. `trace start` creates the ring, only processes
+//    started after that are recorded (runtime.sh starts it at boot when
+//    the `.trace` config flag is set). `trace dump` exports Chrome
+//    trace_event JSON (chrome://tracing, ui.perfetto.dev).
+//
+//    Writers reserve a slot with an atomic increment and publish it by
+//    storing its sequence number last, so readers skip torn slots.
+//
+
+#define TRACE_PATH "/tmp/trace.ring"
+#define TRACE_MAGIC 0x31435254 // "TRC1"
+#define TRACE_VERSION 1
+#define TRACE_DEFAULT_EVENTS 16384
+#define TRACE_NAME_LEN 40
+
+typedef enum {
+    TRACE_PHASE_BEGIN = 'B',
+    TRACE_PHASE_END = 'E',
+    TRACE_PHASE_COUNTER = 'C',
+    TRACE_PHASE_INSTANT = 'i',
+    TRACE_PHASE_PROCESS = 'M' // process name, written on attach
+} TracePhase_e;
+
+typedef struct {
+    uint64_t seq; // index + 1 once the slot is complete
+    uint64_t ts_us;
+    int64_t value;
+    int32_t pid;
+    int32_t tid;
+    char phase;
+    char name[TRACE_NAME_LEN];
+} TraceEvent_s;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t event_size;
+    uint64_t next;
+    uint64_t created_us;
+} TraceRing_s;
+
+#define TRACE_EVENTS(ring) ((TraceEvent_s *)((ring) + 1))
+
+#define TRACE_BEGIN(name) trace_event(TRACE_PHASE_BEGIN, name, 0)
+#define TRACE_END(name) trace_event(TRACE_PHASE_END, name, 0)
+#define TRACE_INSTANT(name) trace_event(TRACE_PHASE_INSTANT, name, 0)
+#define TRACE_COUNTER(name, value) trace_event(TRACE_PHASE_COUNTER, name, value)
+
+// Ends the scope when the enclosing block is left
+#define _TRACE_CONCAT(a, b) a##b
+#define _TRACE_SCOPE_VAR(line) _TRACE_CONCAT(_trace_scope_, line)
+#define TRACE_SCOPE(name)                                                                      \
+    const char *_TRACE_SCOPE_VAR(__LINE__) __attribute__((cleanup(_trace_scopeEnd), unused)) = \
+        (TRACE_BEGIN(name), name)
+
+static TraceRing_s *_trace_ring = NULL;
+static int _trace_state = 0; // 0: not checked, 1: attached, -1: off
+
+uint64_t trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+size_t trace_ringSize(uint32_t capacity)
+{
+    return sizeof(TraceRing_s) + (size_t)capacity * sizeof(TraceEvent_s);
+}
+
+/**
+ * @brief Map an existing ring. Returns NULL if tracing is off.
+ */
+TraceRing_s *trace_map(bool writable)
+{
+    TraceRing_s *ring;
+    struct stat st;
+    int fd;
+
+    if ((fd = open(TRACE_PATH, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC)) == -1)
+        return NULL;
+
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(TraceRing_s)) {
+        close(fd);
+        return NULL;
+    }
+
+    ring = (TraceRing_s *)mmap(NULL, st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (ring == MAP_FAILED)
+        return NULL;
+
+    if (ring->magic != TRACE_MAGIC || ring->version != TRACE_VERSION ||
+        ring->event_size != sizeof(TraceEvent_s) || ring->capacity == 0 ||
+        trace_ringSize(ring->capacity) > st.st_size) {
+        munmap(ring, st.st_size);
+        return NULL;
+    }
+
+    return ring;
+}
+
+static void _trace_write(TraceRing_s *ring, char phase, const char *name, int64_t value, int32_t pid, int32_t tid)
+{
+    uint64_t index = __atomic_fetch_add(&ring->next, 1, __ATOMIC_RELAXED);
+    TraceEvent_s *event = &TRACE_EVENTS(ring)[index % ring->capacity];
+
+    __atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    event->ts_us = trace_now();
+    event->value = value;
+    event->pid = pid;
+    event->tid = tid;
+    event->phase = phase;
+    strncpy(event->name, name, TRACE_NAME_LEN - 1);
+    event->name[TRACE_NAME_LEN - 1] = '\0';
+
+    __atomic_store_n(&event->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Record an event from another process' point of view (used by the
+ * CLI to attribute shell events to the calling script).
+ */
+bool trace_eventAs(TraceRing_s *ring, char phase, const char *name, int64_t value, int32_t pid)
+{
+    if (ring == NULL)
+        return false;
+    _trace_write(ring, phase, name, value, pid, pid);
+    return true;
+}
+
+static bool _trace_attach(void)
+{
+    if (_trace_state == 0) {
+        int saved_errno = errno;
+        char comm[TRACE_NAME_LEN] = "";
+        FILE *fp;
+
+        _trace_ring = trace_map(true);
+        _trace_state = _trace_ring ? 1 : -1;
+
+        if (_trace_ring && (fp = fopen("/proc/self/comm", "r")) != NULL) {
+            if (fgets(comm, sizeof(comm), fp) != NULL)
+                comm[strcspn(comm, "\n")] = '\0';
+            fclose(fp);
+            _trace_write(_trace_ring, TRACE_PHASE_PROCESS, comm, 0, getpid(), getpid());
+        }
+        errno = saved_errno;
+    }
+    return _trace_state == 1;
+}
+
+/**
+ * @brief Record an event in the calling process and thread. A no-op
+ * unless `trace start` created the ring before this process' first event.
+ */
+void trace_event(char phase, const char *name, int64_t value)
+{
+    if (_trace_state == -1 || !_trace_attach())
+        return;
+    _trace_write(_trace_ring, phase, name, value, getpid(), (int32_t)syscall(SYS_gettid));
+}
+
+static inline void _trace_scopeEnd(const char **name)
+{
+    TRACE_END(*name);
+}
+
+#endif // UTILS_TRACE_H__
@@ -0,0 +1,542 @@
+#ifndef UTILS_WRITE_CACHE_H__
+#define UTILS_WRITE_CACHE_H__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./file.h"
+
+//
+//    Write coalescing for small state files on the SD card
+//
+//    Writes (and removals) made between writeCache_begin() and
+//    writeCache_end() are staged in tmpfs instead of hitting the card:
+//      WRITE_CACHE_DIR/files/<path>     content waiting to be written
+//      WRITE_CACHE_DIR/removed/<path>   removal waiting to be done
+//      WRITE_CACHE_DIR/base/<path>      stat of the card file when first staged
+//      WRITE_CACHE_DIR/dirty            paths touched since the last flush
+//    writeCache_flush() writes them in one batch: each file goes to
+//    `<path>.tmp` and is renamed over the old one once everything is
+//    synced, so a file is either the old or the new version. Content
+//    identical to what's on the card is not written at all.
+//
+//    Outside of a batch (the default), writes go straight to the card,
+//    with the same atomic replace and identical-content check, and drop
+//    any staged version of the file. A card file another program rewrote
+//    after it was staged (its mtime, size or inode no longer match the
+//    base record) is left alone by the flush.
+//
+//    Readers must go through writeCache_exists()/writeCache_resolve()
+//    to see staged content (flags.h and config.h do). keymon flushes
+//    on a timer, before suspend/shutdown and when asked with SIGUSR2
+//    (runtime.sh does before every state change).
+//
+//    Only paths under WRITE_CACHE_ROOT are cached, others (/tmp) are
+//    written directly.
+//
+
+#ifndef WRITE_CACHE_DIR
+#define WRITE_CACHE_DIR "/tmp/.writeCache"
+#endif
+#ifndef WRITE_CACHE_ROOT
+#define WRITE_CACHE_ROOT "/mnt/SDCARD/"
+#endif
+#define WRITE_CACHE_DELAY_MS 3000 // quiet time before a staged batch is flushed
+#define WRITE_CACHE_MAX_SIZE (64 * 1024)
+
+typedef struct {
+    unsigned int requested; // writes and removals asked for
+    unsigned int written;   // the ones that reached the SD card
+} WriteCacheStats_s;
+
+static int _write_cache_depth = 0;
+
+/**
+ * @brief Starts staging writes in tmpfs (batches can be nested).
+ */
+void writeCache_begin(void) { _write_cache_depth++; }
+
+void writeCache_end(void)
+{
+    if (_write_cache_depth > 0)
+        _write_cache_depth--;
+}
+
+static bool _writeCache_handles(const char *path)
+{
+    return strncmp(path, WRITE_CACHE_ROOT, strlen(WRITE_CACHE_ROOT)) == 0;
+}
+
+static void _writeCache_path(char *out, const char *kind, const char *path)
+{
+    snprintf(out, PATH_MAX, WRITE_CACHE_DIR "/%s%s", kind, path);
+}
+
+// Creates the parent directories of `path`
+static bool _writeCache_mkdirsFor(const char *path)
+{
+    char dir[PATH_MAX];
+    strncpy(dir, path, PATH_MAX - 1);
+    dir[PATH_MAX - 1] = '\0';
+
+    char *slash = strrchr(dir, '/');
+    if (slash == NULL || slash == dir)
+        return true;
+    *slash = '\0';
+
+    if (is_dir(dir))
+        return true;
+
+    for (char *p = dir + 1; *p; p++) {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        mkdir(dir, 0755);
+        *p = '/';
+    }
+
+    return mkdir(dir, 0755) == 0 || errno == EEXIST;
+}
+
+static int _writeCache_lock(void)
+{
+    mkdir(WRITE_CACHE_DIR, 0755);
+
+    int fd = open(WRITE_CACHE_DIR "/.lock", O_RDWR | O_CREAT, 0644);
+    if (fd >= 0)
+        flock(fd, LOCK_EX);
+    return fd;
+}
+
+static void _writeCache_unlock(int fd)
+{
+    if (fd >= 0)
+        close(fd); // releases the lock
+}
+
+static bool _writeCache_sameContent(const char *path, const void *data, size_t len)
+{
+    struct stat st;
+    char buffer[4096];
+    size_t offset = 0;
+    bool same = true;
+    int fd;
+
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size != len)
+        return false;
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return false;
+
+    while (same && offset < len) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0 || offset + n > len)
+            same = false;
+        else {
+            same = memcmp(buffer, (const char *)data + offset, n) == 0;
+            offset += n;
+        }
+    }
+
+    close(fd);
+    return same;
+}
+
+static bool _writeCache_writeAll(const char *path, const void *data, size_t len, bool do_fsync)
+{
+    int fd;
+
+    if (!_writeCache_mkdirsFor(path) || (fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return false;
+
+    bool ok = len == 0 || write(fd, data, len) == (ssize_t)len;
+    if (ok && do_fsync)
+        ok = fsync(fd) == 0;
+    return close(fd) == 0 && ok;
+}
+
+// Atomic replace: `<path>.tmp` then rename
+static bool _writeCache_replace(const char *path, const void *data, size_t len, bool do_fsync)
+{
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, PATH_MAX, "%s.tmp", path);
+
+    if (!_writeCache_writeAll(tmp_path, data, len, do_fsync) || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return false;
+    }
+
+    return true;
+}
+
+static void _writeCache_count(unsigned int requested, unsigned int written)
+{
+    WriteCacheStats_s stats = {0, 0};
+    FILE *fp;
+
+    if ((fp = fopen(WRITE_CACHE_DIR "/stats", "r")) != NULL) {
+        if (fscanf(fp, "%u %u", &stats.requested, &stats.written) != 2)
+            stats.requested = stats.written = 0;
+        fclose(fp);
+    }
+
+    stats.requested += requested;
+    stats.written += written;
+
+    if ((fp = fopen(WRITE_CACHE_DIR "/stats", "w")) != NULL) {
+        fprintf(fp, "%u %u\n", stats.requested, stats.written);
+        fclose(fp);
+    }
+}
+
+// Forgets the staged version of `path`, a direct write supersedes it
+static void _writeCache_drop(const char *path)
+{
+    char staged[PATH_MAX];
+
+    _writeCache_path(staged, "files", path);
+    unlink(staged);
+    _writeCache_path(staged, "removed", path);
+    unlink(staged);
+    _writeCache_path(staged, "base", path);
+    unlink(staged);
+}
+
+// Empty if `path` doesn't exist. mtimes alone can't tell: FAT rounds
+// them down to 2 s.
+static void _writeCache_formatStat(const char *path, char *out, size_t size)
+{
+    struct stat st;
+
+    if (stat(path, &st) != 0) {
+        out[0] = '\0';
+        return;
+    }
+    snprintf(out, size, "%lld.%09ld %lld %llu\n", (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec,
+             (long long)st.st_size, (unsigned long long)st.st_ino);
+}
+
+// Remembers the card file as it was before the batch staged it
+static void _writeCache_recordBase(const char *path)
+{
+    char base[PATH_MAX], current[96];
+
+    _writeCache_path(base, "base", path);
+    if (exists(base))
+        return; // kept from the first staging
+
+    _writeCache_formatStat(path, current, sizeof(current));
+    _writeCache_writeAll(base, current, strlen(current), false);
+}
+
+static bool _writeCache_markDirty(const char *path)
+{
+    int fd = open(WRITE_CACHE_DIR "/dirty", O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+        return false;
+
+    dprintf(fd, "%s\n", path);
+    close(fd);
+    return true;
+}
+
+/**
+ * @brief Writes `data` to `path`, staged if inside a batch.
+ */
+bool writeCache_put(const char *path, const void *data, size_t len)
+{
+    char staged[PATH_MAX];
+    bool ok;
+
+    if (!_writeCache_handles(path))
+        return _writeCache_replace(path, data, len, false);
+
+    int lock = _writeCache_lock();
+
+    if (_write_cache_depth > 0 && len <= WRITE_CACHE_MAX_SIZE) {
+        _writeCache_recordBase(path);
+        _writeCache_path(staged, "removed", path);
+        unlink(staged);
+        _writeCache_path(staged, "files", path);
+        ok = _writeCache_replace(staged, data, len, false) && _writeCache_markDirty(path);
+        _writeCache_count(1, 0);
+    }
+    else {
+        _writeCache_drop(path);
+        bool same = _writeCache_sameContent(path, data, len);
+        ok = same || _writeCache_replace(path, data, len, true);
+        _writeCache_count(1, same ? 0 : 1);
+    }
+
+    _writeCache_unlock(lock);
+    return ok;
+}
+
+bool writeCache_printf(const char *path, const char *format, ...)
+{
+    char buffer[1024];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    if (len < 0)
+        return false;
+    if ((size_t)len < sizeof(buffer))
+        return writeCache_put(path, buffer, len);
+
+    char *content = (char *)malloc(len + 1);
+    if (content == NULL)
+        return false;
+
+    va_start(args, format);
+    vsnprintf(content, len + 1, format, args);
+    va_end(args);
+
+    bool ok = writeCache_put(path, content, len);
+    free(content);
+    return ok;
+}
+
+/**
+ * @brief Removes `path`, staged if inside a batch.
+ */
+bool writeCache_remove(const char *path)
+{
+    char staged[PATH_MAX];
+    bool ok;
+
+    if (!_writeCache_handles(path))
+        return remove(path) == 0;
+
+    int lock = _writeCache_lock();
+
+    if (_write_cache_depth > 0) {
+        _writeCache_recordBase(path);
+        _writeCache_path(staged, "files", path);
+        unlink(staged);
+        _writeCache_path(staged, "removed", path);
+        ok = _writeCache_writeAll(staged, NULL, 0, false) && _writeCache_markDirty(path);
+        _writeCache_count(1, 0);
+    }
+    else {
+        _writeCache_drop(path);
+        bool present = exists(path);
+        ok = !present || remove(path) == 0;
+        _writeCache_count(1, present ? 1 : 0);
+    }
+
+    _writeCache_unlock(lock);
+    return ok;
+}
+
+/**
+ * @brief Where the current content of `path` can be read: its staged
+ * copy (stored in `buffer`) or `path` itself.
+ *
+ * @return NULL if the file is staged for removal
+ */
+const char *writeCache_resolve(const char *path, char *buffer)
+{
+    if (!_writeCache_handles(path))
+        return path;
+
+    _writeCache_path(buffer, "files", path);
+    if (is_file(buffer))
+        return buffer;
+
+    _writeCache_path(buffer, "removed", path);
+    if (exists(buffer))
+        return NULL;
+
+    return path;
+}
+
+bool writeCache_exists(const char *path)
+{
+    char buffer[PATH_MAX];
+    const char *source = writeCache_resolve(path, buffer);
+    return source != NULL && exists(source);
+}
+
+// True if `path` was written or removed (by another process) after it
+// was staged
+static bool _writeCache_changedSince(const char *path)
+{
+    char base[PATH_MAX], expected[96] = "", current[96];
+    FILE *fp;
+
+    _writeCache_path(base, "base", path);
+    if ((fp = fopen(base, "r")) == NULL)
+        return false;
+    if (fgets(expected, sizeof(expected), fp) == NULL)
+        expected[0] = '\0';
+    fclose(fp);
+
+    _writeCache_formatStat(path, current, sizeof(current));
+    return strcmp(expected, current) != 0;
+}
+
+typedef struct {
+    char *path;
+    bool remove;
+    bool written; // `<path>.tmp` is ready to be renamed
+} _WriteCacheEntry_s;
+
+static int _writeCache_compareEntries(const void *a, const void *b)
+{
+    return strcmp(((const _WriteCacheEntry_s *)a)->path, ((const _WriteCacheEntry_s *)b)->path);
+}
+
+/**
+ * @brief Writes every staged change to the SD card (explicit commit).
+ *
+ * @return Number of files written or removed on the card, -1 on error
+ */
+int writeCache_flush(void)
+{
+    char staged[PATH_MAX], tmp_path[PATH_MAX];
+    int count = 0, written = 0;
+
+    int lock = _writeCache_lock();
+    char *dirty = file_read(WRITE_CACHE_DIR "/dirty");
+
+    if (dirty == NULL || *dirty == '\0') {
+        free(dirty);
+        _writeCache_unlock(lock);
+        return 0;
+    }
+
+    for (char *p = dirty; *p; p++)
+        count += *p == '\n';
+
+    _WriteCacheEntry_s *entries = (_WriteCacheEntry_s *)calloc(count + 1, sizeof(_WriteCacheEntry_s));
+    if (entries == NULL) {
+        free(dirty);
+        _writeCache_unlock(lock);
+        return -1;
+    }
+
+    count = 0;
+    for (char *line = strtok(dirty, "\n"); line != NULL; line = strtok(NULL, "\n"))
+        entries[count++].path = line;
+
+    // A file staged many times is written once
+    qsort(entries, count, sizeof(_WriteCacheEntry_s), _writeCache_compareEntries);
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        if (unique == 0 || strcmp(entries[unique - 1].path, entries[i].path) != 0)
+            entries[unique++] = entries[i];
+    }
+
+    for (int i = 0; i < unique; i++) {
+        _WriteCacheEntry_s *entry = &entries[i];
+        char *content;
+
+        struct stat st;
+
+        if (_writeCache_changedSince(entry->path))
+            continue; // superseded by a direct write
+
+        _writeCache_path(staged, "removed", entry->path);
+        if (exists(staged)) {
+            entry->remove = true;
+            continue;
+        }
+
+        _writeCache_path(staged, "files", entry->path);
+        if (stat(staged, &st) != 0)
+            continue;
+        if ((content = file_read(staged)) == NULL)
+            continue;
+
+        size_t len = (size_t)st.st_size;
+
+        if (!_writeCache_sameContent(entry->path, content, len)) {
+            snprintf(tmp_path, PATH_MAX, "%s.tmp", entry->path);
+            entry->written = _writeCache_writeAll(tmp_path, content, len, false);
+        }
+
+        free(content);
+    }
+
+    // New versions are on the card before any old one is replaced
+    sync();
+
+    for (int i = 0; i < unique; i++) {
+        _WriteCacheEntry_s *entry = &entries[i];
+
+        if (entry->written) {
+            snprintf(tmp_path, PATH_MAX, "%s.tmp", entry->path);
+            if (rename(tmp_path, entry->path) == 0)
+                written++;
+            else
+                unlink(tmp_path);
+        }
+        else if (entry->remove && remove(entry->path) == 0) {
+            written++;
+        }
+
+        _writeCache_drop(entry->path);
+    }
+
+    if (written > 0)
+        sync();
+
+    unlink(WRITE_CACHE_DIR "/dirty");
+    _writeCache_count(0, written);
+
+    free(entries);
+    free(dirty);
+    _writeCache_unlock(lock);
+    return written;
+}
+
+/**
+ * @brief Milliseconds until the staged changes are due for a flush.
+ *
+ * @return -1 if nothing is staged
+ */
+int writeCache_msUntilFlush(void)
+{
+    struct stat st;
+    struct timespec now;
+
+    if (stat(WRITE_CACHE_DIR "/dirty", &st) != 0 || st.st_size == 0)
+        return -1;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    long long age_ms = (long long)(now.tv_sec - st.st_mtim.tv_sec) * 1000 +
+                       (now.tv_nsec - st.st_mtim.tv_nsec) / 1000000;
+
+    if (age_ms < 0 || age_ms >= WRITE_CACHE_DELAY_MS)
+        return 0;
+    return (int)(WRITE_CACHE_DELAY_MS - age_ms);
+}
+
+bool writeCache_getStats(WriteCacheStats_s *stats)
+{
+    FILE *fp;
+    bool ok = false;
+
+    stats->requested = stats->written = 0;
+
+    if ((fp = fopen(WRITE_CACHE_DIR "/stats", "r")) != NULL) {
+        ok = fscanf(fp, "%u %u", &stats->requested, &stats->written) == 2;
+        fclose(fp);
+    }
+
+    return ok;
+}
+
+#endif // UTILS_WRITE_CACHE_H__
@@ -0,0 +1,464 @@
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "system/settings.h"
+#include "system/state.h"
+#include "utils/file.h"
+#include "utils/flags.h"
+#include "utils/journal.h"
+#include "utils/log.h"
+#include "utils/process.h"
+#include "utils/str.h"
+#include "utils/trace.h"
+
+#include "../playActivity/playActivityDB.h"
+
+#define SYSDIR "/mnt/SDCARD/.tmp_update"
+#define RA_DIR "/mnt/SDCARD/RetroArch"
+#define RA_CONFIG RA_DIR "/.retroarch/retroarch.cfg"
+#define LAUNCH_INFO_PATH "/tmp/launch_info"
+#define NEW_RES_FLAG "/tmp/new_res_available"
+#define RETVAL_NOT_FOUND 404
+#define LAUNCH_CONTINUE -1
+
+typedef struct {
+    char cmd[STR_MAX * 6];
+    bool cmd_changed;
+    bool is_game;
+    char launch[STR_MAX];
+    char rompath[STR_MAX];
+    char romext[32];
+    char romcfgpath[STR_MAX];
+    char appendconfig[64];
+    char core[STR_MAX * 2]; // set when the game config overrides the core
+} Launch_s;
+
+static bool _isDefaultCommand(const char *cmd)
+{
+    const char *prefix = "LD_PRELOAD=" LAUNCH_PRELOAD " \"";
+    return strncmp(cmd, prefix, strlen(prefix)) == 0;
+}
+
+static bool _isGame(const char *cmd)
+{
+    return strstr(cmd, "retroarch/cores") != NULL ||
+           strstr(cmd, "/../../Roms/") != NULL ||
+           strstr(cmd, "/mnt/SDCARD/Roms/") != NULL;
+}
+
+// Shell-escaped `$` in rom paths (see _escapeDollar) are plain in memory
+static void _unescapeDollar(char *str)
+{
+    char *src = str, *dst = str;
+    while (*src) {
+        if (src[0] == '\\' && src[1] == '$')
+            src++;
+        *dst++ = *src++;
+    }
+    *dst = '\0';
+}
+
+static void _escapeDollar(char *out, size_t size, const char *str)
+{
+    size_t len = 0;
+    for (; *str && len + 2 < size; str++) {
+        if (*str == '$' && (len == 0 || out[len - 1] != '\\'))
+            out[len++] = '\\';
+        out[len++] = *str;
+    }
+    out[len] = '\0';
+}
+
+// Replaces the last quoted string (the rom path) of the command
+static void _replaceRomPath(Launch_s *l)
+{
+    char escaped[STR_MAX * 2];
+    char *end = strrchr(l->cmd, '"');
+    char *start = NULL;
+
+    if (end != NULL) {
+        *end = '\0';
+        start = strrchr(l->cmd, '"');
+        *end = '"';
+    }
+    if (start == NULL)
+        return;
+
+    _escapeDollar(escaped, sizeof(escaped), l->rompath);
+    snprintf(start, sizeof(l->cmd) - (start - l->cmd), "\"%s\"", escaped);
+    l->cmd_changed = true;
+}
+
+static void _parseCommand(Launch_s *l)
+{
+    char resolved[PATH_MAX];
+    const char *rom_start;
+
+    l->cmd[strcspn(l->cmd, "\r\n")] = '\0';
+    state_parseLaunchCommand(l->cmd, l->launch, l->rompath);
+    _unescapeDollar(l->rompath);
+
+    if (!_isGame(l->cmd) || l->rompath[0] == '\0')
+        return;
+
+    // Custom launch script ("launch:rompath"), run it instead
+    if ((rom_start = strstr(l->cmd, "\" \"")) != NULL && strchr(rom_start, ':') != NULL) {
+        state_formatLaunchCommand(l->cmd, sizeof(l->cmd), l->launch, l->rompath);
+        l->cmd_changed = true;
+    }
+
+    const char *ext = file_getExtension(file_basename(l->rompath));
+    int i;
+    for (i = 0; ext[i] && i < (int)sizeof(l->romext) - 1; i++)
+        l->romext[i] = tolower((unsigned char)ext[i]);
+    l->romext[i] = '\0';
+
+    if (strcmp(l->romext, "miyoocmd") == 0)
+        return;
+
+    if (is_file(l->rompath) && realpath(l->rompath, resolved) != NULL &&
+        strcmp(resolved, l->rompath) != 0) {
+        strncpy(l->rompath, resolved, STR_MAX - 1);
+        _replaceRomPath(l);
+    }
+    else if (strchr(l->rompath, '$') != NULL) {
+        _replaceRomPath(l); // escape it for the shell
+    }
+
+    char *dir = file_dirname(l->rompath);
+    char *name = file_removeExtension(file_basename(l->rompath));
+    snprintf(l->romcfgpath, sizeof(l->romcfgpath), "%s/.game_config/%s.cfg", dir, name);
+    free(dir);
+    free(name);
+
+    print_debug(l->rompath);
+    l->is_game = true;
+}
+
+static bool _scriptContains(const char *path, const char *needle)
+{
+    char *content = file_read(path);
+    bool found = content != NULL && strstr(content, needle) != NULL;
+    free(content);
+    return found;
+}
+
+// The extra config is only passed on the command line, so neither
+// cmd_to_run.sh nor the launch script need cleaning up afterwards
+static void _resolveCore(Launch_s *l)
+{
+    FILE *fp;
+    char core[STR_MAX];
+
+    if (temp_flag_get("reset_game")) {
+        file_put(fp, "/tmp/reset.cfg", "%s", "savestate_auto_load = \"false\"\nconfig_save_on_exit = \"false\"\n");
+        strcpy(l->appendconfig, "/tmp/reset.cfg");
+        temp_flag_set("reset_game", false);
+    }
+    else if (temp_flag_get("force_auto_load_state")) {
+        file_put(fp, "/tmp/auto_load_state.cfg", "%s", "savestate_auto_load = \"true\"\nconfig_save_on_exit = \"false\"\n");
+        strcpy(l->appendconfig, "/tmp/auto_load_state.cfg");
+        temp_flag_set("force_auto_load_state", false);
+    }
+
+    if (!is_file(l->romcfgpath) || !file_parseKeyValue(l->romcfgpath, "core", core, '=', 0))
+        return;
+
+    char corepath[STR_MAX * 2];
+    snprintf(corepath, sizeof(corepath), RA_DIR "/.retroarch/cores/%s.so", core);
+    if (!is_file(corepath)) {
+        printf_debug("Specified core not found: %s\n", corepath);
+        return;
+    }
+
+    printf_debug("Overriding core to: %s\n", core);
+    snprintf(l->core, sizeof(l->core), ".retroarch/cores/%s.so", core);
+
+    char escaped[STR_MAX * 2];
+    _escapeDollar(escaped, sizeof(escaped), l->rompath);
+    snprintf(l->cmd, sizeof(l->cmd), "LD_PRELOAD=" LAUNCH_PRELOAD " ./retroarch -v -L \"%s\" \"%s\"", l->core, escaped);
+    l->cmd_changed = true;
+}
+
+static void _writeShellValue(FILE *fp, const char *key, const char *value)
+{
+    fprintf(fp, "%s='", key);
+    for (; *value; value++) {
+        if (*value == '\'')
+            fputs("'\\''", fp);
+        else
+            fputc(*value, fp);
+    }
+    fputs("'\n", fp);
+}
+
+// Sourced by runtime.sh for the post-launch steps
+static void _writeLaunchInfo(Launch_s *l, int retval)
+{
+    FILE *fp = fopen(LAUNCH_INFO_PATH, "w");
+    if (fp == NULL)
+        return;
+    fprintf(fp, "is_game=%d\n", l->is_game ? 1 : 0);
+    _writeShellValue(fp, "rompath", l->rompath);
+    _writeShellValue(fp, "romext", l->romext);
+    _writeShellValue(fp, "launch_script", l->launch);
+    if (retval != 0)
+        fprintf(fp, "retval=%d\n", retval);
+    fclose(fp);
+}
+
+static bool _getFullResolutionPath(Launch_s *l, char *path_out)
+{
+    char *p;
+
+    path_out[0] = '\0';
+
+    if (strstr(l->cmd, "/mnt/SDCARD/App/") != NULL) {
+        // cd /mnt/SDCARD/App/<app>; ./launch.sh
+        if ((p = strchr(l->cmd, ' ')) != NULL) {
+            sscanf(p + 1, "%[^;]", path_out);
+            strcat(path_out, "/full_resolution");
+        }
+    }
+    else if ((p = strstr(l->cmd, "/mnt/SDCARD/Roms/PORTS/")) != NULL) {
+        char port_path[STR_MAX];
+        char *end = strstr(p, ".port");
+        if (end != NULL) {
+            snprintf(port_path, sizeof(port_path), "%.*s", (int)(end + 5 - p), p);
+            if (_scriptContains(port_path, "FullResolution=1"))
+                strcpy(path_out, NEW_RES_FLAG);
+        }
+    }
+    else if ((p = strstr(l->launch, "launch.sh")) != NULL) {
+        snprintf(path_out, STR_MAX, "%.*sfull_resolution", (int)(p - l->launch), l->launch);
+    }
+
+    return path_out[0] != '\0' && exists(path_out);
+}
+
+static void _changeResolution(int width, int height)
+{
+    char cmd[128];
+    pid_t pid;
+
+    printf_debug("Changing resolution to %d x %d\n", width, height);
+    system("bootScreen clear");
+    snprintf(cmd, sizeof(cmd), "fbset -g %d %d %d %d 32", width, height, width, height * 2);
+    system(cmd);
+
+    // inform batmon and keymon of resolution change
+    if ((pid = process_searchpid("batmon")))
+        kill(pid, SIGUSR1);
+    if ((pid = process_searchpid("keymon")))
+        kill(pid, SIGUSR1);
+}
+
+static void _stopServices(void)
+{
+    const char *services[] = {"dropbear", "bftpd", "filebrowser", "telnetd", "smbd"};
+
+    if (exists(SYSDIR "/config/.keepServicesAlive"))
+        return;
+
+    for (int i = 0; i < (int)(sizeof(services) / sizeof(services[0])); i++)
+        process_killall(services[i]);
+}
+
+// Same as patch_ra_cfg.sh with `network_cmd_enable = "true"`
+static void _enableNetworkCommands(void)
+{
+    char value[STR_MAX];
+
+    if (!is_file(RA_CONFIG))
+        return;
+    if (file_parseKeyValue(RA_CONFIG, "network_cmd_enable", value, '=', 0) &&
+        strcmp(value, "true") == 0)
+        return;
+    file_changeKeyValue(RA_CONFIG, "network_cmd_enable", "network_cmd_enable = \"true\"");
+}
+
+static void _setTimezone(void)
+{
+    char *tz = file_read(SYSDIR "/config/.tz");
+    if (tz == NULL)
+        return;
+    tz[strcspn(tz, "\r\n")] = '\0';
+    setenv("TZ", tz, 1);
+    free(tz);
+}
+
+static int _execGame(Launch_s *l)
+{
+    setenv("LD_PRELOAD", LAUNCH_PRELOAD, 1);
+    fflush(stdout);
+
+    if (l->core[0] != '\0') {
+        if (l->appendconfig[0] != '\0')
+            execl("./retroarch", "retroarch", "-v", "--appendconfig", l->appendconfig,
+                  "-L", l->core, l->rompath, (char *)NULL);
+        else
+            execl("./retroarch", "retroarch", "-v", "-L", l->core, l->rompath, (char *)NULL);
+    }
+    else if (l->appendconfig[0] != '\0') {
+        // Inject the extra config into an in-memory copy of the launch script
+        char *script = file_read(l->launch);
+        char option[128];
+        char *patched = NULL;
+        char *existing;
+
+        snprintf(option, sizeof(option), "--appendconfig \"%s\"", l->appendconfig);
+        if (script != NULL && (existing = strstr(script, "--appendconfig \"")) != NULL) {
+            char *end = strchr(existing + 16, '"');
+            if (end != NULL) {
+                asprintf(&patched, "%.*s%s%s", (int)(existing - script), script, option, end + 1);
+            }
+        }
+        else if (script != NULL && (existing = strstr(script, "retroarch -v")) != NULL) {
+            existing += strlen("retroarch -v");
+            asprintf(&patched, "%.*s %s%s", (int)(existing - script), script, option, existing);
+        }
+
+        if (patched != NULL)
+            execl("/bin/sh", "sh", "-c", patched, l->launch, l->rompath, (char *)NULL);
+        free(patched);
+        free(script);
+    }
+
+    execl("/bin/sh", "sh", l->launch, l->rompath, (char *)NULL);
+    return 1;
+}
+
+static int _execMiyooCmd(Launch_s *l)
+{
+    char emupath[STR_MAX];
+    char *dots;
+
+    system(SYSDIR "/script/remove_last_recent_entry.sh");
+
+    strcpy(emupath, l->launch);
+    if ((dots = strstr(emupath, "..")) != NULL)
+        *dots = '\0';
+    char *dir = file_dirname(emupath);
+    if (chdir(dir) != 0)
+        printf_debug("chdir failed: %s\n", dir);
+    chmod(l->rompath, 0777);
+    fflush(stdout);
+    execl(l->rompath, l->rompath, l->rompath, dir, (char *)NULL);
+    free(dir);
+    return 1;
+}
+
+static bool _loadCommand(Launch_s *l, bool *new_res, char *full_resolution_path)
+{
+    TRACE_SCOPE("launch_parse");
+
+    char *cmd = file_read(CMD_TO_RUN_PATH);
+    if (cmd == NULL) {
+        fprintf(stderr, "Can't open file %s\n", CMD_TO_RUN_PATH);
+        return false;
+    }
+    strncpy(l->cmd, cmd, sizeof(l->cmd) - 1);
+    free(cmd);
+
+    _parseCommand(l);
+    *new_res = exists(NEW_RES_FLAG);
+    if (*new_res)
+        _getFullResolutionPath(l, full_resolution_path);
+    return true;
+}
+
+// Everything before the exec, traced as one span. Returns the exit code,
+// or LAUNCH_CONTINUE when the target should be exec'd.
+static int _prepareLaunch(Launch_s *l)
+{
+    TRACE_SCOPE("launch_total");
+    char full_resolution_path[STR_MAX];
+    bool new_res;
+    FILE *fp;
+
+    if (!_loadCommand(l, &new_res, full_resolution_path))
+        return 1;
+
+    // Recents edited from GameSwitcher are journaled, MainUI needs them folded in
+    journal_compact(getMiyooRecentFilePath());
+
+    if (l->is_game) {
+        {
+            TRACE_SCOPE("launch_core");
+            if (is_file(l->launch) && _scriptContains(l->launch, ".retroarch/cores"))
+                _resolveCore(l);
+        }
+
+        _stopServices();
+
+        TRACE_SCOPE("launch_play_activity");
+        if (!play_activity_start(l->rompath))
+            printf_debug("Play activity not started for %s\n", l->rompath);
+    }
+
+    if (l->cmd_changed)
+        file_put_sync(fp, CMD_TO_RUN_PATH, "%s", l->cmd);
+
+    // Prevent quick switch loop
+    temp_flag_set("quick_switch", false);
+    temp_flag_set("force_auto_load_state", false);
+
+    printf_debug("----- COMMAND:\n%s\n", l->cmd);
+
+    if (l->is_game && !exists(l->rompath)) {
+        _writeLaunchInfo(l, RETVAL_NOT_FOUND);
+        return 0;
+    }
+    _writeLaunchInfo(l, 0);
+
+    if (strcmp(l->romext, "miyoocmd") == 0)
+        return LAUNCH_CONTINUE;
+
+    TRACE_SCOPE("launch_prepare");
+    if (new_res && full_resolution_path[0] != '\0' && exists(full_resolution_path)) {
+        print_debug("Found full_resolution file, changing resolution to 560p");
+        display_getResolution();
+        _changeResolution(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    }
+
+    if (l->is_game && !new_res) {
+        system("infoPanel --message \"LOADING\" --persistent --romscreen &");
+        temp_flag_set("dismiss_info_panel", true);
+        sync();
+    }
+
+    if (chdir(RA_DIR) != 0)
+        printf_debug("chdir failed: %s\n", RA_DIR);
+    _enableNetworkCommands();
+    _setTimezone();
+
+    return LAUNCH_CONTINUE;
+}
+
+int main(int argc, char *argv[])
+{
+    Launch_s l;
+    int ret;
+
+    log_setName("gameLauncher");
+    memset(&l, 0, sizeof(Launch_s));
+
+    if ((ret = _prepareLaunch(&l)) != LAUNCH_CONTINUE)
+        return ret;
+
+    if (strcmp(l.romext, "miyoocmd") == 0)
+        return _execMiyooCmd(&l);
+
+    // Anything else runs through the shell like before
+    if (l.is_game && (l.core[0] != '\0' || _isDefaultCommand(l.cmd)))
+        return _execGame(&l);
+
+    fflush(stdout);
+    execl("/bin/sh", "sh", CMD_TO_RUN_PATH, (char *)NULL);
+    return 1;
+}
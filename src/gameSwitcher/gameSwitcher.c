@@ -24,63 +24,90 @@
 #include "theme/sound.h"
 #include "theme/theme.h"
 #include "utils/config.h"
+#include "utils/eventLoop.h"
 #include "utils/msleep.h"
 #include "utils/surfaceSetAlpha.h"
+#include "utils/trace.h"
 
 #include "gs_appState.h"
 #include "gs_history.h"
 #include "gs_keystate.h"
 #include "gs_overlay.h"
 #include "gs_render.h"
+#include "gs_resident.h"
 
-int main(int argc, char *argv[])
-{
-    appState.is_overlay = argc > 1 && strcmp(argv[1], "--overlay") == 0;
-
-    log_setName("gameSwitcher");
-    print_debug("\n\nDebug logging enabled");
+// The charger state isn't signalled by batmon, so it is still polled
+#define CHARGING_CHECK_MS 1000
 
-    signal(SIGINT, sigHandler);
-    signal(SIGTERM, sigHandler);
+static uint32_t _untilDeadline(uint32_t ticks, uint32_t start, uint32_t timeout)
+{
+    uint32_t elapsed = ticks - start;
+    return elapsed < timeout ? timeout - elapsed : 0;
+}
 
-    init(INIT_ALL);
+/**
+ * @brief Milliseconds the main loop may sleep before something on screen
+ * has to change (animation frame, legend/brightness timeout, held button)
+ */
+static uint32_t _getWakeupDelay(uint32_t ticks, uint32_t hold_delay)
+{
+    uint32_t delay = CHARGING_CHECK_MS;
+    uint32_t acc_ticks = appState.acc_ticks + (ticks - appState.last_ticks);
 
-    readFirstEntry();
-    overlay_init();
-    loadRomScreens();
+    bool animating = appState.changed || appState.brightness_changed ||
+                     (appState.surfaceGameName != NULL && appState.surfaceGameName->w > appState.game_name_max_width);
 
-    settings_load();
-    lang_load();
+    // Without the direct framebuffer, input arrives through SDL events
+    // which can't be waited on here
+    if (animating || _input_fd == -1)
+        delay = acc_ticks < appState.time_step ? appState.time_step - acc_ticks : 0;
 
-    mkdirs("/mnt/SDCARD/.tmp_update/config/gameSwitcher");
+    if (appState.show_legend) {
+        uint32_t legend = _untilDeadline(ticks, appState.legend_start, appState.legend_timeout + 1);
+        delay = legend < delay ? legend : delay;
+    }
 
-    appState.show_time = config_flag_get("gameSwitcher/showTime");
-    appState.show_total = !config_flag_get("gameSwitcher/hideTotal");
-    appState.show_legend = !config_flag_get("gameSwitcher/hideLegend");
-    appState.view_mode = appState.view_restore = config_flag_get("gameSwitcher/minimal") ? VIEW_MINIMAL : VIEW_NORMAL;
+    if (appState.brightness_changed) {
+        uint32_t brightness = _untilDeadline(ticks, appState.brightness_start, appState.brightness_timeout + 1);
+        delay = brightness < delay ? brightness : delay;
+    }
 
-    appState.transparent_bg = SDL_CreateRGBSurface(0, g_display.width, g_display.height, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
-    SDL_FillRect(appState.transparent_bg, NULL, 0xBE000000);
+    if (hold_delay > 0 && hold_delay < delay)
+        delay = hold_delay;
 
-    int battery_percentage = battery_getPercentage();
+    return delay;
+}
 
-    appState.last_ticks = SDL_GetTicks();
-    appState.legend_start = appState.last_ticks;
-    appState.brightness_start = appState.last_ticks;
+static int _waitForEvents(EventLoop_s *event_loop, uint32_t hold_delay)
+{
+    uint32_t delay = _getWakeupDelay(SDL_GetTicks(), hold_delay);
 
-    appState.custom_header = loadOptionalImage("extra/gs-top-bar");
-    appState.custom_footer = loadOptionalImage("extra/gs-bottom-bar");
+    if (delay == 0)
+        return eventLoop_wait(event_loop, 0);
 
-    appState.header_height = getHeightOrDefault(appState.custom_header, 60.0 * g_scale);
-    appState.footer_height = getHeightOrDefault(appState.custom_footer, 60.0 * g_scale);
+    eventLoop_setTimer(event_loop, delay);
+    return eventLoop_wait(event_loop, -1);
+}
 
-    print_debug("gameSwitcher started\n");
+/**
+ * @brief Runs the switcher until the user leaves it
+ */
+static void _runSession(EventLoop_s *event_loop)
+{
+    int battery_percentage = battery_getPercentage();
+    uint32_t hold_delay = 0;
 
     while (!appState.quit) {
+        int events = _waitForEvents(event_loop, hold_delay);
+
         uint32_t ticks = SDL_GetTicks();
         appState.acc_ticks += ticks - appState.last_ticks;
         appState.last_ticks = ticks;
 
+        // Don't replay the frames slept through while idle
+        if (appState.acc_ticks > appState.time_step)
+            appState.acc_ticks = appState.time_step;
+
         if (appState.show_legend && ticks - appState.legend_start > appState.legend_timeout) {
             appState.show_legend = false;
             config_flag_set("gameSwitcher/hideLegend", true);
@@ -92,7 +119,24 @@ int main(int argc, char *argv[])
             appState.changed = true;
         }
 
-        handleKeystate(&appState);
+        if (events & EVENT_INPUT || _input_fd == -1) {
+            handleKeystate(&appState);
+
+            // Show the result of a button press right away
+            if (appState.changed)
+                appState.acc_ticks = appState.time_step;
+        }
+        hold_delay = handleKeyHold(&appState, ticks);
+
+        // batmon rewrote percBat, the polling below still covers charging
+        // and systems without inotify
+        if (events & EVENT_BATTERY && !battery_isCharging()) {
+            int current_percentage = battery_getPercentage();
+            if (current_percentage != battery_percentage) {
+                battery_percentage = current_percentage;
+                appState.changed = true;
+            }
+        }
 
         if (battery_hasChanged(ticks, &battery_percentage))
             appState.changed = true;
@@ -108,6 +152,7 @@ int main(int argc, char *argv[])
 
             if (appState.changed) {
                 SDL_FillRect(screen, NULL, 0);
+                render_markDirty(NULL);
 
                 if (game_list_len == 0) {
                     appState.current_bg = NULL;
@@ -151,16 +196,28 @@ int main(int argc, char *argv[])
             render();
 
             if (appState.first_render) {
+                TRACE_END("gs_startup");
                 appState.first_render = false;
-                readHistory();
-                loadRomScreens();
+
+                // At startup only the first entry was read
+                if (!history_complete) {
+                    imageCache_cancelAll(); // workers read game_list
+                    readHistory();
+                    loadRomScreens(appState.current_game);
+                }
             }
             else {
                 appState.changed = false;
             }
         }
     }
+}
 
+/**
+ * @brief Goes back to the game, to the menu or to another game
+ */
+static void _endSession(void)
+{
     if (appState.exit_to_menu) {
         print_debug("Exiting to menu");
         remove("/mnt/SDCARD/.tmp_update/.runGameSwitcher");
@@ -168,6 +225,7 @@ int main(int argc, char *argv[])
         overlay_exit();
         SDL_FillRect(screen, NULL, 0);
         render();
+        render_syncPages();
     }
     else if (currentGame()->is_running) {
         if (appState.current_bg != NULL) {
@@ -181,12 +239,72 @@ int main(int argc, char *argv[])
         resumeGame(game_list[appState.current_game].index);
         overlay_exit();
         render_showFullscreenMessage("LOADING", true);
+        render_syncPages();
     }
 
+    // MainUI reads the plain list, fold the journal back in before leaving
+    journal_compact(getMiyooRecentFilePath());
+
 #ifndef PLATFORM_MIYOOMINI
     msleep(200);
 #endif
+}
+
+/**
+ * @brief Shows a resident switcher again, with what it kept loaded
+ *
+ * @return false if the theme or language changed, it has to restart
+ */
+static bool _resumeSession(void)
+{
+    char theme[JSON_STRING_LEN], language[JSON_STRING_LEN];
+
+    strcpy(theme, settings.theme);
+    strcpy(language, settings.language);
+    settings_load();
+
+    if (strcmp(theme, settings.theme) != 0 || strcmp(language, settings.language) != 0)
+        return false;
+
+    TRACE_BEGIN("gs_startup");
+
+    resetKeystate();
+    popMenu_destroy();
+    refreshHistory();
+
+    // overlay_init() compares it with what RetroArch is running
+    if (game_list_len > 0)
+        processItem(&game_list[0]);
+
+    overlay_init();
+    loadRomScreens(0);
+    sTotalTimePlayed[0] = '\0';
+
+    appState.quit = false;
+    appState.exit_to_menu = false;
+    appState.changed = true;
+    appState.current_game_changed = true;
+    appState.brightness_changed = false;
+    appState.pop_menu_open = false;
+    appState.first_render = true;
+    appState.current_game = 0;
+    appState.current_bg = NULL;
+    appState.show_legend = !config_flag_get("gameSwitcher/hideLegend");
+    appState.view_mode = appState.view_restore;
+
+    appState.acc_ticks = 0;
+    appState.last_ticks = SDL_GetTicks();
+    appState.legend_start = appState.last_ticks;
+    appState.brightness_start = appState.last_ticks;
+
+    // RetroArch drew on every page meanwhile
+    render_setPageFlip(true);
+
+    return true;
+}
 
+static void _cleanup(void)
+{
     if (appState.custom_header != NULL)
         SDL_FreeSurface(appState.custom_header);
     if (appState.custom_footer != NULL)
@@ -200,8 +318,86 @@ int main(int argc, char *argv[])
 
     freeRomScreens();
     ra_freeHistory();
+    ra_config_free();
 
     deinit();
+}
+
+int main(int argc, char *argv[])
+{
+    TRACE_BEGIN("gs_startup");
+    appState.is_resident = argc > 1 && strcmp(argv[1], "--resident") == 0;
+    appState.is_overlay = appState.is_resident || (argc > 1 && strcmp(argv[1], "--overlay") == 0);
+
+    log_setName("gameSwitcher");
+    print_debug("\n\nDebug logging enabled");
+
+    signal(SIGINT, sigHandler);
+    signal(SIGTERM, sigHandler);
+
+    init(INIT_ALL);
+    render_setPageFlip(true);
+
+    // Before the image cache and autosave threads start
+    if (appState.is_resident && !resident_init())
+        appState.is_resident = false;
+
+    readFirstEntry();
+    overlay_init();
+    loadRomScreens(appState.current_game);
+
+    settings_load();
+    lang_load();
+
+    mkdirs("/mnt/SDCARD/.tmp_update/config/gameSwitcher");
+
+    appState.show_time = config_flag_get("gameSwitcher/showTime");
+    appState.show_total = !config_flag_get("gameSwitcher/hideTotal");
+    appState.show_legend = !config_flag_get("gameSwitcher/hideLegend");
+    appState.view_mode = appState.view_restore = config_flag_get("gameSwitcher/minimal") ? VIEW_MINIMAL : VIEW_NORMAL;
+
+    appState.transparent_bg = SDL_CreateRGBSurface(0, g_display.width, g_display.height, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    SDL_FillRect(appState.transparent_bg, NULL, 0xBE000000);
+
+    appState.last_ticks = SDL_GetTicks();
+    appState.legend_start = appState.last_ticks;
+    appState.brightness_start = appState.last_ticks;
+
+    appState.custom_header = loadOptionalImage("extra/gs-top-bar");
+    appState.custom_footer = loadOptionalImage("extra/gs-bottom-bar");
+
+    appState.header_height = getHeightOrDefault(appState.custom_header, 60.0 * g_scale);
+    appState.footer_height = getHeightOrDefault(appState.custom_footer, 60.0 * g_scale);
+
+    print_debug("gameSwitcher started\n");
+
+    EventLoop_s event_loop;
+    eventLoop_init(&event_loop, _input_fd);
+
+    bool restart = false;
+
+    while (true) {
+        _runSession(&event_loop);
+        _endSession();
+
+        if (!appState.is_resident || appState.terminate || !resident_wait())
+            break;
+
+        if (!_resumeSession()) {
+            restart = true;
+            break;
+        }
+    }
+
+    eventLoop_free(&event_loop);
+    _cleanup();
+
+    if (restart) {
+        // Start over with the new theme, shown right away like a cold start
+        print_debug("Theme or language changed, restarting");
+        execlp(argv[0], argv[0], "--resident", NULL);
+        return EXIT_FAILURE;
+    }
 
     return EXIT_SUCCESS;
 }
@@ -13,6 +13,7 @@
 typedef struct {
     List pop_menu_list;
     bool quit;
+    bool terminate; // SIGTERM, a resident switcher exits too
     bool exit_to_menu;
     bool changed;
     bool current_game_changed;
@@ -22,6 +23,7 @@ typedef struct {
     bool show_total;
     bool show_legend;
     bool is_overlay;
+    bool is_resident;
     int view_mode;
     int view_restore;
     int pop_menu_game_index;
@@ -52,6 +54,7 @@ typedef struct {
 static AppState appState = {
     .pop_menu_list = {{0}},
     .quit = false,
+    .terminate = false,
     .exit_to_menu = false,
     .changed = true,
     .current_game_changed = true,
@@ -61,6 +64,7 @@ static AppState appState = {
     .show_total = true,
     .show_legend = true,
     .is_overlay = false,
+    .is_resident = false,
     .view_mode = VIEW_NORMAL,
     .view_restore = VIEW_NORMAL,
     .pop_menu_game_index = 0,
@@ -94,6 +98,7 @@ static void sigHandler(int sig)
     case SIGTERM:
         appState.exit_to_menu = true;
         appState.quit = true;
+        appState.terminate = true;
         break;
     default:
         break;
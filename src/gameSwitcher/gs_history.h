@@ -10,7 +10,9 @@
 #include "system/screenshot.h"
 #include "system/state.h"
 #include "utils/file.h"
+#include "utils/journal.h"
 #include "utils/json.h"
+#include "utils/jsonLine.h"
 #include "utils/log.h"
 #include "utils/str.h"
 
@@ -20,39 +22,33 @@
 #include "gs_retroarch.h"
 #include "gs_romscreen.h"
 
+// Set once the whole list was read (only the first entry is at startup)
+static bool history_complete = false;
+
 bool parseJsonToRecentItem(const char *jsonStr, RecentItem *recentItem, int lineNo)
 {
-    cJSON *json = cJSON_Parse(jsonStr);
-    if (json == NULL) {
+    // Rejected lines leave `recentItem` untouched
+    RecentItem item = *recentItem;
+    JsonLineField_s fields[] = {
+        JSON_LINE_INT("type", &item.type),
+        JSON_LINE_STRING("label", item.label),
+        JSON_LINE_STRING("rompath", item.rompath),
+        JSON_LINE_STRING("imgpath", item.imgpath),
+        JSON_LINE_STRING("launch", item.launch),
+    };
+
+    if (!jsonLine_read(jsonStr, fields, 5)) {
         print_debug("Error parsing JSON");
         return false;
     }
 
-    cJSON *type = cJSON_GetObjectItemCaseSensitive(json, "type");
-    if (!cJSON_IsNumber(type) || (type->valueint != 5 && type->valueint != 17)) {
-        cJSON_Delete(json);
+    if (!fields[0].found || (item.type != 5 && item.type != 17)) {
         return false;
     }
 
-    cJSON *label = cJSON_GetObjectItemCaseSensitive(json, "label");
-    cJSON *rompath = cJSON_GetObjectItemCaseSensitive(json, "rompath");
-    cJSON *imgpath = cJSON_GetObjectItemCaseSensitive(json, "imgpath");
-    cJSON *launch = cJSON_GetObjectItemCaseSensitive(json, "launch");
-
-    if (cJSON_IsString(label) && (label->valuestring != NULL)) {
-        strncpy(recentItem->label, label->valuestring, sizeof(recentItem->label) - 1);
-    }
-    if (cJSON_IsString(rompath) && (rompath->valuestring != NULL)) {
-        strncpy(recentItem->rompath, rompath->valuestring, sizeof(recentItem->rompath) - 1);
-    }
-    if (cJSON_IsString(imgpath) && (imgpath->valuestring != NULL)) {
-        strncpy(recentItem->imgpath, imgpath->valuestring, sizeof(recentItem->imgpath) - 1);
-    }
-    if (cJSON_IsString(launch) && (launch->valuestring != NULL)) {
-        strncpy(recentItem->launch, launch->valuestring, sizeof(recentItem->launch) - 1);
-    }
-    recentItem->type = type->valueint;
+    *recentItem = item;
     recentItem->lineNo = lineNo;
+    snprintf(recentItem->line, sizeof(recentItem->line), "%s", jsonStr);
 
     // Check if rompath contains a colon (':') and split it into launch and rompath
     char *colonPosition = strchr(recentItem->rompath, ':');
@@ -70,7 +66,6 @@ bool parseJsonToRecentItem(const char *jsonStr, RecentItem *recentItem, int line
         strcpy(recentItem->rompath, secondPart);
     }
 
-    cJSON_Delete(json);
     return true;
 }
 
@@ -78,6 +73,7 @@ void setEntryDefaultValues(Game_s *game, int index)
 {
     game->romScreen = NULL;
     game->totalTime[0] = '\0';
+    game->romScreen_mtime = 0;
     game->processed = false;
     game->is_running = false;
 
@@ -100,7 +96,7 @@ void readHistory()
 
     const char *recentFilePath = getMiyooRecentFilePath();
 
-    file = fopen(recentFilePath, "r");
+    file = journal_open(recentFilePath);
     if (file == NULL) {
         print_debug("Error opening file");
         return;
@@ -125,7 +121,7 @@ void readHistory()
         }
 
         if (isDuplicate) {
-            file_delete_line(recentFilePath, lineNo);
+            journal_deleteLine(recentFilePath, lineNo, line);
             lineNo--;
             continue;
         }
@@ -143,6 +139,74 @@ void readHistory()
 
     fclose(file);
     game_list_len = numRecents;
+    history_complete = true;
+}
+
+/**
+ * @brief Re-reads the history when a resident gameSwitcher is shown again.
+ * Games still in the list keep what was already worked out for them
+ * (names, core, decoded rom screen), so only new ones cost anything.
+ */
+void refreshHistory(void)
+{
+    if (!history_complete) {
+        readHistory();
+        return;
+    }
+
+    // Workers read game_list
+    imageCache_cancelAll();
+
+    int previous_len = game_list_len;
+    Game_s *previous = (Game_s *)malloc(sizeof(Game_s) * (previous_len > 0 ? previous_len : 1));
+
+    // Without a copy nothing is carried over
+    if (previous == NULL)
+        previous_len = 0;
+    else
+        memcpy(previous, game_list, sizeof(Game_s) * previous_len);
+
+    for (int i = 0; i < MAX_HISTORY; i++) {
+        // The capture of the last running game is retaken by overlay_init()
+        if (i < game_list_len && game_list[i].romScreen != NULL)
+            SDL_FreeSurface(game_list[i].romScreen);
+        game_list[i].romScreen = NULL;
+        game_list[i].processed = false;
+    }
+
+    readHistory();
+
+    int old_index[MAX_HISTORY];
+    bool taken[MAX_HISTORY] = {false};
+
+    for (int i = 0; i < game_list_len; i++) {
+        Game_s *game = &game_list[i];
+        old_index[i] = -1;
+
+        for (int j = 0; j < previous_len; j++) {
+            if (taken[j] || !previous[j].processed ||
+                strcmp(previous[j].recentItem.rompath, game->recentItem.rompath) != 0)
+                continue;
+
+            taken[j] = true;
+            strcpy(game->rom_name, previous[j].rom_name);
+            strcpy(game->name, previous[j].name);
+            strcpy(game->shortname, previous[j].shortname);
+            strcpy(game->core_name, previous[j].core_name);
+            strcpy(game->core_path, previous[j].core_path);
+            game->romScreen_mtime = previous[j].romScreen_mtime;
+            game->processed = true;
+
+            if (isRomScreenCurrent(game))
+                old_index[i] = j;
+            else
+                game->romScreen_mtime = 0;
+            break;
+        }
+    }
+
+    imageCache_remap(old_index, game_list_len);
+    free(previous);
 }
 
 bool getGameName(char *name_out, const char *rom_path)
@@ -177,10 +241,6 @@ void processItem(Game_s *game)
     if (ra_findItemInRetroArchHistory(game)) {
         ra_getCoreNameFromInfo(game);
     }
-
-    if (game->romScreen == NULL) {
-        game->romScreen = loadRomScreen(game->index);
-    }
 }
 
 /**
@@ -192,7 +252,7 @@ void readFirstEntry()
     FILE *file;
     char line[STR_MAX * 6];
 
-    file = fopen(getMiyooRecentFilePath(), "r");
+    file = journal_open(getMiyooRecentFilePath());
     if (file == NULL) {
         print_debug("Error opening file");
         return;
@@ -222,7 +282,7 @@ void readFirstEntry()
 
 void getLaunchCommand(Game_s *game, char *launchCommand)
 {
-    snprintf(launchCommand, 4096, "LD_PRELOAD=/mnt/SDCARD/miyoo/app/../lib/libpadsp.so \"%s\" \"%s\"", game->recentItem.launch, game->recentItem.rompath);
+    state_formatLaunchCommand(launchCommand, 4096, game->recentItem.launch, game->recentItem.rompath);
 }
 
 #endif // GAME_SWITCHER_HISTORY_H
\ No newline at end of file
@@ -13,6 +13,8 @@
 #include "gs_popMenu.h"
 #include "gs_romscreen.h"
 
+#define BUTTON_Y_HOLD_MS 300
+
 typedef struct {
     KeyState keystate[320];
     bool btn_a_pressed;
@@ -21,7 +23,8 @@ typedef struct {
     bool select_pressed;
     bool select_combo_key;
     SDLKey changed_key;
-    int button_y_repeat;
+    uint32_t button_y_start;
+    bool button_y_held;
 } AppKeyState_s;
 
 static AppKeyState_s _gs_keystate = {
@@ -32,7 +35,8 @@ static AppKeyState_s _gs_keystate = {
     .select_pressed = false,
     .select_combo_key = false,
     .changed_key = SDLK_UNKNOWN,
-    .button_y_repeat = 0,
+    .button_y_start = 0,
+    .button_y_held = false,
 };
 
 void removeCurrentItem()
@@ -47,7 +51,10 @@ void removeCurrentItem()
         game->romScreen = NULL;
     }
 
-    file_delete_line(getMiyooRecentFilePath(), game->recentItem.lineNo);
+    // Stop the image cache workers before shifting the list under them
+    imageCache_cancelAll();
+
+    journal_deleteLine(getMiyooRecentFilePath(), game->recentItem.lineNo, game->recentItem.line);
 
     if (strlen(game->recentItem.imgpath) > 0 && is_file(game->recentItem.imgpath)) {
         if (strncmp(game->recentItem.imgpath, ROM_SCREENS_DIR, strlen(ROM_SCREENS_DIR)) == 0) {
@@ -63,6 +70,7 @@ void removeCurrentItem()
     }
 
     game_list_len--;
+    imageCache_removeItem(appState.current_game);
 }
 
 int checkQuitAction(void)
@@ -191,12 +199,13 @@ void handleUpdateKeystateMain(AppState *state)
     }
 
     if (_gs_keystate.changed_key == SW_BTN_Y && keystate[SW_BTN_Y] == RELEASED) {
-        if (_gs_keystate.button_y_repeat < 75) {
+        if (!_gs_keystate.button_y_held) {
             state->view_mode = state->view_mode == VIEW_FULLSCREEN ? state->view_restore : !state->view_mode;
             config_flag_set("gameSwitcher/minimal", state->view_mode == VIEW_MINIMAL);
             state->changed = true;
         }
-        _gs_keystate.button_y_repeat = 0;
+        _gs_keystate.button_y_start = 0;
+        _gs_keystate.button_y_held = false;
     }
 
     if (keystate[SW_BTN_X] == PRESSED) {
@@ -263,7 +272,7 @@ void handleKeystate(AppState *state)
 {
     KeyState *keystate = _gs_keystate.keystate;
 
-    if (_updateKeystate(keystate, &state->quit, true, &_gs_keystate.changed_key)) {
+    if (_updateKeystateWait(keystate, &state->quit, true, &_gs_keystate.changed_key, 0)) {
         if (_gs_keystate.menu_pressed && _gs_keystate.changed_key != SW_BTN_MENU)
             _gs_keystate.combo_key = true;
         if (_gs_keystate.select_pressed && _gs_keystate.changed_key != SW_BTN_SELECT)
@@ -305,15 +314,42 @@ void handleKeystate(AppState *state)
             handleUpdateKeystateMain(state);
         }
     }
+}
+
+/**
+ * @brief Handle buttons that act on being held rather than on an event
+ *
+ * @return uint32_t Milliseconds until a held button needs checking again,
+ * 0 if none is pending.
+ */
+uint32_t handleKeyHold(AppState *state, uint32_t ticks)
+{
+    KeyState *keystate = _gs_keystate.keystate;
 
     if (keystate[SW_BTN_Y] == PRESSED && state->view_mode != VIEW_FULLSCREEN && !state->pop_menu_open) {
-        _gs_keystate.button_y_repeat++;
-        if (_gs_keystate.button_y_repeat >= 75) {
-            state->view_restore = state->view_mode;
-            state->view_mode = VIEW_FULLSCREEN;
-            state->changed = true;
-        }
+        if (_gs_keystate.button_y_start == 0)
+            _gs_keystate.button_y_start = ticks;
+
+        uint32_t held = ticks - _gs_keystate.button_y_start;
+        if (held < BUTTON_Y_HOLD_MS)
+            return BUTTON_Y_HOLD_MS - held;
+
+        state->view_restore = state->view_mode;
+        state->view_mode = VIEW_FULLSCREEN;
+        state->changed = true;
+        _gs_keystate.button_y_held = true;
     }
+
+    return 0;
+}
+
+/**
+ * @brief Forgets the buttons that were held when the switcher was hidden
+ */
+void resetKeystate(void)
+{
+    memset(&_gs_keystate, 0, sizeof(AppKeyState_s));
+    _gs_keystate.changed_key = SDLK_UNKNOWN;
 }
 
 #endif // GAME_SWITCHER_KEY_STATE_H__
\ No newline at end of file
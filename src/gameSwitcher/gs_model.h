@@ -4,6 +4,7 @@
 #include <SDL/SDL.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include "SDL/SDL_rotozoom.h"
 #include "system/display.h"
@@ -28,18 +29,20 @@ typedef struct {
     char launch[STR_MAX * 2];
     int type;
     int lineNo;
+    char line[STR_MAX * 6]; // as read from the list, for journal records
 } RecentItem;
 
 // Game history list
 typedef struct {
     RecentItem recentItem;
-    SDL_Surface *romScreen;
+    SDL_Surface *romScreen; // framebuffer capture, others are in imageCache
     char rom_name[STR_MAX * 2];
     char name[STR_MAX * 2];
     char shortname[STR_MAX * 2];
     char core_name[STR_MAX * 2];
     char core_path[STR_MAX * 2];
     char totalTime[100];
+    time_t romScreen_mtime; // of the file decoded into the image cache
     int index;
     bool processed;
     bool is_running;
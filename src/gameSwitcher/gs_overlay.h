@@ -125,6 +125,7 @@ void overlay_resume(void)
         }
 
         render();
+        render_syncPages();
 
         retroarch_unpause();
         system("playActivity resume &");
@@ -437,6 +437,7 @@ void renderPopMenu(AppState *state)
             pthread_join(g_scan_thread_pt, NULL);
         }
 
+        render_markDirty(NULL);
         theme_renderPopMenu(screen, state->view_mode == VIEW_NORMAL ? state->header_height : 0, &appState.pop_menu_list, transparent_bg);
 
         if (item != NULL && item->action_id == POP_MENU_ACTION_LOAD) {
@@ -92,6 +92,7 @@ void renderGameName(AppState *state)
     game_name_bg_pos.h = game_name_bg_size.h;
 
     SDL_FillRect(screen, &game_name_bg_pos, 0);
+    render_markDirty(&game_name_bg_pos);
 
     if (state->current_bg != NULL) {
         renderCentered(state->current_bg, state->view_mode, &game_name_bg_size, &game_name_bg_pos);
@@ -171,6 +172,7 @@ void renderHeader(AppState *state, int battery_percentage)
 
     if (state->custom_header) {
         if (state->header_height > 0) {
+            render_markDirty(&(SDL_Rect){0, 0, g_display.width, state->custom_header->h});
             SDL_BlitSurface(state->custom_header, NULL, screen, NULL);
             SDL_Surface *title = TTF_RenderUTF8_Blended(
                 resource_getFont(TITLE), title_str,
@@ -185,6 +187,7 @@ void renderHeader(AppState *state, int battery_percentage)
         }
     }
     else {
+        render_markDirty(&(SDL_Rect){0, 0, g_display.width, 60.0 * g_scale});
         theme_renderHeader(screen, title_str, false);
         theme_renderHeaderBattery(screen, battery_percentage);
     }
@@ -194,11 +197,13 @@ void renderFooter(AppState *state)
 {
     if (state->custom_footer) {
         if (state->footer_height > 0) {
-            SDL_Rect footer_rect = {0, g_display.height - state->custom_footer->h};
+            SDL_Rect footer_rect = {0, g_display.height - state->custom_footer->h, g_display.width, state->custom_footer->h};
+            render_markDirty(&footer_rect);
             SDL_BlitSurface(state->custom_footer, NULL, screen, &footer_rect);
         }
     }
     else {
+        render_markDirty(&(SDL_Rect){0, g_display.height - 60.0 * g_scale, g_display.width, 60.0 * g_scale});
         theme_renderFooter(screen);
         theme_renderStandardHint(screen,
                                  lang_get(LANG_RESUME_UC, LANG_FALLBACK_RESUME_UC),
@@ -219,6 +224,7 @@ void renderLegend(AppState *state)
             SDL_Rect legend_rect = {g_display.width - legend->w,
                                     state->view_mode == VIEW_NORMAL ? state->header_height : 0};
             SDL_BlitSurface(legend, NULL, screen, &legend_rect);
+            render_markDirty(&(SDL_Rect){legend_rect.x, legend_rect.y, legend->w, legend->h});
         }
     }
 }
@@ -235,6 +241,7 @@ void renderBrightness(AppState *state)
             brightness_rect.y = state->view_mode == VIEW_NORMAL ? state->header_height : 0;
         }
         SDL_BlitSurface(brightness, NULL, screen, &brightness_rect);
+        render_markDirty(&(SDL_Rect){brightness_rect.x, brightness_rect.y, brightness->w, brightness->h});
     }
 }
 
@@ -0,0 +1,100 @@
+#ifndef GAME_SWITCHER_RESIDENT_H
+#define GAME_SWITCHER_RESIDENT_H
+
+#include <linux/input.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#include "system/state.h"
+#include "utils/flags.h"
+#include "utils/log.h"
+#include "utils/sdl_direct_fb.h"
+
+#include "gs_appState.h"
+
+//
+//    Resident mode (gameSwitcher --resident)
+//
+//    When a session ends the switcher hides instead of exiting: it takes
+//    the name GS_RESIDENT_PROCESS and sleeps on a signalfd until keymon
+//    sends SIGUSR1. The theme, fonts, history and decoded rom screens stay
+//    loaded for the next time.
+//
+//    Only with the direct framebuffer, the SDL video surface can't be
+//    handed back to RetroArch.
+//
+
+static int _resident_fd = -1;
+
+/**
+ * @brief Blocks SIGUSR1 and opens the signalfd. Call before any thread is
+ * started, so none of them gets the signal.
+ */
+bool resident_init(void)
+{
+    sigset_t mask;
+
+    if (!_render_direct_to_fb)
+        return false;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    _resident_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    return _resident_fd != -1;
+}
+
+static void _resident_drainInput(void)
+{
+    struct input_event ev;
+
+    if (_input_fd == -1)
+        return;
+
+    while (poll(_fds, 1, 0) > 0 && read(_input_fd, &ev, sizeof(ev)) == sizeof(ev))
+        ;
+}
+
+/**
+ * @brief Hides the switcher until keymon asks for it again
+ *
+ * @return false if it has to exit instead (SIGTERM/SIGINT)
+ */
+bool resident_wait(void)
+{
+    struct signalfd_siginfo info;
+    struct pollfd pfd = {.fd = _resident_fd, .events = POLLIN};
+    bool requested = false;
+
+    // Requests made while it was shown are stale
+    while (read(_resident_fd, &info, sizeof(info)) == sizeof(info))
+        ;
+
+    prctl(PR_SET_NAME, GS_RESIDENT_PROCESS, 0, 0, 0);
+    temp_flag_set("state_changed", true);
+    print_debug("Hidden, waiting for keymon");
+
+    while (!requested && !appState.terminate) {
+        if (poll(&pfd, 1, -1) > 0)
+            requested = read(_resident_fd, &info, sizeof(info)) == sizeof(info);
+    }
+
+    if (appState.terminate)
+        return false;
+
+    prctl(PR_SET_NAME, "gameSwitcher", 0, 0, 0);
+    temp_flag_set("state_changed", true);
+    print_debug("Shown by keymon");
+
+    // Whatever was pressed in-game meanwhile
+    _resident_drainInput();
+
+    return true;
+}
+
+#endif // GAME_SWITCHER_RESIDENT_H
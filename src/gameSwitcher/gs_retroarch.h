@@ -1,96 +1,335 @@
 #ifndef GAME_SWITCHER_RETROARCH_H
 #define GAME_SWITCHER_RETROARCH_H
 
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
 #include "cjson/cJSON.h"
+#include "utils/file.h"
+#include "utils/hash.h"
+#include "utils/retroarch_config.h"
 
 #include "gs_model.h"
 
-static cJSON *g_cachedRetroArchHistory = NULL;
+//
+//    RetroArch history index: rom path -> core path and core name
+//
+//    content_history.lpl is parsed once into a hash table with a string
+//    pool, written to /tmp and mmapped by later launches while the lpl's
+//    mtime and size are unchanged (same racy rule as the settings
+//    snapshot).
+//
+
+#define RA_HISTORY_INDEX_PATH "/tmp/gs_history.index"
+#define RA_HISTORY_INDEX_MAGIC 0x58485352 // "RSHX"
+#define RA_HISTORY_INDEX_VERSION 1
+
+typedef struct {
+    uint32_t hash;
+    uint32_t path; // string pool offsets, 0: empty slot
+    uint32_t core_path;
+    uint32_t core_name;
+} RaHistoryEntry_s;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int64_t source_mtime;
+    int64_t source_size;
+    int64_t built_at;
+    char source_path[STR_MAX * 2];
+    uint32_t capacity; // power of 2
+    uint32_t pool_size;
+    // RaHistoryEntry_s entries[capacity], then the string pool
+} RaHistoryIndex_s;
+
+#define RA_HISTORY_ENTRIES(index) ((const RaHistoryEntry_s *)((index) + 1))
+#define RA_HISTORY_POOL(index) ((const char *)(RA_HISTORY_ENTRIES(index) + (index)->capacity))
+
+static const RaHistoryIndex_s *g_raHistoryIndex = NULL;
+static size_t g_raHistoryIndexSize = 0;
+static bool g_raHistoryIndexMapped = false;
+static bool g_raHistoryLoaded = false;
+
+static void _ra_coreNameFromInfo(const char *core_path, char *core_name, size_t size)
+{
+    char *basePath = file_removeExtension(core_path);
+    if (basePath != NULL) {
+        char infoPath[STR_MAX * 2];
+        snprintf(infoPath, sizeof(infoPath), "%s.info", basePath);
+        ra_config_get(infoPath, "corename", core_name, size);
+        free(basePath);
+    }
+}
+
+typedef struct {
+    char *data;
+    uint32_t size;
+    uint32_t capacity;
+} RaHistoryPool_s;
 
-bool ra_loadHistory(const char *jsonFilePath)
+static uint32_t _ra_poolAdd(RaHistoryPool_s *pool, const char *str)
 {
-    if (g_cachedRetroArchHistory != NULL) {
-        cJSON_Delete(g_cachedRetroArchHistory);
-        g_cachedRetroArchHistory = NULL;
+    uint32_t len = strlen(str) + 1;
+    uint32_t offset = pool->size;
+
+    if (pool->size + len > pool->capacity) {
+        while (pool->size + len > pool->capacity)
+            pool->capacity = pool->capacity ? pool->capacity * 2 : 4096;
+        pool->data = (char *)realloc(pool->data, pool->capacity);
+    }
+
+    memcpy(pool->data + offset, str, len);
+    pool->size += len;
+    return offset;
+}
+
+// A truncated or corrupt file must not send lookups out of bounds
+static bool _ra_historyIndexIsValid(const RaHistoryIndex_s *index, size_t size)
+{
+    if (size < sizeof(RaHistoryIndex_s) ||
+        index->magic != RA_HISTORY_INDEX_MAGIC ||
+        index->version != RA_HISTORY_INDEX_VERSION ||
+        memchr(index->source_path, '\0', sizeof(index->source_path)) == NULL)
+        return false;
+
+    size_t max_entries = (size - sizeof(RaHistoryIndex_s)) / sizeof(RaHistoryEntry_s);
+    uint32_t capacity = index->capacity;
+
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0 || capacity > max_entries ||
+        index->pool_size == 0 ||
+        index->pool_size != size - sizeof(RaHistoryIndex_s) - capacity * sizeof(RaHistoryEntry_s))
+        return false;
+
+    // Every offset then points to a string ending inside the pool
+    if (RA_HISTORY_POOL(index)[index->pool_size - 1] != '\0')
+        return false;
+
+    const RaHistoryEntry_s *entries = RA_HISTORY_ENTRIES(index);
+    bool has_empty_slot = false; // ends the probing
+
+    for (uint32_t i = 0; i < capacity; i++) {
+        if (entries[i].path == 0)
+            has_empty_slot = true;
+        else if (entries[i].path >= index->pool_size || entries[i].core_path >= index->pool_size ||
+                 entries[i].core_name >= index->pool_size)
+            return false;
     }
 
-    FILE *file = fopen(jsonFilePath, "r");
-    if (file == NULL) {
-        print_debug("Error opening JSON file");
+    return has_empty_slot;
+}
+
+static bool _ra_historyIndexIsCurrent(const RaHistoryIndex_s *index, size_t size, const char *lplPath, const struct stat *st)
+{
+    return _ra_historyIndexIsValid(index, size) &&
+           strcmp(index->source_path, lplPath) == 0 &&
+           index->source_mtime == st->st_mtime &&
+           index->source_size == st->st_size &&
+           index->source_mtime + FILE_MTIME_RACY_S < index->built_at;
+}
+
+static bool _ra_mapHistoryIndex(const char *lplPath, const struct stat *source_st)
+{
+    struct stat st;
+    int fd;
+
+    if ((fd = open(RA_HISTORY_INDEX_PATH, O_RDONLY)) == -1)
         return false;
+
+    if (fstat(fd, &st) == 0 && st.st_size >= sizeof(RaHistoryIndex_s)) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (map != MAP_FAILED) {
+            if (_ra_historyIndexIsCurrent((const RaHistoryIndex_s *)map, st.st_size, lplPath, source_st)) {
+                g_raHistoryIndex = (const RaHistoryIndex_s *)map;
+                g_raHistoryIndexSize = st.st_size;
+                g_raHistoryIndexMapped = true;
+            }
+            else {
+                munmap(map, st.st_size);
+            }
+        }
     }
 
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    close(fd);
+    return g_raHistoryIndex != NULL;
+}
 
-    char *fileContent = (char *)malloc(fileSize + 1);
-    fread(fileContent, 1, fileSize, file);
-    fileContent[fileSize] = '\0';
-    fclose(file);
+/**
+ * @brief Parse the lpl into a new index (saved to /tmp when possible)
+ */
+static bool _ra_buildHistoryIndex(const char *lplPath, const struct stat *source_st)
+{
+    char *content = file_read(lplPath);
+    cJSON *root = content ? cJSON_Parse(content) : NULL;
+    cJSON *items = cJSON_GetObjectItemCaseSensitive(root, "items");
+    RaHistoryPool_s pool = {0};
+    RaHistoryEntry_s *entries, *cores;
+    uint32_t capacity = 16;
+    cJSON *item;
 
-    g_cachedRetroArchHistory = cJSON_Parse(fileContent);
-    free(fileContent);
+    free(content);
 
-    if (g_cachedRetroArchHistory == NULL) {
-        print_debug("Error parsing JSON");
+    if (!cJSON_IsArray(items)) {
+        print_debug("Error parsing RetroArch history");
+        cJSON_Delete(root);
         return false;
     }
 
+    while (capacity < cJSON_GetArraySize(items) * 2)
+        capacity <<= 1;
+    entries = (RaHistoryEntry_s *)calloc(capacity, sizeof(RaHistoryEntry_s));
+    cores = (RaHistoryEntry_s *)calloc(capacity, sizeof(RaHistoryEntry_s)); // keyed on core_path
+    _ra_poolAdd(&pool, ""); // offset 0 marks empty slots
+
+    cJSON_ArrayForEach(item, items)
+    {
+        const char *path = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "path"));
+        const char *core_path = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "core_path"));
+        uint32_t hash, slot;
+
+        if (path == NULL || *path == '\0')
+            continue;
+
+        hash = hash_str(path);
+        for (slot = hash & (capacity - 1); entries[slot].path != 0; slot = (slot + 1) & (capacity - 1)) {
+            if (entries[slot].hash == hash && strcmp(pool.data + entries[slot].path, path) == 0)
+                break; // the most recent entry wins
+        }
+        if (entries[slot].path != 0)
+            continue;
+
+        entries[slot].hash = hash;
+        entries[slot].path = _ra_poolAdd(&pool, path);
+
+        if (core_path == NULL || *core_path == '\0')
+            continue;
+
+        // Core names are looked up once per core
+        uint32_t core_hash = hash_str(core_path), core;
+        for (core = core_hash & (capacity - 1); cores[core].core_path != 0; core = (core + 1) & (capacity - 1)) {
+            if (cores[core].hash == core_hash && strcmp(pool.data + cores[core].core_path, core_path) == 0)
+                break;
+        }
+
+        if (cores[core].core_path == 0) {
+            char core_name[STR_MAX * 2] = "";
+            _ra_coreNameFromInfo(core_path, core_name, sizeof(core_name));
+            cores[core].hash = core_hash;
+            cores[core].core_path = _ra_poolAdd(&pool, core_path);
+            cores[core].core_name = _ra_poolAdd(&pool, core_name);
+        }
+
+        entries[slot].core_path = cores[core].core_path;
+        entries[slot].core_name = cores[core].core_name;
+    }
+
+    cJSON_Delete(root);
+    free(cores);
+
+    RaHistoryIndex_s header;
+    memset(&header, 0, sizeof(RaHistoryIndex_s));
+    header.magic = RA_HISTORY_INDEX_MAGIC;
+    header.version = RA_HISTORY_INDEX_VERSION;
+    header.source_mtime = source_st->st_mtime;
+    header.source_size = source_st->st_size;
+    header.built_at = time(NULL);
+    strncpy(header.source_path, lplPath, sizeof(header.source_path) - 1);
+    header.capacity = capacity;
+    header.pool_size = pool.size;
+
+    size_t entries_size = capacity * sizeof(RaHistoryEntry_s);
+    size_t size = sizeof(RaHistoryIndex_s) + entries_size + pool.size;
+    char *index = (char *)malloc(size);
+
+    memcpy(index, &header, sizeof(RaHistoryIndex_s));
+    memcpy(index + sizeof(RaHistoryIndex_s), entries, entries_size);
+    memcpy(index + sizeof(RaHistoryIndex_s) + entries_size, pool.data, pool.size);
+    free(entries);
+    free(pool.data);
+
+    int fd = open(RA_HISTORY_INDEX_PATH ".tmp", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd != -1) {
+        bool written = write(fd, index, size) == size;
+        close(fd);
+        if (written)
+            rename(RA_HISTORY_INDEX_PATH ".tmp", RA_HISTORY_INDEX_PATH);
+        else
+            unlink(RA_HISTORY_INDEX_PATH ".tmp");
+    }
+
+    g_raHistoryIndex = (const RaHistoryIndex_s *)index;
+    g_raHistoryIndexSize = size;
+    g_raHistoryIndexMapped = false;
     return true;
 }
 
 void ra_freeHistory()
 {
-    if (g_cachedRetroArchHistory != NULL) {
-        cJSON_Delete(g_cachedRetroArchHistory);
-        g_cachedRetroArchHistory = NULL;
+    if (g_raHistoryIndex != NULL) {
+        if (g_raHistoryIndexMapped)
+            munmap((void *)g_raHistoryIndex, g_raHistoryIndexSize);
+        else
+            free((void *)g_raHistoryIndex);
     }
+    g_raHistoryIndex = NULL;
+    g_raHistoryLoaded = false;
 }
 
-bool ra_findItemInRetroArchHistory(Game_s *game)
+bool ra_loadHistory(const char *lplPath)
 {
-    if (g_cachedRetroArchHistory == NULL && !ra_loadHistory(HISTORY_PATH)) {
-        print_debug("Error loading RetroArch history");
+    struct stat st;
+
+    ra_freeHistory();
+    g_raHistoryLoaded = true;
+
+    if (stat(lplPath, &st) != 0) {
+        print_debug("Error opening RetroArch history");
         return false;
     }
 
-    cJSON *items = cJSON_GetObjectItemCaseSensitive(g_cachedRetroArchHistory, "items");
-    if (!cJSON_IsArray(items)) {
+    return _ra_mapHistoryIndex(lplPath, &st) || _ra_buildHistoryIndex(lplPath, &st);
+}
+
+bool ra_findItemInRetroArchHistory(Game_s *game)
+{
+    if (!g_raHistoryLoaded)
+        ra_loadHistory(HISTORY_PATH);
+
+    if (g_raHistoryIndex == NULL)
         return false;
-    }
 
     char *cleanPath = file_resolvePath(game->recentItem.rompath);
     if (cleanPath == NULL) {
         return false;
     }
 
-    printf_debug("Searching for: %s\n", cleanPath);
+    const RaHistoryEntry_s *entries = RA_HISTORY_ENTRIES(g_raHistoryIndex);
+    const char *pool = RA_HISTORY_POOL(g_raHistoryIndex);
+    uint32_t mask = g_raHistoryIndex->capacity - 1;
+    uint32_t hash = hash_str(cleanPath);
+    bool found = false;
 
-    cJSON *item;
-    cJSON_ArrayForEach(item, items)
-    {
-        cJSON *path = cJSON_GetObjectItemCaseSensitive(item, "path");
-        if (cJSON_IsString(path) && (path->valuestring != NULL)) {
-            if (strcmp(path->valuestring, cleanPath) == 0) {
-                // Found the matching item
-                cJSON *core_path = cJSON_GetObjectItemCaseSensitive(item, "core_path");
+    for (uint32_t slot = hash & mask; entries[slot].path != 0; slot = (slot + 1) & mask) {
+        if (entries[slot].hash != hash || strcmp(pool + entries[slot].path, cleanPath) != 0)
+            continue;
 
-                if (cJSON_IsString(core_path) && (core_path->valuestring != NULL)) {
-                    strncpy(game->core_path, core_path->valuestring, sizeof(game->core_path) - 1);
-                }
+        strncpy(game->core_path, pool + entries[slot].core_path, sizeof(game->core_path) - 1);
+        if (strlen(game->core_name) == 0)
+            strncpy(game->core_name, pool + entries[slot].core_name, sizeof(game->core_name) - 1);
 
-                printf_debug("Found item in RetroArch history: %s\n", path->valuestring);
-                printf_debug("Core path: %s\n", game->core_path);
-
-                free(cleanPath);
-                return true;
-            }
-        }
+        printf_debug("Found item in RetroArch history: %s\n", cleanPath);
+        printf_debug("Core path: %s\n", game->core_path);
+        found = true;
+        break;
     }
 
     free(cleanPath);
-    return false;
+    return found;
 }
 
 void ra_getCoreNameFromInfo(Game_s *game)
@@ -100,65 +339,30 @@ void ra_getCoreNameFromInfo(Game_s *game)
             return;
         }
 
-        char *basePath = file_removeExtension(game->core_path);
-        if (basePath != NULL) {
-            char infoPath[STR_MAX * 2];
-            snprintf(infoPath, sizeof(infoPath), "%s.info", basePath);
-            file_parseKeyValue(infoPath, "corename", game->core_name, '=', 0);
-            printf_debug("Core name: %s\n", game->core_name);
-            free(basePath);
-        }
-    }
-}
-bool ra_getBoolFromConfig(const char *cfg_path, bool *out_value, const char *key)
-{
-    char value[STR_MAX * 2];
-    file_parseKeyValue(cfg_path, key, value, '=', 0);
-    if (strcmp(value, "true") == 0) {
-        *out_value = true;
-        return true;
+        _ra_coreNameFromInfo(game->core_path, game->core_name, sizeof(game->core_name));
+        printf_debug("Core name: %s\n", game->core_name);
     }
-    else if (strcmp(value, "false") == 0) {
-        *out_value = false;
-        return true;
-    }
-    return false;
 }
 
 bool ra_getConfigOverrideOption(const Game_s *game, const char *key, bool defaultValue)
 {
-    bool result = false;
-    char cfg_path[4096];
-
-    // Game override
-    snprintf(cfg_path, sizeof(cfg_path), CONFIG_DIR "/%s/%s.cfg", game->core_name, game->rom_name);
-    if (ra_getBoolFromConfig(cfg_path, &result, key)) {
-        printf_debug("Game override: %s=%s\n", key, result ? "true" : "false");
-        return result;
-    }
+    char game_cfg[STR_MAX * 2], dir_cfg[STR_MAX * 2], core_cfg[STR_MAX * 2];
+    bool result = defaultValue;
 
-    // Content directory override
     char *contentDir = file_dirname(game->recentItem.rompath);
-    snprintf(cfg_path, sizeof(cfg_path), CONFIG_DIR "/%s/%s.cfg", game->core_name, file_basename(contentDir));
+    snprintf(game_cfg, sizeof(game_cfg), CONFIG_DIR "/%s/%s.cfg", game->core_name, game->rom_name);
+    snprintf(dir_cfg, sizeof(dir_cfg), CONFIG_DIR "/%s/%s.cfg", game->core_name, file_basename(contentDir));
+    snprintf(core_cfg, sizeof(core_cfg), CONFIG_DIR "/%s/%s.cfg", game->core_name, game->core_name);
     free(contentDir);
-    if (ra_getBoolFromConfig(cfg_path, &result, key)) {
-        printf_debug("Content directory override: %s=%s\n", key, result ? "true" : "false");
-        return result;
-    }
 
-    // Core override
-    snprintf(cfg_path, sizeof(cfg_path), CONFIG_DIR "/%s/%s.cfg", game->core_name, game->core_name);
-    if (ra_getBoolFromConfig(cfg_path, &result, key)) {
-        printf_debug("Core override: %s=%s\n", key, result ? "true" : "false");
-        return result;
-    }
+    // Highest precedence first, as RetroArch applies them
+    const char *layers[] = {game_cfg, dir_cfg, core_cfg, RETROARCH_CONFIG_PATH};
+    int layer = ra_config_getLayeredBool(layers, 4, key, &result);
 
-    // Global override
-    if (ra_getBoolFromConfig(RETROARCH_CONFIG_PATH, &result, key)) {
-        return result;
-    }
+    if (layer != -1)
+        printf_debug("Override (%s): %s=%s\n", layers[layer], key, result ? "true" : "false");
 
-    return defaultValue;
+    return result;
 }
 
 #endif // GAME_SWITCHER_RETROARCH_H
\ No newline at end of file
@@ -2,27 +2,17 @@
 #define GAME_SWITCHER_ROMSCREEN_H
 
 #include <SDL/SDL_image.h>
+#include <sys/stat.h>
 
 #include "system/screenshot.h"
+#include "utils/imageCache.h"
+#include "utils/scaler.h"
 
 #include "gs_model.h"
 #include "gs_retroarch.h"
 
-static bool __initial_romscreens_loaded = false;
-static pthread_t romscreen_thread_pt;
-static pthread_mutex_t thread_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-void unloadRomScreen(int index)
-{
-    if (index < 0 || index >= game_list_len)
-        return;
-    Game_s *game = &game_list[index];
-
-    if (game->romScreen != NULL) {
-        SDL_FreeSurface(game->romScreen);
-        game->romScreen = NULL;
-    }
-}
+#define ROMSCREEN_CACHE_RADIUS 3
+#define ROMSCREEN_CACHE_BUDGET (16 * 1024 * 1024)
 
 typedef enum {
     ROM_SCREEN_NONE = 0,
@@ -65,11 +55,11 @@ typedef struct {
     bool integerScaling;
 } ScalingMode_s;
 
-void scaleRomScreen(Game_s *game, ScalingMode_s mode)
+SDL_Surface *scaleRomScreen(SDL_Surface *romScreen, ScalingMode_s mode)
 {
     // Zoom the image to fit the screen
-    double zx = (double)(DISPLAY_WIDTH) / game->romScreen->w;
-    double zy = (double)(DISPLAY_HEIGHT) / game->romScreen->h;
+    double zx = (double)(DISPLAY_WIDTH) / romScreen->w;
+    double zy = (double)(DISPLAY_HEIGHT) / romScreen->h;
 
     if (mode.integerScaling) {
         zx = (int)zx;
@@ -87,9 +77,9 @@ void scaleRomScreen(Game_s *game, ScalingMode_s mode)
             zx = zy;
     }
 
-    SDL_Surface *zoomed = zoomSurface(game->romScreen, zx, zy, SMOOTHING_OFF);
-    SDL_FreeSurface(game->romScreen);
-    game->romScreen = zoomed;
+    SDL_Surface *zoomed = scaler_zoomSurface(romScreen, zx, zy, SMOOTHING_OFF);
+    SDL_FreeSurface(romScreen);
+    return zoomed;
 }
 
 ScalingMode_s getDynamicScalingMode(const Game_s *game)
@@ -100,43 +90,70 @@ ScalingMode_s getDynamicScalingMode(const Game_s *game)
     };
 }
 
-SDL_Surface *loadRomScreen(int index)
+/**
+ * @brief Image cache loader, decodes and scales off the UI thread
+ */
+static SDL_Surface *_loadRomScreenByIndex(int index, void *_)
 {
     if (index < 0 || index >= game_list_len)
         return NULL;
 
     Game_s *game = &game_list[index];
 
-    pthread_mutex_lock(&thread_mutex);
-
-    if (game->romScreen == NULL && game->processed) {
-        char currPicture[STR_MAX * 2];
-        RomScreenType_e romScreenType = findRomScreen(game, currPicture);
-        if (romScreenType != ROM_SCREEN_NONE) {
-            game->romScreen = IMG_Load(currPicture);
-
-            if (game->romScreen == NULL) {
-                printf_debug("Error loading image: %s\n", currPicture);
-            }
-            else if (romScreenType == ROM_SCREEN_STATE) {
-                scaleRomScreen(game, getDynamicScalingMode(game));
-            }
-            else {
-                scaleRomScreen(game, (ScalingMode_s){true, false});
-            }
-        }
-    }
+    // Already have the framebuffer capture of the running game
+    if (game->romScreen != NULL)
+        return NULL;
 
-    if (__initial_romscreens_loaded) {
-        unloadRomScreen(index + 5);
-        if (index > 5) {
-            unloadRomScreen(index - 5);
-        }
+    char currPicture[STR_MAX * 2];
+    RomScreenType_e romScreenType = findRomScreen(game, currPicture);
+
+    if (romScreenType == ROM_SCREEN_NONE)
+        return NULL;
+
+    SDL_Surface *romScreen = IMG_Load(currPicture);
+
+    if (romScreen == NULL) {
+        printf_debug("Error loading image: %s\n", currPicture);
+        return NULL;
     }
 
-    pthread_mutex_unlock(&thread_mutex);
+    struct stat st;
+    game->romScreen_mtime = stat(currPicture, &st) == 0 ? st.st_mtime : 0;
+
+    if (romScreenType == ROM_SCREEN_STATE)
+        return scaleRomScreen(romScreen, getDynamicScalingMode(game));
 
-    return game->romScreen;
+    return scaleRomScreen(romScreen, (ScalingMode_s){true, false});
+}
+
+SDL_Surface *loadRomScreen(int index)
+{
+    if (index < 0 || index >= game_list_len)
+        return NULL;
+
+    Game_s *game = &game_list[index];
+
+    // The framebuffer capture of the running game takes precedence
+    if (game->romScreen != NULL)
+        return game->romScreen;
+
+    imageCache_setCursor(index, ROMSCREEN_CACHE_RADIUS);
+    return imageCache_getItem(index);
+}
+
+/**
+ * @brief Whether the rom screen decoded for `game` is still the one on
+ * disk (a resident gameSwitcher keeps them across sessions)
+ */
+bool isRomScreenCurrent(const Game_s *game)
+{
+    char currPicture[STR_MAX * 2];
+    struct stat st;
+
+    if (game->romScreen_mtime == 0 || findRomScreen(game, currPicture) == ROM_SCREEN_NONE)
+        return false;
+
+    return stat(currPicture, &st) == 0 && st.st_mtime == game->romScreen_mtime;
 }
 
 void freeRomScreens()
@@ -149,25 +166,31 @@ void freeRomScreens()
             game->romScreen = NULL;
         }
     }
+
+    imageCache_freeAll();
 }
 
-static void *_loadRomScreensThread(void *_)
+/**
+ * @brief Syncs the image cache with the game list and starts prefetching
+ * around the current game
+ *
+ * @param current_game
+ */
+void loadRomScreens(int current_game)
 {
-    for (int i = 0; i < 10 && i < game_list_len; i++) {
-        Game_s *game = &game_list[i];
-
-        if (game->romScreen == NULL)
-            loadRomScreen(i);
-    }
+    static bool source_set = false;
 
-    __initial_romscreens_loaded = true;
+    imageCache_init(IMAGECACHE_DEFAULT_WORKERS, ROMSCREEN_CACHE_BUDGET);
 
-    return NULL;
-}
+    if (!source_set) {
+        imageCache_setSource(_loadRomScreenByIndex, NULL, game_list_len);
+        source_set = true;
+    }
+    else {
+        imageCache_setTotal(game_list_len);
+    }
 
-void loadRomScreens()
-{
-    pthread_create(&romscreen_thread_pt, NULL, _loadRomScreensThread, NULL);
+    imageCache_setCursor(current_game, ROMSCREEN_CACHE_RADIUS);
 }
 
 #endif // GAME_SWITCHER_ROMSCREEN_H
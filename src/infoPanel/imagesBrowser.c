@@ -1,135 +1,68 @@
 #include "imagesBrowser.h"
 
-#include <ctype.h>
 #include <dirent.h>
-#include <linux/limits.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
+#include <strings.h>
 
-#define STR_MAX 256
+#include "utils/dirList.h"
 
-static const char *getFilenameExt(const char *filename)
-{
-    const char *dot = strrchr(filename, '.');
-    if (!dot || dot == filename)
-        return "";
-    return dot + 1;
-}
-
-static char *toLower(char *s)
-{
-    for (char *p = s; *p; p++) {
-        *p = tolower(*p);
-    }
-    return s;
-}
+static DirList_s g_images_dir;
+static char **g_images_dir_paths = NULL;
 
-static bool getImagePath(const char *dir_path, const struct dirent *ent,
-                         char *image_path)
+static bool isImage(const char *filename, unsigned char type, void *userdata)
 {
-    const int ext_size = 50;
-    char ext[ext_size];
-    const char *filename = ent->d_name;
-    if (filename[0] == '.' || S_ISDIR(ent->d_type & DT_DIR)) {
+    if (filename[0] == '.' || type == DT_DIR) {
         return false;
     }
-    strncpy(ext, getFilenameExt(filename), ext_size);
-    const char *fileExt = toLower(ext);
-    if (strcmp(fileExt, "png") == 0 || strcmp(fileExt, "jpg") == 0 ||
-        strcmp(fileExt, "jpeg") == 0) {
-        char full_path[PATH_MAX];
-        sprintf(full_path, "%s%s", dir_path, filename);
-        strcpy(image_path, full_path);
-        return true;
-    }
-    return false;
-}
-
-static int getImagesCount(const char *dir_path)
-{
-    int images_count = 0;
-
-    DIR *dir = opendir(dir_path);
-    if (dir == NULL) {
-        return 0;
-    }
-
-    struct dirent *ent;
-
-    while ((ent = readdir(dir)) != NULL) {
-        char image_path[PATH_MAX];
-        const bool is_image = getImagePath(dir_path, ent, image_path);
-        if (is_image) {
-            images_count++;
-        }
+    const char *dot = strrchr(filename, '.');
+    if (!dot) {
+        return false;
     }
-
-    closedir(dir);
-
-    return images_count;
-}
-
-int compare_strings(const void *a, const void *b)
-{
-    const char *aa = *(const char **)a;
-    const char *bb = *(const char **)b;
-    return strcmp(aa, bb);
+    return strcasecmp(dot, ".png") == 0 || strcasecmp(dot, ".jpg") == 0 ||
+           strcasecmp(dot, ".jpeg") == 0;
 }
 
 bool loadImagesPathsFromDir(const char *dir_path, char ***images_paths,
                             int *images_paths_count)
 {
-    char normalized_dir_path[PATH_MAX];
-    const int dir_path_length = strlen(dir_path);
-    if (dir_path_length == 0) {
-        return false;
-    }
-    if (dir_path[dir_path_length - 1] != '/') {
-        sprintf(normalized_dir_path, "%s/", dir_path);
-    }
-    else {
-        strcpy(normalized_dir_path, dir_path);
-    }
-
-    const int images_count = getImagesCount(normalized_dir_path);
-
-    DIR *dir = opendir(normalized_dir_path);
+    imagesBrowser_free();
 
-    if (dir == NULL) {
+    if (!dirList_open(&g_images_dir, dir_path, isImage, NULL)) {
+        dirList_free(&g_images_dir);
         return false;
     }
 
-    struct dirent *ent;
+    // One pass over the names, only the first screen is sorted right away
+    *images_paths_count = dirList_readAll(&g_images_dir);
+    dirList_sort(&g_images_dir, DIRLIST_SORT_NAME, IMAGES_BROWSER_FIRST_SCREEN);
 
-    *images_paths_count = 0;
-    *images_paths = (char **)malloc(images_count * sizeof(char *));
+    // Paths are filled in by imagesBrowser_preparePaths()
+    *images_paths = (char **)calloc(*images_paths_count + 1, sizeof(char *));
+    g_images_dir_paths = *images_paths;
+    imagesBrowser_preparePaths(*images_paths, 0, IMAGES_BROWSER_FIRST_SCREEN);
 
-    while ((ent = readdir(dir)) != NULL) {
-        char image_path[PATH_MAX];
-        const bool is_image =
-            getImagePath(normalized_dir_path, ent, image_path);
+    return *images_paths != NULL;
+}
 
-        if (!is_image) {
-            continue;
-        }
+void imagesBrowser_preparePaths(char **images_paths, int index, int radius)
+{
+    if (images_paths == NULL || images_paths != g_images_dir_paths) {
+        return;
+    }
 
-        (*images_paths)[*images_paths_count] =
-            (char *)malloc(PATH_MAX * sizeof(char));
-        strcpy((*images_paths)[*images_paths_count], image_path);
-        (*images_paths_count)++;
+    const int count = dirList_count(&g_images_dir);
 
-        if ((*images_paths_count) >= images_count) {
-            // we found more images than allocated memory
-            // TODO: handle this
-            break;
+    for (int i = index - radius; i <= index + radius; i++) {
+        if (i >= 0 && i < count && images_paths[i] == NULL) {
+            images_paths[i] = dirList_pathDup(&g_images_dir, i);
         }
     }
+}
 
-    closedir(dir);
-
-    qsort(*images_paths, *images_paths_count, sizeof(char *), compare_strings);
-
-    return true;
-}
\ No newline at end of file
+void imagesBrowser_free(void)
+{
+    // The paths array itself belongs to the caller
+    g_images_dir_paths = NULL;
+    dirList_free(&g_images_dir);
+}
@@ -3,7 +3,22 @@
 
 #include <stdbool.h>
 
+#define IMAGES_BROWSER_FIRST_SCREEN 3 // the first image and the cache look-ahead
+
+/**
+ * @brief List the images in `dir_path`, sorted by name. The array has an
+ * entry per image but only the first few paths are filled in, the others
+ * stay NULL until imagesBrowser_preparePaths() reaches them.
+ */
 bool loadImagesPathsFromDir(const char *dir_path, char ***images_paths,
                             int *images_paths_count);
 
-#endif // IMAGES_BROWSER_H__
\ No newline at end of file
+/**
+ * @brief Fill in the paths within `radius` of `index`, call before the
+ * image cache moves there. Does nothing for arrays from elsewhere.
+ */
+void imagesBrowser_preparePaths(char **images_paths, int index, int radius);
+
+void imagesBrowser_free(void);
+
+#endif // IMAGES_BROWSER_H__
@@ -4,11 +4,12 @@
 #include <SDL/SDL_image.h>
 #include <SDL/SDL_rotozoom.h>
 
+#include "imagesCache.h"
+#include "utils/imageCache.h"
 #include "utils/log.h"
+#include "utils/scaler.h"
 
-static SDL_Surface *g_image_cache_prev = NULL;
-static SDL_Surface *g_image_cache_current = NULL;
-static SDL_Surface *g_image_cache_next = NULL;
+#define IMAGES_CACHE_BUDGET (8 * 1024 * 1024)
 
 #ifdef LOG_DEBUG
 #define DEBUG_PRINT(x) printf x
@@ -27,7 +28,7 @@ SDL_Surface *scaleImageIfNecessary(SDL_Surface *image, SDL_Rect target, bool str
         double ratio_y = (double)target.h / image->h;
         double scale = MIN(ratio_x, ratio_y);
 
-        SDL_Surface *scaledImage = zoomSurface(image, scale, scale, SMOOTHING_OFF);
+        SDL_Surface *scaledImage = scaler_zoomSurface(image, scale, scale, SMOOTHING_OFF);
 
         if (scaledImage) {
             printf_debug("scaled image from %dx%d to %dx%d\n", image->w, image->h, scaledImage->w, scaledImage->h);
@@ -41,38 +42,6 @@ SDL_Surface *scaleImageIfNecessary(SDL_Surface *image, SDL_Rect target, bool str
     return NULL;
 }
 
-SDL_Surface *loadImage(const char *image_path, SDL_Surface *screen)
-{
-    DEBUG_PRINT(("loadImage: %s\n", image_path));
-    if (!image_path) {
-        printf("Error: Image path is NULL\n");
-        return NULL;
-    }
-    if (strlen(image_path) == 0) {
-        printf("Error: Image path is empty\n");
-        return NULL;
-    }
-    if (!screen) {
-        printf("Error: Screen is NULL\n");
-        return NULL;
-    }
-    DEBUG_PRINT(("Loading image: %s\n", image_path));
-    SDL_Surface *image = IMG_Load(image_path);
-
-    if (!image) {
-        printf("Error loading image: %s\n", image_path);
-        return NULL;
-    }
-
-    SDL_Surface *scaledImage = scaleImageIfNecessary(image, screen->clip_rect, false);
-    if (scaledImage) {
-        SDL_FreeSurface(image);
-        return scaledImage;
-    }
-
-    return image;
-}
-
 SDL_Rect getCenterPos(SDL_Surface *image, SDL_Rect target)
 {
     SDL_Rect image_pos = {
@@ -105,9 +74,31 @@ void drawImage(SDL_Surface *image, SDL_Surface *screen, const SDL_Rect *frame)
     SDL_BlitSurface(image, NULL, screen, &image_pos);
 }
 
+static bool g_images_loaded = false;
+static SDL_Rect g_images_target = {0, 0, 640, 480};
+
+static SDL_Surface *_loadImageByIndex(int index, void *userdata)
+{
+    char **images_paths = (char **)userdata;
+    SDL_Surface *image = IMG_Load(images_paths[index]);
+
+    if (!image) {
+        printf("Error loading image: %s\n", images_paths[index]);
+        return NULL;
+    }
+
+    SDL_Surface *scaledImage = scaleImageIfNecessary(image, g_images_target, false);
+    if (scaledImage) {
+        SDL_FreeSurface(image);
+        return scaledImage;
+    }
+
+    return image;
+}
+
 char *drawImageByIndex(const int new_image_index, const int image_index,
                        char **images_paths, const int images_paths_count,
-                       SDL_Surface *screen, SDL_Rect *frame, bool *cache_used)
+                       SDL_Surface *screen, const SDL_Rect *frame, bool *cache_used)
 {
     DEBUG_PRINT(("image_index: %d, new_image_index: %d\n", image_index,
                  new_image_index));
@@ -119,76 +110,30 @@ char *drawImageByIndex(const int new_image_index, const int image_index,
     }
     char *image_path_to_draw = images_paths[new_image_index];
     DEBUG_PRINT(("image_path_to_draw: %s\n", image_path_to_draw));
-    if (new_image_index == image_index) {
-        if (g_image_cache_current == NULL) {
-            DEBUG_PRINT(("invalidating cache\n"));
-            g_image_cache_prev =
-                new_image_index == 0
-                    ? NULL
-                    : loadImage(images_paths[new_image_index - 1], screen);
-            g_image_cache_current = loadImage(images_paths[new_image_index], screen);
-            g_image_cache_next =
-                new_image_index == images_paths_count - 1
-                    ? NULL
-                    : loadImage(images_paths[new_image_index + 1], screen);
-
-            drawImage(g_image_cache_current, screen, frame);
-
-            *cache_used = false;
-            return image_path_to_draw;
-        }
+    if (new_image_index == image_index && !g_images_loaded) {
+        DEBUG_PRINT(("invalidating cache\n"));
+        imageCache_init(IMAGECACHE_DEFAULT_WORKERS, IMAGES_CACHE_BUDGET);
+        g_images_loaded = true;
+        g_images_target = screen->clip_rect;
+        imageCache_setSource(_loadImageByIndex, images_paths, images_paths_count);
+        imageCache_setCursor(new_image_index, IMAGES_CACHE_RADIUS);
+
+        drawImage(imageCache_getItem(new_image_index), screen, frame);
+
+        *cache_used = false;
+        return image_path_to_draw;
     }
     if (abs(new_image_index - image_index) > 1) {
         DEBUG_PRINT(("random jump, not implemented yet\n"));
         return NULL;
     }
 
-    int move_direction = new_image_index - image_index;
-
-    if (move_direction > 0) {
-        DEBUG_PRINT(("moving forward\n"));
-        if (g_image_cache_prev)
-            SDL_FreeSurface(g_image_cache_prev);
-        g_image_cache_prev = g_image_cache_current;
-        g_image_cache_current = g_image_cache_next;
-        if (new_image_index == images_paths_count - 1) {
-            g_image_cache_next = NULL;
-        }
-        else {
-            const int next_image_index = new_image_index + 1;
-            char *image_path_to_load = images_paths[next_image_index];
-            DEBUG_PRINT(("preloading next image '%s' for index #%d\n",
-                         image_path_to_load, next_image_index));
-            g_image_cache_next = loadImage(image_path_to_load, screen);
-        }
-        *cache_used = true;
-    }
-    else if (move_direction < 0) {
-        DEBUG_PRINT(("moving backward\n"));
-
-        if (g_image_cache_next)
-            SDL_FreeSurface(g_image_cache_next);
-        g_image_cache_next = g_image_cache_current;
-        g_image_cache_current = g_image_cache_prev;
-        if (new_image_index == 0) {
-            g_image_cache_prev = NULL;
-        }
-        else {
-            const int prev_image_index = new_image_index - 1;
-            char *image_path_to_load = images_paths[prev_image_index];
-            DEBUG_PRINT(("preloading prev image '%s' for index #%d\n",
-                         image_path_to_load, prev_image_index));
-            g_image_cache_prev = loadImage(image_path_to_load, screen);
-        }
-
-        *cache_used = true;
-    }
-    else {
-        DEBUG_PRINT(("same slide\n"));
-        *cache_used = true;
-    }
+    // Neighbours within the radius are decoded ahead by the workers
+    DEBUG_PRINT(("moving %+d\n", new_image_index - image_index));
+    imageCache_setCursor(new_image_index, IMAGES_CACHE_RADIUS);
+    *cache_used = true;
 
-    drawImage(g_image_cache_current, screen, frame);
+    drawImage(imageCache_getItem(new_image_index), screen, frame);
 
     return image_path_to_draw;
 }
@@ -196,10 +141,6 @@ char *drawImageByIndex(const int new_image_index, const int image_index,
 void cleanImagesCache()
 {
     DEBUG_PRINT(("cleaning images cache\n"));
-    if (g_image_cache_prev)
-        SDL_FreeSurface(g_image_cache_prev);
-    if (g_image_cache_current)
-        SDL_FreeSurface(g_image_cache_current);
-    if (g_image_cache_next)
-        SDL_FreeSurface(g_image_cache_next);
+    imageCache_freeAll();
+    g_images_loaded = false;
 }
@@ -7,8 +7,17 @@ extern "C" {
 
 #include <SDL/SDL.h>
 
+#define IMAGES_CACHE_RADIUS 2
+
 SDL_Surface *scaleImageIfNecessary(SDL_Surface *image, SDL_Rect target, bool stretch);
 void drawImage(SDL_Surface *image_to_draw, SDL_Surface *screen, const SDL_Rect *frame);
+
+/**
+ * @brief Draws the image at `index`. The first call with `index ==
+ * image_index` loads `images_paths` into the cache, later calls reuse it
+ * until cleanImagesCache(), which must be called before switching to
+ * another paths array.
+ */
 char *drawImageByIndex(const int index, const int image_index,
                        char **images_paths, const int images_paths_count,
                        SDL_Surface *screen, const SDL_Rect *frame,
@@ -192,6 +192,7 @@ int main(int argc, char *argv[])
             g_images_paths_count > 0) {
             g_image_index = 0;
             drawBackground();
+            imagesBrowser_preparePaths(g_images_paths, g_image_index, IMAGES_CACHE_RADIUS);
             drawImageByIndex(0, g_image_index, g_images_paths,
                              g_images_paths_count, screen,
                              getControlsAwareFrame(&themedFrame), &cache_used);
@@ -310,6 +311,7 @@ int main(int argc, char *argv[])
                 const int current_index = g_image_index;
                 navigating_forward ? g_image_index++ : g_image_index--;
                 drawBackground();
+                imagesBrowser_preparePaths(g_images_paths, g_image_index, IMAGES_CACHE_RADIUS);
                 drawImageByIndex(g_image_index, current_index, g_images_paths, g_images_paths_count, screen,
                                  getControlsAwareFrame(&themedFrame), &cache_used);
 
@@ -404,6 +406,9 @@ int main(int argc, char *argv[])
             break;
     }
 
+    // The cache workers read the paths, drop it before freeing them
+    cleanImagesCache();
+
     if (g_images_paths != NULL) {
         for (int i = 0; i < g_images_paths_count; i++)
             free(g_images_paths[i]);
@@ -414,6 +419,7 @@ int main(int argc, char *argv[])
             free(g_images_titles[i]);
         free(g_images_titles);
     }
+    imagesBrowser_free();
 
     if (is_persistent) {
         while (!temp_flag_get("dismiss_info_panel")) {
@@ -424,8 +430,6 @@ int main(int argc, char *argv[])
     else if (!wait_confirm)
         msleep(2000);
 
-    cleanImagesCache();
-
     if (static_image != NULL) {
         SDL_FreeSurface(static_image);
     }
@@ -7,6 +7,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "utils/imageBatch.h"
+
 #define ALIGN4K(val) ((val + 4095) & (~4095))
 
 //
@@ -51,6 +53,70 @@ void GFX_BlitSurface(MI_PHY srcPa, void *srcVa, uint32_t sw, uint32_t sh,
     MI_GFX_WaitAllDone(FALSE, Fence);
 }
 
+//
+//	Batch mode decoder, streams rows into the software scaler
+//
+static void batchJpegError(j_common_ptr cinfo)
+{
+    ImageBatchSink_s *sink = (ImageBatchSink_s *)cinfo->client_data;
+    char msg[JMSG_LENGTH_MAX];
+
+    (*cinfo->err->format_message)(cinfo, msg);
+    fprintf(stderr, "%s: %s\n", sink->path, msg);
+    longjmp(sink->jmp, 1);
+}
+
+static bool batchDecodeJpeg(const char *path, ImageBatchSink_s *sink)
+{
+    struct jpeg_decompress_struct jpeg;
+    struct jpeg_error_mgr err;
+    uint32_t dw, dh, y;
+    uint8_t *row;
+    FILE *fp;
+
+    if (!(fp = fopen(path, "rb")))
+        return false;
+
+    jpeg.err = jpeg_std_error(&err);
+    err.error_exit = batchJpegError;
+    jpeg_create_decompress(&jpeg);
+    jpeg.client_data = sink;
+    if (setjmp(sink->jmp)) {
+        jpeg_destroy_decompress(&jpeg);
+        fclose(fp);
+        return false;
+    }
+
+    jpeg_stdio_src(&jpeg, fp);
+    jpeg_read_header(&jpeg, TRUE);
+    jpeg.out_color_space = JCS_RGB;
+    imageBatch_fit(sink->max_w, sink->max_h, jpeg.image_width,
+                   jpeg.image_height, &dw, &dh);
+
+    // Let the DCT do the coarse downscale (1/2, 1/4, 1/8)
+    jpeg.scale_num = 1;
+    jpeg.scale_denom = 1;
+    while (jpeg.scale_denom < 8 &&
+           jpeg.image_width / (jpeg.scale_denom * 2) >= dw &&
+           jpeg.image_height / (jpeg.scale_denom * 2) >= dh)
+        jpeg.scale_denom *= 2;
+
+    jpeg_start_decompress(&jpeg);
+    row = imageBatch_begin(sink, jpeg.output_width, jpeg.output_height, dw,
+                           dh, 3);
+    if (row != NULL) {
+        for (y = 0; y < jpeg.output_height; y++) {
+            jpeg_read_scanlines(&jpeg, &row, 1);
+            imageBatch_pushRow(sink, row);
+        }
+        jpeg_finish_decompress(&jpeg);
+    }
+
+    jpeg_destroy_decompress(&jpeg);
+    fclose(fp);
+    return true;
+}
+
 //
 //	Convert jpeg to png
 //
@@ -68,6 +134,11 @@ int main(int argc, char *argv[])
                                                     mh = 360;
     char filename[256], *ptr;
 
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        ImageBatchConfig_s config = {"jpg2png", "jpg,jpeg", batchDecodeJpeg};
+        return imageBatch_main(argc - 1, argv + 1, &config);
+    }
+
     // Read commandline and open jpg
     if (argc < 2)
         goto usage;
@@ -181,8 +252,9 @@ int main(int argc, char *argv[])
     return 0;
 
 usage:
-    printf("usage: %s filename.jpg [max_width:def=250] [max_height:def=360]\n",
-           argv[0]);
+    printf("usage: %s filename.jpg [max_width:def=250] [max_height:def=360]\n"
+           "       %s --batch <dir|list.txt>... [-o out_dir] [-w max_width] [-h max_height] [-j workers]\n",
+           argv[0], argv[0]);
 error:
     if (jpgVa)
         MI_SYS_Munmap(jpgVa, ss);
@@ -0,0 +1,322 @@
+#ifndef KEYMON_BLUE_LIGHT_H__
+#define KEYMON_BLUE_LIGHT_H__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils/config.h"
+#include "utils/file.h"
+#include "utils/flags.h"
+#include "utils/log.h"
+
+//
+//    Blue light filter schedule and colour temperature ramps
+//
+//    Same behaviour as `blue_light.sh enable|disable|check`, without the
+//    shell: one timerfd (polled by keymon's main loop) fires at the next
+//    schedule boundary, or every BLF_RAMP_STEP_MS while a ramp is running.
+//    Setting the clock (NTP, RTC) cancels the timer so the schedule is
+//    evaluated again.
+//
+
+#define BLF_DISP_PROC "/proc/mi_modules/mi_disp/mi_disp0"
+#define BLF_DISP_INIT "/mnt/SDCARD/.tmp_update/bin/disp_init"
+#define BLF_SCRIPT_LOCK "/tmp/blue_light_script.lock"
+#define BLF_TIMEZONE_PATH CONFIG_PATH ".tz"
+#define BLF_NEUTRAL_RGB 8421504 // R, G, B = 128
+#define BLF_RAMP_STEPS 20
+#define BLF_RAMP_STEP_MS 50
+#define BLF_DISP_INIT_MS 2500
+#define BLF_LOCK_RETRY_MS 1000
+
+#ifndef TFD_TIMER_CANCEL_ON_SET
+#define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+#endif
+
+typedef struct {
+    int timer_fd;
+    bool ramping;
+    bool enable; // filter state once the ramp ends
+    int step;
+    int from_rgb;
+    int to_rgb;
+    int current_rgb;
+} BlueLight_s;
+
+static int _blueLight_levelRGB(int level)
+{
+    static const int levels[][3] = {
+        {140, 125, 110},
+        {140, 120, 100},
+        {140, 115, 90},
+        {140, 110, 80},
+        {140, 105, 70},
+    };
+
+    if (level < 0 || level >= sizeof(levels) / sizeof(levels[0]))
+        return BLF_NEUTRAL_RGB;
+
+    return (levels[level][0] << 16) | (levels[level][1] << 8) | levels[level][2];
+}
+
+static void _blueLight_setTimer(BlueLight_s *blf, uint32_t delay_ms, uint32_t interval_ms)
+{
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = delay_ms / 1000;
+    spec.it_value.tv_nsec = (delay_ms % 1000) * 1000000L;
+    spec.it_interval.tv_sec = interval_ms / 1000;
+    spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+    timerfd_settime(blf->timer_fd, 0, &spec, NULL);
+}
+
+static void _blueLight_writeCSC(int rgb)
+{
+    char cmd[64];
+    int fd = open(BLF_DISP_PROC, O_WRONLY);
+
+    if (fd == -1)
+        return;
+
+    int len = snprintf(cmd, sizeof(cmd), "colortemp 0 0 0 0 %d %d %d\n",
+                       rgb & 0xFF, (rgb >> 8) & 0xFF, (rgb >> 16) & 0xFF);
+    write(fd, cmd, len);
+    close(fd);
+}
+
+static int _blueLight_rampValue(int from, int to, int step)
+{
+    int value = 0;
+    for (int shift = 0; shift <= 16; shift += 8) {
+        int last = (from >> shift) & 0xFF;
+        int end = (to >> shift) & 0xFF;
+        value |= (last + (end - last) * step / BLF_RAMP_STEPS) << shift;
+    }
+    return value;
+}
+
+static int _blueLight_configRGB(void)
+{
+    int rgb = BLF_NEUTRAL_RGB;
+    config_get("display/blueLightRGB", CONFIG_INT, &rgb);
+    return rgb;
+}
+
+static bool _blueLight_isOn(BlueLight_s *blf)
+{
+    return blf->ramping ? blf->enable : temp_flag_get(".blfOn");
+}
+
+static void _blueLight_finishRamp(BlueLight_s *blf)
+{
+    blf->ramping = false;
+    _blueLight_setTimer(blf, 0, 0);
+
+    if (blf->enable) {
+        config_setNumber("display/blueLightRGB", blf->to_rgb);
+        temp_flag_set(".blfOn", true);
+        config_flag_set(".blfOn", true);
+        print_debug("Blue light filter: enabled");
+    }
+    else {
+        temp_flag_set(".blfOn", false);
+        config_flag_set(".blfOn", false);
+        print_debug("Blue light filter: disabled");
+    }
+}
+
+static void _blueLight_startRamp(BlueLight_s *blf, bool enable)
+{
+    int level = 0;
+
+    // A ramp that's cut short continues from where it was
+    if (blf->ramping)
+        blf->from_rgb = blf->current_rgb;
+    else if (enable)
+        blf->from_rgb = temp_flag_get(".blfOn") ? _blueLight_configRGB() : BLF_NEUTRAL_RGB;
+    else
+        blf->from_rgb = _blueLight_configRGB();
+
+    config_get("display/blueLightLevel", CONFIG_INT, &level);
+    blf->to_rgb = enable ? _blueLight_levelRGB(level) : BLF_NEUTRAL_RGB;
+    blf->current_rgb = blf->from_rgb;
+    blf->enable = enable;
+    blf->ramping = true;
+    blf->step = 0;
+
+    if (!exists(BLF_DISP_PROC)) {
+        // The display driver isn't up yet (early boot)
+        system(BLF_DISP_INIT " &");
+        _blueLight_setTimer(blf, BLF_DISP_INIT_MS, BLF_RAMP_STEP_MS);
+        return;
+    }
+
+    _blueLight_writeCSC(blf->current_rgb);
+    _blueLight_setTimer(blf, BLF_RAMP_STEP_MS, BLF_RAMP_STEP_MS);
+}
+
+static int _blueLight_parseTime(const char *time_str)
+{
+    int hour = 0, minute = 0;
+    sscanf(time_str, "%d:%d", &hour, &minute);
+    return hour * 60 + minute;
+}
+
+static void _blueLight_loadTimezone(void)
+{
+    char *tz = file_read(BLF_TIMEZONE_PATH);
+    if (tz == NULL)
+        return;
+    tz[strcspn(tz, "\r\n")] = '\0';
+    setenv("TZ", tz, 1);
+    tzset();
+    free(tz);
+}
+
+/**
+ * @brief Apply the schedule now and arm the timer for its next boundary.
+ * Call again when the schedule settings change.
+ */
+void blueLight_schedule(BlueLight_s *blf)
+{
+    char time_on[16], time_off[16];
+
+    if (blf->ramping)
+        return; // evaluated again once the ramp ends
+
+    _blueLight_setTimer(blf, 0, 0);
+
+    if (!config_flag_get(".blf") || temp_flag_get(".blfIgnoreSchedule"))
+        return;
+
+    if (exists(BLF_SCRIPT_LOCK)) {
+        // Tweaks is running blue_light.sh, let it finish
+        _blueLight_setTimer(blf, BLF_LOCK_RETRY_MS, 0);
+        return;
+    }
+
+    if (!temp_flag_get(".blfOn") && config_flag_get(".blfOn"))
+        config_flag_set(".blfOn", false);
+
+    if (!config_get("display/blueLightTime", CONFIG_STR, time_on) ||
+        !config_get("display/blueLightTimeOff", CONFIG_STR, time_off))
+        return;
+
+    _blueLight_loadTimezone();
+
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+
+    int now_min = local.tm_hour * 60 + local.tm_min;
+    int on_min = _blueLight_parseTime(time_on);
+    int off_min = _blueLight_parseTime(time_off);
+    bool active;
+
+    if (off_min < on_min)
+        active = now_min >= on_min || now_min < off_min;
+    else
+        active = now_min >= on_min && now_min < off_min;
+
+    if (active != temp_flag_get(".blfOn")) {
+        _blueLight_startRamp(blf, active);
+        return;
+    }
+
+    // Sleep until the next on/off minute
+    int now_s = now_min * 60 + local.tm_sec;
+    int delay_s = 24 * 60 * 60;
+    int boundaries[] = {on_min * 60, off_min * 60};
+
+    for (int i = 0; i < 2; i++) {
+        int delta = (boundaries[i] - now_s + 24 * 60 * 60) % (24 * 60 * 60);
+        if (delta > 0 && delta < delay_s)
+            delay_s = delta;
+    }
+
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = now + delay_s;
+    timerfd_settime(blf->timer_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL);
+    printf_debug("Blue light filter: next check in %ds\n", delay_s);
+}
+
+/**
+ * @brief Set up the timer and restore the filter state at startup.
+ */
+bool blueLight_init(BlueLight_s *blf)
+{
+    memset(blf, 0, sizeof(BlueLight_s));
+    blf->timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (blf->timer_fd == -1) {
+        print_debug("Blue light filter: failed to create timerfd");
+        return false;
+    }
+
+    if (config_flag_get(".blf"))
+        blueLight_schedule(blf);
+    else if (config_flag_get(".blfOn") && !temp_flag_get(".blfOn"))
+        _blueLight_startRamp(blf, true);
+
+    return true;
+}
+
+void blueLight_free(BlueLight_s *blf)
+{
+    if (blf->timer_fd != -1)
+        close(blf->timer_fd);
+    blf->timer_fd = -1;
+}
+
+/**
+ * @brief Turn the filter on or off by hand, which overrides the schedule
+ * until it's enabled again in Tweaks.
+ */
+void blueLight_toggle(BlueLight_s *blf)
+{
+    temp_flag_set(".blfIgnoreSchedule", true);
+    _blueLight_startRamp(blf, !_blueLight_isOn(blf));
+}
+
+/**
+ * @brief Handle the timer becoming readable: next ramp step, or a schedule
+ * boundary / clock change.
+ */
+void blueLight_update(BlueLight_s *blf)
+{
+    uint64_t expirations = 0;
+
+    if (read(blf->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        // ECANCELED: the clock was set
+        if (errno == ECANCELED)
+            blueLight_schedule(blf);
+        return;
+    }
+
+    if (!blf->ramping) {
+        blueLight_schedule(blf);
+        return;
+    }
+
+    // Catch up if keymon was busy, so ramps keep their length
+    if (expirations > BLF_RAMP_STEPS - blf->step)
+        expirations = BLF_RAMP_STEPS - blf->step;
+    blf->step += expirations;
+
+    blf->current_rgb = _blueLight_rampValue(blf->from_rgb, blf->to_rgb, blf->step);
+    _blueLight_writeCSC(blf->current_rgb);
+
+    if (blf->step == BLF_RAMP_STEPS) {
+        _blueLight_finishRamp(blf);
+        blueLight_schedule(blf);
+    }
+}
+
+#endif // KEYMON_BLUE_LIGHT_H__
@@ -36,7 +36,9 @@
 #include "utils/msleep.h"
 #include "utils/process.h"
 #include "utils/str.h"
+#include "utils/writeCache.h"
 
+#include "./blueLight.h"
 #include "./input_fd.h"
 #include "./menuButtonAction.h"
 
@@ -53,6 +55,9 @@
 
 uint32_t suspendpid[PIDMAX];
 
+// Set by SIGUSR2 (runtime.sh, before a state change)
+static volatile sig_atomic_t commit_requested = 0;
+
 const int KONAMI_CODE[] = {HW_BTN_UP, HW_BTN_UP, HW_BTN_DOWN, HW_BTN_DOWN,
                            HW_BTN_LEFT, HW_BTN_RIGHT, HW_BTN_LEFT, HW_BTN_RIGHT,
                            HW_BTN_B, HW_BTN_A};
@@ -118,7 +123,8 @@ int suspend(uint32_t mode)
                 }
                 if ((ppid > 2) &&
                     ((state == 'R') || (state == 'S') || (state == 'D')) &&
-                    (strcmp(comm, "(sh)")) && (!(flags & PF_KTHREAD))) {
+                    (strcmp(comm, "(sh)")) && (!(flags & PF_KTHREAD)) &&
+                    (mode || !process_spawnHasFlags(pid, PROCESS_SPAWN_NO_SUSPEND))) {
                     if (mode) {
                         if ((strcmp(comm, "(runtime.sh)")) &&
                             (strcmp(comm, "(updater)")) &&
@@ -163,11 +169,25 @@ void resume(void)
     }
 }
 
+//
+//    Commit the settings staged by settings_save()
+//
+void commitWrites(void)
+{
+    WriteCacheStats_s stats;
+
+    commit_requested = 0;
+    if (writeCache_flush() > 0 && writeCache_getStats(&stats))
+        printf_debug("Write cache: %u writes requested, %u reached the SD card\n",
+                     stats.requested, stats.written);
+}
+
 //
 //    Quit
 //
 void quit(int exitcode)
 {
+    commitWrites();
     display_close();
     if (input_fd > 0)
         close(input_fd);
@@ -188,8 +208,11 @@ void force_shutdown(void)
     terminate_drastic();
     system_clock_get();
     system_clock_save();
+    commitWrites();
     sync();
-    system("shutdown");
+    // Not queued: with 4 jobs running it would wait for a reap that
+    // never comes, since keymon only pauses from here on
+    process_spawnArgsNow("shutdown");
     while (1)
         pause();
     exit(0);
@@ -205,9 +228,7 @@ void wait(int seconds)
 
 void showBootScreen(const char *type)
 {
-    char cmd[256];
-    sprintf(cmd, "bootScreen \"%s\" &", type);
-    system(cmd);
+    process_spawnArgs(NULL, NULL, "bootScreen", type);
 }
 
 //
@@ -215,6 +236,7 @@ void showBootScreen(const char *type)
 //
 void deepsleep(void)
 {
+    commitWrites();
     system_state_update();
 
     if (system_state == MODE_GAME && !check_autosave()) {
@@ -260,10 +282,11 @@ void deepsleep(void)
 //
 void suspend_exec(int timeout)
 {
+    commitWrites();
     keyinput_disable();
 
-    // pause playActivity
-    system("playActivity stop_all");
+    // pause playActivity (keeps running while the others are stopped)
+    process_spawnArgsFlags(PROCESS_SPAWN_NO_SUSPEND, NULL, NULL, "playActivity", "stop_all");
 
     if (temp_flag_get("stay_awake")) {
         // stay awake (keep processes running and volume on)
@@ -335,8 +358,8 @@ void suspend_exec(int timeout)
     if (!killexit) {
         // resume processes
         resume();
-        // resume playActivity
-        system("playActivity resume");
+        // resume playActivity, after stop_all if it's still running
+        process_spawnArgs(NULL, NULL, "playActivity", "resume");
     }
 
     keyinput_enable();
@@ -419,11 +442,21 @@ void cpuClockHotkey(int adjust)
     }
 }
 
+static void on_sync_done(int status, void *userdata)
+{
+    sync();
+}
+
 static void signal_refresh(int sig)
 {
     display_getRenderResolution();
 }
 
+static void signal_commit(int sig)
+{
+    commit_requested = 1;
+}
+
 //
 //    Main
 //
@@ -433,6 +466,7 @@ int main(void)
     signal(SIGTERM, quit);
     signal(SIGSEGV, quit);
     signal(SIGUSR1, signal_refresh);
+    signal(SIGUSR2, signal_commit);
     log_setName("keymon");
 
     getDeviceModel();
@@ -458,6 +492,15 @@ int main(void)
     fds[0].fd = input_fd;
     fds[0].events = POLLIN;
 
+    BlueLight_s blue_light;
+    blueLight_init(&blue_light);
+    process_spawnInit();
+
+    // Input, the blue light filter timer and exited child processes
+    struct pollfd main_fds[3] = {fds[0],
+                                 {.fd = blue_light.timer_fd, .events = POLLIN},
+                                 {.fd = process_spawnFd(), .events = POLLIN}};
+
     // Main Loop
     uint32_t button_flag = 0;
     uint32_t repeat_LR = 0;
@@ -493,8 +536,21 @@ int main(void)
     time_t fav_last_modified = time(NULL);
 
     while (1) {
-        if (poll(fds, 1, (CHECK_SEC - elapsed_sec) * 1000) > 0) {
-            if (!keyinput_isValid())
+        int timeout = (CHECK_SEC - elapsed_sec) * 1000;
+        int flush_in = writeCache_msUntilFlush();
+        bool flush_wakeup = flush_in >= 0 && flush_in < timeout;
+
+        int ready = poll(main_fds, 3, flush_wakeup ? flush_in : timeout);
+
+        if (commit_requested || writeCache_msUntilFlush() == 0)
+            commitWrites();
+
+        if (ready > 0) {
+            if (main_fds[1].revents & POLLIN)
+                blueLight_update(&blue_light);
+            if (main_fds[2].revents & POLLIN)
+                process_spawnReap();
+            if (!(main_fds[0].revents & POLLIN) || !keyinput_isValid())
                 continue;
             val = ev.value;
 
@@ -505,6 +561,7 @@ int main(void)
                 settings_load();
                 remove("/tmp/settings_changed");
                 sync();
+                blueLight_schedule(&blue_light);
             }
 
             if (exists("/tmp/state_changed")) {
@@ -537,10 +594,8 @@ int main(void)
 
             if (system_state == MODE_MAIN_UI && (ev.code == HW_BTN_B || ev.code == HW_BTN_X) && val == RELEASED) {
                 // Check if favorite file changed
-                if (file_isModified(FAVORITES_PATH, &fav_last_modified)) {
-                    system("tools favfix");
-                    sync();
-                }
+                if (file_isModified(FAVORITES_PATH, &fav_last_modified))
+                    process_spawnArgs(on_sync_done, NULL, "tools", "favfix");
             }
 
             switch (ev.code) {
@@ -813,7 +868,7 @@ int main(void)
             // start screen recording after holding for >2secs
             if (menuAndAPressed && (getMilliseconds() - menuAndAPressedTime >= 2000)) {
                 if (access("/mnt/SDCARD/.tmp_update/config/.recHotkey", F_OK) != -1) {
-                    system("/mnt/SDCARD/.tmp_update/script/screen_recorder.sh toggle &");
+                    process_spawnArgs(NULL, NULL, "/mnt/SDCARD/.tmp_update/script/screen_recorder.sh", "toggle");
                 }
 
                 menuAndAPressed = false;
@@ -822,14 +877,7 @@ int main(void)
 
             // toggle blue light filter
             if (menuAndBPressed && (getMilliseconds() - menuAndBPressedTime >= 2000)) {
-                if (access("/tmp/.blfOn", F_OK) != -1) {
-                    system("/mnt/SDCARD/.tmp_update/script/blue_light.sh disable &");
-                    system("touch /tmp/.blfIgnoreSchedule");
-                }
-                else {
-                    system("/mnt/SDCARD/.tmp_update/script/blue_light.sh enable &");
-                    system("touch /tmp/.blfIgnoreSchedule");
-                }
+                blueLight_toggle(&blue_light);
 
                 menuAndBPressed = false;
                 menuAndBPressedTime = 0;
@@ -857,7 +905,10 @@ int main(void)
             }
 
             if (needWriteSettings && (ticks - save_settings_timestamp) > 150) {
+                // Staged in tmpfs, committed once the changes settle
+                writeCache_begin();
                 settings_save();
+                writeCache_end();
                 needWriteSettings = false;
             }
 
@@ -891,6 +942,12 @@ int main(void)
             if (elapsed_sec < CHECK_SEC)
                 continue;
         }
+        else if (ready < 0 || flush_wakeup) {
+            // Woken up by a signal or to commit writes, not a check yet
+            elapsed_sec = (getMilliseconds() - ticks) / 1000;
+            if (elapsed_sec < CHECK_SEC)
+                continue;
+        }
 
         // Comes here every CHECK_SEC(def:15) seconds interval
         if (delete_flag) {
@@ -921,11 +978,6 @@ int main(void)
             }
         }
 
-        // Check bluelight filter
-        if (settings.blue_light_schedule) {
-            system("/mnt/SDCARD/.tmp_update/script/blue_light.sh check");
-        }
-
         // Quit RetroArch / auto-save when battery too low
         if (settings.low_battery_autosave_at && battery_getPercentage() <= settings.low_battery_autosave_at && check_autosave()) {
             temp_flag_set(".lowBat", true);
@@ -12,6 +12,7 @@
 #include "system/system_utils.h"
 #include "utils/apps.h"
 #include "utils/flags.h"
+#include "utils/process.h"
 
 #include "../tweaks/tools_defs.h"
 #include "./input_fd.h"
@@ -146,7 +147,7 @@ void displaySavingMessage(void)
 {
     if (temp_flag_get(".displaySavingMessage")) {
         temp_flag_set(".displaySavingMessage", false);
-        system("infoPanel --message \"SAVING\" --persistent --romscreen &");
+        process_spawnArgs(NULL, NULL, "infoPanel", "--message", "SAVING", "--persistent", "--romscreen");
         temp_flag_set("dismiss_info_panel", true);
     }
 }
@@ -187,13 +188,26 @@ static void _saveAndQuitRetroArch(bool quickSwitch)
     terminate_retroarch();
 }
 
+static void _onGameSwitcherOverlayDone(int status, void *userdata)
+{
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        temp_flag_set("state_changed", true);
+}
+
 void action_RA_gameSwitcher(void)
 {
     if (exists("/mnt/SDCARD/.tmp_update/.runGameSwitcher"))
         return;
     set_gameSwitcher();
     retroarch_pause();
-    system("(gameSwitcher --overlay && touch /tmp/state_changed) &");
+
+    // A resident gameSwitcher only needs to be shown
+    pid_t pid = process_searchpid(GS_RESIDENT_PROCESS);
+    if (pid == 0 || kill(pid, SIGUSR1) != 0) {
+        const char *mode = config_flag_get(GS_RESIDENT_FLAG) ? "--resident" : "--overlay";
+        process_spawnArgs(_onGameSwitcherOverlayDone, NULL, "gameSwitcher", mode);
+    }
+
     system_state_update();
 }
 
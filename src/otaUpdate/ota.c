@@ -0,0 +1,1280 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "cjson/cJSON.h"
+#include "utils/file.h"
+#include "utils/hash.h"
+#include "utils/log.h"
+#include "utils/sha256.h"
+
+#include "ota.h"
+
+#define OTA_RETRIES 3
+#define OTA_REDIRECTS 5
+#define OTA_TIMEOUT_S 30
+#define OTA_CHUNK_SIZE 65536
+#define OTA_SPACE_MARGIN (16 * 1024 * 1024)
+#define OTA_DELTA_BLOCK 512
+#define OTA_DELTA_MAX_RATIO 0.6
+#define OTA_DELTA_MAGIC "OTD1"
+
+extern char **environ;
+
+static OtaProgressCallback_t _ota_progress_cb = NULL;
+static void *_ota_progress_userdata = NULL;
+
+void ota_setProgressCallback(OtaProgressCallback_t callback, void *userdata)
+{
+    _ota_progress_cb = callback;
+    _ota_progress_userdata = userdata;
+}
+
+const char *ota_statusString(OtaStatus_e status)
+{
+    switch (status) {
+    case OTA_OK:
+        return "OK";
+    case OTA_ERR_MANIFEST:
+        return "invalid or unreachable manifest";
+    case OTA_ERR_DOWNLOAD:
+        return "download failed";
+    case OTA_ERR_VERIFY:
+        return "verification failed";
+    case OTA_ERR_SPACE:
+        return "not enough free space";
+    case OTA_ERR_IO:
+        return "write failed";
+    }
+    return "unknown error";
+}
+
+//
+//    Paths
+//
+
+// Creates the parent directories of `path`
+static bool _ota_mkdirsFor(const char *path)
+{
+    char dir[PATH_MAX];
+
+    snprintf(dir, sizeof(dir), "%s", path);
+
+    for (char *p = dir + 1; *p; p++) {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            printf_debug("ota: can't create %s\n", dir);
+            return false;
+        }
+        *p = '/';
+    }
+
+    return true;
+}
+
+// Manifest paths must stay inside the install root
+static bool _ota_isSafePath(const char *path)
+{
+    if (path == NULL || *path == '\0' || *path == '/' || strlen(path) >= PATH_MAX - 64)
+        return false;
+
+    for (const char *p = path; *p;) {
+        size_t len = strcspn(p, "/");
+        if (len == 0 || (len == 1 && p[0] == '.') || (len == 2 && p[0] == '.' && p[1] == '.'))
+            return false;
+        p += len;
+        if (*p == '/')
+            p++;
+    }
+
+    return strchr(path, '\t') == NULL && strchr(path, '\n') == NULL;
+}
+
+static bool _ota_isSha256(const char *str)
+{
+    if (str == NULL || strlen(str) != SHA256_HEX_SIZE - 1)
+        return false;
+    for (; *str; str++)
+        if (!((*str >= '0' && *str <= '9') || (*str >= 'a' && *str <= 'f')))
+            return false;
+    return true;
+}
+
+// Relative URLs are resolved against the manifest's directory
+static void _ota_resolveUrl(const char *manifest_url, const char *url, char *out, size_t size)
+{
+    const char *slash = strrchr(manifest_url, '/');
+
+    if (strstr(url, "://") != NULL || url[0] == '/' || slash == NULL)
+        snprintf(out, size, "%s", url);
+    else
+        snprintf(out, size, "%.*s%s", (int)(slash - manifest_url + 1), manifest_url, url);
+}
+
+static off_t _ota_fileSize(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) ? st.st_size : -1;
+}
+
+//
+//    Downloads
+//
+//    Everything is written through a sink that hashes and reports progress
+//    on the way, so a finished download is verified without reading it back.
+//
+
+typedef struct {
+    int fd;
+    Sha256_s sha;
+    uint64_t done;
+    uint64_t total; // 0: unknown
+    const char *label;
+} OtaSink_s;
+
+static bool _ota_sinkWrite(OtaSink_s *sink, const void *data, size_t len)
+{
+    const char *bytes = (const char *)data;
+    size_t written = 0;
+
+    while (written < len) {
+        ssize_t ret = write(sink->fd, bytes + written, len - written);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        written += ret;
+    }
+
+    sha256_update(&sink->sha, data, len);
+    sink->done += len;
+
+    if (_ota_progress_cb != NULL)
+        _ota_progress_cb(sink->label, sink->done, sink->total, _ota_progress_userdata);
+
+    return true;
+}
+
+// The server ignored the range, start over
+static bool _ota_sinkReset(OtaSink_s *sink)
+{
+    if (ftruncate(sink->fd, 0) != 0 || lseek(sink->fd, 0, SEEK_SET) != 0)
+        return false;
+    sha256_init(&sink->sha);
+    sink->done = 0;
+    return true;
+}
+
+// Hash what's in the file past `sink->done`, written by someone else
+static bool _ota_sinkCatchUp(OtaSink_s *sink)
+{
+    char buf[OTA_CHUNK_SIZE];
+    ssize_t len;
+
+    while ((len = pread(sink->fd, buf, sizeof(buf), sink->done)) > 0) {
+        sha256_update(&sink->sha, buf, len);
+        sink->done += len;
+    }
+
+    lseek(sink->fd, 0, SEEK_END);
+    return len == 0;
+}
+
+static bool _ota_localGet(const char *path, OtaSink_s *sink)
+{
+    char buf[OTA_CHUNK_SIZE];
+    ssize_t len;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1 || lseek(fd, sink->done, SEEK_SET) != (off_t)sink->done) {
+        if (fd != -1)
+            close(fd);
+        return false;
+    }
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+        if (!_ota_sinkWrite(sink, buf, len))
+            break;
+
+    close(fd);
+    return len == 0;
+}
+
+// No TLS here, https goes through curl which resumes the part file itself
+static bool _ota_curlGet(const char *url, OtaSink_s *sink, const char *part_path)
+{
+    char *argv[] = {"curl", "-k", "-L", "-f", "-s", "-S", "--connect-timeout", "30",
+                    "-C", "-", "-o", (char *)part_path, (char *)url, NULL};
+    pid_t pid;
+    int status = -1;
+
+    if (posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ) != 0)
+        return false;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+        ;
+
+    // curl wrote through its own descriptor
+    bool ok = _ota_sinkCatchUp(sink);
+    if (_ota_progress_cb != NULL)
+        _ota_progress_cb(sink->label, sink->done, sink->total, _ota_progress_userdata);
+
+    return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static const char *_ota_httpHeader(const char *headers, const char *name)
+{
+    size_t name_len = strlen(name);
+
+    for (const char *line = strstr(headers, "\r\n"); line != NULL; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, name, name_len) == 0 && line[2 + name_len] == ':') {
+            const char *value = line + 3 + name_len;
+            while (*value == ' ' || *value == '\t')
+                value++;
+            return value;
+        }
+    }
+
+    return NULL;
+}
+
+static int _ota_httpConnect(const char *host, const char *port)
+{
+    struct addrinfo hints = {0}, *res = NULL;
+    struct timeval timeout = {OTA_TIMEOUT_S, 0};
+    int fd = -1;
+
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(host, port, &hints, &res) != 0)
+        return -1;
+
+    for (struct addrinfo *ai = res; ai != NULL; ai = ai->ai_next) {
+        if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) == -1)
+            continue;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(res);
+    return fd;
+}
+
+static bool _ota_transfer(const char *url, OtaSink_s *sink, const char *part_path, int redirects);
+
+// Plain HTTP/1.0 GET, so the body is never chunked
+static bool _ota_httpGet(const char *url, OtaSink_s *sink, const char *part_path, int redirects)
+{
+    char authority[256], host[256], port[8] = "80";
+    char buf[OTA_CHUNK_SIZE];
+    const char *start = url + strlen("http://");
+    const char *path = strchr(start, '/');
+    size_t authority_len = path ? (size_t)(path - start) : strlen(start);
+    size_t received = 0;
+    char *header_end = NULL;
+    ssize_t len;
+    int status = 0;
+    int fd;
+
+    if (authority_len == 0 || authority_len >= sizeof(authority))
+        return false;
+    memcpy(authority, start, authority_len);
+    authority[authority_len] = '\0';
+    snprintf(host, sizeof(host), "%s", authority);
+
+    char *colon = strrchr(host, ':');
+    char *bracket = strchr(host, ']');
+    if (colon != NULL && (bracket == NULL || bracket < colon)) {
+        *colon = '\0';
+        snprintf(port, sizeof(port), "%s", colon + 1);
+    }
+    if (host[0] == '[') {
+        memmove(host, host + 1, strlen(host));
+        host[strcspn(host, "]")] = '\0';
+    }
+
+    if ((fd = _ota_httpConnect(host, port)) == -1) {
+        printf_debug("ota: can't connect to %s\n", authority);
+        return false;
+    }
+
+    len = snprintf(buf, sizeof(buf),
+                   "GET %s HTTP/1.0\r\nHost: %s\r\nUser-Agent: otaUpdate/%s\r\n"
+                   "Accept-Encoding: identity\r\n",
+                   path ? path : "/", authority, ONION_VERSION);
+    if (sink->done > 0)
+        len += snprintf(buf + len, sizeof(buf) - len, "Range: bytes=%llu-\r\n",
+                        (unsigned long long)sink->done);
+    len += snprintf(buf + len, sizeof(buf) - len, "\r\n");
+
+    if (len >= sizeof(buf) || send(fd, buf, len, MSG_NOSIGNAL) != len) {
+        close(fd);
+        return false;
+    }
+
+    while (header_end == NULL && received < sizeof(buf) - 1) {
+        if ((len = recv(fd, buf + received, sizeof(buf) - 1 - received, 0)) <= 0)
+            break;
+        received += len;
+        buf[received] = '\0';
+        header_end = strstr(buf, "\r\n\r\n");
+    }
+
+    if (header_end == NULL || sscanf(buf, "HTTP/%*d.%*d %d", &status) != 1) {
+        close(fd);
+        return false;
+    }
+    header_end[2] = '\0'; // keep the last "\r\n" for _ota_httpHeader()
+
+    const char *body = header_end + 4;
+    size_t body_len = received - (body - buf);
+    const char *location = _ota_httpHeader(buf, "Location");
+    const char *content_length = _ota_httpHeader(buf, "Content-Length");
+    const char *content_range = _ota_httpHeader(buf, "Content-Range");
+    long long remaining = content_length ? atoll(content_length) : -1;
+
+    if (status >= 300 && status < 400 && location != NULL) {
+        char next[PATH_MAX];
+        size_t location_len = strcspn(location, "\r\n");
+
+        close(fd);
+        if (redirects >= OTA_REDIRECTS || location_len >= sizeof(next))
+            return false;
+
+        if (location[0] == '/')
+            snprintf(next, sizeof(next), "http://%s%.*s", authority, (int)location_len, location);
+        else
+            snprintf(next, sizeof(next), "%.*s", (int)location_len, location);
+
+        return _ota_transfer(next, sink, part_path, redirects + 1);
+    }
+
+    if (status == 200 && sink->done > 0 && !_ota_sinkReset(sink)) {
+        close(fd);
+        return false;
+    }
+
+    unsigned long long range_start = 0;
+    if (status == 206 && (content_range == NULL ||
+                          sscanf(content_range, "bytes %llu-", &range_start) != 1 ||
+                          range_start != sink->done)) {
+        close(fd);
+        return false;
+    }
+
+    if (status != 200 && status != 206) {
+        printf_debug("ota: HTTP %d for %s\n", status, url);
+        close(fd);
+        return false;
+    }
+
+    bool ok = body_len == 0 || _ota_sinkWrite(sink, body, body_len);
+    if (remaining >= 0)
+        remaining -= body_len;
+
+    while (ok && remaining != 0) {
+        size_t want = remaining > 0 && remaining < sizeof(buf) ? (size_t)remaining : sizeof(buf);
+        if ((len = recv(fd, buf, want, 0)) < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            break;
+        ok = _ota_sinkWrite(sink, buf, len);
+        if (remaining > 0)
+            remaining -= len;
+    }
+
+    close(fd);
+
+    // Without a length, only a clean EOF tells us it's complete
+    return ok && len >= 0 && remaining <= 0;
+}
+
+static bool _ota_transfer(const char *url, OtaSink_s *sink, const char *part_path, int redirects)
+{
+    if (strncmp(url, "http://", 7) == 0)
+        return _ota_httpGet(url, sink, part_path, redirects);
+    if (strncmp(url, "https://", 8) == 0)
+        return _ota_curlGet(url, sink, part_path);
+    if (strncmp(url, "file://", 7) == 0)
+        return _ota_localGet(url + 7, sink);
+    return _ota_localGet(url, sink);
+}
+
+/**
+ * @brief Download `url` into `part_path`, continuing from what's already
+ * there, and hash it on the way.
+ *
+ * @param expected_size Final size, or -1 if unknown (no resume then)
+ * @param sha256_out Hash of the whole file (SHA256_HEX_SIZE)
+ * @param downloaded_out Incremented by the bytes transferred
+ */
+static bool _ota_download(const char *url, const char *part_path, int64_t expected_size,
+                          const char *label, char *sha256_out, uint64_t *downloaded_out)
+{
+    OtaSink_s sink = {.label = label, .total = expected_size > 0 ? expected_size : 0};
+    bool complete = false;
+
+    if (!_ota_mkdirsFor(part_path) ||
+        (sink.fd = open(part_path, O_RDWR | O_CREAT | (expected_size < 0 ? O_TRUNC : 0), 0644)) == -1)
+        return false;
+
+    sha256_init(&sink.sha);
+
+    // Resume: the part already written only needs hashing
+    if (!_ota_sinkCatchUp(&sink) || (expected_size >= 0 && sink.done > (uint64_t)expected_size))
+        _ota_sinkReset(&sink);
+
+    uint64_t resumed_at = sink.done;
+
+    for (int attempt = 0; attempt < OTA_RETRIES && !complete; attempt++) {
+        if (expected_size >= 0 && sink.done == (uint64_t)expected_size) {
+            complete = true;
+            break;
+        }
+        if (attempt > 0) {
+            printf_debug("ota: retrying %s from %llu\n", url, (unsigned long long)sink.done);
+            sleep(1);
+        }
+        complete = _ota_transfer(url, &sink, part_path, 0) &&
+                   (expected_size < 0 || sink.done == (uint64_t)expected_size);
+    }
+
+    if (fsync(sink.fd) != 0)
+        complete = false;
+    close(sink.fd);
+
+    if (downloaded_out != NULL && sink.done > resumed_at)
+        *downloaded_out += sink.done - resumed_at;
+
+    if (complete)
+        sha256_finalHex(&sink.sha, sha256_out);
+
+    return complete;
+}
+
+/**
+ * @brief Download `url` (http://, https:// or a local path) to `dest_path`.
+ */
+bool ota_fetch(const char *url, const char *dest_path, uint64_t *downloaded_out)
+{
+    char part_path[PATH_MAX];
+    char sha256[SHA256_HEX_SIZE];
+
+    snprintf(part_path, sizeof(part_path), "%s.part", dest_path);
+
+    if (!_ota_download(url, part_path, -1, file_basename(dest_path), sha256, downloaded_out)) {
+        unlink(part_path);
+        return false;
+    }
+
+    return rename(part_path, dest_path) == 0;
+}
+
+//
+//    Delta patches
+//
+//    "OTD1", new size (u64), then operations until 'E':
+//      'C' offset (u32) length (u32)   copy from the old file
+//      'A' length (u32) bytes          add literal bytes
+//    All integers little-endian.
+//
+
+static void _ota_put32(FILE *fp, uint32_t value)
+{
+    uint8_t bytes[4] = {value, value >> 8, value >> 16, value >> 24};
+    fwrite(bytes, 1, 4, fp);
+}
+
+static bool _ota_get32(FILE *fp, uint32_t *value)
+{
+    uint8_t bytes[4];
+    if (fread(bytes, 1, 4, fp) != 4)
+        return false;
+    *value = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+    return true;
+}
+
+static uint8_t *_ota_readAll(const char *path, size_t *len_out)
+{
+    off_t size = _ota_fileSize(path);
+    uint8_t *data;
+    FILE *fp;
+
+    if (size < 0 || (data = (uint8_t *)malloc(size + 1)) == NULL)
+        return NULL;
+
+    if ((fp = fopen(path, "rb")) == NULL || fread(data, 1, size, fp) != (size_t)size) {
+        if (fp != NULL)
+            fclose(fp);
+        free(data);
+        return NULL;
+    }
+
+    fclose(fp);
+    *len_out = size;
+    return data;
+}
+
+static void _ota_emitLiteral(FILE *fp, const uint8_t *data, size_t len)
+{
+    if (len == 0)
+        return;
+    fputc('A', fp);
+    _ota_put32(fp, len);
+    fwrite(data, 1, len, fp);
+}
+
+static void _ota_emitCopy(FILE *fp, size_t offset, size_t len)
+{
+    fputc('C', fp);
+    _ota_put32(fp, offset);
+    _ota_put32(fp, len);
+}
+
+typedef struct {
+    uint32_t sum;
+    uint32_t block; // index + 1, 0: empty
+} OtaBlockSlot_s;
+
+/**
+ * @brief Write a patch that rebuilds `new_path` from `old_path`. Blocks
+ * of the old file are found anywhere in the new one with a rolling
+ * checksum (rsync style), so inserted or removed bytes don't shift
+ * everything after them into literals.
+ */
+bool ota_makeDelta(const char *old_path, const char *new_path, const char *delta_path)
+{
+    const size_t B = OTA_DELTA_BLOCK;
+    size_t old_len = 0, new_len = 0;
+    uint8_t *old_data = _ota_readAll(old_path, &old_len);
+    uint8_t *new_data = _ota_readAll(new_path, &new_len);
+    OtaBlockSlot_s *table = NULL;
+    uint32_t mask = 0;
+    FILE *fp = NULL;
+    bool ok = false;
+
+    if (old_data == NULL || new_data == NULL || old_len > UINT32_MAX || new_len > UINT32_MAX)
+        goto cleanup;
+
+    size_t blocks = old_len / B;
+    uint32_t capacity = 16;
+    while (capacity < blocks * 2)
+        capacity <<= 1;
+    mask = capacity - 1;
+
+    if ((table = (OtaBlockSlot_s *)calloc(capacity, sizeof(OtaBlockSlot_s))) == NULL)
+        goto cleanup;
+
+    for (size_t i = 0; i < blocks; i++) {
+        uint32_t a = 0, b = 0;
+        for (size_t k = 0; k < B; k++) {
+            a += old_data[i * B + k];
+            b += (B - k) * old_data[i * B + k];
+        }
+        uint32_t sum = (a & 0xffff) | (b << 16);
+        uint32_t slot = (sum * 2654435761u) & mask;
+        while (table[slot].block != 0)
+            slot = (slot + 1) & mask;
+        table[slot] = (OtaBlockSlot_s){sum, i + 1};
+    }
+
+    if ((fp = fopen(delta_path, "wb")) == NULL)
+        goto cleanup;
+
+    fwrite(OTA_DELTA_MAGIC, 1, 4, fp);
+    _ota_put32(fp, new_len);
+    _ota_put32(fp, (uint64_t)new_len >> 32);
+
+    size_t pos = 0, literal = 0;
+    uint32_t a = 0, b = 0;
+    bool rolling = false;
+
+    while (blocks > 0 && pos + B <= new_len) {
+        if (!rolling) {
+            a = b = 0;
+            for (size_t k = 0; k < B; k++) {
+                a += new_data[pos + k];
+                b += (B - k) * new_data[pos + k];
+            }
+            rolling = true;
+        }
+
+        uint32_t sum = (a & 0xffff) | (b << 16);
+        size_t match = SIZE_MAX;
+
+        for (uint32_t slot = (sum * 2654435761u) & mask; table[slot].block != 0; slot = (slot + 1) & mask) {
+            size_t offset = (table[slot].block - 1) * B;
+            if (table[slot].sum == sum && memcmp(old_data + offset, new_data + pos, B) == 0) {
+                match = offset;
+                break;
+            }
+        }
+
+        if (match != SIZE_MAX) {
+            size_t len = B;
+            while (pos + len < new_len && match + len < old_len && new_data[pos + len] == old_data[match + len])
+                len++;
+            while (pos > literal && match > 0 && new_data[pos - 1] == old_data[match - 1]) {
+                pos--;
+                match--;
+                len++;
+            }
+            _ota_emitLiteral(fp, new_data + literal, pos - literal);
+            _ota_emitCopy(fp, match, len);
+            pos += len;
+            literal = pos;
+            rolling = false;
+            continue;
+        }
+
+        if (pos + B < new_len) {
+            uint8_t out = new_data[pos], in = new_data[pos + B];
+            a = a - out + in;
+            b = b - B * out + a;
+        }
+        pos++;
+    }
+
+    _ota_emitLiteral(fp, new_data + literal, new_len - literal);
+    fputc('E', fp);
+
+    ok = fflush(fp) == 0 && !ferror(fp);
+
+cleanup:
+    if (fp != NULL && fclose(fp) != 0)
+        ok = false;
+    if (!ok && fp != NULL)
+        unlink(delta_path);
+    free(table);
+    free(old_data);
+    free(new_data);
+    return ok;
+}
+
+static bool _ota_applyDelta(const char *old_path, const char *delta_path, const char *out_path,
+                            const char *label, char *sha256_out)
+{
+    OtaSink_s sink = {.label = label};
+    char buf[OTA_CHUNK_SIZE];
+    char magic[4];
+    uint32_t size_lo, size_hi;
+    off_t old_size = _ota_fileSize(old_path);
+    int old_fd = open(old_path, O_RDONLY);
+    FILE *delta = fopen(delta_path, "rb");
+    bool ok = false;
+
+    sink.fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    sha256_init(&sink.sha);
+
+    if (old_fd == -1 || delta == NULL || sink.fd == -1 ||
+        fread(magic, 1, 4, delta) != 4 || memcmp(magic, OTA_DELTA_MAGIC, 4) != 0 ||
+        !_ota_get32(delta, &size_lo) || !_ota_get32(delta, &size_hi))
+        goto cleanup;
+
+    sink.total = (uint64_t)size_hi << 32 | size_lo;
+
+    for (;;) {
+        int op = fgetc(delta);
+        uint32_t offset, len;
+
+        if (op == 'E') {
+            ok = sink.done == sink.total;
+            break;
+        }
+
+        if (op == 'C') {
+            if (!_ota_get32(delta, &offset) || !_ota_get32(delta, &len) ||
+                (off_t)offset + len > old_size)
+                break;
+            while (len > 0) {
+                size_t chunk = len < sizeof(buf) ? len : sizeof(buf);
+                if (pread(old_fd, buf, chunk, offset) != (ssize_t)chunk || !_ota_sinkWrite(&sink, buf, chunk))
+                    goto cleanup;
+                offset += chunk;
+                len -= chunk;
+            }
+        }
+        else if (op == 'A') {
+            if (!_ota_get32(delta, &len))
+                break;
+            while (len > 0) {
+                size_t chunk = len < sizeof(buf) ? len : sizeof(buf);
+                if (fread(buf, 1, chunk, delta) != chunk || !_ota_sinkWrite(&sink, buf, chunk))
+                    goto cleanup;
+                len -= chunk;
+            }
+        }
+        else {
+            break;
+        }
+
+        if (sink.done > sink.total)
+            break;
+    }
+
+    if (ok && fsync(sink.fd) != 0)
+        ok = false;
+
+cleanup:
+    if (old_fd != -1)
+        close(old_fd);
+    if (delta != NULL)
+        fclose(delta);
+    if (sink.fd != -1)
+        close(sink.fd);
+
+    if (ok)
+        sha256_finalHex(&sink.sha, sha256_out);
+    else
+        unlink(out_path);
+
+    return ok;
+}
+
+/**
+ * @brief Rebuild a file from its old version and a patch, streaming, and
+ * hash the result.
+ */
+bool ota_applyDelta(const char *old_path, const char *delta_path, const char *out_path, char *sha256_out)
+{
+    return _ota_applyDelta(old_path, delta_path, out_path, file_basename(out_path), sha256_out);
+}
+
+//
+//    Staging
+//
+
+typedef struct {
+    const char *path;
+    const char *sha256;
+    const char *url;
+    uint64_t size;
+    const cJSON *delta; // patch from the local version, NULL: full download
+    char staged[PATH_MAX];
+    bool changed;
+} OtaPlanItem_s;
+
+static const char *_ota_jsonString(const cJSON *object, const char *key)
+{
+    const cJSON *item = cJSON_GetObjectItem(object, key);
+    return cJSON_IsString(item) ? item->valuestring : NULL;
+}
+
+static int64_t _ota_jsonSize(const cJSON *object)
+{
+    const cJSON *item = cJSON_GetObjectItem(object, "size");
+    return cJSON_IsNumber(item) && item->valuedouble >= 0 ? (int64_t)item->valuedouble : -1;
+}
+
+// Fills `item` from a manifest entry and compares it with the installed file
+static bool _ota_planFile(const OtaOptions_s *opts, const cJSON *entry, OtaPlanItem_s *item)
+{
+    char dest[PATH_MAX], local_sha[SHA256_HEX_SIZE];
+    int64_t size = _ota_jsonSize(entry);
+
+    memset(item, 0, sizeof(OtaPlanItem_s));
+    item->path = _ota_jsonString(entry, "path");
+    item->sha256 = _ota_jsonString(entry, "sha256");
+    item->url = _ota_jsonString(entry, "url");
+    item->size = size;
+
+    if (!_ota_isSafePath(item->path) || !_ota_isSha256(item->sha256) || size < 0) {
+        printf_debug("ota: invalid manifest entry %s\n", item->path ? item->path : "(null)");
+        return false;
+    }
+
+    snprintf(dest, sizeof(dest), "%s/%s", opts->root, item->path);
+    snprintf(item->staged, sizeof(item->staged), "%s/%s.%08x",
+             opts->staging_dir, item->sha256, hash_str(item->path));
+
+    off_t local_size = _ota_fileSize(dest);
+    bool have_local = local_size >= 0 && sha256_file(dest, local_sha);
+
+    if (have_local && (uint64_t)local_size == item->size && strcmp(local_sha, item->sha256) == 0)
+        return true;
+
+    item->changed = true;
+
+    if (!have_local)
+        return true;
+
+    const cJSON *delta;
+    cJSON_ArrayForEach(delta, cJSON_GetObjectItem(entry, "deltas"))
+    {
+        const char *from = _ota_jsonString(delta, "from");
+        if (from != NULL && strcmp(from, local_sha) == 0 &&
+            _ota_isSha256(_ota_jsonString(delta, "sha256")) &&
+            _ota_jsonString(delta, "url") != NULL && _ota_jsonSize(delta) >= 0) {
+            item->delta = delta;
+            break;
+        }
+    }
+
+    return true;
+}
+
+static bool _ota_stagedIsValid(const OtaPlanItem_s *item)
+{
+    char sha[SHA256_HEX_SIZE];
+    return _ota_fileSize(item->staged) == (off_t)item->size &&
+           sha256_file(item->staged, sha) && strcmp(sha, item->sha256) == 0;
+}
+
+static bool _ota_stageFromDelta(const OtaOptions_s *opts, OtaPlanItem_s *item, OtaResult_s *result)
+{
+    char url[PATH_MAX], delta_path[PATH_MAX], old_path[PATH_MAX], part_path[PATH_MAX + 8];
+    char sha[SHA256_HEX_SIZE];
+    const char *from = _ota_jsonString(item->delta, "from");
+    bool ok;
+
+    _ota_resolveUrl(opts->manifest_url, _ota_jsonString(item->delta, "url"), url, sizeof(url));
+    snprintf(delta_path, sizeof(delta_path), "%s/%.16s-%.16s.delta", opts->staging_dir, from, item->sha256);
+    snprintf(old_path, sizeof(old_path), "%s/%s", opts->root, item->path);
+    snprintf(part_path, sizeof(part_path), "%s.part", item->staged);
+
+    ok = _ota_download(url, delta_path, _ota_jsonSize(item->delta), item->path, sha, &result->bytes_downloaded) &&
+         strcmp(sha, _ota_jsonString(item->delta, "sha256")) == 0 &&
+         _ota_applyDelta(old_path, delta_path, part_path, item->path, sha) &&
+         strcmp(sha, item->sha256) == 0 &&
+         rename(part_path, item->staged) == 0;
+
+    unlink(delta_path);
+    if (!ok)
+        unlink(part_path);
+
+    return ok;
+}
+
+static OtaStatus_e _ota_stageFull(const OtaOptions_s *opts, OtaPlanItem_s *item, OtaResult_s *result)
+{
+    char url[PATH_MAX], part_path[PATH_MAX + 8];
+    char sha[SHA256_HEX_SIZE];
+
+    _ota_resolveUrl(opts->manifest_url, item->url ? item->url : item->sha256, url, sizeof(url));
+    snprintf(part_path, sizeof(part_path), "%s.part", item->staged);
+
+    // A corrupt part is only found once it's complete, then start over once
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (!_ota_download(url, part_path, item->size, item->path, sha, &result->bytes_downloaded))
+            return OTA_ERR_DOWNLOAD;
+
+        if (strcmp(sha, item->sha256) == 0)
+            return rename(part_path, item->staged) == 0 ? OTA_OK : OTA_ERR_IO;
+
+        printf_debug("ota: %s: hash mismatch\n", item->path);
+        unlink(part_path);
+    }
+
+    return OTA_ERR_VERIFY;
+}
+
+static bool _ota_writeSwitchList(const char *staging_dir, const OtaPlanItem_s *items, int count)
+{
+    char path[PATH_MAX], tmp_path[PATH_MAX + 8];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/" OTA_SWITCH_LIST, staging_dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    if ((fp = fopen(tmp_path, "w")) == NULL)
+        return false;
+
+    for (int i = 0; i < count; i++)
+        if (items[i].changed)
+            fprintf(fp, "%s\t%s\n", file_basename(items[i].staged), items[i].path);
+
+    bool ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = fclose(fp) == 0 && ok;
+
+    return ok && rename(tmp_path, path) == 0;
+}
+
+/**
+ * @brief Download and verify every file that differs from the installed
+ * release, ready for ota_switch(). Interrupted downloads continue where
+ * they stopped. Finishes an interrupted switch first.
+ */
+OtaStatus_e ota_stage(const OtaOptions_s *opts, OtaResult_s *result)
+{
+    char manifest_path[PATH_MAX];
+    OtaPlanItem_s *items = NULL;
+    OtaStatus_e status = OTA_OK;
+    cJSON *manifest = NULL;
+    char *json = NULL;
+    bool active = false;
+    int count = 0;
+
+    memset(result, 0, sizeof(OtaResult_s));
+
+    if (ota_switchPending(opts->staging_dir, &active) && active &&
+        (status = ota_switch(opts->root, opts->staging_dir)) != OTA_OK)
+        return status;
+
+    snprintf(manifest_path, sizeof(manifest_path), "%s/" OTA_MANIFEST_NAME, opts->staging_dir);
+
+    if (!ota_fetch(opts->manifest_url, manifest_path, &result->bytes_downloaded) ||
+        (json = file_read(manifest_path)) == NULL ||
+        (manifest = cJSON_Parse(json)) == NULL ||
+        !cJSON_IsArray(cJSON_GetObjectItem(manifest, "files"))) {
+        status = OTA_ERR_MANIFEST;
+        goto cleanup;
+    }
+
+    const char *version = _ota_jsonString(manifest, "version");
+    snprintf(result->version, sizeof(result->version), "%s", version ? version : "");
+
+    const cJSON *files = cJSON_GetObjectItem(manifest, "files");
+    result->files_total = cJSON_GetArraySize(files);
+
+    if ((items = (OtaPlanItem_s *)calloc(result->files_total + 1, sizeof(OtaPlanItem_s))) == NULL) {
+        status = OTA_ERR_IO;
+        goto cleanup;
+    }
+
+    // Plan everything first, so nothing is downloaded if it can't fit
+    uint64_t largest_delta = 0;
+    const cJSON *entry;
+    cJSON_ArrayForEach(entry, files)
+    {
+        OtaPlanItem_s *item = &items[count++];
+
+        if (!_ota_planFile(opts, entry, item)) {
+            status = OTA_ERR_MANIFEST;
+            goto cleanup;
+        }
+        if (!item->changed)
+            continue;
+
+        result->files_changed++;
+        result->bytes_needed += item->size;
+
+        if (item->delta != NULL) {
+            uint64_t delta_size = _ota_jsonSize(item->delta);
+            if (delta_size > largest_delta)
+                largest_delta = delta_size;
+        }
+    }
+    result->bytes_needed += largest_delta;
+
+    struct statvfs fs;
+    if (statvfs(opts->staging_dir, &fs) == 0 &&
+        (uint64_t)fs.f_bavail * fs.f_frsize < result->bytes_needed + OTA_SPACE_MARGIN) {
+        status = OTA_ERR_SPACE;
+        goto cleanup;
+    }
+
+    if (opts->dry_run)
+        goto cleanup;
+
+    for (int i = 0; i < count; i++) {
+        OtaPlanItem_s *item = &items[i];
+
+        if (!item->changed || _ota_stagedIsValid(item))
+            continue;
+
+        unlink(item->staged);
+
+        if (item->delta != NULL) {
+            if (_ota_stageFromDelta(opts, item, result)) {
+                result->files_delta++;
+                continue;
+            }
+            printf_debug("ota: %s: delta failed, downloading the whole file\n", item->path);
+        }
+
+        if ((status = _ota_stageFull(opts, item, result)) != OTA_OK) {
+            printf_debug("ota: %s: %s\n", item->path, ota_statusString(status));
+            goto cleanup;
+        }
+    }
+
+    if (result->files_changed > 0 && !_ota_writeSwitchList(opts->staging_dir, items, count))
+        status = OTA_ERR_IO;
+
+cleanup:
+    free(items);
+    cJSON_Delete(manifest);
+    free(json);
+    return status;
+}
+
+//
+//    Switch
+//
+
+/**
+ * @brief Whether staged files are waiting for ota_switch().
+ *
+ * @param active_out Set if a switch was started and interrupted
+ */
+bool ota_switchPending(const char *staging_dir, bool *active_out)
+{
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/" OTA_SWITCH_ACTIVE, staging_dir);
+    if (active_out != NULL)
+        *active_out = exists(path);
+    if (exists(path))
+        return true;
+
+    snprintf(path, sizeof(path), "%s/" OTA_SWITCH_LIST, staging_dir);
+    return exists(path);
+}
+
+/**
+ * @brief Move the staged files into place. The list is renamed to
+ * OTA_SWITCH_ACTIVE first, so a switch that's cut short is finished by
+ * the next call instead of leaving a mix of releases behind.
+ */
+OtaStatus_e ota_switch(const char *root, const char *staging_dir)
+{
+    char list_path[PATH_MAX], active_path[PATH_MAX];
+    char line[PATH_MAX + 128];
+    OtaStatus_e status = OTA_OK;
+    FILE *fp;
+
+    snprintf(list_path, sizeof(list_path), "%s/" OTA_SWITCH_LIST, staging_dir);
+    snprintf(active_path, sizeof(active_path), "%s/" OTA_SWITCH_ACTIVE, staging_dir);
+
+    if (!exists(active_path)) {
+        if (!exists(list_path))
+            return OTA_OK;
+        if (rename(list_path, active_path) != 0)
+            return OTA_ERR_IO;
+        sync();
+    }
+
+    if ((fp = fopen(active_path, "r")) == NULL)
+        return OTA_ERR_IO;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char staged[PATH_MAX], dest[PATH_MAX];
+        char *tab = strchr(line, '\t');
+
+        line[strcspn(line, "\n")] = '\0';
+        if (tab == NULL || !_ota_isSafePath(tab + 1))
+            continue;
+        *tab = '\0';
+
+        if (snprintf(staged, sizeof(staged), "%s/%s", staging_dir, line) >= (int)sizeof(staged) ||
+            snprintf(dest, sizeof(dest), "%s/%s", root, tab + 1) >= (int)sizeof(dest)) {
+            status = OTA_ERR_IO;
+            continue;
+        }
+
+        if (!exists(staged)) {
+            // Moved before the interruption
+            if (!exists(dest))
+                status = OTA_ERR_IO;
+            continue;
+        }
+
+        if (!_ota_mkdirsFor(dest) || rename(staged, dest) != 0) {
+            printf_debug("ota: can't move %s: %s\n", dest, strerror(errno));
+            status = OTA_ERR_IO;
+        }
+    }
+
+    fclose(fp);
+    sync();
+
+    if (status == OTA_OK)
+        unlink(active_path);
+
+    return status;
+}
+
+/**
+ * @brief ota_stage() then ota_switch().
+ */
+OtaStatus_e ota_update(const OtaOptions_s *opts, OtaResult_s *result)
+{
+    OtaStatus_e status = ota_stage(opts, result);
+
+    if (status != OTA_OK || opts->dry_run)
+        return status;
+
+    return ota_switch(opts->root, opts->staging_dir);
+}
+
+//
+//    Release side
+//
+
+typedef struct {
+    char **paths;
+    int count;
+    int capacity;
+} OtaFileList_s;
+
+static void _ota_listFiles(const char *root, const char *rel, OtaFileList_s *list)
+{
+    char dir_path[PATH_MAX];
+    struct dirent *ent;
+    DIR *dir;
+
+    snprintf(dir_path, sizeof(dir_path), "%s%s%s", root, *rel ? "/" : "", rel);
+
+    if ((dir = opendir(dir_path)) == NULL)
+        return;
+
+    while ((ent = readdir(dir)) != NULL) {
+        char child[PATH_MAX], full[PATH_MAX];
+        struct stat st;
+
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+            continue;
+
+        if (snprintf(child, sizeof(child), "%s%s%s", rel, *rel ? "/" : "", ent->d_name) >= (int)sizeof(child) ||
+            snprintf(full, sizeof(full), "%s/%s", root, child) >= (int)sizeof(full))
+            continue;
+
+        if (stat(full, &st) != 0)
+            continue;
+
+        if (S_ISDIR(st.st_mode)) {
+            _ota_listFiles(root, child, list);
+        }
+        else if (S_ISREG(st.st_mode) && _ota_isSafePath(child)) {
+            if (list->count == list->capacity) {
+                list->capacity = list->capacity ? list->capacity * 2 : 64;
+                list->paths = (char **)realloc(list->paths, list->capacity * sizeof(char *));
+            }
+            list->paths[list->count++] = strdup(child);
+        }
+    }
+
+    closedir(dir);
+}
+
+static int _ota_comparePaths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static bool _ota_copyFile(const char *src_path, const char *dest_path)
+{
+    char sha[SHA256_HEX_SIZE];
+    char part_path[PATH_MAX + 8];
+
+    snprintf(part_path, sizeof(part_path), "%s.part", dest_path);
+    return _ota_download(src_path, part_path, -1, src_path, sha, NULL) &&
+           rename(part_path, dest_path) == 0;
+}
+
+/**
+ * @brief Write a manifest for `release_dir` and the files it points to
+ * into `out_dir`, ready to be uploaded next to each other.
+ *
+ * @param base_dir Previous release, large files that changed get a delta
+ * from it when that's worth it. NULL for none.
+ */
+bool ota_buildManifest(const char *release_dir, const char *base_dir, const char *out_dir, const char *version)
+{
+    OtaFileList_s list = {0};
+    cJSON *manifest = cJSON_CreateObject();
+    cJSON *files = cJSON_CreateArray();
+    char path[PATH_MAX];
+    bool ok = true;
+
+    snprintf(path, sizeof(path), "%s/" OTA_MANIFEST_NAME, out_dir);
+    if (!_ota_mkdirsFor(path)) {
+        cJSON_Delete(manifest);
+        return false;
+    }
+
+    _ota_listFiles(release_dir, "", &list);
+    qsort(list.paths, list.count, sizeof(char *), _ota_comparePaths);
+
+    cJSON_AddStringToObject(manifest, "version", version ? version : "");
+    cJSON_AddItemToObject(manifest, "files", files);
+
+    for (int i = 0; i < list.count && ok; i++) {
+        char src[PATH_MAX], base[PATH_MAX];
+        char sha[SHA256_HEX_SIZE], base_sha[SHA256_HEX_SIZE], delta_sha[SHA256_HEX_SIZE];
+        off_t size;
+
+        snprintf(src, sizeof(src), "%s/%s", release_dir, list.paths[i]);
+        if ((size = _ota_fileSize(src)) < 0 || !sha256_file(src, sha)) {
+            ok = false;
+            break;
+        }
+
+        cJSON *entry = cJSON_CreateObject();
+        cJSON_AddStringToObject(entry, "path", list.paths[i]);
+        cJSON_AddNumberToObject(entry, "size", size);
+        cJSON_AddStringToObject(entry, "sha256", sha);
+        cJSON_AddStringToObject(entry, "url", sha);
+        cJSON_AddItemToArray(files, entry);
+
+        snprintf(path, sizeof(path), "%s/%s", out_dir, sha);
+        if (!exists(path) && !(ok = _ota_copyFile(src, path)))
+            break;
+
+        if (base_dir == NULL || size < OTA_DELTA_MIN_SIZE)
+            continue;
+
+        snprintf(base, sizeof(base), "%s/%s", base_dir, list.paths[i]);
+        if (!sha256_file(base, base_sha) || strcmp(base_sha, sha) == 0)
+            continue;
+
+        char delta_name[64];
+        snprintf(delta_name, sizeof(delta_name), "%.16s-%.16s.delta", base_sha, sha);
+        snprintf(path, sizeof(path), "%s/%s", out_dir, delta_name);
+
+        off_t delta_size;
+        if (!ota_makeDelta(base, src, path) || (delta_size = _ota_fileSize(path)) < 0 ||
+            delta_size > size * OTA_DELTA_MAX_RATIO || !sha256_file(path, delta_sha)) {
+            unlink(path);
+            continue;
+        }
+
+        cJSON *delta = cJSON_CreateObject();
+        cJSON_AddStringToObject(delta, "from", base_sha);
+        cJSON_AddNumberToObject(delta, "size", delta_size);
+        cJSON_AddStringToObject(delta, "sha256", delta_sha);
+        cJSON_AddStringToObject(delta, "url", delta_name);
+        cJSON *deltas = cJSON_CreateArray();
+        cJSON_AddItemToArray(deltas, delta);
+        cJSON_AddItemToObject(entry, "deltas", deltas);
+    }
+
+    char *json = ok ? cJSON_Print(manifest) : NULL;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/" OTA_MANIFEST_NAME, out_dir);
+    if (json == NULL || (fp = fopen(path, "w")) == NULL) {
+        ok = false;
+    }
+    else {
+        ok = fputs(json, fp) >= 0;
+        ok = fclose(fp) == 0 && ok;
+    }
+    free(json);
+
+    for (int i = 0; i < list.count; i++)
+        free(list.paths[i]);
+    free(list.paths);
+    cJSON_Delete(manifest);
+    return ok;
+}
@@ -0,0 +1,86 @@
+#ifndef OTA_UPDATE_OTA_H__
+#define OTA_UPDATE_OTA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+//    Incremental OTA updates
+//
+//    A release is described by a manifest (JSON) listing every file with
+//    its size and SHA-256, plus optional delta patches from older versions
+//    of the same file. Only files whose local hash differs are fetched,
+//    each one streamed into a staging directory next to the install root
+//    (same filesystem) while it's hashed. Nothing under the root is
+//    touched until every staged file is verified, then they are renamed
+//    into place following a journal that survives a power cut.
+//
+//    ota-manifest.json:
+//    {
+//        "version": "4.4.0",
+//        "files": [{
+//            "path": "miyoo/app/.tmp_update/onion.pak",
+//            "size": 123, "sha256": "...", "url": "<sha256>",
+//            "deltas": [{"from": "<old sha256>", "size": 45, "sha256": "...", "url": "..."}]
+//        }]
+//    }
+//
+//    URLs are relative to the manifest. http:// is fetched natively with
+//    Range requests to resume, https:// through curl, anything else is a
+//    local path (USB or SD card update).
+//
+
+#define OTA_MANIFEST_NAME "ota-manifest.json"
+#define OTA_SWITCH_LIST "switch.list"
+#define OTA_SWITCH_ACTIVE "switch.active"
+#define OTA_DELTA_MIN_SIZE (64 * 1024)
+
+typedef enum {
+    OTA_OK = 0,
+    OTA_ERR_MANIFEST,
+    OTA_ERR_DOWNLOAD,
+    OTA_ERR_VERIFY,
+    OTA_ERR_SPACE,
+    OTA_ERR_IO
+} OtaStatus_e;
+
+typedef struct {
+    const char *manifest_url;
+    const char *root;        // install root, e.g. "/mnt/SDCARD"
+    const char *staging_dir; // must be on the same filesystem as root
+    bool dry_run;            // only report what would be downloaded
+} OtaOptions_s;
+
+typedef struct {
+    char version[64];
+    int files_total;
+    int files_changed;
+    int files_delta; // changed files rebuilt from a delta
+    uint64_t bytes_needed;
+    uint64_t bytes_downloaded;
+} OtaResult_s;
+
+typedef void (*OtaProgressCallback_t)(const char *path, uint64_t done, uint64_t total, void *userdata);
+
+void ota_setProgressCallback(OtaProgressCallback_t callback, void *userdata);
+const char *ota_statusString(OtaStatus_e status);
+
+OtaStatus_e ota_stage(const OtaOptions_s *opts, OtaResult_s *result);
+OtaStatus_e ota_switch(const char *root, const char *staging_dir);
+bool ota_switchPending(const char *staging_dir, bool *active_out);
+OtaStatus_e ota_update(const OtaOptions_s *opts, OtaResult_s *result);
+
+bool ota_fetch(const char *url, const char *dest_path, uint64_t *downloaded_out);
+bool ota_makeDelta(const char *old_path, const char *new_path, const char *delta_path);
+bool ota_applyDelta(const char *old_path, const char *delta_path, const char *out_path, char *sha256_out);
+bool ota_buildManifest(const char *release_dir, const char *base_dir, const char *out_dir, const char *version);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OTA_UPDATE_OTA_H__
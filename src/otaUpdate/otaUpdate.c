@@ -0,0 +1,150 @@
+//
+//	Incremental OTA updater CLI, used by ota_update.sh on the device and by
+//	`make ota-manifest` on the release side
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ota.h"
+
+#define OTA_DEFAULT_ROOT "/mnt/SDCARD"
+#define OTA_STAGING_SUBDIR "/.tmp_update/download/ota"
+
+static void print_usage(void)
+{
+    printf("Usage: otaUpdate <command> [args] [--root DIR] [--staging DIR]\n"
+           "  check MANIFEST_URL   show what an update would download\n"
+           "  stage MANIFEST_URL   download and verify changed files\n"
+           "  switch               install staged files (finishes an interrupted switch)\n"
+           "  update MANIFEST_URL  stage, then switch\n"
+           "  manifest RELEASE_DIR OUT_DIR [--base OLD_RELEASE_DIR] [--version VERSION]\n"
+           "                       write a manifest, files and deltas for a release\n"
+           "Defaults: --root " OTA_DEFAULT_ROOT ", --staging ROOT" OTA_STAGING_SUBDIR "\n");
+}
+
+// One line per file and per 10%, the terminal app doesn't cope with \r
+static void print_progress(const char *path, uint64_t done, uint64_t total, void *userdata)
+{
+    static const char *last_path = NULL;
+    static int last_step = -1;
+    int step = total > 0 ? (int)(done * 10 / total) : 0;
+
+    if (path != last_path) {
+        last_path = path;
+        last_step = -1;
+    }
+
+    if (step == last_step)
+        return;
+    last_step = step;
+
+    if (total > 0)
+        printf("  %3d%%  %s\n", step * 10, path);
+    else
+        printf("  %lluKB  %s\n", (unsigned long long)(done / 1024), path);
+    fflush(stdout);
+}
+
+static void print_result(const OtaResult_s *result)
+{
+    printf("Version:    %s\n"
+           "Files:      %d changed of %d (%d from deltas)\n"
+           "Needed:     %lluKB\n"
+           "Downloaded: %lluKB\n",
+           result->version, result->files_changed, result->files_total, result->files_delta,
+           (unsigned long long)(result->bytes_needed / 1024),
+           (unsigned long long)(result->bytes_downloaded / 1024));
+}
+
+int main(int argc, char *argv[])
+{
+    const char *args[3] = {NULL, NULL, NULL};
+    const char *root = OTA_DEFAULT_ROOT;
+    const char *staging = NULL;
+    const char *base = NULL;
+    const char *version = NULL;
+    char staging_buf[512];
+    int arg_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--root") == 0 && i + 1 < argc)
+            root = argv[++i];
+        else if (strcmp(argv[i], "--staging") == 0 && i + 1 < argc)
+            staging = argv[++i];
+        else if (strcmp(argv[i], "--base") == 0 && i + 1 < argc)
+            base = argv[++i];
+        else if (strcmp(argv[i], "--version") == 0 && i + 1 < argc)
+            version = argv[++i];
+        else if (argv[i][0] != '-' && arg_count < 3)
+            args[arg_count++] = argv[i];
+        else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (arg_count == 0) {
+        print_usage();
+        return 1;
+    }
+
+    const char *command = args[0];
+
+    if (strcmp(command, "manifest") == 0) {
+        if (arg_count < 3) {
+            print_usage();
+            return 1;
+        }
+        if (!ota_buildManifest(args[1], base, args[2], version)) {
+            fprintf(stderr, "Failed to write the manifest to %s\n", args[2]);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (staging == NULL) {
+        snprintf(staging_buf, sizeof(staging_buf), "%s" OTA_STAGING_SUBDIR, root);
+        staging = staging_buf;
+    }
+
+    if (strcmp(command, "switch") == 0) {
+        OtaStatus_e status = ota_switch(root, staging);
+        if (status != OTA_OK)
+            fprintf(stderr, "Switch failed: %s\n", ota_statusString(status));
+        return status;
+    }
+
+    if (arg_count < 2) {
+        print_usage();
+        return 1;
+    }
+
+    OtaOptions_s opts = {.manifest_url = args[1], .root = root, .staging_dir = staging};
+    OtaResult_s result;
+    OtaStatus_e status;
+
+    ota_setProgressCallback(print_progress, NULL);
+
+    if (strcmp(command, "check") == 0) {
+        opts.dry_run = true;
+        status = ota_stage(&opts, &result);
+    }
+    else if (strcmp(command, "stage") == 0) {
+        status = ota_stage(&opts, &result);
+    }
+    else if (strcmp(command, "update") == 0) {
+        status = ota_update(&opts, &result);
+    }
+    else {
+        print_usage();
+        return 1;
+    }
+
+    print_result(&result);
+
+    if (status != OTA_OK)
+        fprintf(stderr, "Update failed: %s\n", ota_statusString(status));
+
+    return status;
+}
@@ -1,19 +1,52 @@
 #ifndef PACMAN_APPLY_H__
 #define PACMAN_APPLY_H__
 
+#include "theme/render/dialog.h"
+#include "theme/resources.h"
 #include "utils/file.h"
 #include "utils/log.h"
+#include "utils/msleep.h"
 
 #include "./fileActions.h"
 #include "./globals.h"
+#include "./installer.h"
 
-void applyAllChanges(bool auto_update)
+#define APPLY_REFRESH_MS 250
+
+static void _renderInstallProgress(SDL_Surface *background, const InstallerProgress_s *progress)
 {
-    // installation
-    char cmd[STR_MAX * 2 + 100];
+    char message[STR_MAX * 2];
+    const char *title = "Installing packages";
+
+    switch (progress->phase) {
+    case INSTALLER_PLANNING:
+        snprintf(message, sizeof(message), "Preparing...\n%s", progress->current);
+        break;
+    case INSTALLER_REMOVING:
+        title = "Removing packages";
+        snprintf(message, sizeof(message), "%s\n%d / %d files", progress->current,
+                 progress->files_done, progress->files_total);
+        break;
+    case INSTALLER_COPYING:
+        snprintf(message, sizeof(message), "%s\n%d / %d files\n%.1f / %.1f MB", progress->current,
+                 progress->files_done, progress->files_total,
+                 progress->bytes_done / 1048576.0, progress->bytes_total / 1048576.0);
+        break;
+    default:
+        snprintf(message, sizeof(message), "Finishing...\n%s", progress->current);
+        break;
+    }
 
-    SDL_Surface *surfaceBackground = IMG_Load("/mnt/SDCARD/.tmp_update/res/waitingBG.png");
-    SDL_Surface *surfaceMessage;
+    SDL_BlitSurface(background, NULL, screen, NULL);
+    theme_renderDialogProgress(screen, title, message, false);
+    SDL_BlitSurface(screen, NULL, video, NULL);
+    SDL_Flip(video);
+}
+
+void applyAllChanges(bool auto_update)
+{
+    Installer_s installer;
+    installer_init(&installer, "/mnt/SDCARD", callPackageInstaller);
 
     for (int nT = 0; nT < tab_count; nT++) {
         const char *data_path = layer_dirs[nT];
@@ -21,8 +54,6 @@ void applyAllChanges(bool auto_update)
         if (strlen(data_path) == 0 || !exists(data_path))
             continue;
 
-        SDL_Rect rectMessage = {10, 420, 603, 48};
-
         for (int nLayer = 0; nLayer < package_count[nT]; nLayer++) {
             Package *package = &packages[nT][nLayer];
 
@@ -38,33 +69,46 @@ void applyAllChanges(bool auto_update)
 
             if (should_install) {
                 printf_debug("Installing %s...\n", package->name);
-                SDL_BlitSurface(surfaceBackground, NULL, screen, NULL);
-
-                surfaceMessage = TTF_RenderUTF8_Blended(
-                    font35, package->name, color_white);
-                SDL_BlitSurface(surfaceMessage, NULL, screen, &rectMessage);
-                SDL_FreeSurface(surfaceMessage);
-
-                SDL_BlitSurface(screen, NULL, video, NULL);
-                SDL_Flip(video);
-
-                sprintf(cmd, "/mnt/SDCARD/.tmp_update/script/pacman_install.sh \"%s\" \"%s\"", data_path, package->name);
-                system(cmd);
-                sync();
-
-                callPackageInstaller(data_path, package->name, true);
+                installer_add(&installer, data_path, package->name, true);
             }
             else if (package->installed) {
                 printf_debug("Removing %s...\n", package->name);
-                callPackageInstaller(data_path, package->name, false);
-
-                // app removal
-                char pathAppUninstall[1000];
-                sprintf(pathAppUninstall, "%s/%s", data_path, package->name);
-                appUninstall(pathAppUninstall, strlen(pathAppUninstall));
+                installer_add(&installer, data_path, package->name, false);
             }
         }
     }
+
+    // The package list stays behind the dialog
+    SDL_Surface *background = SDL_CreateRGBSurface(SDL_SWSURFACE, screen->w, screen->h, 32, 0, 0, 0, 0);
+    SDL_BlitSurface(screen, NULL, background, NULL);
+
+    InstallerProgress_s progress;
+
+    if (installer_start(&installer)) {
+        while (!installer_isDone(&installer)) {
+            // Keep the event queue drained, the UI stays responsive
+            SDL_Event event;
+            while (SDL_PollEvent(&event))
+                ;
+
+            installer_getProgress(&installer, &progress);
+            _renderInstallProgress(background, &progress);
+            msleep(APPLY_REFRESH_MS);
+        }
+    }
+    else {
+        _renderInstallProgress(background, &installer.progress);
+        _installer_thread(&installer);
+    }
+
+    installer_getProgress(&installer, &progress);
+    if (progress.errors > 0)
+        printf_debug("%d files could not be installed or removed\n", progress.errors);
+
+    installer_free(&installer);
+    theme_clearDialogProgress();
+    SDL_FreeSurface(background);
+    resources_free();
 }
 
 #endif // PACMAN_APPLY_H__
@@ -10,6 +10,7 @@
 #include "utils/str.h"
 
 #include "./globals.h"
+#include "./romCache.h"
 
 bool checkAppInstalled(const char *basePath, int base_len, int level, bool complete)
 {
@@ -93,69 +94,7 @@ bool getConfigPath(char *config_path, const char *data_path, const char *base_di
     return true;
 }
 
-bool hasExtension(const char *file_name, const char *extlist)
-{
-    const char *file_ext = file_getExtension(file_name);
-
-    if (extlist == NULL || strlen(extlist) == 0)
-        return true;
-
-    if (strcasecmp(file_ext, "miyoocmd") == 0)
-        return false;
-
-    char extlist_dup[STR_MAX];
-    strcpy(extlist_dup, extlist);
-
-    char *token = strtok(extlist_dup, "|");
-
-    while (token != NULL) {
-        if (strcasecmp(file_ext, token) == 0)
-            return true;
-        token = strtok(NULL, "|");
-    }
-
-    return false;
-}
-
-bool checkRomDir(const char *rom_dir, const char *extlist, int level)
-{
-    struct dirent *dp;
-    DIR *dir = opendir(rom_dir);
-
-    // Unable to open directory stream
-    if (!dir)
-        return false;
-
-    while ((dp = readdir(dir)) != NULL) {
-        if (dp->d_name[0] == '.')
-            continue;
-
-        if (dp->d_type == DT_DIR) {
-            if (level == 0) {
-                char subdir[PATH_MAX];
-                snprintf(subdir, PATH_MAX - 1, "%s/%s", rom_dir, dp->d_name);
-                if (checkRomDir(subdir, extlist, level + 1)) {
-                    closedir(dir);
-                    return true;
-                }
-            }
-            continue;
-        }
-
-        if (dp->d_type == DT_REG) {
-            if (!hasExtension(dp->d_name, extlist))
-                continue;
-
-            closedir(dir);
-            return true;
-        }
-    }
-
-    closedir(dir);
-    return false;
-}
-
-bool checkRoms(const char *data_path)
+bool checkRoms(RomCache_s *rom_cache, const char *data_path)
 {
     char path_dup[PATH_MAX];
     strncpy(path_dup, data_path, PATH_MAX - 1);
@@ -167,26 +106,7 @@ bool checkRoms(const char *data_path)
         return false;
     }
 
-    cJSON *config = json_load(config_path);
-    char roms_rel_path[STR_MAX];
-    char extlist[STR_MAX] = {0};
-
-    if (!json_getString(config, "rompath", roms_rel_path)) {
-        free(config);
-        return false;
-    }
-
-    json_getString(config, "extlist", extlist);
-
-    free(config);
-
-    if (strncmp(roms_rel_path, "../../", 6) != 0)
-        return false;
-
-    char rom_dir[PATH_MAX];
-    snprintf(rom_dir, PATH_MAX - 1, "/mnt/SDCARD/%s", roms_rel_path + 6);
-
-    return checkRomDir(rom_dir, extlist, 0);
+    return romCache_hasRoms(rom_cache, config_path);
 }
 
 void loadPackages(bool auto_update)
@@ -194,6 +114,9 @@ void loadPackages(bool auto_update)
     DIR *dp;
     struct dirent *ep;
     char basePath[1000];
+    RomCache_s rom_cache;
+
+    romCache_load(&rom_cache, ROM_CACHE_PATH, "/mnt/SDCARD");
 
     for (int nT = 0; nT < tab_count; nT++) {
         const char *data_path = layer_dirs[nT];
@@ -221,7 +144,7 @@ void loadPackages(bool auto_update)
                 Package package = {.installed = is_installed,
                                    .changed = false,
                                    .complete = is_complete,
-                                   .has_roms = check_roms ? checkRoms(basePath) : false};
+                                   .has_roms = check_roms ? checkRoms(&rom_cache, basePath) : false};
 
                 if (is_installed) {
                     package_installed_count[nT]++;
@@ -240,6 +163,9 @@ void loadPackages(bool auto_update)
         closedir(dp);
     }
 
+    romCache_save(&rom_cache, ROM_CACHE_PATH);
+    romCache_free(&rom_cache);
+
     Package temp;
 
     // Sort function
@@ -320,39 +246,4 @@ void callPackageInstaller(const char *data_path, const char *package_name,
     }
 }
 
-void appUninstall(char *basePath, int strlenBase)
-{
-    char path[1000];
-    char pathInstalledApp[1000];
-
-    struct dirent *dp;
-    DIR *dir = opendir(basePath);
-
-    // Unable to open directory stream
-    if (!dir)
-        return;
-
-    while ((dp = readdir(dir)) != NULL) {
-        if (strcmp(dp->d_name, ".") != 0 && strcmp(dp->d_name, "..") != 0) {
-            // Construct new path from our base path
-            sprintf(path, "%s/%s", basePath, dp->d_name);
-
-            if (exists(path)) {
-                sprintf(pathInstalledApp, "/mnt/SDCARD%s", path + strlenBase);
-
-                if (is_file(pathInstalledApp))
-                    remove(pathInstalledApp);
-
-                if (is_dir(path))
-                    appUninstall(path, strlenBase);
-
-                if (is_dir(pathInstalledApp))
-                    rmdir(pathInstalledApp);
-            }
-        }
-    }
-
-    closedir(dir);
-}
-
 #endif // PACMAN_FILE_ACTIONS_H__
\ No newline at end of file
@@ -0,0 +1,645 @@
+#ifndef PACMAN_INSTALLER_H__
+#define PACMAN_INSTALLER_H__
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cjson/cJSON.h"
+#include "utils/file.h"
+#include "utils/log.h"
+#include "utils/str.h"
+
+//
+//    Package install/uninstall engine
+//
+//    Everything runs off the UI thread, which only polls the progress:
+//    1. Plan: walk every selected package once. That gives the files to
+//       copy and their total size, plus the files to remove. Removals skip
+//       anything an install in the same batch provides. When two
+//       installs share a file (cores), only the last one copies it.
+//    2. Remove: run each uninstall script while its files still exist,
+//       then delete the files and any directories left empty.
+//    3. Copy: a few workers copy files with large buffers, in package
+//       order. When the last file of a package lands, its post-install
+//       step (config fixups, icon, install.sh) is queued on a single
+//       script thread. Scripts never run in parallel with each other,
+//       but they overlap with the copies of the next packages.
+//
+
+#define INSTALLER_WORKERS 3
+#define INSTALLER_BUFFER_SIZE (256 * 1024)
+#define INSTALLER_LABEL_LEN 256
+
+typedef enum {
+    INSTALLER_PLANNING,
+    INSTALLER_REMOVING,
+    INSTALLER_COPYING,
+    INSTALLER_FINISHING,
+    INSTALLER_DONE
+} InstallerPhase_e;
+
+/**
+ * @brief Runs a package's install.sh / uninstall.sh (and applies its
+ * icon), see callPackageInstaller().
+ */
+typedef void (*InstallerScript_t)(const char *data_path, const char *package_name, bool install);
+
+typedef struct {
+    char data_path[STR_MAX];
+    char name[STR_MAX];
+    bool install;
+    int files_left; // copies not done yet, the post-install step runs at 0
+    char config_path[PATH_MAX]; // installed config.json, "" if none
+    char label[INSTALLER_LABEL_LEN]; // kept from the previously installed config
+    char imgpath[INSTALLER_LABEL_LEN];
+} InstallerPackage_s;
+
+typedef struct {
+    char *src; // NULL when removing
+    char *dst;
+    uint64_t size;
+    int package;
+    bool is_dir;
+} InstallerFile_s;
+
+typedef struct {
+    InstallerFile_s *items;
+    int count;
+    int capacity;
+} InstallerFileList_s;
+
+typedef struct {
+    InstallerPhase_e phase;
+    uint64_t bytes_done;
+    uint64_t bytes_total;
+    int files_done;
+    int files_total;
+    int errors;
+    char current[STR_MAX]; // package being worked on
+} InstallerProgress_s;
+
+typedef struct {
+    char root[PATH_MAX]; // "/mnt/SDCARD"
+    InstallerScript_t script;
+    InstallerPackage_s *packages;
+    int package_count;
+    InstallerFileList_s copies;
+    InstallerFileList_s removals;
+    int next_copy; // next copy a worker picks up
+
+    int *script_queue; // packages ready for their post-install step
+    int script_head;
+    int script_tail;
+    bool copies_done;
+
+    InstallerProgress_s progress;
+    pthread_mutex_t lock;
+    pthread_cond_t script_cond;
+    pthread_t thread;
+    bool started;
+} Installer_s;
+
+void installer_init(Installer_s *inst, const char *root, InstallerScript_t script)
+{
+    memset(inst, 0, sizeof(Installer_s));
+    strncpy(inst->root, root, PATH_MAX - 1);
+    inst->script = script;
+    pthread_mutex_init(&inst->lock, NULL);
+    pthread_cond_init(&inst->script_cond, NULL);
+}
+
+/**
+ * @brief Queues `data_path`/`package_name` for installation (or
+ * removal). Packages are processed in the order they were added.
+ */
+bool installer_add(Installer_s *inst, const char *data_path, const char *package_name, bool install)
+{
+    InstallerPackage_s *packages = (InstallerPackage_s *)realloc(
+        inst->packages, (inst->package_count + 1) * sizeof(InstallerPackage_s));
+    if (packages == NULL)
+        return false;
+
+    inst->packages = packages;
+    InstallerPackage_s *package = &packages[inst->package_count++];
+    memset(package, 0, sizeof(InstallerPackage_s));
+    strncpy(package->data_path, data_path, STR_MAX - 1);
+    strncpy(package->name, package_name, STR_MAX - 1);
+    package->install = install;
+
+    return true;
+}
+
+static bool _installer_append(InstallerFileList_s *list, const char *src, const char *dst,
+                              uint64_t size, int package, bool is_dir)
+{
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 256;
+        InstallerFile_s *items = (InstallerFile_s *)realloc(list->items, capacity * sizeof(InstallerFile_s));
+        if (items == NULL)
+            return false;
+        list->items = items;
+        list->capacity = capacity;
+    }
+
+    InstallerFile_s *file = &list->items[list->count++];
+    file->src = src ? strdup(src) : NULL;
+    file->dst = strdup(dst);
+    file->size = size;
+    file->package = package;
+    file->is_dir = is_dir;
+    return true;
+}
+
+static void _installer_setCurrent(Installer_s *inst, int package)
+{
+    pthread_mutex_lock(&inst->lock);
+    snprintf(inst->progress.current, STR_MAX, "%s", inst->packages[package].name);
+    pthread_mutex_unlock(&inst->lock);
+}
+
+// Same layout as `cp -rf package/* root/`: hidden entries at the top of
+// a package aren't installed. Removal lists directories after their
+// contents, so they can be removed once empty.
+static void _installer_walk(Installer_s *inst, int package, const char *src_dir, const char *dst_dir, int level)
+{
+    InstallerPackage_s *pkg = &inst->packages[package];
+    char src[PATH_MAX], dst[PATH_MAX];
+    struct dirent *dp;
+    struct stat st;
+    DIR *dir;
+
+    if ((dir = opendir(src_dir)) == NULL)
+        return;
+
+    while ((dp = readdir(dir)) != NULL) {
+        if (strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
+            continue;
+        if (pkg->install && level == 0 && dp->d_name[0] == '.')
+            continue;
+
+        snprintf(src, PATH_MAX, "%s/%s", src_dir, dp->d_name);
+        snprintf(dst, PATH_MAX, "%s/%s", dst_dir, dp->d_name);
+
+        if (stat(src, &st) != 0)
+            continue;
+
+        if (S_ISDIR(st.st_mode)) {
+            if (pkg->install)
+                _installer_append(&inst->copies, NULL, dst, 0, package, true);
+            _installer_walk(inst, package, src, dst, level + 1);
+            if (!pkg->install)
+                _installer_append(&inst->removals, NULL, dst, 0, package, true);
+        }
+        else if (pkg->install) {
+            _installer_append(&inst->copies, src, dst, st.st_size, package, false);
+            if (pkg->config_path[0] == '\0' && strcmp(dp->d_name, "config.json") == 0)
+                snprintf(pkg->config_path, PATH_MAX, "%s", dst);
+        }
+        else {
+            _installer_append(&inst->removals, NULL, dst, 0, package, false);
+        }
+    }
+
+    closedir(dir);
+}
+
+static int _installer_compareDst(const void *a, const void *b)
+{
+    const InstallerFile_s *fa = *(const InstallerFile_s *const *)a;
+    const InstallerFile_s *fb = *(const InstallerFile_s *const *)b;
+    int cmp = strcmp(fa->dst, fb->dst);
+    // Same destination: the later entry (higher address) sorts first
+    return cmp != 0 ? cmp : (fa < fb) - (fa > fb);
+}
+
+static int _installer_findDst(InstallerFile_s **sorted, int count, const char *dst)
+{
+    int lo = 0, hi = count - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(sorted[mid]->dst, dst);
+        if (cmp == 0)
+            return mid;
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return -1;
+}
+
+static void _installer_freeFile(InstallerFile_s *file)
+{
+    free(file->src);
+    free(file->dst);
+    file->src = file->dst = NULL;
+}
+
+static cJSON *_installer_loadConfig(const char *path)
+{
+    char *contents = file_read(path);
+    cJSON *config = cJSON_Parse(contents);
+    free(contents);
+    return config;
+}
+
+static void _installer_getConfigString(cJSON *config, const char *key, char *dest)
+{
+    const char *value = cJSON_GetStringValue(cJSON_GetObjectItem(config, key));
+    if (value != NULL)
+        snprintf(dest, INSTALLER_LABEL_LEN, "%s", value);
+}
+
+static bool _installer_setConfigString(cJSON *config, const char *key, const char *value)
+{
+    cJSON *item = cJSON_GetObjectItem(config, key);
+    return cJSON_IsString(item) && cJSON_SetValuestring(item, value) != NULL;
+}
+
+static void _installer_plan(Installer_s *inst)
+{
+    char src_root[PATH_MAX];
+
+    for (int i = 0; i < inst->package_count; i++) {
+        InstallerPackage_s *pkg = &inst->packages[i];
+        _installer_setCurrent(inst, i);
+        snprintf(src_root, PATH_MAX, "%s/%s", pkg->data_path, pkg->name);
+        _installer_walk(inst, i, src_root, inst->root, 0);
+
+        // Kept like pacman_install.sh did: renames and custom images
+        if (pkg->install && pkg->config_path[0] != '\0') {
+            cJSON *config = is_file(pkg->config_path) ? _installer_loadConfig(pkg->config_path) : NULL;
+            _installer_getConfigString(config, "label", pkg->label);
+            _installer_getConfigString(config, "imgpath", pkg->imgpath);
+            cJSON_Delete(config);
+        }
+    }
+
+    InstallerFile_s **sorted = (InstallerFile_s **)malloc((inst->copies.count + 1) * sizeof(InstallerFile_s *));
+    if (sorted == NULL)
+        return;
+
+    for (int i = 0; i < inst->copies.count; i++)
+        sorted[i] = &inst->copies.items[i];
+    qsort(sorted, inst->copies.count, sizeof(InstallerFile_s *), _installer_compareDst);
+
+    // Only the last package providing a file copies it. Directories are
+    // all kept: each package lists its own before their contents.
+    int unique = 0;
+    for (int i = 0; i < inst->copies.count; i++) {
+        if (!sorted[i]->is_dir && unique > 0 && !sorted[unique - 1]->is_dir &&
+            strcmp(sorted[unique - 1]->dst, sorted[i]->dst) == 0)
+            _installer_freeFile(sorted[i]);
+        else
+            sorted[unique++] = sorted[i];
+    }
+
+    // Nothing an install brings back is removed
+    for (int i = 0; i < inst->removals.count; i++) {
+        InstallerFile_s *file = &inst->removals.items[i];
+        if (!file->is_dir && _installer_findDst(sorted, unique, file->dst) >= 0)
+            _installer_freeFile(file);
+    }
+
+    free(sorted);
+
+    // Compact, keeping the package order
+    int count = 0;
+    for (int i = 0; i < inst->copies.count; i++) {
+        InstallerFile_s *file = &inst->copies.items[i];
+        if (file->dst == NULL)
+            continue;
+        inst->copies.items[count++] = *file;
+        if (!file->is_dir)
+            inst->packages[file->package].files_left++;
+    }
+    inst->copies.count = count;
+
+    pthread_mutex_lock(&inst->lock);
+    for (int i = 0; i < inst->copies.count; i++) {
+        if (!inst->copies.items[i].is_dir) {
+            inst->progress.files_total++;
+            inst->progress.bytes_total += inst->copies.items[i].size;
+        }
+    }
+    for (int i = 0; i < inst->removals.count; i++)
+        inst->progress.files_total += inst->removals.items[i].dst != NULL && !inst->removals.items[i].is_dir;
+    pthread_mutex_unlock(&inst->lock);
+}
+
+static void _installer_fileDone(Installer_s *inst, uint64_t bytes, bool ok)
+{
+    pthread_mutex_lock(&inst->lock);
+    inst->progress.files_done++;
+    inst->progress.bytes_done += bytes;
+    if (!ok)
+        inst->progress.errors++;
+    pthread_mutex_unlock(&inst->lock);
+}
+
+static void _installer_remove(Installer_s *inst)
+{
+    int next = 0;
+
+    for (int i = 0; i < inst->package_count; i++) {
+        InstallerPackage_s *pkg = &inst->packages[i];
+
+        if (pkg->install)
+            continue;
+
+        // Uninstall scripts need the files they clean up after
+        _installer_setCurrent(inst, i);
+        if (inst->script != NULL)
+            inst->script(pkg->data_path, pkg->name, false);
+
+        for (; next < inst->removals.count && inst->removals.items[next].package == i; next++) {
+            InstallerFile_s *file = &inst->removals.items[next];
+
+            if (file->dst == NULL)
+                continue;
+
+            if (file->is_dir) {
+                rmdir(file->dst); // only if empty
+                continue;
+            }
+
+            bool ok = remove(file->dst) == 0 || errno == ENOENT;
+            _installer_fileDone(inst, 0, ok);
+        }
+    }
+}
+
+static bool _installer_copyFile(Installer_s *inst, const InstallerFile_s *file, uint8_t *buffer, uint64_t *copied)
+{
+    struct stat st;
+    int in, out;
+    bool ok = true;
+
+    if ((in = open(file->src, O_RDONLY)) < 0)
+        return false;
+
+    mode_t mode = fstat(in, &st) == 0 ? st.st_mode & 0777 : 0644;
+
+    // Like cp -f: replace what can't be opened for writing
+    if ((out = open(file->dst, O_WRONLY | O_CREAT | O_TRUNC, mode)) < 0) {
+        if (errno == ENOENT) {
+            char *parent = file_dirname(file->dst);
+            if (parent != NULL)
+                mkdirs(parent);
+            free(parent);
+        }
+        else {
+            unlink(file->dst);
+        }
+        out = open(file->dst, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    }
+
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+
+    ssize_t n;
+    while ((n = read(in, buffer, INSTALLER_BUFFER_SIZE)) > 0) {
+        for (ssize_t done = 0; done < n;) {
+            ssize_t written = write(out, buffer + done, n - done);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0) {
+                ok = false;
+                break;
+            }
+            done += written;
+        }
+        if (!ok)
+            break;
+
+        *copied += n;
+        pthread_mutex_lock(&inst->lock);
+        inst->progress.bytes_done += n;
+        pthread_mutex_unlock(&inst->lock);
+    }
+
+    ok = ok && n == 0;
+    close(in);
+    return close(out) == 0 && ok;
+}
+
+static void _installer_queueScript(Installer_s *inst, int package)
+{
+    // Called with the lock held
+    inst->script_queue[inst->script_tail++] = package;
+    pthread_cond_signal(&inst->script_cond);
+}
+
+static void *_installer_copyWorker(void *arg)
+{
+    Installer_s *inst = (Installer_s *)arg;
+    uint8_t *buffer = (uint8_t *)malloc(INSTALLER_BUFFER_SIZE);
+
+    if (buffer == NULL)
+        return NULL;
+
+    for (;;) {
+        pthread_mutex_lock(&inst->lock);
+        int index = inst->next_copy;
+        while (index < inst->copies.count && inst->copies.items[index].is_dir)
+            index++;
+        inst->next_copy = index + 1;
+        if (index < inst->copies.count)
+            snprintf(inst->progress.current, STR_MAX, "%s", inst->packages[inst->copies.items[index].package].name);
+        pthread_mutex_unlock(&inst->lock);
+
+        if (index >= inst->copies.count)
+            break;
+
+        InstallerFile_s *file = &inst->copies.items[index];
+        uint64_t copied = 0;
+        bool ok = _installer_copyFile(inst, file, buffer, &copied);
+
+        if (!ok)
+            print_debug("Failed to install a file\n");
+
+        pthread_mutex_lock(&inst->lock);
+        inst->progress.files_done++;
+        if (!ok) {
+            inst->progress.errors++;
+            if (copied < file->size)
+                inst->progress.bytes_done += file->size - copied; // the bar still reaches the end
+        }
+        if (--inst->packages[file->package].files_left == 0)
+            _installer_queueScript(inst, file->package);
+        pthread_mutex_unlock(&inst->lock);
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+static void _installer_postInstall(Installer_s *inst, int package)
+{
+    InstallerPackage_s *pkg = &inst->packages[package];
+
+    if (pkg->config_path[0] != '\0' && (pkg->label[0] != '\0' || pkg->imgpath[0] != '\0')) {
+        cJSON *config = _installer_loadConfig(pkg->config_path);
+        bool changed = false;
+        if (pkg->label[0] != '\0')
+            changed |= _installer_setConfigString(config, "label", pkg->label);
+        if (pkg->imgpath[0] != '\0')
+            changed |= _installer_setConfigString(config, "imgpath", pkg->imgpath);
+        if (changed) {
+            char *output = cJSON_Print(config);
+            if (output != NULL)
+                file_write(pkg->config_path, output, strlen(output));
+            free(output);
+        }
+        cJSON_Delete(config);
+    }
+
+    if (inst->script != NULL)
+        inst->script(pkg->data_path, pkg->name, true);
+}
+
+static void *_installer_scriptWorker(void *arg)
+{
+    Installer_s *inst = (Installer_s *)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&inst->lock);
+        while (inst->script_head == inst->script_tail && !inst->copies_done)
+            pthread_cond_wait(&inst->script_cond, &inst->lock);
+        if (inst->script_head == inst->script_tail) {
+            pthread_mutex_unlock(&inst->lock);
+            break;
+        }
+        int package = inst->script_queue[inst->script_head++];
+        pthread_mutex_unlock(&inst->lock);
+
+        _installer_postInstall(inst, package);
+    }
+
+    return NULL;
+}
+
+static void _installer_setPhase(Installer_s *inst, InstallerPhase_e phase)
+{
+    pthread_mutex_lock(&inst->lock);
+    inst->progress.phase = phase;
+    pthread_mutex_unlock(&inst->lock);
+}
+
+static void *_installer_thread(void *arg)
+{
+    Installer_s *inst = (Installer_s *)arg;
+    pthread_t workers[INSTALLER_WORKERS];
+    pthread_t script_thread;
+    int worker_count = 0;
+
+    _installer_plan(inst);
+
+    _installer_setPhase(inst, INSTALLER_REMOVING);
+    _installer_remove(inst);
+
+    _installer_setPhase(inst, INSTALLER_COPYING);
+
+    // Directories first (each package lists parents before children)
+    for (int i = 0; i < inst->copies.count; i++) {
+        if (inst->copies.items[i].is_dir)
+            mkdir(inst->copies.items[i].dst, 0755);
+    }
+
+    inst->script_queue = (int *)malloc((inst->package_count + 1) * sizeof(int));
+    pthread_create(&script_thread, NULL, _installer_scriptWorker, inst);
+
+    // Packages without any file only have their post-install step
+    pthread_mutex_lock(&inst->lock);
+    for (int i = 0; i < inst->package_count; i++) {
+        if (inst->packages[i].install && inst->packages[i].files_left == 0)
+            _installer_queueScript(inst, i);
+    }
+    pthread_mutex_unlock(&inst->lock);
+
+    for (int i = 0; i < INSTALLER_WORKERS; i++) {
+        if (pthread_create(&workers[worker_count], NULL, _installer_copyWorker, inst) == 0)
+            worker_count++;
+    }
+
+    // No worker at all: copy from here
+    if (worker_count == 0)
+        _installer_copyWorker(inst);
+
+    for (int i = 0; i < worker_count; i++)
+        pthread_join(workers[i], NULL);
+
+    _installer_setPhase(inst, INSTALLER_FINISHING);
+
+    pthread_mutex_lock(&inst->lock);
+    inst->copies_done = true;
+    pthread_cond_signal(&inst->script_cond);
+    pthread_mutex_unlock(&inst->lock);
+
+    pthread_join(script_thread, NULL);
+    sync();
+
+    _installer_setPhase(inst, INSTALLER_DONE);
+    return NULL;
+}
+
+/**
+ * @brief Plans and applies every queued package on a background thread.
+ */
+bool installer_start(Installer_s *inst)
+{
+    inst->started = pthread_create(&inst->thread, NULL, _installer_thread, inst) == 0;
+    return inst->started;
+}
+
+void installer_getProgress(Installer_s *inst, InstallerProgress_s *progress_out)
+{
+    pthread_mutex_lock(&inst->lock);
+    *progress_out = inst->progress;
+    pthread_mutex_unlock(&inst->lock);
+}
+
+bool installer_isDone(Installer_s *inst)
+{
+    InstallerProgress_s progress;
+    installer_getProgress(inst, &progress);
+    return progress.phase == INSTALLER_DONE;
+}
+
+/**
+ * @brief Waits for the engine and frees everything.
+ */
+void installer_free(Installer_s *inst)
+{
+    if (inst->started)
+        pthread_join(inst->thread, NULL);
+
+    for (int i = 0; i < inst->copies.count; i++)
+        _installer_freeFile(&inst->copies.items[i]);
+    for (int i = 0; i < inst->removals.count; i++)
+        _installer_freeFile(&inst->removals.items[i]);
+
+    free(inst->copies.items);
+    free(inst->removals.items);
+    free(inst->packages);
+    free(inst->script_queue);
+    pthread_cond_destroy(&inst->script_cond);
+    pthread_mutex_destroy(&inst->lock);
+    memset(inst, 0, sizeof(Installer_s));
+}
+
+#endif // PACMAN_INSTALLER_H__
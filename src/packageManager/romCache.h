@@ -0,0 +1,331 @@
+#ifndef PACMAN_ROM_CACHE_H__
+#define PACMAN_ROM_CACHE_H__
+
+#include <ctype.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "utils/file.h"
+#include "utils/hash.h"
+#include "utils/json.h"
+#include "utils/log.h"
+
+//
+//    "Has ROMs" results of emulator packages, kept between launches
+//
+//    Entries are keyed by the package's config.json and revalidated
+//    with a few stat() calls instead of a rescan:
+//    - a positive result holds while the ROM that proved it exists,
+//    - a negative one while the ROM folder and its subfolders keep the
+//      mtimes they had when they were scanned.
+//    A changed config.json (rompath/extlist) invalidates its entry.
+//    Folders modified within the last 2 s (FAT mtime resolution) are
+//    not cached, a ROM copied right after the scan would go unnoticed.
+//
+
+#define ROM_CACHE_PATH "/mnt/SDCARD/App/PackageManager/.rom_cache.json"
+#define ROM_CACHE_VERSION 1
+
+#define EXT_SET_SLOTS 128 // power of two
+#define EXT_MAX_LEN 32
+
+typedef struct {
+    char exts[EXT_SET_SLOTS][EXT_MAX_LEN]; // lowercase, "" is a free slot
+    int count;
+} ExtSet_s;
+
+typedef struct {
+    char root[PATH_MAX]; // ROM paths are relative to this ("../../Roms/GB")
+    cJSON *loaded;       // entries from the cache file, moved to `entries` when used
+    cJSON *entries;      // entries looked up this session
+    bool dirty;
+} RomCache_s;
+
+// Returns the slot holding `ext` or the free slot where it belongs
+static int _extSet_slot(const ExtSet_s *set, const char *ext)
+{
+    int slot = hash_strCaseInsensitive(ext) & (EXT_SET_SLOTS - 1);
+
+    while (set->exts[slot][0] != '\0' && strcasecmp(set->exts[slot], ext) != 0)
+        slot = (slot + 1) & (EXT_SET_SLOTS - 1);
+
+    return slot;
+}
+
+/**
+ * @brief Compiles a `|` separated extension list ("gb|gbc|zip"). An
+ * empty list matches every file.
+ */
+void extSet_compile(ExtSet_s *set, const char *extlist)
+{
+    memset(set, 0, sizeof(ExtSet_s));
+
+    while (extlist != NULL && *extlist) {
+        const char *end = strchr(extlist, '|');
+        size_t len = end ? (size_t)(end - extlist) : strlen(extlist);
+        char ext[EXT_MAX_LEN];
+
+        if (len > 0 && len < EXT_MAX_LEN && set->count < EXT_SET_SLOTS / 2) {
+            for (size_t i = 0; i < len; i++)
+                ext[i] = tolower((unsigned char)extlist[i]);
+            ext[len] = '\0';
+
+            int slot = _extSet_slot(set, ext);
+            if (set->exts[slot][0] == '\0') {
+                strcpy(set->exts[slot], ext);
+                set->count++;
+            }
+        }
+
+        extlist = end ? end + 1 : NULL;
+    }
+}
+
+/**
+ * @brief Whether `file_name` is a ROM for this extension list
+ * (.miyoocmd files never are).
+ */
+bool extSet_match(const ExtSet_s *set, const char *file_name)
+{
+    const char *ext = file_getExtension(file_name);
+
+    if (strcasecmp(ext, "miyoocmd") == 0)
+        return false;
+    if (set->count == 0)
+        return true;
+    if (strlen(ext) >= EXT_MAX_LEN)
+        return false;
+
+    return set->exts[_extSet_slot(set, ext)][0] != '\0';
+}
+
+// Looks for a ROM in `rom_dir` and its direct subfolders, recording the
+// mtime of every folder it reads (before reading it) in `dirs`
+static bool _romCache_scan(const char *rom_dir, const ExtSet_s *exts, int level, char *witness, cJSON *dirs)
+{
+    struct stat st;
+    struct dirent *dp;
+    DIR *dir;
+
+    cJSON_AddNumberToObject(dirs, rom_dir, stat(rom_dir, &st) == 0 ? (double)st.st_mtime : -1);
+
+    if ((dir = opendir(rom_dir)) == NULL)
+        return false;
+
+    while ((dp = readdir(dir)) != NULL) {
+        if (dp->d_name[0] == '.')
+            continue;
+
+        if (dp->d_type == DT_DIR) {
+            if (level == 0) {
+                char subdir[PATH_MAX];
+                snprintf(subdir, PATH_MAX - 1, "%s/%s", rom_dir, dp->d_name);
+                if (_romCache_scan(subdir, exts, level + 1, witness, dirs)) {
+                    closedir(dir);
+                    return true;
+                }
+            }
+            continue;
+        }
+
+        if (dp->d_type == DT_REG && extSet_match(exts, dp->d_name)) {
+            snprintf(witness, PATH_MAX - 1, "%s/%s", rom_dir, dp->d_name);
+            closedir(dir);
+            return true;
+        }
+    }
+
+    closedir(dir);
+    return false;
+}
+
+static bool _romCache_isValid(cJSON *entry, const char *config_path)
+{
+    struct stat st;
+    cJSON *item;
+
+    if (stat(config_path, &st) != 0 ||
+        (item = cJSON_GetObjectItem(entry, "config_mtime")) == NULL ||
+        (time_t)cJSON_GetNumberValue(item) != st.st_mtime)
+        return false;
+
+    if (cJSON_IsTrue(cJSON_GetObjectItem(entry, "has_roms"))) {
+        const char *witness = cJSON_GetStringValue(cJSON_GetObjectItem(entry, "witness"));
+        return witness != NULL && stat(witness, &st) == 0 && S_ISREG(st.st_mode);
+    }
+
+    cJSON *dirs = cJSON_GetObjectItem(entry, "dirs");
+    if (dirs == NULL)
+        return false;
+
+    cJSON_ArrayForEach(item, dirs)
+    {
+        double mtime = stat(item->string, &st) == 0 ? (double)st.st_mtime : -1;
+        if (mtime != cJSON_GetNumberValue(item))
+            return false;
+    }
+
+    return true;
+}
+
+static cJSON *_romCache_build(RomCache_s *cache, const char *config_path)
+{
+    struct stat st;
+    char roms_rel_path[JSON_STRING_LEN] = {0};
+    char extlist[JSON_STRING_LEN] = {0};
+    char rom_dir[PATH_MAX];
+    char witness[PATH_MAX];
+    ExtSet_s exts;
+
+    if (stat(config_path, &st) != 0)
+        return NULL;
+
+    cJSON *config = json_load(config_path);
+    bool valid = config != NULL && json_getString(config, "rompath", roms_rel_path);
+    json_getString(config, "extlist", extlist);
+    cJSON_Delete(config);
+
+    cJSON *entry = cJSON_CreateObject();
+    cJSON_AddNumberToObject(entry, "config_mtime", (double)st.st_mtime);
+
+    if (!valid || strncmp(roms_rel_path, "../../", 6) != 0 ||
+        snprintf(rom_dir, sizeof(rom_dir), "%s/%s", cache->root, roms_rel_path + 6) >= (int)sizeof(rom_dir)) {
+        // Nothing to scan, only the config can change that
+        cJSON_AddFalseToObject(entry, "has_roms");
+        cJSON_AddObjectToObject(entry, "dirs");
+        return entry;
+    }
+
+    extSet_compile(&exts, extlist);
+
+    cJSON *dirs = cJSON_CreateObject();
+    time_t scan_time = time(NULL);
+
+    if (_romCache_scan(rom_dir, &exts, 0, witness, dirs)) {
+        cJSON_Delete(dirs);
+        cJSON_AddTrueToObject(entry, "has_roms");
+        cJSON_AddStringToObject(entry, "witness", witness);
+        return entry;
+    }
+
+    cJSON_AddFalseToObject(entry, "has_roms");
+    cJSON_AddItemToObject(entry, "dirs", dirs);
+
+    cJSON *item;
+    cJSON_ArrayForEach(item, dirs)
+    {
+        if (cJSON_GetNumberValue(item) >= (double)(scan_time - FILE_MTIME_RACY_S)) {
+            // A change right after the scan would keep this mtime: the
+            // result holds for this session only
+            cJSON_DeleteItemFromObjectCaseSensitive(entry, "dirs");
+            break;
+        }
+    }
+
+    return entry;
+}
+
+/**
+ * @brief Loads the cache file (a missing or outdated one is ignored).
+ *
+ * @param root What the packages' "../../" rompaths point to, "/mnt/SDCARD"
+ */
+void romCache_load(RomCache_s *cache, const char *cache_path, const char *root)
+{
+    memset(cache, 0, sizeof(RomCache_s));
+    strncpy(cache->root, root, PATH_MAX - 1);
+    cache->entries = cJSON_CreateObject();
+
+    cJSON *file = exists(cache_path) ? json_load(cache_path) : NULL;
+    int version = 0;
+
+    if (file != NULL && json_getInt(file, "version", &version) && version == ROM_CACHE_VERSION)
+        cache->loaded = cJSON_DetachItemFromObject(file, "packages");
+
+    if (cache->loaded == NULL)
+        cache->loaded = cJSON_CreateObject();
+
+    cJSON_Delete(file);
+}
+
+/**
+ * @brief Whether the ROM folder of the emulator package described by
+ * `config_path` holds at least one ROM.
+ */
+bool romCache_hasRoms(RomCache_s *cache, const char *config_path)
+{
+    cJSON *entry = cJSON_DetachItemFromObjectCaseSensitive(cache->loaded, config_path);
+
+    if (entry != NULL && !_romCache_isValid(entry, config_path)) {
+        print_debug("ROM cache entry outdated\n");
+        cJSON_Delete(entry);
+        entry = NULL;
+    }
+
+    if (entry == NULL) {
+        cache->dirty = true;
+        if ((entry = _romCache_build(cache, config_path)) == NULL)
+            return false;
+    }
+
+    bool has_roms = cJSON_IsTrue(cJSON_GetObjectItem(entry, "has_roms"));
+
+    cJSON_DeleteItemFromObjectCaseSensitive(cache->entries, config_path);
+    cJSON_AddItemToObject(cache->entries, config_path, entry);
+
+    return has_roms;
+}
+
+/**
+ * @brief Writes the entries used since romCache_load() if anything
+ * changed. Packages that weren't looked up are dropped.
+ */
+void romCache_save(RomCache_s *cache, const char *cache_path)
+{
+    char tmp_path[PATH_MAX];
+
+    if (!cache->dirty && cJSON_GetArraySize(cache->loaded) == 0)
+        return;
+
+    cJSON *file = cJSON_CreateObject();
+    cJSON_AddNumberToObject(file, "version", ROM_CACHE_VERSION);
+    cJSON_AddItemReferenceToObject(file, "packages", cache->entries);
+
+    char *output = cJSON_PrintUnformatted(file);
+    cJSON_Delete(file);
+
+    if (output == NULL)
+        return;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path);
+    FILE *fp = fopen(tmp_path, "w");
+
+    if (fp != NULL) {
+        bool ok = fputs(output, fp) >= 0;
+        ok = fclose(fp) == 0 && ok;
+        if (!ok || rename(tmp_path, cache_path) != 0)
+            remove(tmp_path);
+    }
+
+    cJSON_free(output);
+
+    // Nothing left to drop, the next save only happens on a change
+    cJSON_Delete(cache->loaded);
+    cache->loaded = cJSON_CreateObject();
+    cache->dirty = false;
+}
+
+void romCache_free(RomCache_s *cache)
+{
+    cJSON_Delete(cache->loaded);
+    cJSON_Delete(cache->entries);
+    memset(cache, 0, sizeof(RomCache_s));
+}
+
+#endif // PACMAN_ROM_CACHE_H__
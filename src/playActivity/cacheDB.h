@@ -23,7 +23,8 @@ sqlite3 *cache_db = NULL;
 
 void cache_db_close(void)
 {
-    sqlite3_close(cache_db);
+    // Deferred until the last statement is finalized (see cache_db_prepare)
+    sqlite3_close_v2(cache_db);
     cache_db = NULL;
 }
 
@@ -27,7 +27,8 @@ int main(int argc, char *argv[])
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "start") == 0) {
             if (i + 1 < argc) {
-                play_activity_start(argv[++i]);
+                if (!play_activity_start(argv[++i]))
+                    return EXIT_FAILURE;
             }
             else {
                 printf("Error: Missing rom_path argument\n");
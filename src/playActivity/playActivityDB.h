@@ -458,16 +458,17 @@ int __db_get_active_closed_activity(void)
     return rom_id;
 }
 
-void play_activity_start(char *rom_file_path)
+bool play_activity_start(char *rom_file_path)
 {
     printf_debug("\n:: play_activity_start(%s)\n", rom_file_path);
     int rom_id = play_activity_transaction_rom_find_by_file_path(rom_file_path, true);
     if (rom_id == ROM_NOT_FOUND) {
-        exit(1);
+        return false;
     }
     char *sql = sqlite3_mprintf("INSERT INTO play_activity(rom_id) VALUES(%d);", rom_id);
     play_activity_db_execute(sql);
     sqlite3_free(sql);
+    return true;
 }
 
 void play_activity_resume(void)
@@ -6,6 +6,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "utils/imageBatch.h"
+
 #define ALIGN4K(val) ((val + 4095) & (~4095))
 #define ERROR(str)                 \
     {                              \
@@ -55,6 +57,77 @@ void GFX_BlitSurface(MI_PHY srcPa, void *srcVa, uint32_t sw, uint32_t sh,
     MI_GFX_WaitAllDone(FALSE, Fence);
 }
 
+//
+//	Batch mode decoder, streams rows into the software scaler
+//
+static bool batchDecodePng(const char *path, ImageBatchSink_s *sink)
+{
+    png_structp png_ptr;
+    png_infop info_ptr;
+    png_byte sig_bytes[8];
+    uint32_t sw, sh, dw, dh, y;
+    uint8_t *row;
+    int passes;
+    FILE *fp;
+
+    if (!(fp = fopen(path, "rb")))
+        return false;
+    if (fread(sig_bytes, sizeof(sig_bytes), 1, fp) != 1 ||
+        png_sig_cmp(sig_bytes, 0, sizeof(sig_bytes))) {
+        fprintf(stderr, "%s: png format error\n", path);
+        fclose(fp);
+        return false;
+    }
+
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, sink,
+                                     imageBatch_pngError, imageBatch_pngWarning);
+    info_ptr = png_create_info_struct(png_ptr);
+    if (setjmp(sink->jmp)) {
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        fclose(fp);
+        return false;
+    }
+
+    png_init_io(png_ptr, fp);
+    png_set_sig_bytes(png_ptr, sizeof(sig_bytes));
+    png_read_info(png_ptr, info_ptr);
+    sw = png_get_image_width(png_ptr, info_ptr);
+    sh = png_get_image_height(png_ptr, info_ptr);
+
+    // Always decode to RGBA8888
+    png_set_expand(png_ptr);
+    png_set_strip_16(png_ptr);
+    png_set_packing(png_ptr);
+    png_set_gray_to_rgb(png_ptr);
+    png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER);
+    passes = png_set_interlace_handling(png_ptr);
+    png_read_update_info(png_ptr, info_ptr);
+
+    imageBatch_fit(sink->max_w, sink->max_h, sw, sh, &dw, &dh);
+    if ((row = imageBatch_begin(sink, sw, sh, dw, dh, 4)) != NULL) {
+        if (passes > 1) {
+            // Interlaced images can't be streamed
+            uint8_t *image = imageBatch_scratch(sink, (size_t)sw * sh * 4);
+            for (int pass = 0; pass < passes; pass++)
+                for (y = 0; y < sh; y++)
+                    png_read_row(png_ptr, image + (size_t)y * sw * 4, NULL);
+            for (y = 0; y < sh; y++)
+                imageBatch_pushRow(sink, image + (size_t)y * sw * 4);
+        }
+        else {
+            for (y = 0; y < sh; y++) {
+                png_read_row(png_ptr, row, NULL);
+                imageBatch_pushRow(sink, row);
+            }
+        }
+        png_read_end(png_ptr, NULL);
+    }
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    fclose(fp);
+    return true;
+}
+
 //
 //	Scale png
 //
@@ -72,6 +145,11 @@ int main(int argc, char *argv[])
     uint32_t *src, *dst, pix, x, y, sw, sh, dw, dh, ss = 0, ds = 0, mw = 250,
                                                     mh = 360;
 
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        ImageBatchConfig_s config = {"pngScale", "png", batchDecodePng};
+        return imageBatch_main(argc - 1, argv + 1, &config);
+    }
+
     // Read commandline and open src
     if (argc < 3)
         goto usage;
@@ -218,8 +296,9 @@ int main(int argc, char *argv[])
 
 usage:
     printf(
-        "usage: %s src.png dst.png [max_width:def=250] [max_height:def=360]\n",
-        argv[0]);
+        "usage: %s src.png dst.png [max_width:def=250] [max_height:def=360]\n"
+        "       %s --batch <dir|list.txt>... [-o out_dir] [-w max_width] [-h max_height] [-j workers]\n",
+        argv[0], argv[0]);
 error:
     if (srcVa)
         MI_SYS_Munmap(srcVa, ss);
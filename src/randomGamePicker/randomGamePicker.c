@@ -4,11 +4,14 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 
 #include "cjson/cJSON.h"
 #include "components/JsonGameEntry.h"
 #include "utils/file.h"
 #include "utils/flags.h"
+#include "utils/journal.h"
+#include "utils/jsonLine.h"
 #include "utils/log.h"
 
 #define MAX_SYSTEMS 500
@@ -18,6 +21,10 @@
 #define PATH_RECENTS "/mnt/SDCARD/Roms/recentlist.json"
 #define PATH_EMU "/mnt/SDCARD/Emu/"
 #define PATH_RAPP "/mnt/SDCARD/RApp/"
+#define PATH_MANIFEST "/mnt/SDCARD/Emu/.random_manifest"
+
+#define MANIFEST_HEADER "randomGamePicker manifest v1"
+#define MANIFEST_FIELDS 7
 
 typedef struct game_entry_s {
     int id;
@@ -30,11 +37,27 @@ typedef struct game_entry_s {
     char launch_path[STR_MAX * 2];
 } GameEntry;
 
+typedef struct system_entry_s {
+    char emupath[STR_MAX + 17];
+    long config_mtime;
+    long cache_mtime;
+    int count;
+    char emu_name[STR_MAX];
+    char romsdir[STR_MAX * 2 + 2];
+    char launch_path[STR_MAX * 2 + 2];
+    bool seen; // not stored, set when the Emu folder still exists
+} SystemEntry;
+
 static GameEntry
-    random_games[MAX_SYSTEMS]; // contains a random game for each system
+    random_games[MAX_SYSTEMS]; // picked games, or favorites/recents
 static int system_count = 0;
 static int total_games_count = 0;
 
+static SystemEntry manifest[MAX_SYSTEMS];
+static int manifest_count = 0;
+static SystemEntry *systems[MAX_SYSTEMS]; // systems with games, in order
+static int c_sums[MAX_SYSTEMS];           // cumulative game counts
+
 void print_game(GameEntry *game)
 {
     printf("emu=%s\n"
@@ -102,93 +125,306 @@ bool loadEmuConfig(char *emupath, char *emuname_out, char *romsdir_out,
 int getTotalGamesCount(sqlite3 *db, const char *table_name)
 {
     sqlite3_stmt *res;
-    const char *sql = sqlite3_mprintf(
+    char *sql = sqlite3_mprintf(
         "SELECT COUNT(id) FROM %q WHERE type=0 AND path NOT LIKE '%%.miyoocmd'",
         table_name);
-    if (sqlite3_prepare_v2(db, sql, -1, &res, 0) != SQLITE_OK)
-        return 0;
-    if (sqlite3_step(res) != SQLITE_ROW) {
-        sqlite3_finalize(res);
+    int rc = sqlite3_prepare_v2(db, sql, -1, &res, 0);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK)
         return 0;
+    int count = sqlite3_step(res) == SQLITE_ROW ? sqlite3_column_int(res, 0) : 0;
+    sqlite3_finalize(res);
+    return count;
+}
+
+static long getMtime(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_mtime : 0;
+}
+
+static void getCachePath(const SystemEntry *sys, char *cache_path_out, char *table_name_out)
+{
+    char romsdir[STR_MAX * 2 + 2];
+    strcpy(romsdir, sys->romsdir);
+    const char *name = basename(romsdir);
+    snprintf(cache_path_out, STR_MAX * 3 - 1, "%s/%s_cache6.db", sys->romsdir, name);
+    if (table_name_out != NULL)
+        snprintf(table_name_out, STR_MAX, "%s_roms", name);
+}
+
+//
+//    Manifest: per-system game counts, so a pick only opens one cache DB
+//
+//    One line per Emu folder: path, config.json mtime, cache DB mtime,
+//    count, label, roms dir and launch script, tab separated. An entry is
+//    reused as long as both mtimes match.
+//
+static void loadManifest(void)
+{
+    FILE *fp;
+    char line[STR_MAX * 8];
+
+    manifest_count = 0;
+
+    if ((fp = fopen(PATH_MANIFEST, "r")) == NULL)
+        return;
+
+    if (fgets(line, sizeof(line), fp) == NULL || strcmp(line, MANIFEST_HEADER "\n") != 0) {
+        fclose(fp);
+        return;
     }
-    return sqlite3_column_int(res, 0);
+
+    while (manifest_count < MAX_SYSTEMS && fgets(line, sizeof(line), fp) != NULL) {
+        SystemEntry *sys = &manifest[manifest_count];
+        char *fields[MANIFEST_FIELDS];
+        char *save = NULL;
+        int n = 0;
+
+        line[strcspn(line, "\n")] = '\0';
+
+        // strtok would merge the empty fields of invalid systems
+        for (char *p = line; n < MANIFEST_FIELDS; n++) {
+            fields[n] = p;
+            if ((save = strchr(p, '\t')) == NULL) {
+                n++;
+                break;
+            }
+            *save = '\0';
+            p = save + 1;
+        }
+
+        if (n != MANIFEST_FIELDS)
+            continue;
+
+        memset(sys, 0, sizeof(SystemEntry));
+        strncpy(sys->emupath, fields[0], sizeof(sys->emupath) - 1);
+        sys->config_mtime = atol(fields[1]);
+        sys->cache_mtime = atol(fields[2]);
+        sys->count = atoi(fields[3]);
+        strncpy(sys->emu_name, fields[4], sizeof(sys->emu_name) - 1);
+        strncpy(sys->romsdir, fields[5], sizeof(sys->romsdir) - 1);
+        strncpy(sys->launch_path, fields[6], sizeof(sys->launch_path) - 1);
+        manifest_count++;
+    }
+
+    fclose(fp);
 }
 
-bool pickRandomGameFromCache(char *emuname, char *romsdir,
-                             const char *launch_path)
+static void saveManifest(bool prune)
 {
-    sqlite3 *db;
-    sqlite3_stmt *res;
+    FILE *fp;
 
-    char cache_path[STR_MAX * 3];
-    snprintf(cache_path, STR_MAX * 3 - 1, "%s/%s_cache6.db", romsdir,
-             basename(romsdir));
-    printf_debug("cache: %s\n", cache_path);
+    if ((fp = fopen(PATH_MANIFEST ".tmp", "w")) == NULL)
+        return;
 
-    if (!is_file(cache_path))
-        return false;
+    fprintf(fp, MANIFEST_HEADER "\n");
 
+    for (int i = 0; i < manifest_count; i++) {
+        SystemEntry *sys = &manifest[i];
+        if (prune && !sys->seen)
+            continue;
+        fprintf(fp, "%s\t%ld\t%ld\t%d\t%s\t%s\t%s\n", sys->emupath,
+                sys->config_mtime, sys->cache_mtime, sys->count, sys->emu_name,
+                sys->romsdir, sys->launch_path);
+    }
+
+    fclose(fp);
+    rename(PATH_MANIFEST ".tmp", PATH_MANIFEST);
+}
+
+static SystemEntry *findManifestEntry(const char *emupath)
+{
+    for (int i = 0; i < manifest_count; i++) {
+        if (strcmp(manifest[i].emupath, emupath) == 0)
+            return &manifest[i];
+    }
+
+    if (manifest_count == MAX_SYSTEMS)
+        return NULL;
+
+    SystemEntry *sys = &manifest[manifest_count++];
+    memset(sys, 0, sizeof(SystemEntry));
+    strncpy(sys->emupath, emupath, sizeof(sys->emupath) - 1);
+    sys->config_mtime = -1;
+    return sys;
+}
+
+/**
+ * @brief Bring the manifest entry of an Emu folder up to date and add it to
+ * the weighted system list if it has any games
+ *
+ * @return true if the manifest entry changed
+ */
+bool addSystemFromEmu(char *emupath)
+{
+    char config_path[STR_MAX + 30];
+    char cache_path[STR_MAX * 3];
     char table_name[STR_MAX];
-    snprintf(table_name, STR_MAX, "%s_roms", basename(romsdir));
+    bool changed = false;
 
-    if (sqlite3_open(cache_path, &db) != SQLITE_OK) {
-        fprintf(stderr, "Cannot open database: %s (%s)\n", sqlite3_errmsg(db),
-                cache_path);
-        sqlite3_close(db);
+    SystemEntry *sys = findManifestEntry(emupath);
+    if (sys == NULL)
         return false;
+    sys->seen = true;
+
+    snprintf(config_path, sizeof(config_path), "%s/config.json", emupath);
+    long config_mtime = getMtime(config_path);
+
+    if (config_mtime != sys->config_mtime) {
+        sys->config_mtime = config_mtime;
+        sys->cache_mtime = -1;
+        sys->count = 0;
+        if (!loadEmuConfig(emupath, sys->emu_name, sys->romsdir, sys->launch_path, NULL))
+            sys->romsdir[0] = '\0';
+        changed = true;
     }
 
-    int count = getTotalGamesCount(db, table_name);
+    if (strlen(sys->romsdir) == 0)
+        return changed;
+
+    getCachePath(sys, cache_path, table_name);
+    long cache_mtime = getMtime(cache_path);
+
+    if (cache_mtime != sys->cache_mtime) {
+        sqlite3 *db;
 
-    const char *sql = sqlite3_mprintf("SELECT id, pinyin, path, imgpath FROM "
-                                      "%q WHERE type=0 AND path NOT LIKE "
-                                      "'%%.miyoocmd' ORDER BY RANDOM() LIMIT 1",
-                                      table_name);
+        sys->cache_mtime = cache_mtime;
+        sys->count = 0;
+        changed = true;
 
-    if (sqlite3_prepare_v2(db, sql, -1, &res, 0) != SQLITE_OK) {
+        printf_debug("counting: %s\n", cache_path);
+
+        db = NULL;
+        if (cache_mtime != 0 && sqlite3_open_v2(cache_path, &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK)
+            sys->count = getTotalGamesCount(db, table_name);
         sqlite3_close(db);
-        return false;
     }
 
-    if (sqlite3_step(res) == SQLITE_ROW) {
-        GameEntry *game = &random_games[system_count];
+    if (sys->count > 0 && system_count < MAX_SYSTEMS) {
+        total_games_count += sys->count;
+        systems[system_count] = sys;
+        c_sums[system_count] = total_games_count;
         system_count++;
-        total_games_count += count;
+    }
 
-        game->id = sqlite3_column_int(res, 0);
-        game->sum = count;
-        game->c_sum = total_games_count;
+    return changed;
+}
 
-        strncpy(game->label, (const char *)sqlite3_column_text(res, 1),
-                STR_MAX - 1);
-        strncpy(game->path, (const char *)sqlite3_column_text(res, 2),
-                STR_MAX - 1);
-        strncpy(game->img_path, (const char *)sqlite3_column_text(res, 3),
-                STR_MAX - 1);
+/**
+ * @brief Find the system holding game `index` of all games, by binary
+ * search over the cumulative counts
+ */
+static int findSystemByIndex(int index)
+{
+    int lo = 0, hi = system_count - 1;
 
-        strncpy(game->launch_path, launch_path, STR_MAX * 2 - 1);
-        strncpy(game->emu_name, emuname, STR_MAX - 1);
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (index < c_sums[mid])
+            hi = mid;
+        else
+            lo = mid + 1;
     }
 
-    sqlite3_finalize(res);
+    return lo;
+}
+
+/**
+ * @brief Fetch game `index` (0 based, over all systems) into `game`,
+ * reading a single row from a single cache DB
+ */
+bool fetchGameByIndex(int index, GameEntry *game)
+{
+    sqlite3 *db;
+    sqlite3_stmt *res;
+    char cache_path[STR_MAX * 3];
+    char table_name[STR_MAX];
+    bool found = false;
+
+    int s = findSystemByIndex(index);
+    SystemEntry *sys = systems[s];
+    int offset = index - (c_sums[s] - sys->count);
+
+    getCachePath(sys, cache_path, table_name);
+
+    if (sqlite3_open_v2(cache_path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Cannot open database: %s (%s)\n", sqlite3_errmsg(db),
+                cache_path);
+        sqlite3_close(db);
+        return false;
+    }
+
+    char *sql = sqlite3_mprintf("SELECT id, pinyin, path, imgpath FROM "
+                                "%q WHERE type=0 AND path NOT LIKE "
+                                "'%%.miyoocmd' LIMIT 1 OFFSET %d",
+                                table_name, offset);
+
+    if (sqlite3_prepare_v2(db, sql, -1, &res, 0) == SQLITE_OK) {
+        if (sqlite3_step(res) == SQLITE_ROW) {
+            memset(game, 0, sizeof(GameEntry));
+            game->id = sqlite3_column_int(res, 0);
+            game->sum = sys->count;
+            game->c_sum = c_sums[s];
+
+            strncpy(game->label, (const char *)sqlite3_column_text(res, 1),
+                    STR_MAX - 1);
+            strncpy(game->path, (const char *)sqlite3_column_text(res, 2),
+                    STR_MAX - 1);
+            strncpy(game->img_path, (const char *)sqlite3_column_text(res, 3),
+                    STR_MAX - 1);
+
+            strncpy(game->launch_path, sys->launch_path, STR_MAX * 2 - 1);
+            strncpy(game->emu_name, sys->emu_name, STR_MAX - 1);
+            found = true;
+        }
+        sqlite3_finalize(res);
+    }
+
+    sqlite3_free(sql);
     sqlite3_close(db);
 
-    return true;
+    return found;
 }
 
-bool addRandomFromEmu(char *emupath)
+/**
+ * @brief Pick `n` distinct games over all systems, weighted by game count
+ * (Floyd's sampling over the global game index)
+ *
+ * @return int Number of games written to `random_games`
+ */
+int pickRandomGames(int n)
 {
-    char emuname[STR_MAX];
-    char romsdir[STR_MAX * 2 + 2];
-    char launch_path[STR_MAX * 2 + 2];
+    static int picks[MAX_SYSTEMS];
+    int count = 0;
 
-    if (!loadEmuConfig(emupath, emuname, romsdir, launch_path, NULL))
-        return false;
+    if (n > total_games_count)
+        n = total_games_count;
+    if (n > MAX_SYSTEMS)
+        n = MAX_SYSTEMS;
 
-    printf_debug("\nemuname: %s\nromsdir: %s\nlaunch: %s\n", emuname, romsdir,
-                 launch_path);
+    for (int j = total_games_count - n; j < total_games_count; j++) {
+        int t = rand() % (j + 1);
+        bool taken = false;
 
-    return pickRandomGameFromCache(emuname, romsdir, launch_path);
+        for (int i = 0; i < count; i++) {
+            if (picks[i] == t) {
+                taken = true;
+                break;
+            }
+        }
+
+        picks[count++] = taken ? j : t;
+    }
+
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        printf_debug("rwi: %d\n", picks[i]);
+        if (fetchGameByIndex(picks[i], &random_games[found]))
+            found++;
+    }
+
+    return found;
 }
 
 typedef enum {
@@ -217,33 +453,32 @@ bool addRandomFromJson(char *json_path)
     char line[STR_MAX * 4];
     char path_a[STR_MAX];
     char path_b[STR_MAX];
-    cJSON *json_root;
-    JsonEntryType_e type;
+    int type;
 
-    if ((fp = fopen(json_path, "r")) == NULL)
+    if ((fp = journal_open(json_path)) == NULL)
         return false;
 
     while (fgets(line, sizeof(line), fp)) {
-        json_root = cJSON_Parse(line);
-        if(!json_getInt(json_root, "type", (int *)&type)) {
+        GameEntry *game = &random_games[count];
+        game->label[0] = game->path[0] = game->img_path[0] = game->launch_path[0] = '\0';
+
+        JsonLineField_s fields[] = {
+            JSON_LINE_INT("type", &type),
+            JSON_LINE_STRING("label", game->label),
+            JSON_LINE_STRING("rompath", game->path),
+            JSON_LINE_STRING("imgpath", game->img_path),
+            JSON_LINE_STRING("launch", game->launch_path),
+        };
+
+        if (!jsonLine_read(line, fields, 5) || !fields[0].found) {
             print_debug("Malformed json; Skipping\n");
             continue;
         }
 
         if (type == TYPE_GAME || type == TYPE_EXPERT) {
-            GameEntry *game = &random_games[count];
-            memset(game->label, 0, strlen(game->label));
-            memset(game->path, 0, strlen(game->path));
-            memset(game->img_path, 0, strlen(game->img_path));
-            memset(game->launch_path, 0, strlen(game->launch_path));
-
             game->id = type;
             game->sum = 1;
             game->c_sum = count + 1;
-            json_getString(json_root, "label", game->label);
-            json_getString(json_root, "rompath", game->path);
-            json_getString(json_root, "imgpath", game->img_path);
-            json_getString(json_root, "launch", game->launch_path);
 
             if (!is_file(game->path))
                 continue;
@@ -289,8 +524,6 @@ bool addRandomFromJson(char *json_path)
 
             count++;
         }
-
-        cJSON_Delete(json_root);
     }
 
     total_games_count = system_count = count;
@@ -306,7 +539,7 @@ bool addRandomFromJson(char *json_path)
 
 void logWeights()
 {
-    GameEntry *g;
+    SystemEntry *sys;
     FILE *fp;
 
     if ((fp = fopen("/mnt/SDCARD/Emu/random_weights.log", "w+")) == NULL)
@@ -324,13 +557,13 @@ void logWeights()
     fprintf(fp, THIN_BAR "\n");
 
     for (int i = 0; i < system_count; i++) {
-        g = &random_games[i];
+        sys = systems[i];
 
-        float weight = (float)g->sum / total_games_count;
-        float chance = 1.0 / g->sum;
+        float weight = (float)sys->count / total_games_count;
+        float chance = 1.0 / sys->count;
 
         fprintf(fp, " %-15s  %6d    %6.2f%%  %6.2f%%    %6.2f%%  %6.2f%%\n",
-                g->emu_name, g->sum, weight * 100, equal_chance * 100,
+                sys->emu_name, sys->count, weight * 100, equal_chance * 100,
                 system_chance * 100, chance * system_chance * 100);
     }
 
@@ -353,6 +586,8 @@ typedef enum {
 int main(int argc, char *argv[])
 {
     int random_number = 0;
+    int shuffle_count = 0;
+    bool manifest_changed = false;
     srand(time(NULL));
 
     DIR *dp;
@@ -366,6 +601,8 @@ int main(int argc, char *argv[])
             mode = MODE_FAVORITES;
         else if (strcmp("--recents", argv[1]) == 0)
             mode = MODE_RECENTS;
+        else if (strcmp("--shuffle", argv[1]) == 0)
+            shuffle_count = argc > 2 ? atoi(argv[2]) : 10;
         else {
             strncpy(emupath, argv[1], STR_MAX + 16);
             mode = MODE_SINGLE_SYSTEM;
@@ -377,23 +614,28 @@ int main(int argc, char *argv[])
     case MODE_RECENTS:
         addRandomFromJson(mode == MODE_FAVORITES ? PATH_FAVORITES
                                                  : PATH_RECENTS);
-        random_number = rand() % total_games_count;
+        if (total_games_count > 0)
+            random_number = rand() % total_games_count;
         break;
     case MODE_SINGLE_SYSTEM:
         printf_debug("mode: single, emupath: %s\n", emupath);
-        addRandomFromEmu(emupath);
+        loadManifest();
+        if (addSystemFromEmu(emupath))
+            saveManifest(false);
+        system_count = total_games_count > 0 ? pickRandomGames(1) : 0;
         break;
     case MODE_ALL:
     default:
-        if ((dp = opendir("/mnt/SDCARD/Emu")) != NULL) {
+        loadManifest();
 
-            // choose a random game from all emus
+        if ((dp = opendir("/mnt/SDCARD/Emu")) != NULL) {
             while ((ep = readdir(dp))) {
-                if (ep->d_type != DT_DIR)
+                if (ep->d_type != DT_DIR || ep->d_name[0] == '.')
                     continue;
                 snprintf(emupath, STR_MAX + 16, "/mnt/SDCARD/Emu/%s",
                          ep->d_name);
-                addRandomFromEmu(emupath);
+                if (addSystemFromEmu(emupath))
+                    manifest_changed = true;
             }
 
             closedir(dp);
@@ -402,24 +644,35 @@ int main(int argc, char *argv[])
             perror("Emu folder does not exists");
         }
 
-        int random_weighted_index = rand() % total_games_count;
+        // Drop the entries of removed Emu folders
+        for (int i = 0; i < manifest_count && !manifest_changed; i++)
+            manifest_changed = !manifest[i].seen;
+
+        if (manifest_changed)
+            saveManifest(true);
+
         printf_debug("total: %d\n", total_games_count);
-        printf_debug("rwi: %d\n", random_weighted_index);
 
-        for (int i = 0; i < system_count; i++) {
-            if (random_weighted_index < random_games[i].c_sum) {
-                random_number = i;
-                break;
-            }
-        }
+        if (total_games_count > 0)
+            logWeights();
 
-        logWeights();
+        system_count = total_games_count > 0 ? pickRandomGames(shuffle_count > 0 ? shuffle_count : 1) : 0;
         break;
     }
 
     if (system_count == 0)
         return ERROR_CODE_NO_GAME_FOUND;
 
+    if (shuffle_count > 0) {
+        // Shuffle view: list the picks, don't launch anything
+        for (int i = 0; i < system_count; i++) {
+            if (i > 0)
+                printf("\n");
+            print_game(&random_games[i]);
+        }
+        return EXIT_SUCCESS;
+    }
+
     GameEntry *chosen_game = &random_games[random_number];
 
     char cmd_to_run[STR_MAX * 3 + 65];
@@ -438,4 +691,4 @@ int main(int argc, char *argv[])
 
     fflush(stdin);
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,121 @@
+#ifndef SCREEN_RECORDER_FRAME_RING_H__
+#define SCREEN_RECORDER_FRAME_RING_H__
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+//    Single producer / single consumer ring of preallocated frames
+//
+//    The capture thread converts straight into the slot it acquires and
+//    the encoder thread writes that same slot to the encoder, so a frame
+//    is never copied once it has left the framebuffer. When every slot
+//    is taken the producer doesn't wait: the frame is dropped before it
+//    costs a conversion.
+//
+
+typedef struct {
+    uint8_t *data; // slot_count * slot_size
+    size_t slot_size;
+    int slot_count;
+    unsigned int head; // frames committed
+    unsigned int tail; // frames released
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} FrameRing_s;
+
+bool frameRing_init(FrameRing_s *ring, int slot_count, size_t slot_size)
+{
+    memset(ring, 0, sizeof(FrameRing_s));
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->cond, NULL);
+
+    ring->slot_count = slot_count;
+    ring->slot_size = slot_size;
+    return (ring->data = (uint8_t *)malloc(slot_count * slot_size)) != NULL;
+}
+
+/**
+ * @brief Number of frames waiting for the encoder.
+ */
+int frameRing_fill(FrameRing_s *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    int fill = (int)(ring->head - ring->tail);
+    pthread_mutex_unlock(&ring->lock);
+    return fill;
+}
+
+/**
+ * @brief Producer: the next free slot, NULL if the ring is full. The
+ * slot is only handed to the consumer by frameRing_commit().
+ */
+uint8_t *frameRing_acquire(FrameRing_s *ring)
+{
+    uint8_t *slot = NULL;
+
+    pthread_mutex_lock(&ring->lock);
+    if ((int)(ring->head - ring->tail) < ring->slot_count)
+        slot = ring->data + (ring->head % ring->slot_count) * ring->slot_size;
+    pthread_mutex_unlock(&ring->lock);
+
+    return slot;
+}
+
+void frameRing_commit(FrameRing_s *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    ring->head++;
+    pthread_cond_signal(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/**
+ * @brief Consumer: waits for the oldest committed frame. Returns NULL
+ * once the ring is closed and drained.
+ */
+uint8_t *frameRing_peek(FrameRing_s *ring)
+{
+    uint8_t *slot = NULL;
+
+    pthread_mutex_lock(&ring->lock);
+    while (ring->head == ring->tail && !ring->closed)
+        pthread_cond_wait(&ring->cond, &ring->lock);
+    if (ring->head != ring->tail)
+        slot = ring->data + (ring->tail % ring->slot_count) * ring->slot_size;
+    pthread_mutex_unlock(&ring->lock);
+
+    return slot;
+}
+
+void frameRing_release(FrameRing_s *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    ring->tail++;
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/**
+ * @brief No more frames, the consumer drains what's left.
+ */
+void frameRing_close(FrameRing_s *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    ring->closed = true;
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+void frameRing_free(FrameRing_s *ring)
+{
+    free(ring->data);
+    pthread_cond_destroy(&ring->cond);
+    pthread_mutex_destroy(&ring->lock);
+    memset(ring, 0, sizeof(FrameRing_s));
+}
+
+#endif // SCREEN_RECORDER_FRAME_RING_H__
@@ -0,0 +1,307 @@
+//
+//	Native screen recorder: grabs the framebuffer when the display pans to
+//	a new buffer, converts it to I420 on the spot and pipes the frames to
+//	ffmpeg, which only has to encode them
+//
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "system/osd.h"
+#include "theme/render/textbox.h"
+#include "utils/log.h"
+#include "utils/yuv.h"
+
+#include "./frameRing.h"
+
+#define RECORDER_SLOTS 4
+#define RECORDER_DEFAULT_FPS 30
+#define RECORDER_MAX_SKIP 4
+#define RECORDER_POLL_US 2000
+#define RECORDER_IDLE_MS 100 // capture anyway if nothing was flipped for this long
+#define RECORDER_STATS_MS 1000
+
+extern char **environ;
+
+static volatile sig_atomic_t quit = 0;
+
+typedef struct {
+    FrameRing_s ring;
+    int fd; // ffmpeg's stdin
+    int width;
+    int height;
+    size_t frame_size;
+    volatile bool encoder_failed;
+    unsigned int frames_encoded; // written by the encoder thread only
+} Recorder_s;
+
+static void sigHandler(int sig)
+{
+    quit = 1;
+}
+
+static void print_usage(void)
+{
+    printf("Usage: screenRecorder [--fps N] [--stats] [--no-rotate] OUTPUT.mp4\n"
+           "  Records until SIGINT or SIGTERM.\n"
+           "  --fps N      capture at most N frames per second (default %d)\n"
+           "  --stats      show fps and dropped frames on screen\n"
+           "  --no-rotate  keep the framebuffer orientation\n",
+           RECORDER_DEFAULT_FPS);
+}
+
+static pid_t start_encoder(Recorder_s *rec, const char *output)
+{
+    char size[32];
+    int fds[2];
+    pid_t pid;
+    posix_spawn_file_actions_t actions;
+
+    snprintf(size, sizeof(size), "%dx%d", rec->width, rec->height);
+
+    // Frames carry no timestamps, ffmpeg stamps them when it reads them
+    const char *argv[] = {"ffmpeg", "-hide_banner", "-loglevel", "error", "-y",
+                          "-use_wallclock_as_timestamps", "1",
+                          "-f", "rawvideo", "-pix_fmt", "yuv420p", "-video_size", size, "-i", "pipe:0",
+                          "-c:v", "libx264", "-preset", "superfast", "-maxrate", "3000k", "-bufsize", "6000k",
+                          "-threads", "2", "-vsync", "vfr", output, NULL};
+
+    if (pipe(fds) != 0)
+        return -1;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+
+    int rc = posix_spawnp(&pid, argv[0], &actions, NULL, (char *const *)argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[0]);
+
+    if (rc != 0) {
+        close(fds[1]);
+        return -1;
+    }
+
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    rec->fd = fds[1];
+    return pid;
+}
+
+static bool write_all(int fd, const uint8_t *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+static void *encoder_thread(void *arg)
+{
+    Recorder_s *rec = (Recorder_s *)arg;
+    uint8_t *frame;
+
+    // Frames go from their ring slot straight into the pipe
+    while ((frame = frameRing_peek(&rec->ring)) != NULL) {
+        bool ok = write_all(rec->fd, frame, rec->frame_size);
+        frameRing_release(&rec->ring);
+        if (!ok) {
+            rec->encoder_failed = true;
+            quit = 1;
+            break;
+        }
+        rec->frames_encoded++;
+    }
+
+    close(rec->fd);
+    return NULL;
+}
+
+static void show_stats(int elapsed_ms, int fps, unsigned int dropped)
+{
+    char text[64];
+
+    snprintf(text, sizeof(text), "REC %02d:%02d  %d fps  %u dropped",
+             elapsed_ms / 60000, elapsed_ms / 1000 % 60, fps, dropped);
+
+    SDL_Surface *surface = theme_createTextOverlay(text, (SDL_Color){255, 255, 255}, (SDL_Color){0, 0, 0}, 0.6, 4);
+    if (surface && overlay_surface(surface, 10, 10, RECORDER_STATS_MS * 2, true) != 0)
+        SDL_FreeSurface(surface);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output = NULL;
+    int max_fps = RECORDER_DEFAULT_FPS;
+    bool stats = false;
+    bool rotate = true;
+
+    log_setName("screenRecorder");
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+            max_fps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--stats") == 0)
+            stats = true;
+        else if (strcmp(argv[i], "--no-rotate") == 0)
+            rotate = false;
+        else if (argv[i][0] != '-' && output == NULL)
+            output = argv[i];
+        else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (output == NULL || max_fps <= 0) {
+        print_usage();
+        return 1;
+    }
+
+    signal(SIGINT, sigHandler);
+    signal(SIGTERM, sigHandler);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Only what the overlay needs: display_init() would pan the running
+    // game back to the first buffer
+    if ((fb_fd = open("/dev/fb0", O_RDWR)) < 0) {
+        perror("/dev/fb0");
+        return 1;
+    }
+    ioctl(fb_fd, FBIOGET_FSCREENINFO, &g_display.finfo);
+    g_display.init_done = true;
+
+    struct fb_var_screeninfo vinfo;
+    if (ioctl(fb_fd, FBIOGET_VSCREENINFO, &vinfo) != 0 || vinfo.bits_per_pixel != 32) {
+        fprintf(stderr, "Only 32bpp framebuffers are supported\n");
+        return 1;
+    }
+
+    size_t fb_size = g_display.finfo.smem_len;
+    const uint8_t *fb = (const uint8_t *)mmap(NULL, fb_size, PROT_READ, MAP_SHARED, fb_fd, 0);
+    if (fb == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    Recorder_s rec = {.width = vinfo.xres & ~1, .height = vinfo.yres & ~1};
+    rec.frame_size = yuv_frameSize(rec.width, rec.height);
+
+    if (!frameRing_init(&rec.ring, RECORDER_SLOTS, rec.frame_size)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    pid_t encoder_pid = start_encoder(&rec, output);
+    if (encoder_pid < 0) {
+        fprintf(stderr, "Failed to start ffmpeg\n");
+        return 1;
+    }
+
+    pthread_t encoder;
+    pthread_create(&encoder, NULL, encoder_thread, &rec);
+
+    printf_debug("Recording %dx%d to %s\n", rec.width, rec.height, output);
+
+    int frame_interval = 1000 / max_fps;
+    int start = getMilliseconds();
+    int last_capture = start - frame_interval;
+    int last_flip = start;
+    int last_stats = start;
+    unsigned int last_yoffset = vinfo.yoffset;
+    unsigned int captured = 0, dropped = 0, stats_encoded = 0;
+    int skip = 1, skip_count = 0, calm = 0;
+
+    while (!quit) {
+        if (ioctl(fb_fd, FBIOGET_VSCREENINFO, &vinfo) != 0)
+            break;
+
+        int now = getMilliseconds();
+        bool flipped = vinfo.yoffset != last_yoffset;
+
+        if (stats && now - last_stats >= RECORDER_STATS_MS) {
+            unsigned int encoded = rec.frames_encoded;
+            show_stats(now - start, (int)((encoded - stats_encoded) * 1000 / (now - last_stats)), dropped);
+            stats_encoded = encoded;
+            last_stats = now;
+        }
+
+        // Single buffered screens never pan, sample them at a low rate
+        if (flipped) {
+            last_yoffset = vinfo.yoffset;
+            last_flip = now;
+        }
+        else if (now - last_flip < RECORDER_IDLE_MS || now - last_capture < RECORDER_IDLE_MS) {
+            usleep(RECORDER_POLL_US);
+            continue;
+        }
+
+        if (now - last_capture < frame_interval || ++skip_count < skip)
+            continue;
+        skip_count = 0;
+
+        // The mode changed under us, the stream keeps its size
+        if ((int)vinfo.xres < rec.width || (int)vinfo.yres < rec.height ||
+            (size_t)(vinfo.yoffset + rec.height) * g_display.finfo.line_length > fb_size)
+            continue;
+
+        int waiting = frameRing_fill(&rec.ring);
+        uint8_t *slot = frameRing_acquire(&rec.ring);
+
+        // Encoder is behind: drop this frame and capture fewer of the next
+        if (slot == NULL) {
+            dropped++;
+            calm = 0;
+            if (skip < RECORDER_MAX_SKIP)
+                skip++;
+            continue;
+        }
+
+        // ...and back to every frame once it kept up for a second
+        if (waiting == 0 && skip > 1 && ++calm >= max_fps / skip) {
+            skip--;
+            calm = 0;
+        }
+
+        const uint8_t *buffer = fb + (size_t)vinfo.yoffset * g_display.finfo.line_length + vinfo.xoffset * 4;
+        yuv_fromArgb((const uint32_t *)buffer, g_display.finfo.line_length, rec.width, rec.height, rotate, slot);
+        frameRing_commit(&rec.ring);
+
+        captured++;
+        last_capture = now;
+    }
+
+    frameRing_close(&rec.ring);
+    pthread_join(encoder, NULL);
+
+    int status = 0;
+    while (waitpid(encoder_pid, &status, 0) == -1 && errno == EINTR)
+        ;
+
+    if (stats)
+        cancel_overlay();
+
+    printf("Captured %u frames, encoded %u, dropped %u in %ds\n",
+           captured, rec.frames_encoded, dropped, (getMilliseconds() - start) / 1000);
+
+    frameRing_free(&rec.ring);
+    munmap((void *)fb, fb_size);
+    close(fb_fd);
+
+    return rec.encoder_failed || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
@@ -0,0 +1,219 @@
+//
+//	Trace recorder CLI: controls the ring from utils/trace.h, records events
+//	for shell scripts and exports Chrome trace_event JSON
+//
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/trace.h"
+
+static void print_usage(void)
+{
+    printf("Usage: trace <command> [args]\n"
+           "  start [events]       create the ring (default %d events)\n"
+           "  stop                 remove the ring\n"
+           "  begin NAME           begin a span in the calling script\n"
+           "  end NAME             end it\n"
+           "  instant NAME         mark a point in time\n"
+           "  counter NAME VALUE   record a value\n"
+           "  dump [FILE]          write Chrome trace JSON (default: stdout)\n",
+           TRACE_DEFAULT_EVENTS);
+}
+
+static int trace_start(uint32_t capacity)
+{
+    TraceRing_s ring;
+    size_t size = trace_ringSize(capacity);
+    int fd;
+
+    memset(&ring, 0, sizeof(TraceRing_s));
+    ring.magic = TRACE_MAGIC;
+    ring.version = TRACE_VERSION;
+    ring.capacity = capacity;
+    ring.event_size = sizeof(TraceEvent_s);
+    ring.created_us = trace_now();
+
+    if ((fd = open(TRACE_PATH ".tmp", O_RDWR | O_CREAT | O_TRUNC, 0666)) == -1) {
+        perror(TRACE_PATH);
+        return 1;
+    }
+
+    // Sized before it's visible, so writers never map a short file
+    if (ftruncate(fd, size) != 0 || pwrite(fd, &ring, sizeof(TraceRing_s), 0) != sizeof(TraceRing_s)) {
+        perror(TRACE_PATH);
+        close(fd);
+        unlink(TRACE_PATH ".tmp");
+        return 1;
+    }
+    close(fd);
+
+    if (rename(TRACE_PATH ".tmp", TRACE_PATH) != 0) {
+        perror(TRACE_PATH);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void _json_string(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+    for (; *str; str++) {
+        unsigned char c = (unsigned char)*str;
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+static int trace_dump(const char *out_path)
+{
+    TraceRing_s *ring = trace_map(false);
+    FILE *fp = stdout;
+    bool first = true;
+    int dropped = 0;
+
+    if (ring == NULL) {
+        fprintf(stderr, "Tracing is not running\n");
+        return 1;
+    }
+
+    if (out_path != NULL && (fp = fopen(out_path, "w")) == NULL) {
+        perror(out_path);
+        munmap(ring, trace_ringSize(ring->capacity));
+        return 1;
+    }
+
+    uint64_t end = __atomic_load_n(&ring->next, __ATOMIC_ACQUIRE);
+    uint64_t start = end > ring->capacity ? end - ring->capacity : 0;
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    for (uint64_t index = start; index < end; index++) {
+        const TraceEvent_s *slot = &TRACE_EVENTS(ring)[index % ring->capacity];
+        TraceEvent_s event;
+
+        // Copy, then check the slot wasn't reused or still being written
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != index + 1) {
+            dropped++;
+            continue;
+        }
+        memcpy(&event, slot, sizeof(TraceEvent_s));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != index + 1) {
+            dropped++;
+            continue;
+        }
+        event.name[TRACE_NAME_LEN - 1] = '\0';
+
+        fprintf(fp, "%s\n{", first ? "" : ",");
+        first = false;
+
+        if (event.phase == TRACE_PHASE_PROCESS) {
+            fprintf(fp, "\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":", event.pid);
+            _json_string(fp, event.name);
+            fprintf(fp, "}}");
+            continue;
+        }
+
+        fprintf(fp, "\"name\":");
+        _json_string(fp, event.name);
+        fprintf(fp, ",\"ph\":\"%c\",\"ts\":%llu,\"pid\":%d,\"tid\":%d",
+                event.phase, (unsigned long long)(event.ts_us - ring->created_us),
+                event.pid, event.tid);
+
+        if (event.phase == TRACE_PHASE_COUNTER)
+            fprintf(fp, ",\"args\":{\"value\":%lld}", (long long)event.value);
+        else if (event.phase == TRACE_PHASE_INSTANT)
+            fprintf(fp, ",\"s\":\"t\"");
+
+        fputc('}', fp);
+    }
+
+    fprintf(fp, "\n]}\n");
+
+    if (fp != stdout)
+        fclose(fp);
+
+    if (dropped > 0)
+        fprintf(stderr, "%d events were being written or overwritten\n", dropped);
+    if (end > ring->capacity)
+        fprintf(stderr, "%llu older events were overwritten\n", (unsigned long long)(end - ring->capacity));
+
+    munmap(ring, trace_ringSize(ring->capacity));
+    return 0;
+}
+
+// Events from a script belong to the shell running it
+static int trace_record(char phase, const char *name, int64_t value)
+{
+    TraceRing_s *ring = trace_map(true);
+    char comm[TRACE_NAME_LEN] = "sh";
+    char path[64];
+    FILE *fp;
+
+    if (ring == NULL)
+        return 0; // not tracing, not an error for scripts
+
+    snprintf(path, sizeof(path), "/proc/%d/comm", getppid());
+    if ((fp = fopen(path, "r")) != NULL) {
+        if (fgets(comm, sizeof(comm), fp) != NULL)
+            comm[strcspn(comm, "\n")] = '\0';
+        fclose(fp);
+    }
+
+    trace_eventAs(ring, TRACE_PHASE_PROCESS, comm, 0, getppid());
+    trace_eventAs(ring, phase, name, value, getppid());
+
+    munmap(ring, trace_ringSize(ring->capacity));
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+
+    const char *command = argv[1];
+
+    if (strcmp(command, "start") == 0) {
+        long capacity = argc > 2 ? atol(argv[2]) : TRACE_DEFAULT_EVENTS;
+        if (capacity <= 0 || capacity > 1 << 20) {
+            print_usage();
+            return 1;
+        }
+        return trace_start((uint32_t)capacity);
+    }
+
+    if (strcmp(command, "stop") == 0) {
+        unlink(TRACE_PATH);
+        return 0;
+    }
+
+    if (strcmp(command, "dump") == 0)
+        return trace_dump(argc > 2 ? argv[2] : NULL);
+
+    if (argc > 2 && strcmp(command, "begin") == 0)
+        return trace_record(TRACE_PHASE_BEGIN, argv[2], 0);
+    if (argc > 2 && strcmp(command, "end") == 0)
+        return trace_record(TRACE_PHASE_END, argv[2], 0);
+    if (argc > 2 && strcmp(command, "instant") == 0)
+        return trace_record(TRACE_PHASE_INSTANT, argv[2], 0);
+    if (argc > 3 && strcmp(command, "counter") == 0)
+        return trace_record(TRACE_PHASE_COUNTER, argv[2], atoll(argv[3]));
+
+    print_usage();
+    return 1;
+}
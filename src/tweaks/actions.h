@@ -6,12 +6,14 @@
 #include "system/osd.h"
 #include "system/rumble.h"
 #include "system/settings.h"
+#include "system/state.h"
 #include "theme/resources.h"
 #include "theme/sound.h"
 #include "utils/apps.h"
 #include "utils/config.h"
 #include "utils/file.h"
 #include "utils/msleep.h"
+#include "utils/process.h"
 
 #include "./appstate.h"
 #include "./diags.h"
@@ -387,6 +389,16 @@ void action_setCpuClockHotkey(void *pt)
     config_flag_set(".cpuClockHotkey", ((ListItem *)pt)->value);
 }
 
+void action_setGameSwitcherResident(void *pt)
+{
+    bool enabled = ((ListItem *)pt)->value;
+    config_flag_set(GS_RESIDENT_FLAG, enabled);
+
+    // Hidden, so nothing is lost
+    if (!enabled)
+        process_kill(GS_RESIDENT_PROCESS);
+}
+
 void action_setAltBrightness(void *pt)
 {
     config_flag_set(".altBrightness", ((ListItem *)pt)->value);
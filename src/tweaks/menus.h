@@ -737,6 +737,15 @@ void menu_advanced(void *_)
                                      .action = action_setCpuClockHotkey},
                                  "Enable the global hotkeys for\n"
                                  "overclocking the CPU.");
+        list_addItemWithInfoNote(&_menu_advanced,
+                                 (ListItem){
+                                     .label = "Keep GameSwitcher loaded",
+                                     .item_type = TOGGLE,
+                                     .value = config_flag_get(GS_RESIDENT_FLAG),
+                                     .action = action_setGameSwitcherResident},
+                                 "Keep GameSwitcher in memory while\n"
+                                 "playing, so it opens instantly\n"
+                                 "(uses more RAM).");
         if (DEVICE_ID == MIYOO283) {
             list_addItemWithInfoNote(&_menu_advanced,
                                      (ListItem){
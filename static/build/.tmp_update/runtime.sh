@@ -12,6 +12,12 @@ MODEL_MMP=354
 screen_resolution="640x480"
 
 main() {
+    # Record a boot trace, export it with `trace dump <file>`
+    if [ -f $sysdir/config/.trace ]; then
+        command trace start
+    fi
+    trace begin boot
+
     # Set model ID
     axp 0 > /dev/null
     export DEVICE_ID=$([ $? -eq 0 ] && echo $MODEL_MMP || echo $MODEL_MM)
@@ -59,13 +65,6 @@ main() {
     # Make sure MainUI doesn't show charging animation
     touch /tmp/no_charging_ui
 
-    # Check if blf needs enabling
-    if [ -f $sysdir/config/.blf ]; then
-        /mnt/SDCARD/.tmp_update/script/blue_light.sh check &
-    elif [ -f $sysdir/config/.blfOn ]; then
-        /mnt/SDCARD/.tmp_update/script/blue_light.sh enable &
-    fi
-
     cd $sysdir
     bootScreen "Boot"
 
@@ -80,7 +79,7 @@ main() {
     # Start networking (Checks networking, checks timezone)
     start_networking
 
-    # Start the key monitor
+    # Start the key monitor (also restores the blue light filter)
     keymon &
 
     # Init
@@ -119,6 +118,8 @@ main() {
         sh "$startup_script"
     done
 
+    trace end boot
+
     # Auto launch
     if [ ! -f $sysdir/config/.noAutoStart ]; then
         state_change check_game
@@ -158,11 +159,28 @@ state_change() {
     log "state change: $1"
     runifnecessary "keymon" keymon
     check_networking
+    commit_writes
     touch /tmp/state_changed
     sync
     eval "$1"
 }
 
+# Ask keymon to write the settings it has staged in tmpfs (see writeCache.h)
+commit_writes() {
+    if [ ! -s /tmp/.writeCache/dirty ]; then
+        return
+    fi
+
+    killall -USR2 keymon 2> /dev/null
+
+    # Wait up to 1s for the commit
+    i=0
+    while [ -s /tmp/.writeCache/dirty ] && [ $i -lt 10 ]; do
+        sleep 0.1
+        i=$((i + 1))
+    done
+}
+
 set_prev_state() {
     echo "$1" > /tmp/prev_state
 }
@@ -219,11 +237,13 @@ launch_main_ui() {
     mute_theme_bgm
 
     # MainUI launch
+    trace instant mainui_launch
     cd $miyoodir/app
     PATH="$miyoodir/app:$PATH" \
         LD_LIBRARY_PATH="$miyoodir/lib:/config/lib:/lib" \
         LD_PRELOAD="$miyoodir/lib/libpadsp.so" \
         ./MainUI 2>&1 > /dev/null
+    trace instant mainui_exit
 
     # Merge the last game launched into the recent list
     check_hide_recents
@@ -302,135 +322,38 @@ change_resolution() {
 
 launch_game() {
     log "\n:: Launch game"
-    cmd=$(cat $sysdir/cmd_to_run.sh)
-    TZ_VALUE=$(cat "$sysdir/config/.tz")
-
-    is_game=0
-    rompath=""
-    romext=""
-    romcfgpath=""
-    retroarch_core=""
-    full_resolution_path=""
-    launch_script=""
+    trace begin launch_game
 
     start_audioserver
     save_settings
 
-    if check_is_game "$cmd"; then
-        # Extract rom path
-        rompath=$(echo "$cmd" | awk '{ st = index($0,"\" \""); print substr($0,st+3,length($0)-st-3)}')
-
-        # Check for custom launch script
-        if echo "$rompath" | grep -q ":"; then
-            launch_script=$(echo "$rompath" | awk '{split($0,a,":"); print a[1]}')
-            rompath=$(echo "$rompath" | awk '{split($0,a,":"); print a[2]}')
-            echo "LD_PRELOAD=/mnt/SDCARD/miyoo/app/../lib/libpadsp.so \"$launch_script\" \"$rompath\"" > $sysdir/cmd_to_run.sh
-        fi
-
-        orig_path="$rompath"
-        romext=$(echo "$(basename "$rompath")" | awk -F. '{print tolower($NF)}')
-
-        if [ "$romext" != "miyoocmd" ]; then
-            # Resolve real path
-            if [ -f "$rompath" ]; then
-                rompath=$(realpath "$rompath")
-            fi
-
-            # Update cmd_to_run with resolved path
-            if [ "$rompath" != "$orig_path" ]; then
-                temp=$(cat $sysdir/cmd_to_run.sh)
-                cmd_replaced=$(echo "$temp" | rev | sed 's/^"[^"]*"//g' | rev)"\"$rompath\""
-                echo "$cmd_replaced" > $sysdir/cmd_to_run.sh
-            fi
-
-            # Game config path
-            romcfgpath="$(dirname "$rompath")/.game_config/$(basename "$rompath" ".$romext").cfg"
-            log "rompath: $rompath (ext: $romext)"
-            log "romcfgpath: $romcfgpath"
-            is_game=1
-        fi
-    fi
-
-    full_resolution_path="$(get_full_resolution_path)"
+    # Resolves cmd_to_run.sh, records play activity and execs the target,
+    # then leaves is_game, rompath, romext and launch_script in launch_info
+    rm -f /tmp/launch_info
+    cd $sysdir
+    gameLauncher
+    retval=$?
 
-    if [ -z "$launch_script" ]; then
-        launch_script=$(echo "$cmd" | awk -F'"' '{print $2}')
+    is_game=0
+    rompath=""
+    romext=""
+    launch_script=""
+    if [ -f /tmp/launch_info ]; then
+        . /tmp/launch_info
     fi
 
-    if [ $is_game -eq 1 ]; then
-        if [ -f "$launch_script" ] && cat "$launch_script" | grep -q '.retroarch/cores'; then
-            # Override core if needed
-            override_game_core "$romcfgpath" "$launch_script"
-        fi
-
-        # Handle dollar sign
-        if echo "$rompath" | grep -q "\$"; then
-            temp=$(cat $sysdir/cmd_to_run.sh)
-            echo "$temp" | sed 's/\$/\\\$/g' > $sysdir/cmd_to_run.sh
+    if [ $retval -ne 404 ] && [ "$romext" != "miyoocmd" ]; then
+        if [ -f /tmp/new_res_available ]; then
+            # Restore resolution
+            change_resolution "640x480"
         fi
 
-        # Kill services for maximum performance
-        if [ ! -f $sysdir/config/.keepServicesAlive ]; then
-            for process in dropbear bftpd filebrowser telnetd smbd; do
-                if is_running $process; then
-                    killall -9 $process
-                fi
-            done
-        fi
-
-        playActivity start "$rompath"
-    fi
-
-    # Prevent quick switch loop
-    rm -f /tmp/quick_switch 2> /dev/null
-    rm -f /tmp/force_auto_load_state 2> /dev/null
-
-    log "----- COMMAND:"
-    log "$(cat $sysdir/cmd_to_run.sh)"
-
-    if [ $is_game -eq 0 ] || [ -f "$rompath" ]; then
-        if [ "$romext" == "miyoocmd" ]; then
-            /mnt/SDCARD/.tmp_update/script/remove_last_recent_entry.sh
-            emupath=$(dirname $(echo "$cmd" | awk '{ gsub(/"/, "", $2); st = index($2,".."); if (st) { print substr($2,0,st) } else { print $2 } }'))
-            cd "$emupath"
-            chmod a+x "$rompath"
-            "$rompath" "$rompath" "$emupath"
-            retval=$?
-        else
-            # Change resolution if needed
-            if [ -f /tmp/new_res_available ] && [ -f "$full_resolution_path" ]; then
-                log "Found full_resolution file, changing resolution to 560p"
-                change_resolution
-            fi
-
-            if [ $is_game -eq 1 ] && [ ! -f /tmp/new_res_available ]; then
-                infoPanel --message "LOADING" --persistent --romscreen &
-                touch /tmp/dismiss_info_panel
-                sync
-            fi
-
-            # GAME LAUNCH
-            cd /mnt/SDCARD/RetroArch
-            force_retroarch_cfg
-
-            # make the cmd_to_run shell env aware of the new timezone
-            TZ="$TZ_VALUE" $sysdir/cmd_to_run.sh
-            retval=$?
-
-            if [ -f /tmp/new_res_available ]; then
-                # Restore resolution
-                change_resolution "640x480"
-            fi
-
-            if [ $is_game -eq 1 ] && [ ! -f /tmp/.offOrder ] && [ -f /tmp/.displaySavingMessage ]; then
-                rm /tmp/.displaySavingMessage
-                infoPanel --message "SAVING" --persistent --romscreen &
-                touch /tmp/dismiss_info_panel
-                sync
-            fi
+        if [ $is_game -eq 1 ] && [ ! -f /tmp/.offOrder ] && [ -f /tmp/.displaySavingMessage ]; then
+            rm /tmp/.displaySavingMessage
+            infoPanel --message "SAVING" --persistent --romscreen &
+            touch /tmp/dismiss_info_panel
+            sync
         fi
-    else
-        retval=404
     fi
 
     log "cmd retval: $retval"
@@ -442,75 +365,7 @@ launch_game() {
     fi
 
     launch_game_postprocess $is_game "$launch_script" "$rompath"
-}
-
-force_retroarch_cfg() {
-    # Enable network commands in RetroArch
-    cat > /tmp/onion_ra_patch.cfg <<- EOM
-network_cmd_enable = "true"
-EOM
-
-    $sysdir/script/patch_ra_cfg.sh /tmp/onion_ra_patch.cfg
-
-    rm /tmp/onion_ra_patch.cfg
-}
-
-override_game_core() {
-    romcfgpath="$1"
-    launch_path="$2"
-
-    retroarch_core=""
-
-    # Determine the appropriate appendconfig
-    if [ -f /tmp/reset_game ]; then
-        echo -e "savestate_auto_load = \"false\"\nconfig_save_on_exit = \"false\"\n" > /tmp/reset.cfg
-        appendconfig="/tmp/reset.cfg"
-        rm /tmp/reset_game
-    elif [ -f /tmp/force_auto_load_state ]; then
-        echo -e "savestate_auto_load = \"true\"\nconfig_save_on_exit = \"false\"\n" > /tmp/auto_load_state.cfg
-        appendconfig="/tmp/auto_load_state.cfg"
-        rm /tmp/force_auto_load_state
-    else
-        appendconfig=""
-    fi
-
-    # Extract the core name from the ROM's config file
-    if [ -f "$romcfgpath" ]; then
-        romcfg=$(cat "$romcfgpath")
-        retroarch_core=$(get_info_value "$romcfg" core)
-    fi
-
-    # Check if core override is specified in the ROM's config
-    if [ ! -z "$retroarch_core" ]; then
-        corepath=".retroarch/cores/$retroarch_core.so"
-        log "Overriding core to: $retroarch_core"
-
-        if [ -f "/mnt/SDCARD/RetroArch/$corepath" ]; then
-            if [ -z "$appendconfig" ]; then
-                # No appendconfig needed
-                echo "LD_PRELOAD=$miyoodir/lib/libpadsp.so ./retroarch -v -L \"$corepath\" \"$rompath\"" > $sysdir/cmd_to_run.sh
-            else
-                # Inject appendconfig directly into the final runtime command
-                echo "LD_PRELOAD=$miyoodir/lib/libpadsp.so ./retroarch -v --appendconfig \"$appendconfig\" -L \"$corepath\" \"$rompath\"" > $sysdir/cmd_to_run.sh
-            fi
-            return 0 # Success
-        else
-            log "Specified core not found: $corepath"
-        fi
-    fi
-
-    # Add appendconfig to the launch script if necessary
-    if [ ! -z "$appendconfig" ]; then
-        if grep -q -- "--appendconfig" "$launch_path"; then
-            # Update existing appendconfig in the script
-            sed -i "s|--appendconfig \".*\"|--appendconfig \"$appendconfig\"|g" "$launch_path"
-            log "Updated existing appendconfig in launch script: $appendconfig (path: $launch_path)"
-        else
-            # Inject appendconfig argument into the command
-            sed -i "s|./retroarch -v|& --appendconfig \"$appendconfig\"|g" "$launch_path"
-            log "Injected appendconfig into launch script: $appendconfig (path: $launch_path)"
-        fi
-    fi
+    trace end launch_game
 }
 
 cleanup_appendconfig() {
@@ -583,33 +438,6 @@ launch_game_postprocess() {
     fi
 }
 
-get_full_resolution_path() {
-    if [ -f /tmp/new_res_available ]; then
-        # Check if the program to be launched supports 560p
-        # Different programs need different checks (Apps vs Ports vs the rest)
-        if grep -qF "/mnt/SDCARD/App/" $sysdir/cmd_to_run.sh; then
-            # ----- App launch ----- #
-
-            echo "$(cat $sysdir/cmd_to_run.sh | cut -d' ' -f 2 | sed 's/;/\/full_resolution/')"
-
-        elif grep -qF "/mnt/SDCARD/Roms/PORTS/" $sysdir/cmd_to_run.sh; then
-            # ----- Port launch ----- #
-
-            dot_port_path=$(grep -o '\/mnt\/SDCARD\/Roms\/PORTS.*\.port' $sysdir/cmd_to_run.sh)
-
-            if grep -qF "FullResolution=1" "$dot_port_path"; then
-                # Look for FullResolution=1 in the .port file
-                # set full_resolution_path to a file that will always exist
-                echo "/tmp/new_res_available"
-            fi
-
-        else
-            # ----- Everything else ----- #
-            echo "$(grep -o '".*launch\.sh"' $sysdir/cmd_to_run.sh | sed 's/"//g; s/launch\.sh/full_resolution/')"
-        fi
-    fi
-}
-
 is_running() {
     process_name="$1"
     pgrep "$process_name" > /dev/null
@@ -636,9 +464,11 @@ check_switcher() {
 
 launch_switcher() {
     log "\n:: Launch switcher"
+    trace begin launch_switcher
     cd $sysdir
     start_audioserver
     LD_PRELOAD="$miyoodir/lib/libpadsp.so" gameSwitcher
+    trace end launch_switcher
     rm $sysdir/.runGameSwitcher
     set_prev_state "switcher"
     sync
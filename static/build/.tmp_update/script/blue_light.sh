@@ -44,6 +44,7 @@ set_intensity() {
 
     if [ "$reset_to_default" -eq 0 ]; then
         echo "8421504" > $sysdir/config/display/blueLightRGB
+        rm -f /tmp/settings.snapshot
         return
     fi
     
@@ -57,6 +58,7 @@ set_intensity() {
 
     newCombinedRGB=$(( (endR << 16) | (endG << 8) | endB ))
     echo $newCombinedRGB > $sysdir/config/display/blueLightRGB
+    rm -f /tmp/settings.snapshot
     sync
 
     # echo ":: Blue Light Filter Intensity Set to $value, ready for next toggle." 
@@ -115,6 +117,7 @@ blueLightStart() {
 
     newCombinedRGB=$(( (endR << 16) | (endG << 8) | endB ))
     echo $newCombinedRGB > $sysdir/config/display/blueLightRGB
+    rm -f /tmp/settings.snapshot
     rm -f /tmp/blueLightIntensityChange
 }
 
@@ -3,4 +3,10 @@ log() {
     if [ -f $sysdir/config/.logging ]; then
         echo -e "($program) $(date +"%Y-%m-%d %H:%M:%S"):" $* | tee -a "$sysdir/logs/$logfile.log"
     fi
-}
\ No newline at end of file
+}
+# Only spawns the trace CLI while `trace start` has a ring running
+trace() {
+    if [ -f /tmp/trace.ring ]; then
+        command trace "$@"
+    fi
+}
@@ -2,6 +2,8 @@
 # OTA updates for Onion.
 cmd=$1
 sysdir=/mnt/SDCARD/.tmp_update
+otabin=$sysdir/bin/otaUpdate
+otastaging=$sysdir/download/ota
 
 # Colors
 RED='\033[1;31m'
@@ -34,6 +36,7 @@ main() {
 
 	rm $sysdir/cmd_to_run.sh 2> /dev/null
 
+	resume_switch
 	check_available_space
 	enable_wifi
 	check_connection
@@ -55,6 +58,28 @@ main() {
 	apply_update
 }
 
+resume_switch() {
+	# A previous update was cut short while its files were being moved
+	if [ -f "$otastaging/switch.active" ] && [ -x "$otabin" ]; then
+		echo "Finishing the interrupted update..."
+		if $otabin switch; then
+			sync
+			echo -ne "\n\n" \
+				"${GREEN}Update applied.${NC}\n" \
+				"Rebooting to run installation...\n"
+			echo -ne "${YELLOW}"
+			read -n 1 -s -r -p "Press A to reboot"
+			sleep 1
+			reboot
+		fi
+	fi
+}
+
+# Only changed files are downloaded when the release has a manifest
+use_incremental() {
+	[ -n "$Release_manifest_url" ] && [ "$Release_manifest_url" != "null" ] && [ -x "$otabin" ]
+}
+
 check_available_space() {
 	# Available space in MB
 	mount_point=$(mount | grep -m 1 '/mnt/SDCARD' | awk '{print $1}') # it could be /dev/mmcblk0p1 or /dev/mmcblk0
@@ -133,6 +158,7 @@ get_release_info() {
 	Release_size_MB=$(echo "$(($Release_size / 1024 / 1024))MB")
 	Release_Date=$(echo $Release_asset | jq -r '.created_at')
 	Release_info=$(echo $Release_assets_info | jq '.body')
+	Release_manifest_url=$(echo "$Release_assets_info" | jq -r '.assets[]? | select(.name == "ota-manifest.json") | .browser_download_url')
 
 	Current_FullVersion=$(installUI --version)
 	Current_Version=$(echo $Current_FullVersion | sed 's/-.*$//g')
@@ -188,6 +214,21 @@ download_update() {
 			"${BLUE}== Downloading Onion $Release_Version ($channel channel) ==${NC}\n"
 		/mnt/SDCARD/.tmp_update/bin/freemma > NUL
 		sync
+		if use_incremental; then
+			if ! $otabin stage "$Release_manifest_url"; then
+				echo -ne "\n\n" \
+					"${RED}Error: The update could not be downloaded or verified.${NC}\n" \
+					"Run OTA update again to resume the download.\n"
+				echo -ne "${YELLOW}"
+				read -n 1 -s -r -p "Press A to exit"
+				exit 5
+			fi
+			echo -ne "\n\n" \
+				"${GREEN}================== Download done ==================${NC}\n"
+			sync
+			sleep 2
+			return
+		fi
 		wget --no-check-certificate $Release_url -O "$sysdir/download/$Release_Version.zip"
 		echo -ne "\n\n" \
 			"${GREEN}================== Download done ==================${NC}\n"
@@ -219,8 +260,12 @@ apply_update() {
 		umount /mnt/SDCARD/miyoo/app/MainUI 2> /dev/null
 		/mnt/SDCARD/.tmp_update/bin/freemma > NUL
 
-		# unzip -o "$sysdir/download/$Release_Version.zip" -d "/mnt/SDCARD"
-		7z x -aoa -o"/mnt/SDCARD" "$sysdir/download/$Release_Version.zip"
+		if use_incremental; then
+			$otabin switch
+		else
+			# unzip -o "$sysdir/download/$Release_Version.zip" -d "/mnt/SDCARD"
+			7z x -aoa -o"/mnt/SDCARD" "$sysdir/download/$Release_Version.zip"
+		fi
 
 		if [ $? -eq 0 ]; then
 			echo -e "${GREEN}Decompression successful.${NC}"
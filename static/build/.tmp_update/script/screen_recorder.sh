@@ -8,6 +8,7 @@ re_dir="/mnt/SDCARD/Media/Videos/Recorded"
 active_file="/tmp/recorder_active"
 lock_file="/tmp/screen_recorder.lock"
 rec_icon="$sysdir/res/rec.png"
+native_recorder="$sysdir/bin/screenRecorder"
 
 if [ -f "$lock_file" ]; then
     exit 1
@@ -147,10 +148,36 @@ show_indicator() {
     imgpop 10000 0 $rec_icon 150 435 >/dev/null 2>&1 &
 }
 
+is_recording() {
+    pgrep -f "ffmpeg -f fbdev -nostdin" >/dev/null || pgrep screenRecorder >/dev/null
+}
+
+# screenRecorder grabs frames on page flips and converts them natively,
+# ffmpeg only encodes. Its on-screen stats replace the indicator.
+start_recording() {
+    output="$(date +%Y%m%d%H%M%S).mp4"
+
+    if [ -x "$native_recorder" ]; then
+        stats_arg=""
+        if [ -f "$sysdir/config/.recIndicator" ]; then
+            stats_arg="--stats"
+        fi
+        $native_recorder $stats_arg "$output" >/dev/null 2>&1 &
+        return
+    fi
+
+    if [ -f "$sysdir/config/.recIndicator" ]; then
+        show_indicator
+    fi
+
+    ffmpeg -f fbdev -nostdin -framerate 25 -i /dev/fb0 -vf "vflip,hflip, format=yuv420p" -c:v libx264 -preset superfast -maxrate 3000k -bufsize 6000k -threads 2 "$output" >/dev/null 2>&1 &
+}
+
 toggle_ffmpeg() {
     sync
-    if pgrep -f "ffmpeg -f fbdev -nostdin" >/dev/null; then
+    if is_recording; then
         cpuclock 1200
+        pkill -2 screenRecorder
         pkill -2 -f "ffmpeg -f fbdev -nostdin"
         killall -9 imgpop
 
@@ -168,16 +195,12 @@ toggle_ffmpeg() {
             short_vibration &
         fi
 
-        if [ -f "$sysdir/config/.recIndicator" ]; then
-            show_indicator
-        fi
-
         cpuclock 1600
-        ffmpeg -f fbdev -nostdin -framerate 25 -i /dev/fb0 -vf "vflip,hflip, format=yuv420p" -c:v libx264 -preset superfast -maxrate 3000k -bufsize 6000k -threads 2 "$(date +%Y%m%d%H%M%S).mp4" >/dev/null 2>&1 &
+        start_recording
 
         sleep 0.5
 
-        if ! pgrep -f "ffmpeg -f fbdev -nostdin" >/dev/null; then
+        if ! is_recording; then
             return 1
         fi
 
@@ -188,11 +211,13 @@ toggle_ffmpeg() {
 }
 
 hardkill_ffmpeg() {
+    killall -2 screenRecorder
     killall -2 ffmpeg # give it a chance
 
     sleep 0.5
 
-    if pgrep -f "ffmpeg -f fbdev -nostdin" >/dev/null; then
+    if is_recording; then
+        killall -9 screenRecorder
         killall -9 ffmpeg
         rm -f "$lock_file"
         return 1
@@ -0,0 +1,197 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+
+#define BENCH_MAX_RESULTS 256
+#define BENCH_REGRESSION_PCT 10.0
+
+const char *bench_root = BENCH_DEFAULT_ROOT;
+FILE *bench_out = NULL;
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} BenchSuite_s;
+
+static const BenchSuite_s suites[] = {
+    {"scaler", bench_scaler},
+    {"display", bench_display},
+    {"hash", bench_hash},
+    {"history", bench_history},
+    {"recents", bench_recents},
+    {"cachedb", bench_cachedb},
+    {"screenshot", bench_screenshot},
+    {"list", bench_list},
+};
+
+typedef struct {
+    char name[128];
+    double ns_per_op;
+} BenchResult_s;
+
+void bench_result(const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    putchar('\n');
+    fflush(stdout);
+
+    if (bench_out != NULL) {
+        va_start(args, format);
+        vfprintf(bench_out, format, args);
+        va_end(args);
+        fputc('\n', bench_out);
+        fflush(bench_out);
+    }
+}
+
+const char *bench_fixture(const char *rel_path)
+{
+    static char path[512];
+
+    snprintf(path, sizeof(path), "%s/%s", bench_root, rel_path);
+
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(path, 0755) != 0 && errno != EEXIST)
+            fprintf(stderr, "Can't create %s\n", path);
+        *p = '/';
+    }
+
+    return path;
+}
+
+static int _loadResults(const char *path, BenchResult_s *results)
+{
+    char line[512];
+    int count = 0;
+    FILE *fp;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    while (count < BENCH_MAX_RESULTS && fgets(line, sizeof(line), fp)) {
+        BenchResult_s *r = &results[count];
+        unsigned long long iterations;
+        if (sscanf(line, "{\"bench\":\"%127[^\"]\",\"iterations\":%llu,\"ns_per_op\":%lf",
+                   r->name, &iterations, &r->ns_per_op) == 3)
+            count++;
+    }
+
+    fclose(fp);
+    return count;
+}
+
+// Matches the timings of two runs by name, fails if any got slower than
+// `threshold` percent
+static int _compare(const char *old_path, const char *new_path, double threshold)
+{
+    static BenchResult_s old_results[BENCH_MAX_RESULTS];
+    static BenchResult_s new_results[BENCH_MAX_RESULTS];
+    int old_count = _loadResults(old_path, old_results);
+    int new_count = _loadResults(new_path, new_results);
+    int regressions = 0;
+
+    if (old_count < 0 || new_count < 0)
+        return 2;
+
+    for (int i = 0; i < new_count; i++) {
+        for (int j = 0; j < old_count; j++) {
+            if (strcmp(new_results[i].name, old_results[j].name) != 0 || old_results[j].ns_per_op <= 0)
+                continue;
+
+            double change = (new_results[i].ns_per_op / old_results[j].ns_per_op - 1.0) * 100.0;
+            bool regressed = change > threshold;
+            regressions += regressed;
+
+            printf("{\"bench\":\"%s\",\"old_ns\":%.0f,\"new_ns\":%.0f,\"change_pct\":%.1f,\"regressed\":%s}\n",
+                   new_results[i].name, old_results[j].ns_per_op, new_results[i].ns_per_op,
+                   change, regressed ? "true" : "false");
+            break;
+        }
+    }
+
+    return regressions > 0 ? 1 : 0;
+}
+
+static void _usage(void)
+{
+    fprintf(stderr,
+            "Usage: bench [--root DIR] [--out FILE] [suite...]\n"
+            "       bench --compare OLD.jsonl NEW.jsonl [--threshold PCT]\n"
+            "Suites:");
+    for (int i = 0; i < sizeof(suites) / sizeof(suites[0]); i++)
+        fprintf(stderr, " %s", suites[i].name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filters[sizeof(suites) / sizeof(suites[0])];
+    int filter_count = 0;
+    double threshold = BENCH_REGRESSION_PCT;
+    const char *compare[2] = {NULL, NULL};
+
+    if (getenv("BENCH_ROOT") != NULL)
+        bench_root = getenv("BENCH_ROOT");
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--root") == 0 && i + 1 < argc) {
+            bench_root = argv[++i];
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            if ((bench_out = fopen(argv[++i], "w")) == NULL) {
+                perror(argv[i]);
+                return 2;
+            }
+        }
+        else if (strcmp(argv[i], "--compare") == 0 && i + 2 < argc) {
+            compare[0] = argv[++i];
+            compare[1] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        }
+        else if (argv[i][0] != '-' && filter_count < sizeof(filters) / sizeof(filters[0])) {
+            filters[filter_count++] = argv[i];
+        }
+        else {
+            _usage();
+            return 2;
+        }
+    }
+
+    if (compare[0] != NULL)
+        return _compare(compare[0], compare[1], threshold);
+
+    const char *commit = getenv("BENCH_COMMIT");
+    bench_result("{\"meta\":{\"root\":\"%s\",\"commit\":\"%s\",\"min_ns\":%llu}}",
+                 bench_root, commit ? commit : "", (unsigned long long)BENCH_MIN_NS);
+
+    for (int i = 0; i < sizeof(suites) / sizeof(suites[0]); i++) {
+        // Optional filter: ./bench scaler display
+        bool selected = filter_count == 0;
+        for (int f = 0; f < filter_count; f++)
+            if (strcmp(filters[f], suites[i].name) == 0)
+                selected = true;
+        if (selected)
+            suites[i].run();
+    }
+
+    if (bench_out != NULL)
+        fclose(bench_out);
+
+    return 0;
+}
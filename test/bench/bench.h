@@ -0,0 +1,77 @@
+#ifndef BENCH_H__
+#define BENCH_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_MIN_NS 200000000ULL
+#define BENCH_MIN_ITERATIONS 5
+#define BENCH_DEFAULT_ROOT "/tmp/onion_bench"
+
+// Fixtures are generated below this directory (--root / BENCH_ROOT),
+// never in /mnt/SDCARD
+extern const char *bench_root;
+
+// Results also go here when --out is given
+extern FILE *bench_out;
+
+typedef void (*BenchFunc_t)(void *arg);
+
+/**
+ * @brief Prints one JSON result line (without the newline) to stdout and
+ * the --out file.
+ */
+void bench_result(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * @brief Returns `bench_root`/`rel_path` in a static buffer and creates its
+ * parent directories.
+ */
+const char *bench_fixture(const char *rel_path);
+
+static inline uint64_t bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Runs `func` for at least BENCH_MIN_NS and prints the result as a
+ * JSON line, so runs can be diffed between commits.
+ *
+ * @return Average nanoseconds per call
+ */
+static inline double bench_run(const char *name, BenchFunc_t func, void *arg)
+{
+    uint64_t iterations = 0;
+    uint64_t elapsed = 0;
+
+    func(arg); // warm up
+
+    uint64_t start = bench_now();
+
+    while (elapsed < BENCH_MIN_NS || iterations < BENCH_MIN_ITERATIONS) {
+        func(arg);
+        iterations++;
+        elapsed = bench_now() - start;
+    }
+
+    double ns_per_op = (double)elapsed / iterations;
+    bench_result("{\"bench\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.0f}",
+                 name, (unsigned long long)iterations, ns_per_op);
+
+    return ns_per_op;
+}
+
+void bench_scaler(void);
+void bench_display(void);
+void bench_hash(void);
+void bench_history(void);
+void bench_recents(void);
+void bench_cachedb(void);
+void bench_screenshot(void);
+void bench_list(void);
+
+#endif // BENCH_H__
@@ -0,0 +1,129 @@
+#include <SDL/SDL.h>
+#include <SDL/SDL_rotozoom.h>
+#include <stdlib.h>
+
+#include "utils/scaler.h"
+#include "utils/yuv.h"
+
+#include "bench.h"
+
+typedef struct {
+    SDL_Surface *src;
+    double zx;
+    double zy;
+    int smooth;
+} ZoomCase_s;
+
+static void _runZoomSurface(void *arg)
+{
+    ZoomCase_s *c = (ZoomCase_s *)arg;
+    SDL_FreeSurface(zoomSurface(c->src, c->zx, c->zy, c->smooth));
+}
+
+static void _runScaler(void *arg)
+{
+    ZoomCase_s *c = (ZoomCase_s *)arg;
+    SDL_FreeSurface(scaler_zoomSurface(c->src, c->zx, c->zy, c->smooth));
+}
+
+static void _runRotozoom180(void *arg)
+{
+    SDL_FreeSurface(rotozoomSurface((SDL_Surface *)arg, 180.0, 1.0, 0));
+}
+
+static void _runScalerRotate180(void *arg)
+{
+    scaler_rotate180((SDL_Surface *)arg);
+}
+
+static uint8_t *yuv_frame = NULL;
+
+static void _runYuvRotate180(void *arg)
+{
+    SDL_Surface *src = (SDL_Surface *)arg;
+    yuv_fromArgb((const uint32_t *)src->pixels, src->pitch, src->w, src->h, true, yuv_frame);
+}
+
+static SDL_Surface *_createNoise(int w, int h)
+{
+    SDL_Surface *surface = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    uint32_t seed = 0x12345678;
+    for (int y = 0; y < h; y++) {
+        uint32_t *row = (uint32_t *)((uint8_t *)surface->pixels + y * surface->pitch);
+        for (int x = 0; x < w; x++) {
+            seed = seed * 1664525 + 1013904223;
+            row[x] = seed;
+        }
+    }
+    return surface;
+}
+
+// Largest per-channel difference between the two implementations
+static int _maxChannelDiff(ZoomCase_s *c)
+{
+    SDL_Surface *a = zoomSurface(c->src, c->zx, c->zy, c->smooth);
+    SDL_Surface *b = scaler_zoomSurface(c->src, c->zx, c->zy, c->smooth);
+    int max_diff = -1;
+
+    if (a != NULL && b != NULL && a->w == b->w && a->h == b->h) {
+        max_diff = 0;
+        for (int y = 0; y < a->h; y++) {
+            uint8_t *pa = (uint8_t *)a->pixels + y * a->pitch;
+            uint8_t *pb = (uint8_t *)b->pixels + y * b->pitch;
+            for (int i = 0; i < a->w * 4; i++) {
+                int diff = abs(pa[i] - pb[i]);
+                if (diff > max_diff)
+                    max_diff = diff;
+            }
+        }
+    }
+
+    SDL_FreeSurface(a);
+    SDL_FreeSurface(b);
+    return max_diff;
+}
+
+static void _compare(const char *name, SDL_Surface *src, double zx, double zy, int smooth)
+{
+    char label[128];
+    ZoomCase_s c = {src, zx, zy, smooth};
+
+    snprintf(label, sizeof(label), "scaler/%s/zoomSurface", name);
+    double base = bench_run(label, _runZoomSurface, &c);
+
+    snprintf(label, sizeof(label), "scaler/%s/scaler", name);
+    double ours = bench_run(label, _runScaler, &c);
+
+    bench_result("{\"bench\":\"scaler/%s\",\"speedup\":%.2f,\"max_channel_diff\":%d}",
+                 name, base / ours, _maxChannelDiff(&c));
+}
+
+void bench_scaler(void)
+{
+    SDL_Surface *screen = _createNoise(640, 480);
+    SDL_Surface *half = _createNoise(320, 240);
+
+    // Romscreens and theme assets on the 752x560 display
+    _compare("640x480_752x560_nearest", screen, 752.0 / 640.0, 560.0 / 480.0, SMOOTHING_OFF);
+    _compare("640x480_752x560_bilinear", screen, 752.0 / 640.0, 560.0 / 480.0, SMOOTHING_ON);
+
+    // Box art / preview thumbnails
+    _compare("640x480_250x188_nearest", screen, 250.0 / 640.0, 188.0 / 480.0, SMOOTHING_OFF);
+    _compare("640x480_250x188_bilinear", screen, 250.0 / 640.0, 188.0 / 480.0, SMOOTHING_ON);
+    _compare("640x480_320x240_box", screen, 0.5, 0.5, SMOOTHING_ON);
+
+    // Integer upscale
+    _compare("320x240_640x480_integer", half, 2.0, 2.0, SMOOTHING_OFF);
+
+    // Theme background rotation (rotate180.h)
+    bench_run("scaler/rotate180_640x480/rotozoomSurface", _runRotozoom180, screen);
+    bench_run("scaler/rotate180_640x480/scaler", _runScalerRotate180, screen);
+
+    // Screen recorder frame conversion
+    yuv_frame = (uint8_t *)malloc(yuv_frameSize(screen->w, screen->h));
+    bench_run("scaler/argb_i420_rotate180_640x480/yuv", _runYuvRotate180, screen);
+    free(yuv_frame);
+
+    SDL_FreeSurface(screen);
+    SDL_FreeSurface(half);
+}
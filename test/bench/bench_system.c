@@ -0,0 +1,472 @@
+#include <SDL/SDL.h>
+#include <SDL/SDL_ttf.h>
+#include <sqlite3/sqlite3.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cjson/cJSON.h"
+#include "components/list.h"
+#include "system/display.h"
+#include "system/screenshot.h"
+#include "theme/render/list.h"
+#include "utils/file.h"
+#include "utils/hash.h"
+#include "utils/jsonLine.h"
+
+#include "../../src/playActivity/cacheDB.h"
+
+#include "bench.h"
+
+//
+//    Hot paths of the system apps, with fixtures generated under bench_root
+//
+
+#define BENCH_FB_WIDTH 640
+#define BENCH_FB_HEIGHT 480
+#define BENCH_FB_BUFFERS 3
+#define BENCH_ROM_COUNT 1000
+#define BENCH_HISTORY_ENTRIES 100
+#define BENCH_RECENT_ENTRIES 2000
+#define BENCH_LIST_ITEMS 30
+
+static uint32_t *_createNoiseBuffer(int w, int h)
+{
+    uint32_t *buffer = malloc(w * h * sizeof(uint32_t));
+    uint32_t seed = 0x9E3779B9;
+    for (int i = 0; i < w * h; i++) {
+        seed = seed * 1664525 + 1013904223;
+        buffer[i] = seed;
+    }
+    return buffer;
+}
+
+//
+//    display: framebuffer reads/writes as done by the OSD and overlays
+//
+typedef struct {
+    display_t *display;
+    uint32_t *pixels;
+    rect_t rect;
+    bool rotate;
+    bool mask;
+    bool write;
+} DisplayCase_s;
+
+static void _runReadOrWrite(void *arg)
+{
+    DisplayCase_s *c = (DisplayCase_s *)arg;
+    display_readOrWriteBuffer(1, c->display, c->pixels, c->rect, c->rotate, c->mask, c->write);
+}
+
+static void _runBlit(void *arg)
+{
+    DisplayCase_s *c = (DisplayCase_s *)arg;
+    display_blitToBuffer(1, c->display, c->pixels, BENCH_FB_WIDTH, c->rect, c->rotate);
+}
+
+void bench_display(void)
+{
+    static const struct {
+        const char *name;
+        rect_t rect;
+    } rects[] = {
+        {"fullscreen", {0, 0, BENCH_FB_WIDTH, BENCH_FB_HEIGHT}},
+        {"overlay_250x40", {380, 10, 250, 40}},
+    };
+    display_t display;
+    char label[128];
+
+    memset(&display, 0, sizeof(display_t));
+    display.vinfo.xres = BENCH_FB_WIDTH;
+    display.vinfo.yres = BENCH_FB_HEIGHT;
+    display.vinfo.yres_virtual = BENCH_FB_HEIGHT * BENCH_FB_BUFFERS;
+    display.fb_addr = _createNoiseBuffer(BENCH_FB_WIDTH, BENCH_FB_HEIGHT * BENCH_FB_BUFFERS);
+
+    uint32_t *pixels = _createNoiseBuffer(BENCH_FB_WIDTH, BENCH_FB_HEIGHT);
+
+    for (int r = 0; r < sizeof(rects) / sizeof(rects[0]); r++) {
+        for (int variant = 0; variant < 8; variant++) {
+            DisplayCase_s c = {&display, pixels, rects[r].rect, variant & 1, variant & 2, variant & 4};
+            snprintf(label, sizeof(label), "display/%s/%s%s%s", rects[r].name,
+                     c.write ? "write" : "read", c.rotate ? "_rotate" : "", c.mask ? "_mask" : "");
+            bench_run(label, _runReadOrWrite, &c);
+        }
+
+        for (int rotate = 0; rotate < 2; rotate++) {
+            DisplayCase_s c = {&display, pixels, rects[r].rect, rotate, false, true};
+            snprintf(label, sizeof(label), "display/%s/blit%s", rects[r].name, rotate ? "_rotate" : "");
+            bench_run(label, _runBlit, &c);
+        }
+    }
+
+    free(pixels);
+    free(display.fb_addr);
+}
+
+//
+//    hash: romscreen and state file names
+//
+typedef struct {
+    char **paths;
+    int count;
+} HashCase_s;
+
+static void _runHash(void *arg)
+{
+    HashCase_s *c = (HashCase_s *)arg;
+    volatile uint32_t sink = 0;
+    for (int i = 0; i < c->count; i++)
+        sink ^= FNV1A_Pippip_Yurii(c->paths[i], strlen(c->paths[i]));
+}
+
+void bench_hash(void)
+{
+    HashCase_s c = {malloc(BENCH_ROM_COUNT * sizeof(char *)), BENCH_ROM_COUNT};
+
+    for (int i = 0; i < c.count; i++) {
+        // The hash reads up to 8 bytes past the end
+        c.paths[i] = calloc(1, STR_MAX + 8);
+        snprintf(c.paths[i], STR_MAX, "/mnt/SDCARD/Roms/GBA/Some Game Title %04d (USA, Europe) (Rev %d).gba", i, i % 3);
+    }
+
+    bench_run("hash/FNV1A_Pippip_Yurii/1000_rom_paths", _runHash, &c);
+
+    for (int i = 0; i < c.count; i++)
+        free(c.paths[i]);
+    free(c.paths);
+}
+
+//
+//    history: RetroArch's content_history.lpl, read by GameSwitcher
+//
+static const char *_createHistoryFixture(void)
+{
+    const char *path = bench_fixture("Saves/CurrentProfile/lists/content_history.lpl");
+    cJSON *root = cJSON_CreateObject();
+    cJSON *items = cJSON_CreateArray();
+    char value[STR_MAX];
+
+    cJSON_AddStringToObject(root, "version", "1.5");
+    cJSON_AddItemToObject(root, "items", items);
+
+    for (int i = 0; i < BENCH_HISTORY_ENTRIES; i++) {
+        cJSON *item = cJSON_CreateObject();
+        snprintf(value, sizeof(value), "/mnt/SDCARD/Roms/GBA/Some Game Title %04d (USA).gba", i);
+        cJSON_AddStringToObject(item, "path", value);
+        cJSON_AddStringToObject(item, "label", "");
+        cJSON_AddStringToObject(item, "core_path", "/mnt/SDCARD/RetroArch/.retroarch/cores/gpsp_libretro.so");
+        cJSON_AddStringToObject(item, "core_name", "gpSP");
+        cJSON_AddStringToObject(item, "crc32", "DETECT");
+        cJSON_AddStringToObject(item, "db_name", "Nintendo - Game Boy Advance.lpl");
+        cJSON_AddItemToArray(items, item);
+    }
+
+    char *content = cJSON_Print(root);
+    FILE *fp = fopen(path, "w");
+    if (fp != NULL) {
+        fputs(content, fp);
+        fclose(fp);
+    }
+    cJSON_free(content);
+    cJSON_Delete(root);
+
+    return path;
+}
+
+static void _runHistoryParse(void *arg)
+{
+    cJSON_Delete(cJSON_Parse((const char *)arg));
+}
+
+static void _runHistoryLoad(void *arg)
+{
+    char *content = file_read((const char *)arg);
+    cJSON *root = cJSON_Parse(content);
+    cJSON *item;
+    volatile int count = 0;
+
+    cJSON_ArrayForEach(item, cJSON_GetObjectItem(root, "items"))
+    {
+        if (cJSON_GetStringValue(cJSON_GetObjectItem(item, "path")) != NULL)
+            count++;
+    }
+
+    cJSON_Delete(root);
+    free(content);
+}
+
+void bench_history(void)
+{
+    char path[512];
+    strncpy(path, _createHistoryFixture(), sizeof(path) - 1);
+    path[sizeof(path) - 1] = '\0';
+
+    char *content = file_read(path);
+    if (content == NULL) {
+        bench_result("{\"bench\":\"history\",\"skipped\":\"can't write %s\"}", path);
+        return;
+    }
+
+    bench_run("history/cJSON_Parse/100_entries", _runHistoryParse, content);
+    bench_run("history/read_and_walk/100_entries", _runHistoryLoad, path);
+
+    free(content);
+}
+
+//
+//    recents: MainUI's recentlist.json / favourite.json (JSON lines)
+//
+static char *_createRecentsFixture(void)
+{
+    size_t size = BENCH_RECENT_ENTRIES * 512 + 1;
+    char *content = malloc(size);
+    size_t len = 0;
+
+    for (int i = 0; i < BENCH_RECENT_ENTRIES && content != NULL; i++) {
+        len += snprintf(content + len, size - len,
+                        "{\"label\":\"Some Game Title %04d (USA)\",\"launch\":\"/mnt/SDCARD/Emu/GBA/launch.sh\","
+                        "\"type\":5,\"imgpath\":\"/mnt/SDCARD/Roms/GBA/Imgs/Some Game Title %04d (USA).png\","
+                        "\"rompath\":\"/mnt/SDCARD/Emu/GBA/../../Roms/GBA/Some Game Title %04d (USA).gba\"}\n",
+                        i, i, i);
+    }
+
+    return content;
+}
+
+typedef struct {
+    char label[STR_MAX * 2];
+    char rompath[STR_MAX * 2];
+    char imgpath[STR_MAX * 2];
+    char launch[STR_MAX * 2];
+    int type;
+} RecentEntry_s;
+
+static void _copyString(cJSON *object, const char *key, char *dest, size_t size)
+{
+    cJSON *item = cJSON_GetObjectItemCaseSensitive(object, key);
+    if (cJSON_IsString(item))
+        strncpy(dest, item->valuestring, size - 1);
+}
+
+// GameSwitcher's reader before jsonLine.h: a cJSON tree per line
+static void _runRecentsCJSON(void *arg)
+{
+    static RecentEntry_s entry;
+    char line[STR_MAX * 6];
+    const char *p = (const char *)arg;
+    volatile int count = 0;
+
+    while (*p) {
+        const char *eol = strchr(p, '\n');
+        size_t len = eol ? (size_t)(eol - p) : strlen(p);
+        memcpy(line, p, len);
+        line[len] = '\0';
+        p += len + (eol != NULL);
+
+        cJSON *json = cJSON_Parse(line);
+        cJSON *type = cJSON_GetObjectItemCaseSensitive(json, "type");
+        if (cJSON_IsNumber(type)) {
+            entry.type = type->valueint;
+            _copyString(json, "label", entry.label, sizeof(entry.label));
+            _copyString(json, "rompath", entry.rompath, sizeof(entry.rompath));
+            _copyString(json, "imgpath", entry.imgpath, sizeof(entry.imgpath));
+            _copyString(json, "launch", entry.launch, sizeof(entry.launch));
+            count++;
+        }
+        cJSON_Delete(json);
+    }
+}
+
+static void _runRecentsJsonLine(void *arg)
+{
+    static RecentEntry_s entry;
+    char line[STR_MAX * 6];
+    const char *p = (const char *)arg;
+    volatile int count = 0;
+
+    JsonLineField_s fields[] = {
+        JSON_LINE_INT("type", &entry.type),
+        JSON_LINE_STRING("label", entry.label),
+        JSON_LINE_STRING("rompath", entry.rompath),
+        JSON_LINE_STRING("imgpath", entry.imgpath),
+        JSON_LINE_STRING("launch", entry.launch),
+    };
+
+    while (*p) {
+        const char *eol = strchr(p, '\n');
+        size_t len = eol ? (size_t)(eol - p) : strlen(p);
+        memcpy(line, p, len);
+        line[len] = '\0';
+        p += len + (eol != NULL);
+
+        if (jsonLine_read(line, fields, 5) && fields[0].found)
+            count++;
+    }
+}
+
+void bench_recents(void)
+{
+    char *content = _createRecentsFixture();
+    if (content == NULL)
+        return;
+
+    bench_run("recents/cJSON_Parse/2000_lines", _runRecentsCJSON, content);
+    bench_run("recents/jsonLine_read/2000_lines", _runRecentsJsonLine, content);
+
+    free(content);
+}
+
+//
+//    cachedb: MainUI's per-system rom cache, looked up for names and box art
+//
+static bool _createCacheFixture(char *rom_path)
+{
+    const char *db_path = bench_fixture("Roms/GBA/GBA_cache6.db");
+    sqlite3 *db;
+    char *sql;
+
+    remove(db_path);
+    if (sqlite3_open(db_path, &db) != SQLITE_OK)
+        return false;
+
+    sqlite3_exec(db,
+                 "CREATE TABLE GBA_roms (id INTEGER PRIMARY KEY, disp TEXT, path TEXT, imgpath TEXT, "
+                 "type INTEGER, ppath TEXT, pinyin TEXT, cpinyin TEXT, opinyin TEXT);"
+                 "BEGIN;",
+                 NULL, NULL, NULL);
+
+    for (int i = 0; i < BENCH_ROM_COUNT; i++) {
+        sql = sqlite3_mprintf("INSERT INTO GBA_roms (disp, path, imgpath, type, ppath, pinyin) "
+                              "VALUES ('Some Game Title %04d', '../../Roms/GBA/Some Game Title %04d.gba', "
+                              "'../../Roms/GBA/Imgs/Some Game Title %04d.png', 0, '', 'Some Game Title %04d');",
+                              i, i, i, i);
+        sqlite3_exec(db, sql, NULL, NULL, NULL);
+        sqlite3_free(sql);
+    }
+
+    sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+    sqlite3_close(db);
+
+    // Towards the end of the table, like most lookups in a large library
+    snprintf(rom_path, STR_MAX, "%s/Roms/GBA/Some Game Title %04d.gba", bench_root, BENCH_ROM_COUNT * 3 / 4);
+    return true;
+}
+
+static void _runCacheFind(void *arg)
+{
+    free(cache_db_find((const char *)arg));
+}
+
+void bench_cachedb(void)
+{
+    char rom_path[STR_MAX];
+
+    if (!_createCacheFixture(rom_path)) {
+        bench_result("{\"bench\":\"cachedb\",\"skipped\":\"can't create the cache db\"}");
+        return;
+    }
+
+    bench_run("cachedb/cache_db_find/1000_roms", _runCacheFind, rom_path);
+}
+
+//
+//    screenshot: PNG encoding of a framebuffer copy (romscreens, screenshots)
+//
+typedef struct {
+    uint32_t *buffer;
+    const char *path;
+    bool rotate;
+} ScreenshotCase_s;
+
+static void _runScreenshot(void *arg)
+{
+    ScreenshotCase_s *c = (ScreenshotCase_s *)arg;
+    screenshot_save(c->buffer, c->path, c->rotate);
+}
+
+void bench_screenshot(void)
+{
+    char path[512];
+
+    // Resolves the render size the same way screenshot_save does
+    display_getRenderResolution();
+
+    strncpy(path, bench_fixture("Screenshots/bench.png"), sizeof(path) - 1);
+    path[sizeof(path) - 1] = '\0';
+
+    ScreenshotCase_s c = {_createNoiseBuffer(g_display.width, g_display.height), path, false};
+    bench_run("screenshot/screenshot_save/noise", _runScreenshot, &c);
+
+    c.rotate = true;
+    bench_run("screenshot/screenshot_save/noise_rotate180", _runScreenshot, &c);
+
+    // Flat areas compress very differently from noise
+    memset(c.buffer, 0, g_display.width * g_display.height * sizeof(uint32_t));
+    c.rotate = false;
+    bench_run("screenshot/screenshot_save/black", _runScreenshot, &c);
+
+    free(c.buffer);
+}
+
+//
+//    list: Tweaks/menus list rendering, needs a theme at <root>/theme/
+//
+typedef struct {
+    SDL_Surface *screen;
+    List *list;
+} ListCase_s;
+
+static void _runListRender(void *arg)
+{
+    ListCase_s *c = (ListCase_s *)arg;
+    theme_renderList(c->screen, c->list);
+}
+
+static void _runListScroll(void *arg)
+{
+    ListCase_s *c = (ListCase_s *)arg;
+    if (!list_keyDown(c->list, false))
+        list_scrollTo(c->list, 0);
+    theme_renderList(c->screen, c->list);
+}
+
+void bench_list(void)
+{
+    char theme_path[512];
+    char config_path[600];
+
+    snprintf(theme_path, sizeof(theme_path), "%s/theme/", bench_root);
+    snprintf(config_path, sizeof(config_path), "%sconfig.json", theme_path);
+
+    if (!is_file(config_path)) {
+        bench_result("{\"bench\":\"list\",\"skipped\":\"copy a theme to %s\"}", theme_path);
+        return;
+    }
+
+    TTF_Init();
+
+    resources.theme = theme_loadFromPath(theme_path, false);
+    resources.theme_back = resources.theme;
+    resources._theme_loaded = true;
+    resources.background = theme_loadImage(theme_path, "background");
+    resources._background_loaded = true;
+
+    SDL_Surface *screen = SDL_CreateRGBSurface(SDL_SWSURFACE, 640, 480, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    List list = list_create(BENCH_LIST_ITEMS, LIST_SMALL);
+    char label[STR_MAX];
+
+    for (int i = 0; i < BENCH_LIST_ITEMS; i++) {
+        ListItem item = {.item_type = i % 3 == 0 ? TOGGLE : ACTION};
+        snprintf(label, sizeof(label), "Setting number %d", i);
+        strcpy(item.label, label);
+        list_addItem(&list, item);
+    }
+
+    ListCase_s c = {screen, &list};
+    bench_run("list/theme_renderList/30_items", _runListRender, &c);
+    bench_run("list/keyDown_and_render/30_items", _runListScroll, &c);
+
+    list_free(&list);
+    SDL_FreeSurface(screen);
+    TTF_Quit();
+}
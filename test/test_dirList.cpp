@@ -0,0 +1,125 @@
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <vector>
+
+#include "../src/common/utils/dirList.h"
+
+static bool isPng(const char *name, unsigned char type, void *userdata)
+{
+    const char *dot = strrchr(name, '.');
+    return type != DT_DIR && dot != NULL && strcmp(dot, ".png") == 0;
+}
+
+class test_dirList : public ::testing::Test {
+protected:
+    std::string dir;
+
+    void SetUp() override
+    {
+        char tmp[] = "/tmp/test_dirList_XXXXXX";
+        ASSERT_NE(mkdtemp(tmp), (char *)NULL);
+        dir = tmp;
+    }
+
+    void TearDown() override
+    {
+        ASSERT_EQ(system(("rm -rf '" + dir + "'").c_str()), 0);
+    }
+
+    void touch(const std::string &name, time_t mtime = 0)
+    {
+        std::string path = dir + "/" + name;
+        std::ofstream(path) << name;
+        if (mtime != 0) {
+            struct utimbuf times = {mtime, mtime};
+            utime(path.c_str(), &times);
+        }
+    }
+};
+
+TEST_F(test_dirList, sortedByName)
+{
+    std::vector<std::string> names;
+    char name[64];
+
+    // Enough names for more than one arena block, in reverse order
+    for (int i = 999; i >= 0; i--) {
+        snprintf(name, sizeof(name), "shot_%04d_with_a_longer_name.png", i);
+        touch(name);
+        names.insert(names.begin(), name);
+    }
+    touch("notes.txt");
+    mkdir((dir + "/folder.png").c_str(), 0755);
+
+    DirList_s list;
+    ASSERT_TRUE(dirList_open(&list, dir.c_str(), isPng, NULL));
+    ASSERT_EQ(dirList_readAll(&list), 1000);
+
+    // Only the first screen is sorted up front, the rest on first access
+    dirList_sort(&list, DIRLIST_SORT_NAME, 3);
+    EXPECT_EQ(list.sorted, 3);
+    EXPECT_STREQ(dirList_name(&list, 0), names[0].c_str());
+    EXPECT_STREQ(dirList_name(&list, 2), names[2].c_str());
+    EXPECT_EQ(list.sorted, 3);
+
+    for (int i = 0; i < 1000; i++)
+        ASSERT_STREQ(dirList_name(&list, i), names[i].c_str());
+    EXPECT_EQ(list.sorted, 1000);
+
+    char path[PATH_MAX];
+    ASSERT_TRUE(dirList_path(&list, 5, path, sizeof(path)));
+    EXPECT_EQ(std::string(path), dir + "/" + names[5]);
+
+    char *dup = dirList_pathDup(&list, 999);
+    EXPECT_EQ(std::string(dup), dir + "/" + names[999]);
+    free(dup);
+
+    EXPECT_EQ(dirList_name(&list, 1000), (const char *)NULL);
+    dirList_free(&list);
+}
+
+TEST_F(test_dirList, sortedByMtime)
+{
+    touch("old.png", 1000);
+    touch("new.png", 3000);
+    touch("middle_b.png", 2000);
+    touch("middle_a.png", 2000);
+
+    DirList_s list;
+    ASSERT_TRUE(dirList_open(&list, (dir + "/").c_str(), isPng, NULL));
+    dirList_readAll(&list);
+    dirList_sort(&list, DIRLIST_SORT_MTIME, 0);
+
+    EXPECT_STREQ(dirList_name(&list, 0), "new.png");
+    EXPECT_STREQ(dirList_name(&list, 1), "middle_a.png");
+    EXPECT_STREQ(dirList_name(&list, 2), "middle_b.png");
+    EXPECT_STREQ(dirList_name(&list, 3), "old.png");
+    dirList_free(&list);
+}
+
+TEST_F(test_dirList, readInBatches)
+{
+    for (int i = 0; i < 10; i++)
+        touch("img" + std::to_string(i) + ".png");
+
+    DirList_s list;
+    ASSERT_TRUE(dirList_open(&list, dir.c_str(), NULL, NULL));
+    EXPECT_EQ(dirList_readSome(&list, 4), 4);
+    EXPECT_FALSE(dirList_isComplete(&list));
+    EXPECT_EQ(dirList_count(&list), 4);
+    EXPECT_EQ(dirList_readSome(&list, 4), 4);
+    EXPECT_EQ(dirList_readSome(&list, 4), 2);
+    EXPECT_TRUE(dirList_isComplete(&list));
+    EXPECT_EQ(dirList_count(&list), 10);
+    dirList_free(&list);
+
+    EXPECT_FALSE(dirList_open(&list, (dir + "/missing").c_str(), NULL, NULL));
+    dirList_free(&list);
+}
@@ -0,0 +1,196 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <unistd.h>
+#include <vector>
+#include <SDL/SDL.h>
+
+#include "../src/common/utils/imageCache.h"
+
+#define TEST_IMAGE_SIZE 100
+#define TEST_IMAGE_BYTES (TEST_IMAGE_SIZE * TEST_IMAGE_SIZE * 4)
+
+static std::atomic<int> g_loads(0);
+
+typedef struct
+{
+    int decode_us;
+    std::vector<int> ids;
+} TestSource;
+
+static TestSource makeSource(int decode_us, int count)
+{
+    TestSource source = {decode_us, std::vector<int>(count)};
+    for (int i = 0; i < count; i++)
+        source.ids[i] = i;
+    return source;
+}
+
+// Fake decoder: tags the first pixel with the id of the image it loaded
+static SDL_Surface *loadTaggedImage(int index, void *userdata)
+{
+    TestSource *source = (TestSource *)userdata;
+    g_loads++;
+    usleep(source->decode_us);
+
+    SDL_Surface *image = SDL_CreateRGBSurface(SDL_SWSURFACE, TEST_IMAGE_SIZE, TEST_IMAGE_SIZE, 32, 0, 0, 0, 0);
+    ((Uint32 *)image->pixels)[0] = source->ids[index];
+    return image;
+}
+
+static Uint32 imageTag(SDL_Surface *image)
+{
+    return ((Uint32 *)image->pixels)[0];
+}
+
+static void waitForWorkers()
+{
+    for (int i = 0; i < 500 && imageCache_isActive(); i++)
+        usleep(10000);
+    ASSERT_FALSE(imageCache_isActive());
+}
+
+TEST(test_imageCache, prefetchesAroundCursor)
+{
+    TestSource source = makeSource(1000, 20);
+    g_loads = 0;
+
+    ASSERT_TRUE(imageCache_init(2, 64 * TEST_IMAGE_BYTES));
+    imageCache_setSource(loadTaggedImage, &source, 20);
+    imageCache_setCursor(10, 2);
+    waitForWorkers();
+
+    for (int i = 0; i < 20; i++)
+    {
+        SDL_Surface *image = imageCache_peekItem(i);
+        if (i >= 8 && i <= 12)
+        {
+            ASSERT_NE(image, (SDL_Surface *)NULL);
+            ASSERT_EQ(imageTag(image), (Uint32)i);
+        }
+        else
+        {
+            ASSERT_EQ(image, (SDL_Surface *)NULL);
+        }
+    }
+    ASSERT_EQ(g_loads, 5);
+
+    ImageCacheStats_s stats;
+    SDL_Surface *image = imageCache_getItem(11);
+    imageCache_getStats(&stats);
+    ASSERT_EQ(imageTag(image), 11u);
+    ASSERT_EQ(stats.hits, 1u);
+    ASSERT_EQ(stats.misses, 0u);
+
+    imageCache_freeAll();
+}
+
+TEST(test_imageCache, staysWithinByteBudget)
+{
+    TestSource source = makeSource(500, 50);
+    g_loads = 0;
+
+    ASSERT_TRUE(imageCache_init(3, 3 * TEST_IMAGE_BYTES));
+    imageCache_setSource(loadTaggedImage, &source, 50);
+
+    ImageCacheStats_s stats;
+    for (int i = 0; i < 50; i++)
+    {
+        imageCache_setCursor(i, 5);
+        SDL_Surface *image = imageCache_getItem(i);
+        ASSERT_NE(image, (SDL_Surface *)NULL);
+        ASSERT_EQ(imageTag(image), (Uint32)i);
+
+        imageCache_getStats(&stats);
+        ASSERT_LE(stats.used_bytes, (size_t)3 * TEST_IMAGE_BYTES);
+    }
+
+    waitForWorkers();
+    imageCache_getStats(&stats);
+    ASSERT_LE(stats.resident, 3);
+    ASSERT_GT(stats.evictions, 0u);
+    ASSERT_NE(imageCache_peekItem(49), (SDL_Surface *)NULL);
+
+    imageCache_freeAll();
+}
+
+TEST(test_imageCache, cancelsWhenScrollingPast)
+{
+    TestSource source = makeSource(20000, 100);
+    g_loads = 0;
+
+    ASSERT_TRUE(imageCache_init(4, 64 * TEST_IMAGE_BYTES));
+    imageCache_setSource(loadTaggedImage, &source, 100);
+
+    // Scroll faster than the workers can decode
+    for (int i = 0; i < 100; i += 10)
+    {
+        imageCache_setCursor(i, 3);
+        usleep(2000);
+    }
+
+    SDL_Surface *image = imageCache_getItem(99);
+    ASSERT_NE(image, (SDL_Surface *)NULL);
+    ASSERT_EQ(imageTag(image), 99u);
+    waitForWorkers();
+
+    ImageCacheStats_s stats;
+    imageCache_getStats(&stats);
+    ASSERT_GT(stats.cancelled, 0u);
+    ASSERT_LT(g_loads, 100);
+
+    imageCache_freeAll();
+}
+
+TEST(test_imageCache, removeItemShiftsWhileLoading)
+{
+    TestSource source = makeSource(2000, 10);
+    g_loads = 0;
+
+    ASSERT_TRUE(imageCache_init(2, 64 * TEST_IMAGE_BYTES));
+    imageCache_setSource(loadTaggedImage, &source, 10);
+    imageCache_setCursor(3, 3);
+
+    // Removing while workers are busy must not lose or misplace images
+    imageCache_cancelAll();
+    source.ids.erase(source.ids.begin() + 3);
+    imageCache_removeItem(3);
+    imageCache_setCursor(3, 3);
+    waitForWorkers();
+
+    SDL_Surface *image = imageCache_getItem(3);
+    ASSERT_NE(image, (SDL_Surface *)NULL);
+    ASSERT_EQ(imageTag(image), 4u);
+    ASSERT_EQ(imageCache_getItem(9), (SDL_Surface *)NULL);
+
+    imageCache_freeAll();
+}
+
+TEST(test_imageCache, remapKeepsMovedImages)
+{
+    TestSource source = makeSource(0, 6);
+    g_loads = 0;
+
+    ASSERT_TRUE(imageCache_init(0, 64 * TEST_IMAGE_BYTES));
+    imageCache_setSource(loadTaggedImage, &source, 6);
+    for (int i = 0; i < 4; i++)
+        ASSERT_NE(imageCache_getItem(i), (SDL_Surface *)NULL);
+
+    // Game 2 moved to the top, game 3 is gone and games 6 and 7 were added
+    int old_index[5] = {2, 0, 1, -1, -1};
+    source.ids = {2, 0, 1, 6, 7};
+    imageCache_remap(old_index, 5);
+
+    ASSERT_EQ(imageTag(imageCache_peekItem(0)), 2u);
+    ASSERT_EQ(imageTag(imageCache_peekItem(1)), 0u);
+    ASSERT_EQ(imageTag(imageCache_peekItem(2)), 1u);
+    ASSERT_EQ(imageCache_peekItem(4), (SDL_Surface *)NULL);
+    ASSERT_EQ(imageTag(imageCache_getItem(3)), 6u);
+    ASSERT_EQ(g_loads, 5);
+
+    ImageCacheStats_s stats;
+    imageCache_getStats(&stats);
+    ASSERT_EQ(stats.resident, 4);
+
+    imageCache_freeAll();
+}
@@ -70,9 +70,11 @@ TEST(test_infoPanel, cacheTest)
         ASSERT_EQ(cache_used, test_item.cache_used);
     }
 
+    cleanImagesCache();
+
     for (int i = 0; i < images_paths_count; i++)
     {
         delete[] images_paths[i];
     }
     delete[] images_paths;
-}
\ No newline at end of file
+}
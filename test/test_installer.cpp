@@ -0,0 +1,166 @@
+#include "gtest/gtest.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+extern "C" {
+#include "../src/packageManager/installer.h"
+}
+
+static std::vector<std::string> script_calls;
+
+static void recordScript(const char *data_path, const char *package_name, bool install)
+{
+    script_calls.push_back(std::string(install ? "install " : "uninstall ") + package_name);
+}
+
+class test_installer : public ::testing::Test {
+protected:
+    std::string tmp, data, root;
+
+    void SetUp() override
+    {
+        char tmpl[] = "/tmp/test_installerXXXXXX";
+        tmp = mkdtemp(tmpl);
+        data = tmp + "/data";
+        root = tmp + "/sdcard";
+        mkdir(data.c_str(), 0755);
+        mkdir(root.c_str(), 0755);
+        script_calls.clear();
+    }
+
+    void TearDown() override
+    {
+        std::string cmd = "rm -rf " + tmp;
+        system(cmd.c_str());
+    }
+
+    void writeFile(const std::string &path, const std::string &contents)
+    {
+        std::string cmd = "mkdir -p \"$(dirname '" + path + "')\"";
+        system(cmd.c_str());
+        std::ofstream(path) << contents;
+    }
+
+    std::string readFile(const std::string &path)
+    {
+        std::ifstream in(path);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+};
+
+TEST_F(test_installer, copiesPackageTree)
+{
+    std::string big(INSTALLER_BUFFER_SIZE * 2 + 17, 'x');
+    writeFile(data + "/GB/Emu/GB/launch.sh", "#!/bin/sh");
+    writeFile(data + "/GB/Emu/GB/config.json", "{\"label\": \"GB\"}");
+    writeFile(data + "/GB/RetroArch/.retroarch/cores/gambatte.so", big);
+    writeFile(data + "/GB/.hidden", "");
+
+    Installer_s inst;
+    InstallerProgress_s progress;
+    installer_init(&inst, root.c_str(), recordScript);
+    installer_add(&inst, data.c_str(), "GB", true);
+    ASSERT_TRUE(installer_start(&inst));
+    while (!installer_isDone(&inst))
+        usleep(1000);
+    installer_getProgress(&inst, &progress);
+    installer_free(&inst);
+
+    EXPECT_EQ("#!/bin/sh", readFile(root + "/Emu/GB/launch.sh"));
+    EXPECT_EQ(big, readFile(root + "/RetroArch/.retroarch/cores/gambatte.so"));
+    EXPECT_FALSE(exists((root + "/.hidden").c_str()));
+
+    EXPECT_EQ(3, progress.files_total);
+    EXPECT_EQ(3, progress.files_done);
+    EXPECT_EQ(progress.bytes_total, progress.bytes_done);
+    EXPECT_EQ(0, progress.errors);
+    EXPECT_EQ(std::vector<std::string>{"install GB"}, script_calls);
+}
+
+TEST_F(test_installer, keepsLabelAndImage)
+{
+    writeFile(data + "/GB/Emu/GB/config.json",
+              "{\"label\": \"Game Boy\", \"imgpath\": \"default.png\", \"launch\": \"new.sh\"}");
+    writeFile(root + "/Emu/GB/config.json",
+              "{\"label\": \"My GB\", \"imgpath\": \"custom.png\", \"launch\": \"old.sh\"}");
+
+    Installer_s inst;
+    installer_init(&inst, root.c_str(), NULL);
+    installer_add(&inst, data.c_str(), "GB", true);
+    _installer_thread(&inst);
+    installer_free(&inst);
+
+    cJSON *config = _installer_loadConfig((root + "/Emu/GB/config.json").c_str());
+    ASSERT_NE(nullptr, config);
+    EXPECT_STREQ("My GB", cJSON_GetStringValue(cJSON_GetObjectItem(config, "label")));
+    EXPECT_STREQ("custom.png", cJSON_GetStringValue(cJSON_GetObjectItem(config, "imgpath")));
+    EXPECT_STREQ("new.sh", cJSON_GetStringValue(cJSON_GetObjectItem(config, "launch")));
+    cJSON_Delete(config);
+}
+
+TEST_F(test_installer, removalKeepsSharedFiles)
+{
+    // GBC is removed, GB (installed in the same batch) shares its core
+    writeFile(data + "/GBC/Emu/GBC/launch.sh", "gbc");
+    writeFile(data + "/GBC/RetroArch/cores/gambatte.so", "core");
+    writeFile(data + "/GB/RetroArch/cores/gambatte.so", "core");
+    writeFile(root + "/Emu/GBC/launch.sh", "gbc");
+    writeFile(root + "/Emu/GBC/user.cfg", "kept");
+    writeFile(root + "/RetroArch/cores/gambatte.so", "old core");
+
+    Installer_s inst;
+    InstallerProgress_s progress;
+    installer_init(&inst, root.c_str(), recordScript);
+    installer_add(&inst, data.c_str(), "GBC", false);
+    installer_add(&inst, data.c_str(), "GB", true);
+    _installer_thread(&inst);
+    installer_getProgress(&inst, &progress);
+    installer_free(&inst);
+
+    EXPECT_FALSE(exists((root + "/Emu/GBC/launch.sh").c_str()));
+    // Not empty, the folder stays
+    EXPECT_EQ("kept", readFile(root + "/Emu/GBC/user.cfg"));
+    EXPECT_EQ("core", readFile(root + "/RetroArch/cores/gambatte.so"));
+
+    // The uninstall script runs before anything is copied
+    std::vector<std::string> expected = {"uninstall GBC", "install GB"};
+    EXPECT_EQ(expected, script_calls);
+    EXPECT_EQ(2, progress.files_total);
+    EXPECT_EQ(0, progress.errors);
+}
+
+TEST_F(test_installer, sharedFileIsCopiedOnce)
+{
+    for (int i = 0; i < 8; i++) {
+        std::string name = "P" + std::to_string(i);
+        writeFile(data + "/" + name + "/Emu/" + name + "/launch.sh", name);
+        writeFile(data + "/" + name + "/RetroArch/cores/shared.so", name);
+    }
+
+    Installer_s inst;
+    InstallerProgress_s progress;
+    installer_init(&inst, root.c_str(), recordScript);
+    for (int i = 0; i < 8; i++)
+        installer_add(&inst, data.c_str(), ("P" + std::to_string(i)).c_str(), true);
+    _installer_thread(&inst);
+    installer_getProgress(&inst, &progress);
+    installer_free(&inst);
+
+    // The last package wins, like copying them one after the other
+    EXPECT_EQ("P7", readFile(root + "/RetroArch/cores/shared.so"));
+    for (int i = 0; i < 8; i++) {
+        std::string name = "P" + std::to_string(i);
+        EXPECT_EQ(name, readFile(root + "/Emu/" + name + "/launch.sh"));
+    }
+    EXPECT_EQ(9, progress.files_total);
+    EXPECT_EQ(9, progress.files_done);
+    EXPECT_EQ(0, progress.errors);
+    EXPECT_EQ(8u, script_calls.size());
+}
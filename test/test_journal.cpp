@@ -0,0 +1,118 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+#include "../src/common/utils/journal.h"
+
+static std::string readAll(FILE *fp)
+{
+    std::string out;
+    char buf[256];
+    while (fgets(buf, sizeof(buf), fp) != NULL)
+        out += buf;
+    return out;
+}
+
+static std::string readView(const std::string &path)
+{
+    FILE *fp = journal_open(path.c_str());
+    if (fp == NULL)
+        return "";
+    std::string out = readAll(fp);
+    fclose(fp);
+    return out;
+}
+
+static std::string readFile(const std::string &path)
+{
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+class test_journal : public ::testing::Test {
+protected:
+    std::string list_path;
+
+    void SetUp() override
+    {
+        char dir[] = "/tmp/test_journal_XXXXXX";
+        ASSERT_NE(mkdtemp(dir), (char *)NULL);
+        list_path = std::string(dir) + "/recentlist.json";
+        std::ofstream(list_path) << "a\nb\nc\n";
+    }
+
+    void TearDown() override
+    {
+        remove((list_path + JOURNAL_SUFFIX).c_str());
+        remove((list_path + JOURNAL_TEMP_SUFFIX).c_str());
+        remove(list_path.c_str());
+        rmdir(list_path.substr(0, list_path.rfind('/')).c_str());
+    }
+};
+
+TEST_F(test_journal, mergedView)
+{
+    EXPECT_EQ(readView(list_path), "a\nb\nc\n");
+
+    ASSERT_TRUE(journal_addLine(list_path.c_str(), "d\n"));
+    ASSERT_TRUE(journal_deleteLine(list_path.c_str(), 3, "b\n"));
+    ASSERT_TRUE(journal_moveLine(list_path.c_str(), 3, "c"));
+    // Lines that aren't there are left alone
+    ASSERT_TRUE(journal_deleteLine(list_path.c_str(), 10, "x"));
+
+    EXPECT_EQ(readView(list_path), "c\nd\na\n");
+    // The list itself stays untouched until compaction
+    EXPECT_EQ(readFile(list_path), "a\nb\nc\n");
+
+    ASSERT_TRUE(journal_compact(list_path.c_str()));
+    EXPECT_TRUE(journal_isEmpty(list_path.c_str()));
+    EXPECT_EQ(readFile(list_path), "c\nd\na\n");
+}
+
+TEST_F(test_journal, staleLineNumber)
+{
+    // A record whose line number no longer matches falls back to the content
+    ASSERT_TRUE(journal_append(list_path.c_str(), JOURNAL_REMOVE, 1, "c"));
+    EXPECT_EQ(readView(list_path), "a\nb\n");
+}
+
+TEST_F(test_journal, recoverInterruptedCompaction)
+{
+    // Interrupted before the journal was dropped: the temp file is discarded
+    ASSERT_TRUE(journal_addLine(list_path.c_str(), "d"));
+    std::ofstream(list_path + JOURNAL_TEMP_SUFFIX) << "partial";
+    EXPECT_EQ(readView(list_path), "d\na\nb\nc\n");
+    EXPECT_NE(access((list_path + JOURNAL_TEMP_SUFFIX).c_str(), F_OK), 0);
+
+    // Interrupted after: the temp file holds the compacted list
+    remove((list_path + JOURNAL_SUFFIX).c_str());
+    std::ofstream(list_path + JOURNAL_TEMP_SUFFIX) << "d\na\nb\nc\n";
+    EXPECT_EQ(readView(list_path), "d\na\nb\nc\n");
+    EXPECT_EQ(readFile(list_path), "d\na\nb\nc\n");
+}
+
+TEST_F(test_journal, autoCompact)
+{
+    std::string line(200, 'x');
+    for (int i = 0; i < 64; i++)
+        ASSERT_TRUE(journal_addLine(list_path.c_str(), line.c_str()));
+
+    FILE *fp = fopen((list_path + JOURNAL_SUFFIX).c_str(), "r");
+    long size = 0;
+    if (fp != NULL) {
+        fseek(fp, 0, SEEK_END);
+        size = ftell(fp);
+        fclose(fp);
+    }
+    EXPECT_LE(size, JOURNAL_COMPACT_SIZE);
+
+    std::string view = readView(list_path);
+    EXPECT_EQ(std::count(view.begin(), view.end(), '\n'), 67);
+}
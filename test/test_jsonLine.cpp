@@ -0,0 +1,125 @@
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "../src/common/utils/jsonLine.h"
+
+struct Entry {
+    char label[64];
+    char rompath[64];
+    char launch[16]; // small, to cover truncation
+    int type;
+    JsonLineField_s fields[4];
+
+    Entry() : label(""), rompath(""), launch(""), type(-1),
+              fields{JSON_LINE_STRING("label", label), JSON_LINE_STRING("rompath", rompath),
+                     JSON_LINE_STRING("launch", launch), JSON_LINE_INT("type", &type)}
+    {
+    }
+
+    bool operator==(const Entry &other) const
+    {
+        for (int i = 0; i < 4; i++) {
+            if (fields[i].found != other.fields[i].found)
+                return false;
+        }
+        return strcmp(label, other.label) == 0 && strcmp(rompath, other.rompath) == 0 &&
+               strcmp(launch, other.launch) == 0 && type == other.type;
+    }
+};
+
+static void PrintTo(const Entry &e, std::ostream *os)
+{
+    *os << "{label=" << e.label << ", rompath=" << e.rompath << ", launch=" << e.launch
+        << ", type=" << e.type << "}";
+}
+
+TEST(test_jsonLine, readsMainUIEntries)
+{
+    Entry e;
+    const char *line = "{\"label\":\"Pok\\u00e9mon \\\"Red\\\"\",\"launch\":\"/mnt/SDCARD/Emu/GB/launch.sh\","
+                       "\"type\":5,\"rompath\":\"/mnt/SDCARD/Emu/GB/../../Roms/GB/Pokemon Red.gb\"}\n";
+
+    EXPECT_EQ(4, jsonLine_scan(line, e.fields, 4));
+    EXPECT_STREQ("Pok\xc3\xa9mon \"Red\"", e.label);
+    EXPECT_STREQ("/mnt/SDCARD/Emu/GB/../../Roms/GB/Pokemon Red.gb", e.rompath);
+    EXPECT_STREQ("/mnt/SDCARD/Emu", e.launch); // truncated to 15 bytes
+    EXPECT_EQ(5, e.type);
+}
+
+TEST(test_jsonLine, missingAndMistypedFields)
+{
+    Entry e;
+    strcpy(e.label, "default");
+
+    EXPECT_EQ(1, jsonLine_scan("{\"type\":17.9,\"label\":5,\"extra\":{\"rompath\":\"x\"},\"rompath\":null}",
+                               e.fields, 4));
+    EXPECT_STREQ("default", e.label);
+    EXPECT_STREQ("", e.rompath);
+    EXPECT_FALSE(e.fields[0].found);
+    EXPECT_TRUE(e.fields[3].found);
+    EXPECT_EQ(17, e.type);
+}
+
+TEST(test_jsonLine, fallsBackToCJSON)
+{
+    Entry e;
+
+    // Escaped keys aren't handled by the scanner
+    const char *line = "{\"lab\\u0065l\":\"Tetris\",\"type\":5}";
+    EXPECT_EQ(-1, jsonLine_scan(line, e.fields, 4));
+    EXPECT_TRUE(jsonLine_read(line, e.fields, 4));
+    EXPECT_STREQ("Tetris", e.label);
+    EXPECT_EQ(5, e.type);
+
+    EXPECT_FALSE(jsonLine_read("{\"label\":\"Tetris\",", e.fields, 4));
+    EXPECT_FALSE(jsonLine_read("\n", e.fields, 4));
+    EXPECT_FALSE(jsonLine_read("[1, 2]", e.fields, 4));
+    EXPECT_FALSE(jsonLine_read(NULL, e.fields, 4));
+}
+
+TEST(test_jsonLine, matchesCJSON)
+{
+    // Long enough strings for the NEON steps, every escape and a few
+    // values to skip
+    const std::string base =
+        "{\"label\":\"A rather long game title \\\\ with \\/ escapes \\t and \\ud83d\\ude00 emoji\","
+        " \"type\" : -3e1 ,\"extra\":[1,{\"a\":[true,false,null]},\"s\"],"
+        "\"rompath\":\"/mnt/SDCARD/Emu/GBA/../../Roms/GBA/Some Game Title 0042 (USA).gba\","
+        "\"launch\":\"\\u0041\\u00e9\\u20ac\",\"label\":\"duplicate\"}";
+    const char alphabet[] = "{}[]\":,\\u0aZ -.eE1tfn/";
+    std::mt19937 rng(1234);
+
+    for (int i = 0; i < 20000; i++) {
+        std::string line = base;
+
+        // Random edits: most lines end up malformed somewhere
+        int edits = i == 0 ? 0 : 1 + rng() % 3;
+        for (int j = 0; j < edits; j++) {
+            size_t pos = rng() % line.size();
+            switch (rng() % 3) {
+            case 0:
+                line.erase(pos, 1);
+                break;
+            case 1:
+                line.insert(pos, 1, alphabet[rng() % (sizeof(alphabet) - 1)]);
+                break;
+            default:
+                line[pos] = alphabet[rng() % (sizeof(alphabet) - 1)];
+                break;
+            }
+        }
+
+        Entry scanned, parsed;
+        bool scan_ok = jsonLine_scan(line.c_str(), scanned.fields, 4) >= 0;
+        bool parse_ok = _jsonLine_readCJSON(line.c_str(), parsed.fields, 4);
+
+        if (scan_ok) {
+            // Whatever the scanner accepts, cJSON reads the same way
+            ASSERT_TRUE(parse_ok) << line;
+            ASSERT_EQ(parsed, scanned) << line;
+        }
+    }
+}
@@ -0,0 +1,370 @@
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <netinet/in.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "../src/otaUpdate/ota.h"
+
+static std::string readFile(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+static void writeFile(const std::string &path, const std::string &data)
+{
+    std::string dir = path.substr(0, path.rfind('/'));
+    std::string cmd = "mkdir -p '" + dir + "'";
+    ASSERT_EQ(system(cmd.c_str()), 0);
+    std::ofstream(path, std::ios::binary) << data;
+}
+
+static bool fileExists(const std::string &path)
+{
+    return access(path.c_str(), F_OK) == 0;
+}
+
+static std::string randomBytes(size_t len, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::string data(len, '\0');
+    for (size_t i = 0; i < len; i++)
+        data[i] = (char)(rng() & 0xff);
+    return data;
+}
+
+// Serves a directory over HTTP/1.0 with Range support, one request at a time
+class FixtureServer {
+public:
+    std::string dir;
+    std::atomic<long> drop_after{-1}; // close after this many body bytes
+    std::atomic<bool> ignore_range{false};
+    std::atomic<int> requests{0};
+    std::atomic<int> range_requests{0};
+    int port = 0;
+
+    explicit FixtureServer(const std::string &dir_) : dir(dir_)
+    {
+        struct sockaddr_in addr = {};
+        socklen_t len = sizeof(addr);
+
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+        listen(listen_fd, 8);
+        getsockname(listen_fd, (struct sockaddr *)&addr, &len);
+        port = ntohs(addr.sin_port);
+
+        thread = std::thread([this] { serve(); });
+    }
+
+    ~FixtureServer()
+    {
+        shutdown(listen_fd, SHUT_RDWR);
+        close(listen_fd);
+        thread.join();
+    }
+
+    std::string url(const std::string &path) const
+    {
+        return "http://127.0.0.1:" + std::to_string(port) + "/" + path;
+    }
+
+private:
+    int listen_fd;
+    std::thread thread;
+
+    void serve()
+    {
+        int fd;
+        while ((fd = accept(listen_fd, NULL, NULL)) != -1) {
+            handle(fd);
+            close(fd);
+        }
+    }
+
+    void handle(int fd)
+    {
+        std::string request;
+        char buf[4096];
+        ssize_t len;
+
+        while (request.find("\r\n\r\n") == std::string::npos && (len = recv(fd, buf, sizeof(buf), 0)) > 0)
+            request.append(buf, len);
+
+        requests++;
+
+        size_t path_start = request.find(' ') + 2;
+        std::string path = request.substr(path_start, request.find(' ', path_start) - path_start);
+        std::string body = readFile(dir + "/" + path);
+        size_t offset = 0;
+
+        if (!fileExists(dir + "/" + path)) {
+            sendAll(fd, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+            return;
+        }
+
+        size_t range = request.find("Range: bytes=");
+        std::string header;
+
+        if (range != std::string::npos && !ignore_range) {
+            range_requests++;
+            offset = std::stoul(request.substr(range + 13));
+            header = "HTTP/1.0 206 Partial Content\r\nContent-Range: bytes " + std::to_string(offset) + "-" +
+                     std::to_string(body.size() - 1) + "/" + std::to_string(body.size()) + "\r\n";
+        }
+        else {
+            header = "HTTP/1.0 200 OK\r\n";
+        }
+
+        body = body.substr(offset);
+        header += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+        sendAll(fd, header);
+
+        long limit = drop_after;
+        if (limit >= 0 && (size_t)limit < body.size())
+            body = body.substr(0, limit);
+        sendAll(fd, body);
+    }
+
+    static void sendAll(int fd, const std::string &data)
+    {
+        size_t sent = 0;
+        ssize_t len;
+        while (sent < data.size() && (len = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL)) > 0)
+            sent += len;
+    }
+};
+
+class test_ota : public ::testing::Test {
+protected:
+    std::string base;
+    std::string v1, v2, server_dir, root, staging;
+    std::string big_v1, big_v2;
+
+    void SetUp() override
+    {
+        char dir[] = "/tmp/test_ota_XXXXXX";
+        ASSERT_NE(mkdtemp(dir), (char *)NULL);
+        base = dir;
+        v1 = base + "/v1";
+        v2 = base + "/v2";
+        server_dir = base + "/server";
+        root = base + "/root";
+        staging = base + "/root/.tmp_update/download/ota";
+
+        // A large file with a few local edits, one new file, one unchanged
+        big_v1 = randomBytes(256 * 1024, 1);
+        big_v2 = big_v1;
+        big_v2.insert(1000, "inserted bytes");
+        big_v2.replace(200000, 300, randomBytes(300, 2));
+
+        writeFile(v1 + "/miyoo/app/.tmp_update/onion.pak", big_v1);
+        writeFile(v1 + "/RetroArch/ra_package_version.txt", "1.22.1-1\n");
+        writeFile(v1 + "/autorun.inf", "same\n");
+
+        writeFile(v2 + "/miyoo/app/.tmp_update/onion.pak", big_v2);
+        writeFile(v2 + "/RetroArch/ra_package_version.txt", "1.22.2-1\n");
+        writeFile(v2 + "/autorun.inf", "same\n");
+        writeFile(v2 + "/RetroArch/retroarch.pak", randomBytes(100 * 1024, 3));
+
+        ASSERT_TRUE(ota_buildManifest(v2.c_str(), v1.c_str(), server_dir.c_str(), "4.4.0"));
+        ASSERT_EQ(system(("cp -R '" + v1 + "' '" + root + "'").c_str()), 0);
+    }
+
+    void TearDown() override
+    {
+        ASSERT_EQ(system(("rm -rf '" + base + "'").c_str()), 0);
+    }
+
+    OtaOptions_s options(const std::string &manifest_url)
+    {
+        manifest = manifest_url;
+        OtaOptions_s opts = {};
+        opts.manifest_url = manifest.c_str();
+        opts.root = root.c_str();
+        opts.staging_dir = staging.c_str();
+        return opts;
+    }
+
+    void expectRelease(const std::string &release)
+    {
+        for (const char *path : {"miyoo/app/.tmp_update/onion.pak", "RetroArch/ra_package_version.txt",
+                                 "autorun.inf", "RetroArch/retroarch.pak"}) {
+            if (fileExists(release + "/" + path)) {
+                EXPECT_EQ(readFile(root + "/" + path), readFile(release + "/" + path)) << path;
+            }
+        }
+    }
+
+private:
+    std::string manifest;
+};
+
+TEST_F(test_ota, deltaRoundTrip)
+{
+    std::string patched = base + "/patched";
+    std::string delta = base + "/onion.delta";
+    char sha[65];
+
+    ASSERT_TRUE(ota_makeDelta((v1 + "/miyoo/app/.tmp_update/onion.pak").c_str(),
+                              (v2 + "/miyoo/app/.tmp_update/onion.pak").c_str(), delta.c_str()));
+    EXPECT_LT(readFile(delta).size(), big_v2.size() / 20);
+
+    ASSERT_TRUE(ota_applyDelta((v1 + "/miyoo/app/.tmp_update/onion.pak").c_str(),
+                               delta.c_str(), patched.c_str(), sha));
+    EXPECT_EQ(readFile(patched), big_v2);
+
+    // Applied to the wrong base, the copies don't line up with the hash
+    std::string other = base + "/other";
+    writeFile(other, randomBytes(big_v1.size(), 4));
+    char other_sha[65];
+    ASSERT_TRUE(ota_applyDelta(other.c_str(), delta.c_str(), patched.c_str(), other_sha));
+    EXPECT_STRNE(sha, other_sha);
+}
+
+TEST_F(test_ota, manifestHashes)
+{
+    std::string manifest = readFile(server_dir + "/" OTA_MANIFEST_NAME);
+
+    // sha256("same\n")
+    EXPECT_NE(manifest.find("a6328afc76e9db71da297ebff4b0d3e7a7eb3b01d917c05a6573fef121b6ecb6"), std::string::npos);
+    EXPECT_NE(manifest.find("\"deltas\""), std::string::npos);
+}
+
+TEST_F(test_ota, updateOverHttp)
+{
+    FixtureServer server(server_dir);
+    OtaOptions_s opts = options(server.url(OTA_MANIFEST_NAME));
+    OtaResult_s result;
+
+    ASSERT_EQ(ota_update(&opts, &result), OTA_OK);
+    expectRelease(v2);
+
+    EXPECT_EQ(result.files_total, 4);
+    EXPECT_EQ(result.files_changed, 3);
+    EXPECT_EQ(result.files_delta, 1);
+    EXPECT_STREQ(result.version, "4.4.0");
+    // The delta and the new files, not the whole release
+    EXPECT_LT(result.bytes_downloaded, big_v2.size() / 2 + 101 * 1024);
+
+    // Nothing left to do
+    ASSERT_EQ(ota_update(&opts, &result), OTA_OK);
+    EXPECT_EQ(result.files_changed, 0);
+    EXPECT_FALSE(ota_switchPending(staging.c_str(), NULL));
+}
+
+TEST_F(test_ota, resumeDroppedConnections)
+{
+    FixtureServer server(server_dir);
+    OtaOptions_s opts = options(server.url(OTA_MANIFEST_NAME));
+    OtaResult_s result;
+
+    // Every response is cut short, each retry continues from the part file
+    ASSERT_EQ(system(("rm -f '" + root + "/miyoo/app/.tmp_update/onion.pak'").c_str()), 0);
+    server.drop_after = 64 * 1024;
+
+    OtaStatus_e status = ota_stage(&opts, &result);
+    for (int i = 0; i < 5 && status == OTA_ERR_DOWNLOAD; i++)
+        status = ota_stage(&opts, &result);
+
+    ASSERT_EQ(status, OTA_OK);
+    EXPECT_GT(server.range_requests, 0);
+    // Root untouched until the switch
+    EXPECT_EQ(readFile(root + "/RetroArch/ra_package_version.txt"), "1.22.1-1\n");
+    EXPECT_FALSE(fileExists(root + "/miyoo/app/.tmp_update/onion.pak"));
+
+    ASSERT_EQ(ota_switch(root.c_str(), staging.c_str()), OTA_OK);
+    expectRelease(v2);
+}
+
+TEST_F(test_ota, serverIgnoresRange)
+{
+    FixtureServer server(server_dir);
+    OtaOptions_s opts = options(server.url(OTA_MANIFEST_NAME));
+    OtaResult_s result;
+
+    // Leave part files behind, then resume against a server without ranges
+    ASSERT_EQ(system(("rm -f '" + root + "/miyoo/app/.tmp_update/onion.pak'").c_str()), 0);
+    server.drop_after = 64 * 1024;
+    EXPECT_EQ(ota_stage(&opts, &result), OTA_ERR_DOWNLOAD);
+
+    server.drop_after = -1;
+    server.ignore_range = true;
+    ASSERT_EQ(ota_update(&opts, &result), OTA_OK);
+    expectRelease(v2);
+}
+
+TEST_F(test_ota, corruptFileIsNotInstalled)
+{
+    FixtureServer server(server_dir);
+    OtaOptions_s opts = options(server.url(OTA_MANIFEST_NAME));
+    OtaResult_s result;
+    std::string manifest = readFile(server_dir + "/" OTA_MANIFEST_NAME);
+
+    // Tamper with the retroarch.pak blob (the first "url" after its path)
+    size_t entry = manifest.find("RetroArch/retroarch.pak");
+    size_t url = manifest.find("\"url\":", entry);
+    size_t start = manifest.find('"', url + 6) + 1;
+    std::string blob = server_dir + "/" + manifest.substr(start, 64);
+    writeFile(blob, randomBytes(100 * 1024, 5));
+
+    EXPECT_EQ(ota_update(&opts, &result), OTA_ERR_VERIFY);
+    expectRelease(v1);
+    EXPECT_FALSE(fileExists(root + "/RetroArch/retroarch.pak"));
+    EXPECT_FALSE(ota_switchPending(staging.c_str(), NULL));
+}
+
+TEST_F(test_ota, interruptedSwitch)
+{
+    OtaOptions_s opts = options(server_dir + "/" OTA_MANIFEST_NAME);
+    OtaResult_s result;
+    bool active = false;
+
+    ASSERT_EQ(ota_stage(&opts, &result), OTA_OK);
+    ASSERT_TRUE(ota_switchPending(staging.c_str(), &active));
+    EXPECT_FALSE(active);
+
+    // Power cut after the first rename: the list is active, one file moved
+    std::string list = readFile(staging + "/" OTA_SWITCH_LIST);
+    std::string first = list.substr(0, list.find('\n'));
+    std::string staged = first.substr(0, first.find('\t'));
+    std::string path = first.substr(first.find('\t') + 1);
+    ASSERT_EQ(rename((staging + "/" OTA_SWITCH_LIST).c_str(), (staging + "/" OTA_SWITCH_ACTIVE).c_str()), 0);
+    ASSERT_EQ(rename((staging + "/" + staged).c_str(), (root + "/" + path).c_str()), 0);
+
+    ASSERT_TRUE(ota_switchPending(staging.c_str(), &active));
+    EXPECT_TRUE(active);
+
+    // The next run finishes it before anything else
+    ASSERT_EQ(ota_stage(&opts, &result), OTA_OK);
+    EXPECT_EQ(result.files_changed, 0);
+    expectRelease(v2);
+    EXPECT_FALSE(ota_switchPending(staging.c_str(), NULL));
+}
+
+TEST_F(test_ota, rejectsPathsOutsideRoot)
+{
+    std::string manifest = base + "/evil/" OTA_MANIFEST_NAME;
+    writeFile(manifest, "{\"version\":\"x\",\"files\":[{\"path\":\"../escape\",\"size\":5,"
+                        "\"sha256\":\"a6328afc76e9db71da297ebff4b0d3e7a7eb3b01d917c05a6573fef121b6ecb6\"}]}");
+    OtaOptions_s opts = options(manifest);
+    OtaResult_s result;
+
+    EXPECT_EQ(ota_update(&opts, &result), OTA_ERR_MANIFEST);
+    EXPECT_FALSE(fileExists(base + "/escape"));
+}
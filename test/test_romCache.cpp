@@ -0,0 +1,155 @@
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+extern "C" {
+#include "../src/packageManager/romCache.h"
+}
+
+class test_romCache : public ::testing::Test {
+protected:
+    std::string root, config, cache_path, roms;
+
+    void SetUp() override
+    {
+        char tmpl[] = "/tmp/test_romCacheXXXXXX";
+        root = mkdtemp(tmpl);
+        config = root + "/config.json";
+        cache_path = root + "/rom_cache.json";
+        roms = root + "/Roms/GB";
+        mkdir((root + "/Roms").c_str(), 0755);
+        mkdir(roms.c_str(), 0755);
+        writeConfig("gb|GBC|zip", 1000);
+    }
+
+    void TearDown() override
+    {
+        std::string cmd = "rm -rf " + root;
+        system(cmd.c_str());
+    }
+
+    void writeFile(const std::string &path, const std::string &contents)
+    {
+        std::ofstream(path) << contents;
+    }
+
+    void writeConfig(const std::string &extlist, time_t mtime)
+    {
+        writeFile(config, "{\"rompath\": \"../../Roms/GB\", \"extlist\": \"" + extlist + "\"}");
+        setMtime(config, mtime);
+    }
+
+    // Back-dated mtimes are old enough for the cache to trust
+    void setMtime(const std::string &path, time_t mtime)
+    {
+        struct utimbuf times = {mtime, mtime};
+        utime(path.c_str(), &times);
+    }
+
+    bool hasRoms()
+    {
+        RomCache_s cache;
+        romCache_load(&cache, cache_path.c_str(), root.c_str());
+        bool has_roms = romCache_hasRoms(&cache, config.c_str());
+        romCache_save(&cache, cache_path.c_str());
+        romCache_free(&cache);
+        return has_roms;
+    }
+};
+
+TEST(test_extSet, match)
+{
+    ExtSet_s set;
+    extSet_compile(&set, "gb|GBC|zip||7z");
+
+    EXPECT_EQ(4, set.count);
+    EXPECT_TRUE(extSet_match(&set, "Tetris.gb"));
+    EXPECT_TRUE(extSet_match(&set, "Zelda.GBC"));
+    EXPECT_TRUE(extSet_match(&set, "pack.tar.7Z"));
+    EXPECT_FALSE(extSet_match(&set, "readme.txt"));
+    EXPECT_FALSE(extSet_match(&set, "gb"));
+    EXPECT_FALSE(extSet_match(&set, "Tetris.gba"));
+
+    extSet_compile(&set, "");
+    EXPECT_TRUE(extSet_match(&set, "anything.bin"));
+    EXPECT_FALSE(extSet_match(&set, "Launch.miyoocmd"));
+}
+
+TEST_F(test_romCache, positiveHoldsWhileTheRomExists)
+{
+    mkdir((roms + "/Hacks").c_str(), 0755);
+    writeFile(roms + "/Hacks/Tetris DX.gbc", "");
+
+    EXPECT_TRUE(hasRoms());
+    EXPECT_TRUE(hasRoms());
+
+    remove((roms + "/Hacks/Tetris DX.gbc").c_str());
+    EXPECT_FALSE(hasRoms());
+}
+
+TEST_F(test_romCache, negativeHoldsWhileFoldersAreUnchanged)
+{
+    mkdir((roms + "/Imgs").c_str(), 0755);
+    writeFile(roms + "/Imgs/cover.png", "");
+    setMtime(roms + "/Imgs", 2000);
+    setMtime(roms, 2000);
+
+    EXPECT_FALSE(hasRoms());
+
+    // Same mtimes: the cached result is used, the folder isn't read
+    writeFile(roms + "/Imgs/Tetris.gb", "");
+    setMtime(roms + "/Imgs", 2000);
+    EXPECT_FALSE(hasRoms());
+
+    setMtime(roms + "/Imgs", 3000);
+    EXPECT_TRUE(hasRoms());
+}
+
+TEST_F(test_romCache, recentFoldersAreRescanned)
+{
+    EXPECT_FALSE(hasRoms());
+
+    // Added within the same second, the mtime may not have moved
+    struct stat st;
+    stat(roms.c_str(), &st);
+    writeFile(roms + "/Tetris.gb", "");
+    setMtime(roms, st.st_mtime);
+
+    EXPECT_TRUE(hasRoms());
+}
+
+TEST_F(test_romCache, configChangeInvalidates)
+{
+    writeFile(roms + "/Tetris.gba", "");
+    setMtime(roms, 2000);
+    EXPECT_FALSE(hasRoms());
+
+    writeConfig("gba", 1001);
+    EXPECT_TRUE(hasRoms());
+}
+
+TEST_F(test_romCache, unusedEntriesAreDropped)
+{
+    std::string other = root + "/other.json";
+    writeFile(other, "{\"rompath\": \"../../Roms/GB\"}");
+
+    RomCache_s cache;
+    romCache_load(&cache, cache_path.c_str(), root.c_str());
+    romCache_hasRoms(&cache, config.c_str());
+    romCache_hasRoms(&cache, other.c_str());
+    romCache_save(&cache, cache_path.c_str());
+    romCache_free(&cache);
+
+    hasRoms();
+
+    romCache_load(&cache, cache_path.c_str(), root.c_str());
+    EXPECT_NE(nullptr, cJSON_GetObjectItemCaseSensitive(cache.loaded, config.c_str()));
+    EXPECT_EQ(nullptr, cJSON_GetObjectItemCaseSensitive(cache.loaded, other.c_str()));
+    romCache_free(&cache);
+}
@@ -0,0 +1,155 @@
+#include "gtest/gtest.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <utime.h>
+
+#define WRITE_CACHE_DIR "/tmp/test_writeCache/cache"
+#define WRITE_CACHE_ROOT "/tmp/test_writeCache/sd/"
+
+extern "C" {
+#include "../src/common/utils/flags.h"
+#include "../src/common/utils/writeCache.h"
+}
+
+#define SD WRITE_CACHE_ROOT
+
+class test_writeCache : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        system("rm -rf /tmp/test_writeCache");
+        mkdir("/tmp/test_writeCache", 0755);
+        mkdir(SD, 0755);
+    }
+
+    void TearDown() override
+    {
+        while (_write_cache_depth > 0)
+            writeCache_end();
+        system("rm -rf /tmp/test_writeCache");
+    }
+
+    static std::string read(const char *path)
+    {
+        std::ifstream file(path);
+        std::stringstream content;
+        content << file.rdbuf();
+        return content.str();
+    }
+};
+
+TEST_F(test_writeCache, writesThroughOutsideBatch)
+{
+    WriteCacheStats_s stats;
+
+    EXPECT_TRUE(writeCache_printf(SD "config/vibration", "%d", 2));
+    EXPECT_EQ("2", read(SD "config/vibration"));
+
+    // Same content: nothing reaches the card
+    struct stat before, after;
+    stat(SD "config/vibration", &before);
+    EXPECT_TRUE(writeCache_put(SD "config/vibration", "2", 1));
+    stat(SD "config/vibration", &after);
+    EXPECT_EQ(before.st_ino, after.st_ino);
+
+    EXPECT_TRUE(writeCache_getStats(&stats));
+    EXPECT_EQ(2u, stats.requested);
+    EXPECT_EQ(1u, stats.written);
+    EXPECT_EQ(-1, writeCache_msUntilFlush());
+}
+
+TEST_F(test_writeCache, stagesAndCoalescesBatch)
+{
+    WriteCacheStats_s stats;
+    char buffer[PATH_MAX];
+
+    writeCache_put(SD ".muteVolume_", "", 0);
+
+    writeCache_begin();
+    for (int i = 0; i < 10; i++) {
+        writeCache_printf(SD "system.json", "{\"vol\": %d}", i);
+        flag_set(SD, ".muteVolume", i % 2 == 0);
+        flag_set(SD, ".muteVolume_", i % 2 != 0);
+    }
+    writeCache_end();
+
+    // Nothing written yet, but readers see the staged state
+    EXPECT_FALSE(exists(SD "system.json"));
+    EXPECT_TRUE(exists(SD ".muteVolume_"));
+    EXPECT_EQ("{\"vol\": 9}", read(writeCache_resolve(SD "system.json", buffer)));
+    EXPECT_FALSE(flag_get(SD, ".muteVolume"));
+    EXPECT_TRUE(flag_get(SD, ".muteVolume_"));
+    EXPECT_GT(writeCache_msUntilFlush(), 0);
+
+    // Unchanged flag and the remove of a missing one cost nothing
+    EXPECT_EQ(1, writeCache_flush());
+    EXPECT_EQ("{\"vol\": 9}", read(SD "system.json"));
+    EXPECT_TRUE(exists(SD ".muteVolume_"));
+    EXPECT_FALSE(exists(SD ".muteVolume"));
+    EXPECT_FALSE(exists(SD "system.json.tmp"));
+    EXPECT_STREQ(SD "system.json", writeCache_resolve(SD "system.json", buffer));
+    EXPECT_EQ(-1, writeCache_msUntilFlush());
+    EXPECT_EQ(0, writeCache_flush());
+
+    EXPECT_TRUE(writeCache_getStats(&stats));
+    EXPECT_EQ(31u, stats.requested);
+    EXPECT_EQ(2u, stats.written);
+}
+
+TEST_F(test_writeCache, directWriteSupersedesStaged)
+{
+    writeCache_begin();
+    writeCache_put(SD "keymap.json", "staged", 6);
+    writeCache_remove(SD "other");
+    writeCache_end();
+
+    writeCache_put(SD "keymap.json", "direct", 6);
+    EXPECT_TRUE(writeCache_put(SD "other", "kept", 4));
+
+    EXPECT_EQ(0, writeCache_flush());
+    EXPECT_EQ("direct", read(SD "keymap.json"));
+    EXPECT_EQ("kept", read(SD "other"));
+}
+
+TEST_F(test_writeCache, cardRewriteAfterStagingIsKept)
+{
+    writeCache_put(SD "system.json", "v1", 2);
+
+    writeCache_begin();
+    writeCache_put(SD "system.json", "staged", 6);
+    writeCache_put(SD "system.json", "staged again", 12);
+    writeCache_remove(SD "gone");
+    writeCache_put(SD "new.json", "new", 3);
+    writeCache_end();
+
+    // Written by MainUI right after, with a FAT mtime rounded down to
+    // before the staging
+    std::ofstream(SD "system.json") << "mainui";
+    std::ofstream(SD "gone") << "back";
+    struct utimbuf times = {time(NULL) - 2, time(NULL) - 2};
+    utime(SD "system.json", &times);
+    utime(SD "gone", &times);
+
+    EXPECT_EQ(1, writeCache_flush());
+    EXPECT_EQ("mainui", read(SD "system.json"));
+    EXPECT_EQ("back", read(SD "gone"));
+    EXPECT_EQ("new", read(SD "new.json"));
+}
+
+TEST_F(test_writeCache, bypassesOtherPaths)
+{
+    const char *path = "/tmp/test_writeCache/state";
+
+    writeCache_begin();
+    EXPECT_TRUE(writeCache_put(path, "tmpfs", 5));
+    EXPECT_EQ("tmpfs", read(path));
+    EXPECT_TRUE(writeCache_remove(path));
+    EXPECT_FALSE(exists(path));
+    writeCache_end();
+
+    EXPECT_EQ(-1, writeCache_msUntilFlush());
+}
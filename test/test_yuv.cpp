@@ -0,0 +1,144 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "../src/common/utils/yuv.h"
+#include "../src/screenRecorder/frameRing.h"
+
+static std::vector<uint32_t> solid(int w, int h, uint32_t color)
+{
+    return std::vector<uint32_t>(w * h, color);
+}
+
+TEST(test_yuv, solidColors)
+{
+    const int w = 36, h = 4; // NEON steps plus a scalar tail
+    struct {
+        uint32_t argb;
+        uint8_t y, u, v;
+    } cases[] = {
+        {0xFF000000, 16, 128, 128},
+        {0xFFFFFFFF, 235, 128, 128},
+        {0xFFFF0000, 82, 90, 240},
+        {0xFF00FF00, 144, 54, 34},
+        {0xFF0000FF, 41, 240, 110},
+    };
+
+    for (auto &c : cases) {
+        std::vector<uint32_t> src = solid(w, h, c.argb);
+        std::vector<uint8_t> dst(yuv_frameSize(w, h));
+
+        yuv_fromArgb(src.data(), w * 4, w, h, true, dst.data());
+
+        for (int i = 0; i < w * h; i++)
+            ASSERT_EQ(c.y, dst[i]) << std::hex << c.argb;
+        for (int i = w * h; i < (int)dst.size(); i++)
+            ASSERT_EQ(i < w * h * 5 / 4 ? c.u : c.v, dst[i]) << std::hex << c.argb;
+    }
+}
+
+TEST(test_yuv, rotate180MatchesFlippedSource)
+{
+    const int w = 40, h = 6, pitch = 48; // padded lines, like the framebuffer
+    std::vector<uint32_t> src(pitch * h), flipped(w * h);
+
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint32_t pix = 0xFF000000 | (x * 6) << 16 | (y * 40) << 8 | ((x * 7 + y * 13) & 0xFF);
+            src[y * pitch + x] = pix;
+            flipped[(h - 1 - y) * w + (w - 1 - x)] = pix;
+        }
+    }
+
+    std::vector<uint8_t> rotated(yuv_frameSize(w, h)), expected(yuv_frameSize(w, h));
+    yuv_fromArgb(src.data(), pitch * 4, w, h, true, rotated.data());
+    yuv_fromArgb(flipped.data(), w * 4, w, h, false, expected.data());
+
+    EXPECT_EQ(expected, rotated);
+
+    // Top left of the output is the bottom right of the source
+    uint32_t last = src[(h - 1) * pitch + w - 1];
+    EXPECT_EQ(_yuv_luma((last >> 16) & 0xFF, (last >> 8) & 0xFF, last & 0xFF), rotated[0]);
+}
+
+TEST(test_yuv, chromaIsTheBlockAverage)
+{
+    const int w = 2, h = 2;
+    std::vector<uint32_t> src = {0xFFFF0000, 0xFF000000, 0xFF000000, 0xFF000000};
+    std::vector<uint8_t> dst(yuv_frameSize(w, h));
+
+    yuv_fromArgb(src.data(), w * 4, w, h, false, dst.data());
+
+    // A quarter red: R = 64
+    EXPECT_EQ(_yuv_chroma(-38 * 64, 0, 0), dst[4]);
+    EXPECT_EQ(_yuv_chroma(112 * 64, 0, 0), dst[5]);
+}
+
+TEST(test_frameRing, dropsWhenFull)
+{
+    FrameRing_s ring;
+    ASSERT_TRUE(frameRing_init(&ring, 2, 16));
+
+    uint8_t *a = frameRing_acquire(&ring);
+    ASSERT_NE(nullptr, a);
+    a[0] = 1;
+    frameRing_commit(&ring);
+
+    uint8_t *b = frameRing_acquire(&ring);
+    ASSERT_NE(nullptr, b);
+    ASSERT_NE(a, b);
+    b[0] = 2;
+    frameRing_commit(&ring);
+
+    EXPECT_EQ(2, frameRing_fill(&ring));
+    EXPECT_EQ(nullptr, frameRing_acquire(&ring));
+
+    // Consumer sees the producer's slot, not a copy
+    EXPECT_EQ(a, frameRing_peek(&ring));
+    frameRing_release(&ring);
+    EXPECT_EQ(a, frameRing_acquire(&ring));
+
+    frameRing_close(&ring);
+    EXPECT_EQ(2, frameRing_peek(&ring)[0]);
+    frameRing_release(&ring);
+    EXPECT_EQ(nullptr, frameRing_peek(&ring));
+
+    frameRing_free(&ring);
+}
+
+TEST(test_frameRing, producerAndConsumerThreads)
+{
+    FrameRing_s ring;
+    ASSERT_TRUE(frameRing_init(&ring, 4, sizeof(int)));
+
+    std::vector<int> received;
+    std::thread consumer([&] {
+        uint8_t *slot;
+        while ((slot = frameRing_peek(&ring)) != NULL) {
+            received.push_back(*(int *)slot);
+            frameRing_release(&ring);
+        }
+    });
+
+    int dropped = 0;
+    for (int i = 0; i < 10000; i++) {
+        uint8_t *slot = frameRing_acquire(&ring);
+        if (slot == NULL) {
+            dropped++;
+            continue;
+        }
+        *(int *)slot = i;
+        frameRing_commit(&ring);
+    }
+
+    frameRing_close(&ring);
+    consumer.join();
+
+    EXPECT_EQ(10000, (int)received.size() + dropped);
+    for (size_t i = 1; i < received.size(); i++)
+        ASSERT_LT(received[i - 1], received[i]);
+
+    frameRing_free(&ring);
+}